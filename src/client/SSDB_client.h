@@ -59,11 +59,133 @@ private:
 	std::string code_;
 };
 
+/**
+ * A field of a Response, which points into the client's receive buffer.
+ */
+class Slice{
+public:
+	Slice(){
+		data_ = "";
+		size_ = 0;
+	}
+	Slice(const char *data, int size){
+		data_ = data;
+		size_ = size;
+	}
+	const char* data() const{
+		return data_;
+	}
+	int size() const{
+		return size_;
+	}
+	bool empty() const{
+		return size_ == 0;
+	}
+	std::string String() const{
+		return std::string(data_, size_);
+	}
+	int64_t Int64() const;
+	bool operator==(const std::string &s) const{
+		return s.size() == (size_t)size_ && s.compare(0, s.size(), data_, size_) == 0;
+	}
+	bool operator!=(const std::string &s) const{
+		return !(*this == s);
+	}
+private:
+	const char *data_;
+	int size_;
+};
+
+/**
+ * A response which is not copied out of the client's receive buffer.
+ * It is only valid until the next request on the same client.
+ */
+class Response{
+public:
+	/**
+	 * Iterates the fields after the response code as pairs, like the
+	 * key-value pairs of scan/hscan/multi_get, or the key-score pairs of
+	 * zscan/zrange.
+	 *
+	 *	Response::PairIterator it = resp->pairs();
+	 *	while(it.next()){
+	 *		printf("%.*s\n", it.key().size(), it.key().data());
+	 *	}
+	 */
+	class PairIterator{
+	public:
+		PairIterator(const std::vector<Slice> *fields){
+			fields_ = fields;
+			pos_ = -1;
+		}
+		bool next(){
+			if(pos_ == -1){
+				pos_ = 1;
+			}else{
+				pos_ += 2;
+			}
+			return pos_ + 1 < (int)fields_->size();
+		}
+		const Slice& key() const{
+			return fields_->at(pos_);
+		}
+		const Slice& val() const{
+			return fields_->at(pos_ + 1);
+		}
+		int64_t score() const{
+			return val().Int64();
+		}
+	private:
+		const std::vector<Slice> *fields_;
+		int pos_;
+	};
+
+	Status status() const{
+		return fields_.empty()? Status("error") : Status(fields_[0].String());
+	}
+	bool ok() const{
+		return !fields_.empty() && fields_[0] == "ok";
+	}
+	/**
+	 * Number of fields after the response code.
+	 */
+	int size() const{
+		return fields_.empty()? 0 : (int)fields_.size() - 1;
+	}
+	/**
+	 * The i-th field after the response code.
+	 */
+	const Slice& operator[](int i) const{
+		return fields_[i + 1];
+	}
+	PairIterator pairs() const{
+		return PairIterator(&fields_);
+	}
+private:
+	friend class ClientImpl;
+	std::vector<Slice> fields_;
+};
+
+/**
+ * Counters of the client side cache, see Client::enable_cache().
+ */
+struct CacheStats{
+	int64_t items;
+	int64_t hits;
+	int64_t misses;
+	/// Items dropped by invalidation messages from the server.
+	int64_t invalidations;
+};
+
 /**
  * The SSDB client used to connect to SSDB server.
  */
 class Client{
 public:
+	/**
+	 * Connect to a server. If ip starts with '/', it is the path of the
+	 * server's unix socket(server.unixsocket) and port is ignored.
+	 */
 	static Client* connect(const char *ip, int port);
 	static Client* connect(const std::string &ip, int port);
 	Client(){};
@@ -83,6 +205,106 @@ public:
 	virtual const std::vector<std::string>* request(const std::string &cmd, const std::vector<std::string> &s2) = 0;
 	virtual const std::vector<std::string>* request(const std::string &cmd, const std::string &s2, const std::vector<std::string> &s3) = 0;
 	/// @}
+
+	/**
+	 * Like request(), but the response is not copied, see Response.
+	 * @return NULL if error.
+	 */
+	virtual const Response* request_view(const std::vector<std::string> &req) = 0;
+
+	/// @name Multiplexed requests
+	/// send_request() sends a request without waiting for its response,
+	/// recv_response() returns responses as they arrive. With the binary
+	/// protocol(v2), the server replies as soon as each request finishes, so
+	/// a slow request does not delay the others on the same connection.
+	/// The methods above can be mixed with these.
+	/// @{
+	/**
+	 * Switch the connection to protocol version 2(binary, out of order
+	 * responses). Must be called with no outstanding send_request().
+	 */
+	virtual Status protocol(int version) = 0;
+	/**
+	 * @return The request id(> 0), or -1 on error.
+	 */
+	virtual int64_t send_request(const std::vector<std::string> &req) = 0;
+	/**
+	 * Wait for the response of any request sent by send_request().
+	 * @param id Set to the id of the request.
+	 * @return NULL on error.
+	 */
+	virtual const std::vector<std::string>* recv_response(int64_t *id) = 0;
+	/// @}
+
+	/// @name Asynchronous requests
+	/// async_request() only puts the request into the output buffer, so
+	/// many requests can be sent by one write with flush(). The response is
+	/// passed to the callback, or, if there is no callback, kept until
+	/// wait() is called with the request id(like a future).
+	///
+	/// To use the client in an external event loop(epoll, etc), watch fd()
+	/// for reading, and for writing when want_write() returns true, then
+	/// call on_readable() and on_writable(), which never block. Callbacks
+	/// are called in on_readable(), wait() and the methods above.
+	/// @{
+	/**
+	 * @param resp NULL if the connection is broken.
+	 */
+	typedef void (*Callback)(int64_t id, const std::vector<std::string> *resp, void *arg);
+	/**
+	 * @return The request id(> 0), or -1 on error.
+	 */
+	virtual int64_t async_request(const std::vector<std::string> &req,
+		Callback callback=NULL, void *arg=NULL) = 0;
+	/**
+	 * Send all the buffered requests, blocks until they are written.
+	 */
+	virtual int flush() = 0;
+	/**
+	 * Wait for the response of an async_request() without callback.
+	 * @return NULL on error.
+	 */
+	virtual const std::vector<std::string>* wait(int64_t id) = 0;
+	/**
+	 * The number of async_request()s waiting for responses.
+	 */
+	virtual int pending() = 0;
+	virtual int fd() = 0;
+	virtual bool want_write() = 0;
+	/**
+	 * @return The number of responses received, or -1 on error(the
+	 * callbacks of all pending requests are called with NULL).
+	 */
+	virtual int on_readable() = 0;
+	/**
+	 * @return -1 on error.
+	 */
+	virtual int on_writable() = 0;
+	/**
+	 * Get the keys with pipelined get requests, depth requests are sent
+	 * at a time. vals[i] is the value of keys[i], and found[i] tells
+	 * whether it exists.
+	 */
+	virtual Status batch_get(const std::vector<std::string> &keys,
+		std::vector<std::string> *vals, std::vector<bool> *found=NULL,
+		int depth=256) = 0;
+	/// @}
+
+	/// @name Client side cache
+	/// get() and hget() results(including not found) are cached in the
+	/// client. The server tracks the keys read by this connection, and
+	/// pushes an invalidation message when any of them is modified(by any
+	/// client), the cached values are dropped when the message is received,
+	/// which is checked before each cache lookup. A value may be stale for
+	/// the time the message is on the way.
+	/// @{
+	/**
+	 * Enable the cache, at most max_items values are kept(least recently
+	 * used ones are dropped). 0 disables and clears the cache.
+	 */
+	virtual Status enable_cache(int max_items) = 0;
+	virtual void cache_stats(CacheStats *ret) = 0;
+	/// @}
 	
 	virtual Status dbsize(int64_t *ret) = 0;
 	virtual Status get_kv_range(std::string *start, std::string *end) = 0;
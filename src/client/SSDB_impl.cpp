@@ -1,16 +1,23 @@
 #include "SSDB_impl.h"
 #include "util/strings.h"
 #include <signal.h>
+#include <string.h>
+#include <poll.h>
 
 namespace ssdb{
 
+// 只从接收缓冲区复制一次
 inline static
-Status _read_list(const std::vector<std::string> *resp, std::vector<std::string> *ret){
-	Status s(resp);
+Status _read_list(const Response *resp, std::vector<std::string> *ret){
+	if(resp == NULL){
+		return Status("error");
+	}
+	Status s = resp->status();
 	if(s.ok()){
-		std::vector<std::string>::const_iterator it;
-		for(it = resp->begin() + 1; it != resp->end(); it++){
-			ret->push_back(*it);
+		ret->reserve(ret->size() + resp->size());
+		for(int i=0; i<resp->size(); i++){
+			const Slice &b = (*resp)[i];
+			ret->push_back(std::string(b.data(), b.size()));
 		}
 	}
 	return s;
@@ -44,8 +51,24 @@ Status _read_str(const std::vector<std::string> *resp, std::string *ret){
 	return s;
 }
 
+// hash 的缓存 key 的前缀, 后面是 hash 中的 key
+inline static
+std::string _hash_prefix(const char *name, size_t size){
+	std::string ret(1, 'h');
+	ret.push_back((char)(uint8_t)size);
+	ret.append(name, size);
+	return ret;
+}
+
 ClientImpl::ClientImpl(){
 	link = NULL;
+	broken_ = false;
+	pool_slot = NULL;
+	next_id = 1;
+	tracking_ = false;
+	cache_max_ = 0;
+	loading_stale_ = false;
+	memset(&cache_stats_, 0, sizeof(cache_stats_));
 }
 
 ClientImpl::~ClientImpl(){
@@ -73,23 +96,425 @@ Client* Client::connect(const std::string &ip, int port){
 	return client;
 }
 
+int64_t ClientImpl::send_packet(const std::vector<std::string> &req, bool flush){
+	uint32_t id = next_id++;
+	if(next_id == 0){
+		next_id = 1;
+	}
+	if(link->proto() == Link::PROTO_V2){
+		if(link->send_frame(id, req) == -1){
+			broken_ = true;
+			return -1;
+		}
+	}else{
+		if(link->send(req) == -1){
+			broken_ = true;
+			return -1;
+		}
+		pending_.push_back(id);
+	}
+	if(flush && link->flush() == -1){
+		broken_ = true;
+		return -1;
+	}
+	return id;
+}
+
+int64_t Slice::Int64() const{
+	return str_to_int64(data_, size_);
+}
+
+// 刚收到的响应的 id, 文本协议的响应对应最早发出的请求
+int ClientImpl::packet_id(uint32_t *id){
+	if(link->proto() == Link::PROTO_V2){
+		*id = link->recv_id;
+	}else{
+		if(pending_.empty()){
+			return -1;
+		}
+		*id = pending_.front();
+		pending_.pop_front();
+	}
+	return 0;
+}
+
+int ClientImpl::take_packet(const std::vector<Bytes> *packet, uint32_t *id, std::vector<std::string> *resp){
+	if(packet_id(id) == -1){
+		return -1;
+	}
+	resp->clear();
+	for(std::vector<Bytes>::const_iterator it=packet->begin(); it!=packet->end(); it++){
+		const Bytes &b = *it;
+		resp->push_back(b.String());
+	}
+	return 0;
+}
+
+// 读取下一个响应, 出错时连接不能再使用, 所有异步请求失败
+int ClientImpl::recv_packet(uint32_t *id, std::vector<std::string> *resp){
+	while(1){
+		const std::vector<Bytes> *packet = link->response();
+		if(packet != NULL && is_push(packet)){
+			invalidate(packet);
+			continue;
+		}
+		if(packet == NULL || take_packet(packet, id, resp) == -1){
+			fail_async();
+			return -1;
+		}
+		return 0;
+	}
+}
+
+// 如果是 async_request() 的响应, 交给回调或者留给 wait(), 返回 true
+bool ClientImpl::dispatch(uint32_t id, std::vector<std::string> *resp){
+	std::map<uint32_t, AsyncCall>::iterator it = async_.find(id);
+	if(it == async_.end()){
+		return false;
+	}
+	AsyncCall call = it->second;
+	async_.erase(it);
+	if(call.callback){
+		// 回调中可以发出新的请求
+		call.callback(id, resp, call.arg);
+	}else{
+		results_[id].swap(*resp);
+	}
+	return true;
+}
+
+void ClientImpl::fail_async(){
+	broken_ = true;
+	std::map<uint32_t, AsyncCall> calls;
+	calls.swap(async_);
+	std::map<uint32_t, AsyncCall>::iterator it;
+	for(it = calls.begin(); it != calls.end(); it++){
+		if(it->second.callback){
+			it->second.callback(it->first, NULL, it->second.arg);
+		}
+	}
+}
+
+// 等待这个请求的响应, 期间收到的其它请求的响应留给 recv_response(),
+// 或者交给异步请求的回调
 const std::vector<std::string>* ClientImpl::request(const std::vector<std::string> &req){
-	if(link->send(req) == -1){
+	int64_t id = send_packet(req);
+	if(id == -1){
 		return NULL;
 	}
-	if(link->flush() == -1){
+	while(1){
+		uint32_t rid;
+		if(recv_packet(&rid, &resp_) == -1){
+			return NULL;
+		}
+		if(rid == id){
+			return &resp_;
+		}
+		if(!dispatch(rid, &resp_)){
+			ready_.push_back(std::make_pair(rid, resp_));
+		}
+	}
+	return NULL;
+}
+
+// 响应的字段指向 link 的输入缓冲区, 下一次读取之前有效
+const Response* ClientImpl::request_view(const std::vector<std::string> &req){
+	int64_t id = send_packet(req);
+	if(id == -1){
 		return NULL;
 	}
-	const std::vector<Bytes> *packet = link->response();
-	if(packet == NULL){
+	while(1){
+		const std::vector<Bytes> *packet = link->response();
+		if(packet != NULL && is_push(packet)){
+			invalidate(packet);
+			continue;
+		}
+		uint32_t rid;
+		if(packet == NULL || packet_id(&rid) == -1){
+			fail_async();
+			return NULL;
+		}
+		if(rid == id){
+			std::vector<Slice> &fields = view_.fields_;
+			fields.resize(packet->size());
+			for(int i=0; i<(int)packet->size(); i++){
+				const Bytes &b = packet->at(i);
+				fields[i] = Slice(b.data(), b.size());
+			}
+			return &view_;
+		}
+		// 其它请求的响应需要复制
+		resp_.clear();
+		for(int i=0; i<(int)packet->size(); i++){
+			resp_.push_back(packet->at(i).String());
+		}
+		if(!dispatch(rid, &resp_)){
+			ready_.push_back(std::make_pair(rid, resp_));
+		}
+	}
+	return NULL;
+}
+
+const Response* ClientImpl::request_view(const std::string &cmd, const std::string &s2, const std::string &s3, const std::string &s4){
+	std::vector<std::string> req;
+	req.push_back(cmd);
+	req.push_back(s2);
+	req.push_back(s3);
+	req.push_back(s4);
+	return request_view(req);
+}
+
+const Response* ClientImpl::request_view(const std::string &cmd, const std::string &s2, const std::string &s3, const std::string &s4, const std::string &s5){
+	std::vector<std::string> req;
+	req.push_back(cmd);
+	req.push_back(s2);
+	req.push_back(s3);
+	req.push_back(s4);
+	req.push_back(s5);
+	return request_view(req);
+}
+
+const Response* ClientImpl::request_view(const std::string &cmd, const std::string &s2, const std::string &s3, const std::string &s4, const std::string &s5, const std::string &s6){
+	std::vector<std::string> req;
+	req.push_back(cmd);
+	req.push_back(s2);
+	req.push_back(s3);
+	req.push_back(s4);
+	req.push_back(s5);
+	req.push_back(s6);
+	return request_view(req);
+}
+
+const Response* ClientImpl::request_view(const std::string &cmd, const std::vector<std::string> &s2){
+	std::vector<std::string> req;
+	req.reserve(s2.size() + 1);
+	req.push_back(cmd);
+	req.insert(req.end(), s2.begin(), s2.end());
+	return request_view(req);
+}
+
+const Response* ClientImpl::request_view(const std::string &cmd, const std::string &s2, const std::vector<std::string> &s3){
+	std::vector<std::string> req;
+	req.reserve(s3.size() + 2);
+	req.push_back(cmd);
+	req.push_back(s2);
+	req.insert(req.end(), s3.begin(), s3.end());
+	return request_view(req);
+}
+
+Status ClientImpl::protocol(int version){
+	if(version == link->proto()){
+		return Status("ok");
+	}
+	if(version != Link::PROTO_V2 || !pending_.empty() || !ready_.empty()
+		|| !async_.empty() || !results_.empty())
+	{
+		return Status("client_error");
+	}
+	const std::vector<std::string> *resp = this->request("proto", str(version));
+	Status s(resp);
+	if(s.ok()){
+		link->set_proto(Link::PROTO_V2);
+	}
+	return s;
+}
+
+int64_t ClientImpl::send_request(const std::vector<std::string> &req){
+	return send_packet(req);
+}
+
+const std::vector<std::string>* ClientImpl::recv_response(int64_t *id){
+	if(!ready_.empty()){
+		*id = ready_.front().first;
+		resp_.swap(ready_.front().second);
+		ready_.pop_front();
+		return &resp_;
+	}
+	while(1){
+		uint32_t rid;
+		if(recv_packet(&rid, &resp_) == -1){
+			return NULL;
+		}
+		if(!dispatch(rid, &resp_)){
+			*id = rid;
+			return &resp_;
+		}
+	}
+	return NULL;
+}
+
+/******************** async *************************/
+
+int64_t ClientImpl::async_request(const std::vector<std::string> &req, Callback callback, void *arg){
+	int64_t id = send_packet(req, false);
+	if(id == -1){
+		return -1;
+	}
+	AsyncCall call;
+	call.callback = callback;
+	call.arg = arg;
+	async_[(uint32_t)id] = call;
+	return id;
+}
+
+int ClientImpl::flush(){
+	int ret = link->flush();
+	if(ret == -1){
+		broken_ = true;
+	}
+	return ret;
+}
+
+const std::vector<std::string>* ClientImpl::wait(int64_t id){
+	std::map<uint32_t, std::vector<std::string> >::iterator it;
+	it = results_.find((uint32_t)id);
+	if(it != results_.end()){
+		resp_.swap(it->second);
+		results_.erase(it);
+		return &resp_;
+	}
+	std::map<uint32_t, AsyncCall>::iterator it2 = async_.find((uint32_t)id);
+	if(it2 == async_.end() || it2->second.callback){
 		return NULL;
 	}
-	resp_.clear();
-	for(std::vector<Bytes>::const_iterator it=packet->begin(); it!=packet->end(); it++){
-		const Bytes &b = *it;
-		resp_.push_back(b.String());
+	if(this->flush() == -1){
+		return NULL;
 	}
-	return &resp_;
+	while(1){
+		uint32_t rid;
+		if(recv_packet(&rid, &resp_) == -1){
+			return NULL;
+		}
+		if(rid == id){
+			async_.erase((uint32_t)id);
+			return &resp_;
+		}
+		if(!dispatch(rid, &resp_)){
+			ready_.push_back(std::make_pair(rid, resp_));
+		}
+	}
+	return NULL;
+}
+
+int ClientImpl::pending(){
+	return (int)async_.size();
+}
+
+int ClientImpl::fd(){
+	return link->fd();
+}
+
+bool ClientImpl::want_write(){
+	return !link->output->empty();
+}
+
+// 在 fd 可读时调用, 只读取一次, 所以不会阻塞
+int ClientImpl::on_readable(){
+	if(link->read() <= 0){
+		fail_async();
+		return -1;
+	}
+	return process_input();
+}
+
+int ClientImpl::process_input(){
+	int num = 0;
+	while(1){
+		const std::vector<Bytes> *packet = link->recv();
+		if(packet == NULL){
+			fail_async();
+			return -1;
+		}
+		if(packet->empty()){
+			break;
+		}
+		if(is_push(packet)){
+			invalidate(packet);
+			continue;
+		}
+		uint32_t rid;
+		if(take_packet(packet, &rid, &resp_) == -1){
+			fail_async();
+			return -1;
+		}
+		num ++;
+		if(!dispatch(rid, &resp_)){
+			ready_.push_back(std::make_pair(rid, resp_));
+		}
+	}
+	return num;
+}
+
+int ClientImpl::on_writable(){
+	if(link->output->empty()){
+		return 0;
+	}
+	// 连接平时是阻塞的, 同步的方法依赖它
+	link->noblock(true);
+	int ret = link->write();
+	link->noblock(false);
+	if(ret == -1){
+		broken_ = true;
+	}
+	return ret;
+}
+
+// 保持 depth/2 到 depth 个请求在途, 每次补充请求时写一次
+Status ClientImpl::batch_get(const std::vector<std::string> &keys,
+	std::vector<std::string> *vals, std::vector<bool> *found, int depth)
+{
+	vals->clear();
+	vals->resize(keys.size());
+	if(found){
+		found->clear();
+		found->resize(keys.size(), false);
+	}
+	if(depth <= 0){
+		depth = 1;
+	}
+	Status ret("ok");
+	std::vector<int64_t> ids(keys.size());
+	std::vector<std::string> req(2);
+	req[0] = "get";
+	size_t sent = 0;
+	size_t done = 0;
+	while(done < keys.size()){
+		if(sent - done <= (size_t)depth/2 && sent < keys.size()){
+			while(sent < keys.size() && sent - done < (size_t)depth){
+				req[1] = keys[sent];
+				ids[sent] = this->async_request(req);
+				if(ids[sent] == -1){
+					break;
+				}
+				sent ++;
+			}
+			if(sent < keys.size() && sent - done < (size_t)depth){
+				ret = Status("error");
+				break;
+			}
+		}
+		const std::vector<std::string> *resp = this->wait(ids[done]);
+		if(resp == NULL){
+			ret = Status("error");
+			break;
+		}
+		Status s(resp);
+		if(s.ok() && resp->size() >= 2){
+			(*vals)[done] = resp->at(1);
+			if(found){
+				(*found)[done] = true;
+			}
+		}else if(!s.not_found() && ret.ok()){
+			ret = s;
+		}
+		done ++;
+	}
+	// 出错时丢弃剩下的请求
+	for(; done < sent; done++){
+		async_.erase((uint32_t)ids[done]);
+		results_.erase((uint32_t)ids[done]);
+	}
+	return ret;
 }
 
 const std::vector<std::string>* ClientImpl::request(const std::string &cmd){
@@ -162,6 +587,168 @@ const std::vector<std::string>* ClientImpl::request(const std::string &cmd, cons
 	return request(req);
 }
 
+/******************** cache *************************/
+
+Status ClientImpl::enable_cache(int max_items){
+	if(max_items <= 0){
+		cache_max_ = 0;
+		cache_trim(0);
+		if(!tracking_){
+			return Status("ok");
+		}
+		// 已经在路上的失效通知仍然能被识别
+		const std::vector<std::string> *resp = this->request("tracking", "off");
+		return Status(resp);
+	}
+	if(cache_max_ == 0){
+		const std::vector<std::string> *resp = this->request("tracking", "on");
+		Status s(resp);
+		if(!s.ok()){
+			return s;
+		}
+		tracking_ = true;
+	}
+	cache_max_ = max_items;
+	cache_trim(cache_max_);
+	return Status("ok");
+}
+
+void ClientImpl::cache_stats(CacheStats *ret){
+	*ret = cache_stats_;
+	ret->items = (int64_t)cache_.size();
+}
+
+// 服务器推送的失效通知: 文本协议中插在两个响应之间, v2 协议的 id 是 0
+bool ClientImpl::is_push(const std::vector<Bytes> *packet){
+	if(!tracking_ || packet->empty()){
+		return false;
+	}
+	if(link->proto() == Link::PROTO_V2 && link->recv_id != 0){
+		return false;
+	}
+	const Bytes &b = packet->at(0);
+	return b.size() == 10 && memcmp(b.data(), "invalidate", 10) == 0;
+}
+
+// invalidate type key type key ..., 没有 key 时清空所有缓存
+void ClientImpl::invalidate(const std::vector<Bytes> *packet){
+	if(packet->size() == 1){
+		cache_stats_.invalidations += cache_.size();
+		cache_trim(0);
+		if(!loading_.empty()){
+			loading_stale_ = true;
+		}
+		return;
+	}
+	for(int i=1; i + 1<(int)packet->size(); i+=2){
+		const Bytes &type = packet->at(i);
+		const Bytes &key = packet->at(i + 1);
+		if(type.size() != 1){
+			continue;
+		}
+		std::string tkey = type.String() + key.String();
+		if(tkey == loading_){
+			loading_stale_ = true;
+		}
+		if(type.data()[0] == 'h'){
+			cache_stats_.invalidations += cache_erase_prefix(_hash_prefix(key.data(), key.size()));
+		}else{
+			cache_stats_.invalidations += cache_erase(tkey);
+		}
+	}
+}
+
+// 先处理输入缓冲区中已有的, 再不阻塞地读取一次
+void ClientImpl::poll_pushes(){
+	if(process_input() == -1){
+		return;
+	}
+	struct pollfd pfd;
+	pfd.fd = link->fd();
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+	if(::poll(&pfd, 1, 0) > 0){
+		this->on_readable();
+	}
+}
+
+bool ClientImpl::cache_get(const std::string &key, std::string *val, Status *s){
+	poll_pushes();
+	std::map<std::string, CacheItem>::iterator it = cache_.find(key);
+	if(it == cache_.end()){
+		cache_stats_.misses ++;
+		return false;
+	}
+	cache_stats_.hits ++;
+	cache_lru_.splice(cache_lru_.begin(), cache_lru_, it->second.lru);
+	if(it->second.found){
+		*val = it->second.val;
+		*s = Status("ok");
+	}else{
+		*s = Status("not_found");
+	}
+	return true;
+}
+
+// 读取期间 key 失效了的不缓存, 因为读到的可能是旧值
+void ClientImpl::cache_put(const std::string &key, const std::vector<std::string> *resp){
+	if(resp == NULL || loading_stale_){
+		return;
+	}
+	Status s(resp);
+	bool found;
+	if(s.ok() && resp->size() >= 2){
+		found = true;
+	}else if(s.not_found()){
+		found = false;
+	}else{
+		return;
+	}
+	std::map<std::string, CacheItem>::iterator it = cache_.find(key);
+	if(it == cache_.end()){
+		cache_trim(cache_max_ - 1);
+		cache_lru_.push_front(key);
+		it = cache_.insert(std::make_pair(key, CacheItem())).first;
+		it->second.lru = cache_lru_.begin();
+	}else{
+		cache_lru_.splice(cache_lru_.begin(), cache_lru_, it->second.lru);
+	}
+	it->second.found = found;
+	if(found){
+		it->second.val = resp->at(1);
+	}else{
+		it->second.val.clear();
+	}
+}
+
+int ClientImpl::cache_erase(const std::string &key){
+	std::map<std::string, CacheItem>::iterator it = cache_.find(key);
+	if(it == cache_.end()){
+		return 0;
+	}
+	cache_lru_.erase(it->second.lru);
+	cache_.erase(it);
+	return 1;
+}
+
+int ClientImpl::cache_erase_prefix(const std::string &prefix){
+	int num = 0;
+	std::map<std::string, CacheItem>::iterator it = cache_.lower_bound(prefix);
+	while(it != cache_.end() && it->first.compare(0, prefix.size(), prefix) == 0){
+		cache_lru_.erase(it->second.lru);
+		cache_.erase(it++);
+		num ++;
+	}
+	return num;
+}
+
+void ClientImpl::cache_trim(size_t max){
+	while(cache_.size() > max){
+		cache_.erase(cache_lru_.back());
+		cache_lru_.pop_back();
+	}
+}
+
 /******************** misc *************************/
 
 Status ClientImpl::dbsize(int64_t *ret){
@@ -192,11 +779,27 @@ Status ClientImpl::set_kv_range(const std::string &start, const std::string &end
 
 Status ClientImpl::get(const std::string &key, std::string *val){
 	const std::vector<std::string> *resp;
-	resp = this->request("get", key);
+	if(cache_max_ > 0){
+		std::string ckey = "k" + key;
+		Status s;
+		if(cache_get(ckey, val, &s)){
+			return s;
+		}
+		loading_ = ckey;
+		loading_stale_ = false;
+		resp = this->request("get", key);
+		cache_put(ckey, resp);
+		loading_.clear();
+	}else{
+		resp = this->request("get", key);
+	}
 	return _read_str(resp, val);
 }
 
 Status ClientImpl::set(const std::string &key, const std::string &val){
+	if(cache_max_ > 0){
+		cache_erase("k" + key);
+	}
 	const std::vector<std::string> *resp;
 	resp = this->request("set", key, val);
 	Status s(resp);
@@ -204,6 +807,9 @@ Status ClientImpl::set(const std::string &key, const std::string &val){
 }
 
 Status ClientImpl::setx(const std::string &key, const std::string &val, int ttl){
+	if(cache_max_ > 0){
+		cache_erase("k" + key);
+	}
 	const std::vector<std::string> *resp;
 	resp = this->request("setx", key, val, str(ttl));
 	Status s(resp);
@@ -211,6 +817,9 @@ Status ClientImpl::setx(const std::string &key, const std::string &val, int ttl)
 }
 
 Status ClientImpl::del(const std::string &key){
+	if(cache_max_ > 0){
+		cache_erase("k" + key);
+	}
 	const std::vector<std::string> *resp;
 	resp = this->request("del", key);
 	Status s(resp);
@@ -218,6 +827,9 @@ Status ClientImpl::del(const std::string &key){
 }
 
 Status ClientImpl::incr(const std::string &key, int64_t incrby, int64_t *ret){
+	if(cache_max_ > 0){
+		cache_erase("k" + key);
+	}
 	std::string s_incrby = str(incrby);
 	const std::vector<std::string> *resp;
 	resp = this->request("incr", key, s_incrby);
@@ -228,8 +840,8 @@ Status ClientImpl::keys(const std::string &key_start, const std::string &key_end
 	uint64_t limit, std::vector<std::string> *ret)
 {
 	std::string s_limit = str(limit);
-	const std::vector<std::string> *resp;
-	resp = this->request("keys", key_start, key_end, s_limit);
+	const Response *resp;
+	resp = this->request_view("keys", key_start, key_end, s_limit);
 	return _read_list(resp, ret);
 }
 
@@ -237,8 +849,8 @@ Status ClientImpl::scan(const std::string &key_start, const std::string &key_end
 	uint64_t limit, std::vector<std::string> *ret)
 {
 	std::string s_limit = str(limit);
-	const std::vector<std::string> *resp;
-	resp = this->request("scan", key_start, key_end, s_limit);
+	const Response *resp;
+	resp = this->request_view("scan", key_start, key_end, s_limit);
 	return _read_list(resp, ret);
 }
 
@@ -246,14 +858,14 @@ Status ClientImpl::rscan(const std::string &key_start, const std::string &key_en
 	uint64_t limit, std::vector<std::string> *ret)
 {
 	std::string s_limit = str(limit);
-	const std::vector<std::string> *resp;
-	resp = this->request("rscan", key_start, key_end, s_limit);
+	const Response *resp;
+	resp = this->request_view("rscan", key_start, key_end, s_limit);
 	return _read_list(resp, ret);
 }
 
 Status ClientImpl::multi_get(const std::vector<std::string> &keys, std::vector<std::string> *ret){
-	const std::vector<std::string> *resp;
-	resp = this->request("multi_get", keys);
+	const Response *resp;
+	resp = this->request_view("multi_get", keys);
 	return _read_list(resp, ret);
 }
 
@@ -265,6 +877,9 @@ Status ClientImpl::multi_set(const std::map<std::string, std::string> &kvs){
 	{
 		list.push_back(it->first);
 		list.push_back(it->second);
+		if(cache_max_ > 0){
+			cache_erase("k" + it->first);
+		}
 	}
 	resp = this->request("multi_set", list);
 	Status s(resp);
@@ -272,6 +887,11 @@ Status ClientImpl::multi_set(const std::map<std::string, std::string> &kvs){
 }
 
 Status ClientImpl::multi_del(const std::vector<std::string> &keys){
+	if(cache_max_ > 0){
+		for(int i=0; i<(int)keys.size(); i++){
+			cache_erase("k" + keys[i]);
+		}
+	}
 	const std::vector<std::string> *resp;
 	resp = this->request("multi_del", keys);
 	Status s(resp);
@@ -284,11 +904,27 @@ Status ClientImpl::multi_del(const std::vector<std::string> &keys){
 
 Status ClientImpl::hget(const std::string &name, const std::string &key, std::string *val){
 	const std::vector<std::string> *resp;
-	resp = this->request("hget", name, key);
+	if(cache_max_ > 0){
+		std::string ckey = _hash_prefix(name.data(), name.size()) + key;
+		Status s;
+		if(cache_get(ckey, val, &s)){
+			return s;
+		}
+		loading_ = "h" + name;
+		loading_stale_ = false;
+		resp = this->request("hget", name, key);
+		cache_put(ckey, resp);
+		loading_.clear();
+	}else{
+		resp = this->request("hget", name, key);
+	}
 	return _read_str(resp, val);
 }
 
 Status ClientImpl::hset(const std::string &name, const std::string &key, const std::string &val){
+	if(cache_max_ > 0){
+		cache_erase_prefix(_hash_prefix(name.data(), name.size()));
+	}
 	const std::vector<std::string> *resp;
 	resp = this->request("hset", name, key, val);
 	Status s(resp);
@@ -296,6 +932,9 @@ Status ClientImpl::hset(const std::string &name, const std::string &key, const s
 }
 
 Status ClientImpl::hdel(const std::string &name, const std::string &key){
+	if(cache_max_ > 0){
+		cache_erase_prefix(_hash_prefix(name.data(), name.size()));
+	}
 	const std::vector<std::string> *resp;
 	resp = this->request("hdel", name, key);
 	Status s(resp);
@@ -303,6 +942,9 @@ Status ClientImpl::hdel(const std::string &name, const std::string &key){
 }
 
 Status ClientImpl::hincr(const std::string &name, const std::string &key, int64_t incrby, int64_t *ret){
+	if(cache_max_ > 0){
+		cache_erase_prefix(_hash_prefix(name.data(), name.size()));
+	}
 	std::string s_incrby = str(incrby);
 	const std::vector<std::string> *resp;
 	resp = this->request("hincr", name, key, s_incrby);
@@ -316,6 +958,9 @@ Status ClientImpl::hsize(const std::string &name, int64_t *ret){
 }
 
 Status ClientImpl::hclear(const std::string &name, int64_t *ret){
+	if(cache_max_ > 0){
+		cache_erase_prefix(_hash_prefix(name.data(), name.size()));
+	}
 	const std::vector<std::string> *resp;
 	resp = this->request("hclear", name);
 	return _read_int64(resp, ret);
@@ -326,8 +971,8 @@ Status ClientImpl::hkeys(const std::string &name,
 	uint64_t limit, std::vector<std::string> *ret)
 {
 	std::string s_limit = str(limit);
-	const std::vector<std::string> *resp;
-	resp = this->request("hkeys", name, key_start, key_end, s_limit);
+	const Response *resp;
+	resp = this->request_view("hkeys", name, key_start, key_end, s_limit);
 	return _read_list(resp, ret);
 }
 
@@ -336,8 +981,8 @@ Status ClientImpl::hscan(const std::string &name,
 	uint64_t limit, std::vector<std::string> *ret)
 {
 	std::string s_limit = str(limit);
-	const std::vector<std::string> *resp;
-	resp = this->request("hscan", name, key_start, key_end, s_limit);
+	const Response *resp;
+	resp = this->request_view("hscan", name, key_start, key_end, s_limit);
 	return _read_list(resp, ret);
 }
 
@@ -346,19 +991,22 @@ Status ClientImpl::hrscan(const std::string &name,
 	uint64_t limit, std::vector<std::string> *ret)
 {
 	std::string s_limit = str(limit);
-	const std::vector<std::string> *resp;
-	resp = this->request("hrscan", name, key_start, key_end, s_limit);
+	const Response *resp;
+	resp = this->request_view("hrscan", name, key_start, key_end, s_limit);
 	return _read_list(resp, ret);
 }
 
 Status ClientImpl::multi_hget(const std::string &name, const std::vector<std::string> &keys,
 	std::vector<std::string> *ret){
-	const std::vector<std::string> *resp;
-	resp = this->request("multi_hget", name, keys);
+	const Response *resp;
+	resp = this->request_view("multi_hget", name, keys);
 	return _read_list(resp, ret);
 }
 
 Status ClientImpl::multi_hset(const std::string &name, const std::map<std::string, std::string> &kvs){
+	if(cache_max_ > 0){
+		cache_erase_prefix(_hash_prefix(name.data(), name.size()));
+	}
 	const std::vector<std::string> *resp;
 	std::vector<std::string> list;
 	for(std::map<std::string, std::string>::const_iterator it = kvs.begin();
@@ -373,6 +1021,9 @@ Status ClientImpl::multi_hset(const std::string &name, const std::map<std::strin
 }
 
 Status ClientImpl::multi_hdel(const std::string &name, const std::vector<std::string> &keys){
+	if(cache_max_ > 0){
+		cache_erase_prefix(_hash_prefix(name.data(), name.size()));
+	}
 	const std::vector<std::string> *resp;
 	resp = this->request("multi_hdel", name, keys);
 	Status s(resp);
@@ -441,8 +1092,8 @@ Status ClientImpl::zrange(const std::string &name,
 {
 	std::string s_offset = str(offset);
 	std::string s_limit = str(limit);
-	const std::vector<std::string> *resp;
-	resp = this->request("zrange", name, s_offset, s_limit);
+	const Response *resp;
+	resp = this->request_view("zrange", name, s_offset, s_limit);
 	return _read_list(resp, ret);
 }
 
@@ -452,8 +1103,8 @@ Status ClientImpl::zrrange(const std::string &name,
 {
 	std::string s_offset = str(offset);
 	std::string s_limit = str(limit);
-	const std::vector<std::string> *resp;
-	resp = this->request("zrrange", name, s_offset, s_limit);
+	const Response *resp;
+	resp = this->request_view("zrrange", name, s_offset, s_limit);
 	return _read_list(resp, ret);
 }
 
@@ -464,8 +1115,8 @@ Status ClientImpl::zkeys(const std::string &name, const std::string &key_start,
 	std::string s_score_start = score_start? str(*score_start) : "";
 	std::string s_score_end = score_end? str(*score_end) : "";
 	std::string s_limit = str(limit);
-	const std::vector<std::string> *resp;
-	resp = this->request("zkeys", name, key_start, s_score_start, s_score_end, s_limit);
+	const Response *resp;
+	resp = this->request_view("zkeys", name, key_start, s_score_start, s_score_end, s_limit);
 	return _read_list(resp, ret);
 }
 
@@ -476,8 +1127,8 @@ Status ClientImpl::zscan(const std::string &name, const std::string &key_start,
 	std::string s_score_start = score_start? str(*score_start) : "";
 	std::string s_score_end = score_end? str(*score_end) : "";
 	std::string s_limit = str(limit);
-	const std::vector<std::string> *resp;
-	resp = this->request("zscan", name, key_start, s_score_start, s_score_end, s_limit);
+	const Response *resp;
+	resp = this->request_view("zscan", name, key_start, s_score_start, s_score_end, s_limit);
 	return _read_list(resp, ret);
 }
 
@@ -488,15 +1139,15 @@ Status ClientImpl::zrscan(const std::string &name, const std::string &key_start,
 	std::string s_score_start = score_start? str(*score_start) : "";
 	std::string s_score_end = score_end? str(*score_end) : "";
 	std::string s_limit = str(limit);
-	const std::vector<std::string> *resp;
-	resp = this->request("zrscan", name, key_start, s_score_start, s_score_end, s_limit);
+	const Response *resp;
+	resp = this->request_view("zrscan", name, key_start, s_score_start, s_score_end, s_limit);
 	return _read_list(resp, ret);
 }
 
 Status ClientImpl::multi_zget(const std::string &name, const std::vector<std::string> &keys,
 	std::vector<std::string> *ret){
-	const std::vector<std::string> *resp;
-	resp = this->request("multi_zget", name, keys);
+	const Response *resp;
+	resp = this->request_view("multi_zget", name, keys);
 	return _read_list(resp, ret);
 }
 
@@ -540,8 +1191,8 @@ Status ClientImpl::qslice(const std::string &name,
 {
 	std::string s_begin = str(begin);
 	std::string s_end = str(end);
-	const std::vector<std::string> *resp;
-	resp = this->request("qslice", name, s_begin, s_end);
+	const Response *resp;
+	resp = this->request_view("qslice", name, s_begin, s_end);
 	return _read_list(resp, ret);
 }
 
@@ -1,6 +1,8 @@
 #ifndef SSDB_API_IMPL_CPP
 #define SSDB_API_IMPL_CPP
 
+#include <deque>
+#include <list>
 #include "SSDB_client.h"
 #include "net/link.h"
 
@@ -11,11 +13,76 @@ private:
 	friend class Client;
 	
 	Link *link;
+	// 连接出错, 不能再使用
+	bool broken_;
 	std::vector<std::string> resp_;
+	// request_view() 的响应, 复用它的内存
+	Response view_;
+	// 请求的 id, 从 1 开始
+	uint32_t next_id;
+	// 文本协议下还没有收到响应的请求, 响应按顺序返回
+	std::deque<uint32_t> pending_;
+	// 收到了, 但还没有被 recv_response() 取走的响应
+	std::deque< std::pair<uint32_t, std::vector<std::string> > > ready_;
+	struct AsyncCall{
+		Callback callback;
+		void *arg;
+	};
+	// async_request() 发出的, 还没有收到响应的请求
+	std::map<uint32_t, AsyncCall> async_;
+	// 没有回调的 async_request() 的响应, 等待 wait() 取走
+	std::map<uint32_t, std::vector<std::string> > results_;
+	int64_t send_packet(const std::vector<std::string> &req, bool flush=true);
+	int recv_packet(uint32_t *id, std::vector<std::string> *resp);
+	int packet_id(uint32_t *id);
+	int take_packet(const std::vector<Bytes> *packet, uint32_t *id, std::vector<std::string> *resp);
+	bool dispatch(uint32_t id, std::vector<std::string> *resp);
+	// 给返回列表的方法使用
+	const Response* request_view(const std::string &cmd, const std::string &s2, const std::string &s3, const std::string &s4);
+	const Response* request_view(const std::string &cmd, const std::string &s2, const std::string &s3, const std::string &s4, const std::string &s5);
+	const Response* request_view(const std::string &cmd, const std::string &s2, const std::string &s3, const std::string &s4, const std::string &s5, const std::string &s6);
+	const Response* request_view(const std::string &cmd, const std::vector<std::string> &s2);
+	const Response* request_view(const std::string &cmd, const std::string &s2, const std::vector<std::string> &s3);
+	void fail_async();
+	// 处理输入缓冲区中完整的包, 返回收到的响应数
+	int process_input();
+
+	// 客户端缓存, 见 enable_cache(). kv 的缓存 key 是 k+key, hash 的是
+	// h+name 的长度+name+key. tracking 的 key 见 net/tracking.h
+	struct CacheItem{
+		bool found;
+		std::string val;
+		std::list<std::string>::iterator lru;
+	};
+	// 开启过 tracking, 之后要识别服务器推送的失效通知
+	bool tracking_;
+	size_t cache_max_;
+	std::map<std::string, CacheItem> cache_;
+	// 最近使用的在前面
+	std::list<std::string> cache_lru_;
+	// 正在读取的 key(tracking 的 key), 读取期间失效了则不缓存读到的值
+	std::string loading_;
+	bool loading_stale_;
+	CacheStats cache_stats_;
+	bool is_push(const std::vector<Bytes> *packet);
+	void invalidate(const std::vector<Bytes> *packet);
+	void poll_pushes();
+	bool cache_get(const std::string &key, std::string *val, Status *s);
+	void cache_put(const std::string &key, const std::vector<std::string> *resp);
+	int cache_erase(const std::string &key);
+	int cache_erase_prefix(const std::string &prefix);
+	// 删除最久没有使用的, 直到剩下 max 个
+	void cache_trim(size_t max);
 public:
 	ClientImpl();
 	~ClientImpl();
 
+	bool broken() const{
+		return broken_;
+	}
+	// 所属的连接池的位置, 见 SSDB_pool.cpp
+	void *pool_slot;
+
 	virtual const std::vector<std::string>* request(const std::vector<std::string> &req);
 	virtual const std::vector<std::string>* request(const std::string &cmd);
 	virtual const std::vector<std::string>* request(const std::string &cmd, const std::string &s2);
@@ -26,6 +93,28 @@ public:
 	virtual const std::vector<std::string>* request(const std::string &cmd, const std::vector<std::string> &s2);
 	virtual const std::vector<std::string>* request(const std::string &cmd, const std::string &s2, const std::vector<std::string> &s3);
 
+	virtual const Response* request_view(const std::vector<std::string> &req);
+
+	virtual Status protocol(int version);
+	virtual int64_t send_request(const std::vector<std::string> &req);
+	virtual const std::vector<std::string>* recv_response(int64_t *id);
+
+	virtual int64_t async_request(const std::vector<std::string> &req,
+		Callback callback=NULL, void *arg=NULL);
+	virtual int flush();
+	virtual const std::vector<std::string>* wait(int64_t id);
+	virtual int pending();
+	virtual int fd();
+	virtual bool want_write();
+	virtual int on_readable();
+	virtual int on_writable();
+	virtual Status batch_get(const std::vector<std::string> &keys,
+		std::vector<std::string> *vals, std::vector<bool> *found=NULL,
+		int depth=256);
+
+	virtual Status enable_cache(int max_items);
+	virtual void cache_stats(CacheStats *ret);
+
 	virtual Status dbsize(int64_t *ret);
 	virtual Status get_kv_range(std::string *start, std::string *end);
 	virtual Status set_kv_range(const std::string &start, const std::string &end);
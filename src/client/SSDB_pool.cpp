@@ -0,0 +1,532 @@
+#include "SSDB_pool.h"
+#include "SSDB_impl.h"
+#include "util/strings.h"
+#include <errno.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <algorithm>
+
+namespace ssdb{
+
+static inline int64_t time_ms(){
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	return (int64_t)now.tv_sec * 1000 + now.tv_usec / 1000;
+}
+
+static inline int64_t time_us(){
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	return (int64_t)now.tv_sec * 1000000 + now.tv_usec;
+}
+
+// 重连的间隔从 100ms 开始, 每次失败加倍
+static const int MIN_BACKOFF = 100;
+static const int MAX_BACKOFF = 5000;
+
+// 连接池中的一个位置, state 只用 CAS 修改, 修改成 BUSY 的线程独占它
+struct PoolSlot{
+	static const int EMPTY	= 0;
+	static const int IDLE	= 1;
+	static const int BUSY	= 2;
+
+	volatile int state;
+	ClientImpl *client;
+	// 开始空闲的时间(ms)
+	int64_t idle_since;
+	PoolNode *node;
+};
+
+// 到一个服务器的连接
+class PoolNode{
+public:
+	ClientPool *pool;
+	std::string ip;
+	int port;
+	int size;
+	PoolSlot *slots;
+
+	PoolNode(ClientPool *pool, const std::string &ip, int port, int size);
+	~PoolNode();
+	ClientImpl* get(int64_t deadline, bool *waited);
+	void put(PoolSlot *slot);
+	bool acquire(PoolSlot *slot, int from){
+		return __sync_bool_compare_and_swap(&slot->state, from, PoolSlot::BUSY);
+	}
+
+private:
+	// 下一次检出从这个位置开始找, 使各连接被平均使用
+	volatile unsigned int next;
+	// 在这个时间(ms)之前不重连
+	volatile int64_t retry_time;
+	volatile int backoff;
+	// 只在等待空闲连接时使用
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	volatile int waiters;
+
+	int connect(PoolSlot *slot);
+	// 返回可以检出的位置, 没有则返回 NULL. 如果所有位置都没有连接, 并且
+	// 还不能重连, down 被设为 true
+	PoolSlot* try_acquire(bool *down);
+};
+
+PoolNode::PoolNode(ClientPool *pool, const std::string &ip, int port, int size){
+	this->pool = pool;
+	this->ip = ip;
+	this->port = port;
+	this->size = size;
+	this->next = 0;
+	this->retry_time = 0;
+	this->backoff = 0;
+	this->waiters = 0;
+	slots = new PoolSlot[size];
+	for(int i=0; i<size; i++){
+		slots[i].state = PoolSlot::EMPTY;
+		slots[i].client = NULL;
+		slots[i].idle_since = 0;
+		slots[i].node = this;
+	}
+	pthread_mutex_init(&mutex, NULL);
+	pthread_cond_init(&cond, NULL);
+}
+
+// 调用者保证没有检出的连接
+PoolNode::~PoolNode(){
+	for(int i=0; i<size; i++){
+		delete slots[i].client;
+	}
+	delete[] slots;
+	pthread_cond_destroy(&cond);
+	pthread_mutex_destroy(&mutex);
+}
+
+int PoolNode::connect(PoolSlot *slot){
+	Client *client = Client::connect(ip, port);
+	if(client && !pool->auth.empty()){
+		const std::vector<std::string> *resp = client->request("auth", pool->auth);
+		if(!Status(resp).ok()){
+			delete client;
+			client = NULL;
+		}
+	}
+	if(client == NULL){
+		__sync_fetch_and_add(&pool->counters.connect_errors, 1);
+		int b = backoff;
+		b = (b == 0)? MIN_BACKOFF : std::min(b * 2, MAX_BACKOFF);
+		backoff = b;
+		retry_time = time_ms() + b;
+		return -1;
+	}
+	__sync_fetch_and_add(&pool->counters.connects, 1);
+	backoff = 0;
+	retry_time = 0;
+	slot->client = (ClientImpl *)client;
+	slot->client->pool_slot = slot;
+	return 0;
+}
+
+PoolSlot* PoolNode::try_acquire(bool *down){
+	unsigned int start = __sync_fetch_and_add(&next, 1);
+	int empty = 0;
+	for(int i=0; i<size; i++){
+		PoolSlot *slot = &slots[(start + i) % size];
+		int state = slot->state;
+		if(state == PoolSlot::IDLE && acquire(slot, PoolSlot::IDLE)){
+			return slot;
+		}
+		if(state == PoolSlot::EMPTY){
+			empty ++;
+		}
+	}
+	*down = false;
+	if(empty == 0){
+		return NULL;
+	}
+	if(time_ms() < retry_time){
+		*down = (empty == size);
+		return NULL;
+	}
+	for(int i=0; i<size; i++){
+		PoolSlot *slot = &slots[(start + i) % size];
+		if(slot->state == PoolSlot::EMPTY && acquire(slot, PoolSlot::EMPTY)){
+			if(this->connect(slot) == 0){
+				return slot;
+			}
+			slot->state = PoolSlot::EMPTY;
+			__sync_synchronize();
+			*down = true;
+			return NULL;
+		}
+	}
+	return NULL;
+}
+
+ClientImpl* PoolNode::get(int64_t deadline, bool *waited){
+	*waited = false;
+	while(1){
+		bool down;
+		PoolSlot *slot = try_acquire(&down);
+		if(slot){
+			return slot->client;
+		}
+		if(down){
+			return NULL;
+		}
+		int64_t now = time_ms();
+		if(now >= deadline){
+			return NULL;
+		}
+		*waited = true;
+
+		pthread_mutex_lock(&mutex);
+		waiters ++;
+		// put() 先修改 state 再读取 waiters, 这里先增加 waiters 再检查,
+		// 所以不会错过唤醒
+		__sync_synchronize();
+		bool ready = false;
+		for(int i=0; i<size; i++){
+			int state = slots[i].state;
+			if(state == PoolSlot::IDLE || (state == PoolSlot::EMPTY && now >= retry_time)){
+				ready = true;
+				break;
+			}
+		}
+		if(!ready){
+			int64_t wake = deadline;
+			if(retry_time > now && retry_time < wake){
+				wake = retry_time;
+			}
+			struct timespec ts;
+			ts.tv_sec = wake / 1000;
+			ts.tv_nsec = (wake % 1000) * 1000 * 1000;
+			pthread_cond_timedwait(&cond, &mutex, &ts);
+		}
+		waiters --;
+		pthread_mutex_unlock(&mutex);
+	}
+	return NULL;
+}
+
+void PoolNode::put(PoolSlot *slot){
+	ClientImpl *client = slot->client;
+	// 还有没收到的响应的连接不能给别人使用
+	if(client->broken() || client->pending() > 0){
+		__sync_fetch_and_add(&pool->counters.broken, 1);
+		delete client;
+		slot->client = NULL;
+		__sync_synchronize();
+		slot->state = PoolSlot::EMPTY;
+	}else{
+		slot->idle_since = time_ms();
+		__sync_synchronize();
+		slot->state = PoolSlot::IDLE;
+	}
+	__sync_synchronize();
+	if(waiters > 0){
+		pthread_mutex_lock(&mutex);
+		pthread_cond_signal(&cond);
+		pthread_mutex_unlock(&mutex);
+	}
+}
+
+
+// 集群的 key 区间表, 区间是 (begin, end], 空的 begin 和 end 表示没有限制
+class PoolTable{
+public:
+	struct Range{
+		std::string begin;
+		std::string end;
+		PoolNode *node;
+	};
+	std::vector<Range> ranges;
+
+	static bool range_less(const Range &a, const Range &b){
+		return a.begin < b.begin;
+	}
+	bool equals(const PoolTable *t) const{
+		if(t == NULL || t->ranges.size() != ranges.size()){
+			return false;
+		}
+		for(int i=0; i<(int)ranges.size(); i++){
+			const Range &a = ranges[i];
+			const Range &b = t->ranges[i];
+			if(a.begin != b.begin || a.end != b.end || a.node != b.node){
+				return false;
+			}
+		}
+		return true;
+	}
+	PoolNode* route(const std::string &key) const{
+		if(ranges.empty()){
+			return NULL;
+		}
+		if(key.empty()){
+			return ranges[0].node;
+		}
+		// 找到最后一个 begin < key 的区间
+		int lo = 0, hi = (int)ranges.size();
+		while(lo < hi){
+			int mid = (lo + hi) / 2;
+			if(ranges[mid].begin < key){
+				lo = mid + 1;
+			}else{
+				hi = mid;
+			}
+		}
+		if(lo == 0){
+			return NULL;
+		}
+		const Range &r = ranges[lo - 1];
+		if(!r.end.empty() && r.end < key){
+			return NULL;
+		}
+		return r.node;
+	}
+};
+
+
+ClientPool::ClientPool(){
+	port = 0;
+	size = 0;
+	cluster = false;
+	wait_timeout = 1000;
+	ping_interval = 30;
+	table = NULL;
+	quit = false;
+	thread_started = false;
+	memset(&counters, 0, sizeof(counters));
+	pthread_mutex_init(&nodes_mutex, NULL);
+}
+
+ClientPool::~ClientPool(){
+	if(thread_started){
+		quit = true;
+		pthread_join(tid, NULL);
+	}
+	for(int i=0; i<(int)nodes.size(); i++){
+		delete nodes[i];
+	}
+	for(int i=0; i<(int)old_tables.size(); i++){
+		delete old_tables[i];
+	}
+	delete (PoolTable *)table;
+	pthread_mutex_destroy(&nodes_mutex);
+}
+
+ClientPool* ClientPool::create(const std::string &ip, int port, int size,
+	const std::string &password)
+{
+	return ClientPool::init(ip, port, size, password, false);
+}
+
+ClientPool* ClientPool::create_cluster(const std::string &ip, int port, int size,
+	const std::string &password)
+{
+	return ClientPool::init(ip, port, size, password, true);
+}
+
+ClientPool* ClientPool::init(const std::string &ip, int port, int size,
+	const std::string &password, bool cluster)
+{
+	if(size <= 0){
+		return NULL;
+	}
+	ClientPool *pool = new ClientPool();
+	pool->ip = ip;
+	pool->port = port;
+	pool->size = size;
+	pool->auth = password;
+	pool->cluster = cluster;
+	if(cluster){
+		if(pool->reload() == -1){
+			delete pool;
+			return NULL;
+		}
+	}else{
+		PoolTable *t = new PoolTable();
+		PoolTable::Range r;
+		r.node = pool->get_node(ip, port);
+		t->ranges.push_back(r);
+		pool->table = t;
+	}
+
+	int err = pthread_create(&pool->tid, NULL, &ClientPool::_run_thread, pool);
+	if(err == 0){
+		pool->thread_started = true;
+	}
+	return pool;
+}
+
+void ClientPool::set_wait_timeout(int ms){
+	this->wait_timeout = ms;
+}
+
+void ClientPool::set_ping_interval(int seconds){
+	this->ping_interval = seconds;
+}
+
+PoolNode* ClientPool::get_node(const std::string &ip, int port){
+	pthread_mutex_lock(&nodes_mutex);
+	PoolNode *node = NULL;
+	for(int i=0; i<(int)nodes.size(); i++){
+		if(nodes[i]->ip == ip && nodes[i]->port == port){
+			node = nodes[i];
+			break;
+		}
+	}
+	if(node == NULL){
+		node = new PoolNode(this, ip, port, size);
+		nodes.push_back(node);
+	}
+	pthread_mutex_unlock(&nodes_mutex);
+	return node;
+}
+
+Client* ClientPool::get(const std::string &key){
+	__sync_fetch_and_add(&counters.gets, 1);
+	PoolNode *node = table->route(key);
+	if(node == NULL){
+		__sync_fetch_and_add(&counters.errors, 1);
+		return NULL;
+	}
+	int64_t start = time_us();
+	bool waited;
+	ClientImpl *client = node->get(start / 1000 + wait_timeout, &waited);
+	if(waited){
+		__sync_fetch_and_add(&counters.waits, 1);
+		__sync_fetch_and_add(&counters.wait_time_us, time_us() - start);
+	}
+	if(client == NULL){
+		__sync_fetch_and_add(&counters.errors, 1);
+	}
+	return client;
+}
+
+void ClientPool::put(Client *client){
+	if(client == NULL){
+		return;
+	}
+	PoolSlot *slot = (PoolSlot *)((ClientImpl *)client)->pool_slot;
+	slot->node->put(slot);
+}
+
+// 节点列表: ok, 然后每个节点是 6 id status begin end ip port
+int ClientPool::reload(){
+	if(!cluster){
+		return 0;
+	}
+	Client *client = Client::connect(ip, port);
+	if(client == NULL){
+		return -1;
+	}
+	const std::vector<std::string> *resp = NULL;
+	if(!auth.empty()){
+		resp = client->request("auth", auth);
+		if(!Status(resp).ok()){
+			delete client;
+			return -1;
+		}
+	}
+	resp = client->request("cluster_kv_node_list");
+	if(!Status(resp).ok() || (resp->size() - 1) % 7 != 0){
+		delete client;
+		return -1;
+	}
+	PoolTable *t = new PoolTable();
+	for(int i=1; i + 7<=(int)resp->size(); i+=7){
+		// 只使用 SERVING(1) 的节点
+		if(str_to_int(resp->at(i + 2)) != 1){
+			continue;
+		}
+		PoolTable::Range r;
+		r.begin = resp->at(i + 3);
+		r.end = resp->at(i + 4);
+		r.node = get_node(resp->at(i + 5), str_to_int(resp->at(i + 6)));
+		t->ranges.push_back(r);
+	}
+	delete client;
+
+	std::sort(t->ranges.begin(), t->ranges.end(), PoolTable::range_less);
+	pthread_mutex_lock(&nodes_mutex);
+	if(t->equals(table)){
+		delete t;
+	}else{
+		// 其它线程可能还在读旧的表
+		if(table){
+			old_tables.push_back((PoolTable *)table);
+		}
+		__sync_synchronize();
+		table = t;
+	}
+	pthread_mutex_unlock(&nodes_mutex);
+	return 0;
+}
+
+void ClientPool::stats(ClientPoolStats *ret){
+	*ret = counters;
+	ret->size = 0;
+	ret->busy = 0;
+	ret->idle = 0;
+	pthread_mutex_lock(&nodes_mutex);
+	for(int i=0; i<(int)nodes.size(); i++){
+		PoolNode *node = nodes[i];
+		ret->size += node->size;
+		for(int j=0; j<node->size; j++){
+			int state = node->slots[j].state;
+			if(state == PoolSlot::BUSY){
+				ret->busy ++;
+			}else if(state == PoolSlot::IDLE){
+				ret->idle ++;
+			}
+		}
+	}
+	pthread_mutex_unlock(&nodes_mutex);
+}
+
+// 检查空闲了 ping_interval 秒的连接, 检查时连接被占用
+void ClientPool::ping_all(){
+	std::vector<PoolNode *> list;
+	pthread_mutex_lock(&nodes_mutex);
+	list = nodes;
+	pthread_mutex_unlock(&nodes_mutex);
+
+	int64_t now = time_ms();
+	for(int i=0; i<(int)list.size(); i++){
+		PoolNode *node = list[i];
+		for(int j=0; j<node->size && !quit; j++){
+			PoolSlot *slot = &node->slots[j];
+			if(slot->state != PoolSlot::IDLE || now - slot->idle_since < ping_interval * 1000){
+				continue;
+			}
+			if(!node->acquire(slot, PoolSlot::IDLE)){
+				continue;
+			}
+			__sync_fetch_and_add(&counters.pings, 1);
+			const std::vector<std::string> *resp = slot->client->request("ping");
+			if(!Status(resp).ok()){
+				__sync_fetch_and_add(&counters.ping_errors, 1);
+			}
+			node->put(slot);
+		}
+	}
+}
+
+void* ClientPool::_run_thread(void *arg){
+	ClientPool *pool = (ClientPool *)arg;
+	int64_t last = time_ms();
+	while(!pool->quit){
+		usleep(100 * 1000);
+		int interval = pool->ping_interval;
+		if(interval <= 0 || time_ms() - last < interval * 1000){
+			continue;
+		}
+		pool->ping_all();
+		pool->reload();
+		last = time_ms();
+	}
+	return (void *)NULL;
+}
+
+}; // namespace ssdb
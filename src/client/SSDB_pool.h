@@ -0,0 +1,171 @@
+#ifndef SSDB_API_POOL_CPP
+#define SSDB_API_POOL_CPP
+
+#include <pthread.h>
+#include "SSDB_client.h"
+
+namespace ssdb{
+
+class PoolNode;
+class PoolTable;
+
+/**
+ * Counters of a ClientPool.
+ */
+struct ClientPoolStats{
+	/// Max number of connections(of all nodes).
+	int64_t size;
+	/// Connections in use.
+	int64_t busy;
+	/// Connections ready to use.
+	int64_t idle;
+	/// Number of get()s.
+	int64_t gets;
+	/// get()s which had to wait for a connection.
+	int64_t waits;
+	/// Microseconds spent waiting in get().
+	int64_t wait_time_us;
+	/// get()s which returned NULL.
+	int64_t errors;
+	int64_t connects;
+	int64_t connect_errors;
+	/// Connections dropped because of errors.
+	int64_t broken;
+	int64_t pings;
+	int64_t ping_errors;
+
+	/// busy / size
+	double utilization() const{
+		return size > 0? (double)busy / size : 0;
+	}
+};
+
+/**
+ * A thread-safe pool of connections. Idle connections are checked out
+ * without locking. Broken connections are dropped when returned, and
+ * reconnected with exponential backoff. Idle connections are checked with
+ * <code>ping</code> periodically.
+ *
+ * A pool created by create_cluster() keeps connections to every node of
+ * a cluster, and routes keys by the key range table(cluster_kv_node_list).
+ */
+class ClientPool{
+public:
+	/**
+	 * @param size Max number of connections.
+	 * @param password Sent with <code>auth</code> on every new connection.
+	 */
+	static ClientPool* create(const std::string &ip, int port, int size,
+		const std::string &password=std::string());
+	/**
+	 * @param ip,port The node which stores the key range table.
+	 * @param size Max number of connections to each node.
+	 * @return NULL if the table can't be loaded.
+	 */
+	static ClientPool* create_cluster(const std::string &ip, int port, int size,
+		const std::string &password=std::string());
+	~ClientPool();
+
+	/// @name Options
+	/// Should be set before the pool is used.
+	/// @{
+	/**
+	 * Max milliseconds get() waits for an idle connection, default 1000.
+	 */
+	void set_wait_timeout(int ms);
+	/**
+	 * Ping connections idle for this many seconds(and reload the key range
+	 * table of a cluster) every this many seconds, default 30, 0 disables.
+	 */
+	void set_ping_interval(int seconds);
+	/// @}
+
+	/**
+	 * Check out a connection, it must be given back by put().
+	 * @param key A key stored by the node, only for cluster pools. Empty
+	 * means any node.
+	 * @return NULL on timeout, or the node can't be connected.
+	 */
+	Client* get(const std::string &key=std::string());
+	/**
+	 * Give back a connection. It is closed if it has broken.
+	 */
+	void put(Client *client);
+	/**
+	 * Reload the key range table, call it if a node replies out_of_range.
+	 */
+	int reload();
+	void stats(ClientPoolStats *ret);
+
+private:
+	ClientPool();
+	static ClientPool* init(const std::string &ip, int port, int size,
+		const std::string &password, bool cluster);
+	std::string ip;
+	int port;
+	int size;
+	bool cluster;
+	std::string auth;
+	int wait_timeout;
+	int ping_interval;
+
+	// 节点不会删除, 直到连接池被释放
+	std::vector<PoolNode *> nodes;
+	pthread_mutex_t nodes_mutex;
+	PoolNode* get_node(const std::string &ip, int port);
+	// 当前的区间表, 替换之后旧的表在析构时释放, 所以读取时不需要加锁
+	PoolTable * volatile table;
+	std::vector<PoolTable *> old_tables;
+
+	ClientPoolStats counters;
+
+	volatile bool quit;
+	pthread_t tid;
+	bool thread_started;
+	static void* _run_thread(void *arg);
+	void ping_all();
+
+	friend class PoolNode;
+	// No copying allowed
+	ClientPool(const ClientPool&);
+	void operator=(const ClientPool&);
+};
+
+/**
+ * Check out a connection from pool, and give it back when destroyed.
+ *
+ *	ssdb::PooledClient client(pool, key);
+ *	if(client.ok()){
+ *		client->set(key, val);
+ *	}
+ */
+class PooledClient{
+public:
+	PooledClient(ClientPool *pool, const std::string &key=std::string()){
+		this->pool = pool;
+		this->client = pool->get(key);
+	}
+	~PooledClient(){
+		if(client){
+			pool->put(client);
+		}
+	}
+	bool ok() const{
+		return client != NULL;
+	}
+	Client* operator->(){
+		return client;
+	}
+	Client* get(){
+		return client;
+	}
+private:
+	ClientPool *pool;
+	Client *client;
+	PooledClient(const PooledClient&);
+	void operator=(const PooledClient&);
+};
+
+}; // namespace ssdb
+
+#endif
@@ -8,6 +8,7 @@ found in the LICENSE file.
 #include "util/log.h"
 #include "cluster_store.h"
 #include "cluster_migrate.h"
+#include "cluster_rebalance.h"
 
 Cluster::Cluster(SSDB *db){
 	log_debug("Cluster init");
@@ -156,7 +157,8 @@ int Cluster::get_kv_node(int id, Node *ret){
 }
 
 // 从一个节点向另一个节点迁移数据
-int64_t Cluster::migrate_kv_data(int src_id, int dst_id, int num_keys){
+int64_t Cluster::migrate_kv_data(int src_id, int dst_id, int num_keys, MigrateStats *stats){
+	Locking migrating(&migrate_mutex);
 	Locking l(&mutex);
 	
 	// 根据ID获取到两个节点
@@ -171,8 +173,8 @@ int64_t Cluster::migrate_kv_data(int src_id, int dst_id, int num_keys){
 	
 	ClusterMigrate migrate;
 	// 从一个节点向另一个节点迁移数据，过程中会改变src和dst节点的key区间
-	int64_t size = migrate.migrate_kv_data(src, dst, num_keys);
-	if(size > 0){
+	int64_t size = migrate.migrate_kv_data(src, dst, num_keys, stats);
+	if(size >= 0){
 	    // 将修改后的key区间保存
 		if(store->save_kv_node(*src) == -1){
 			log_error("after migrate_kv_data, save src failed!");
@@ -186,3 +188,35 @@ int64_t Cluster::migrate_kv_data(int src_id, int dst_id, int num_keys){
 	return size;
 }
 
+static bool node_range_less(const Node *a, const Node *b){
+	return a->range.begin < b->range.begin;
+}
+
+int Cluster::rebalance(const RebalanceOptions &opt, std::vector<RebalanceMove> *moves){
+	// 迁移期间不持有 mutex, 其它集群命令不需要等待. 每次迁移之后通过
+	// set_kv_range() 更新区间
+	Locking migrating(&migrate_mutex);
+
+	std::vector<Node> list;
+	{
+		Locking l(&mutex);
+		std::vector<Node>::iterator it;
+		for(it=kv_node_list.begin(); it!=kv_node_list.end(); it++){
+			if(it->status == Node::SERVING){
+				list.push_back(*it);
+			}
+		}
+	}
+	// 按区间排序
+	std::vector<Node *> nodes;
+	for(int i=0; i<(int)list.size(); i++){
+		nodes.push_back(&list[i]);
+	}
+	std::sort(nodes.begin(), nodes.end(), node_range_less);
+
+	ClusterRebalance rebalance(opt, this);
+	if(rebalance.run(nodes, moves) == -1){
+		return -1;
+	}
+	return (int)moves->size();
+}
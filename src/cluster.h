@@ -68,8 +68,27 @@ public:
 	}
 };
 
+// 迁移的统计
+struct MigrateStats{
+	// kv 的 key, 以及 hash, zset 和 queue 的元素个数
+	int64_t keys;
+	int64_t bytes;
+	int64_t batches;
+	// 秒
+	double time;
+
+	MigrateStats(){
+		keys = 0;
+		bytes = 0;
+		batches = 0;
+		time = 0;
+	}
+};
+
 class SSDB;
 class ClusterStore;
+struct RebalanceOptions;
+struct RebalanceMove;
 
 // SSDB集群，进行集群的管理，包括添加节点、获取节点状态、在集群中迁移数据等等。
 class Cluster
@@ -87,15 +106,20 @@ public:
 	int set_kv_range(int id, const KeyRange &range);
 	int set_kv_status(int id, int status);
 	int get_kv_node_list(std::vector<Node> *list);
-	// 返回迁移的字节数
-	int64_t migrate_kv_data(int src_id, int dst_id, int num_keys);
+	// 返回迁移的字节数, stats 不为 NULL 时返回迁移的统计
+	int64_t migrate_kv_data(int src_id, int dst_id, int num_keys, MigrateStats *stats=NULL);
+	// 在 SERVING 节点之间迁移数据, 使各节点的负载平衡, 返回迁移的次数
+	int rebalance(const RebalanceOptions &opt, std::vector<RebalanceMove> *moves);
 
 private:
 	SSDB *db;
 	ClusterStore *store;
 	int next_id;
 	std::vector<Node> kv_node_list;
+	// 保护 kv_node_list
 	Mutex mutex;
+	// 同时只能有一个迁移或者 rebalance, 先于 mutex 加锁
+	Mutex migrate_mutex;
 	
 	Node* get_kv_node_ref(int id);
 };
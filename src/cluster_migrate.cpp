@@ -1,8 +1,25 @@
 #include "cluster_migrate.h"
 #include "util/log.h"
+#include "util/clock.h"
+#include "serv.h"
 #include "SSDB_client.h"
 
-#define BATCH_SIZE 100
+// 每一批最多的元素个数和字节数
+#define BATCH_ITEMS		1000
+#define BATCH_BYTES		(256 * 1024)
+// 最多有多少批在等待目标节点的确认
+#define MAX_PENDING		16
+// 每隔多少秒在日志中报告一次进度
+#define REPORT_INTERVAL	5
+// 迁移期间写入到已迁移部分的数据, 最多再迁移几次
+#define MAX_PASSES		10
+
+static const int MIGRATE_KV		= 0;
+// 带过期时间的 key, 删除时还要删除过期时间
+static const int MIGRATE_KV_TTL	= 1;
+static const int MIGRATE_HASH	= 2;
+static const int MIGRATE_ZSET	= 3;
+static const int MIGRATE_QUEUE	= 4;
 
 // 初始化客户端连接，将返回一个客户端指针
 static ssdb::Client* init_client(const std::string &ip, int port){
@@ -45,46 +62,127 @@ int ClusterMigrate::check_version(ssdb::Client *client){
 	return 0;
 }
 
-// 将指定key的数据从一个节点移动到另一个节点，返回移动的数据的大小
-int ClusterMigrate::move_key(const std::string &key){
-	std::string val;
-	ssdb::Status s;
-	s = src->get(key, &val);
-	if(s.not_found()){
-		return 0;
+// 连接两个节点, 并检查版本
+int ClusterMigrate::open(const Node &src_node, const Node &dst_node){
+	src = init_client(src_node.ip, src_node.port);
+	if(src == NULL){
+		log_error("failed to connect to server!");
+		return -1;
 	}
-	if(!s.ok()){
-		log_error("src server error! %s", s.code().c_str());
+	dst = init_client(dst_node.ip, dst_node.port);
+	if(dst == NULL){
+		log_error("failed to connect to server!");
 		return -1;
 	}
-	// TODO: TTL
-	s = dst->set(key, val);
-	if(!s.ok()){
-		log_error("dst server error! %s", s.code().c_str());
+	if(check_version(src) == -1){
 		return -1;
 	}
-	s = src->del(key);
-	if(!s.ok()){
-		log_error("src server error! %s", s.code().c_str());
+	if(check_version(dst) == -1){
 		return -1;
 	}
-	return (int)key.size() + (int)val.size();
+	return 0;
+}
+
+// 数据由 src 直接推送给 dst(migrate_range 命令, 见 MigrateStream), 这里只
+// 修改区间并等待结果. range 中的 hash, zset 和 queue 也一起迁移.
+int64_t ClusterMigrate::move_range(const Node &dst_node, const KeyRange &range, int speed, MigrateStats *stats){
+	int64_t bytes = 0;
+	// 迁移期间写入到已迁移部分的数据(不检查区间的命令), 再迁移一次, 直到
+	// 没有剩余的数据
+	for(int pass=0; pass<MAX_PASSES; pass++){
+		const std::vector<std::string> *resp;
+		resp = src->request("migrate_range", dst_node.ip, str(dst_node.port),
+			range.begin, range.end, str(speed));
+		if(!resp || resp->size() < 4 || resp->at(0) != "ok"){
+			log_error("src server migrate_range error! %s",
+				(resp && !resp->empty())? resp->at(0).c_str() : "");
+			return -1;
+		}
+		int64_t n = str_to_int64(resp->at(1));
+		int64_t size = str_to_int64(resp->at(2));
+		double time = str_to_double(resp->at(3).data(), resp->at(3).size());
+		bytes += size;
+		stats->keys += n;
+		stats->bytes += size;
+		stats->time += time;
+		log_info("migrated %" PRId64 " keys, %" PRId64 " bytes in %.3f s, %.2f MB/s",
+			n, size, time, time > 0? size / time / 1024 / 1024 : 0);
+		if(n == 0){
+			break;
+		}
+	}
+	return bytes;
 }
 
-// 将src节点中的前num_keys个数据记录移动到dst节点中。moved_max_key返回移动的最大的key，也就是移动后dst的最后一个key
-// 注意：要保证各个节点的区间不重合，迁移需要保证dst的key区间一定小于src的key区间。
+// 把 src 在 split_key 一侧的数据迁移到 dst. head 为 true 时迁移 src 的头部
+// (src.begin, split_key], dst 的区间扩展到 split_key; 否则迁移尾部
+// (split_key, src.end], dst 的区间从 split_key 开始.
+// 注意：要保证各个节点的区间不重合，迁移需要保证dst的区间和src相邻。
 // 举例：
 //      src: (100, 200], dst: (0, 100]
-// 迁移50个key。迁移后：
+// 迁移头部, split_key 为 150。迁移后：
 //      src: (150, 200], dst: (0, 150]
-//
-// 注意：参数max_key表示的是src的end
-int64_t ClusterMigrate::move_range(const std::string &max_key, std::string *moved_max_key, int num_keys){
+int64_t ClusterMigrate::migrate(Node *src_node, Node *dst_node, const std::string &split_key,
+	bool head, int speed, MigrateStats *stats)
+{
+	// 原来两个节点各自的key区间
+	KeyRange src_range = src_node->range;
+	KeyRange dst_range = dst_node->range;
+	log_info("old src %s", src_range.str().c_str());
+	log_info("old dst %s", dst_range.str().c_str());
+
+	KeyRange moved, new_src, new_dst;
+	if(head){
+		// 从 "" 开始遍历, 是因为在中断之后, 重新执行时, 之前被中断了的数据是可以被迁移的. 
+		moved = KeyRange("", split_key);
+		new_src = KeyRange(split_key, src_range.end);
+		new_dst = KeyRange(dst_range.begin, split_key);
+	}else{
+		moved = KeyRange(split_key, "");
+		new_src = KeyRange(src_range.begin, split_key);
+		new_dst = KeyRange(split_key, dst_range.end);
+	}
+
+	// 先修改src的key区间, 迁移的部分不再接受写入
+	log_info("new src: %s", new_src.str().c_str());
+	ssdb::Status s = src->set_kv_range(new_src.begin, new_src.end);
+	if(!s.ok()){
+		log_error("src server set_kv_range error! %s", s.code().c_str());
+		return -1;
+	}
+	src_node->range = new_src;
+
+	int64_t bytes = move_range(*dst_node, moved, speed, stats);
+	if(bytes == -1){
+		return -1;
+	}
+
+	// 更新目标节点的key区间信息
+	log_info("new dst: %s", new_dst.str().c_str());
+	s = dst->set_kv_range(new_dst.begin, new_dst.end);
+	if(!s.ok()){
+		log_fatal("dst server set_kv_range error!");
+		return -1;
+	}
+	dst_node->range = new_dst;
+	return bytes;
+}
+
+// 从一个节点向另一个节点迁移指定数量的KV数据
+// 将src中的前num_keys条数据迁移到dst中
+int64_t ClusterMigrate::migrate_kv_data(Node *src_node, Node *dst_node, int num_keys, MigrateStats *stats){
+	MigrateStats tmp;
+	if(stats == NULL){
+		stats = &tmp;
+	}
+	if(open(*src_node, *dst_node) == -1){
+		return -1;
+	}
+
 	// get key range
 	std::vector<std::string> keys;
 	ssdb::Status s;
-	// 从 "" 开始遍历, 是因为在中断之后, 重新执行时, 之前被中断了的数据是可以被迁移的. 
-	s = src->keys("", max_key, num_keys, &keys);
+	s = src->keys("", src_node->range.end, num_keys, &keys);
 	if(!s.ok()){
 		log_error("response error: %s", s.code().c_str());
 		return -1;
@@ -92,106 +190,384 @@ int64_t ClusterMigrate::move_range(const std::string &max_key, std::string *move
 	if(keys.empty()){
 		return 0;
 	}
+	// 移动的数据的最大的key, 也就是移动后dst的最后一个key
+	return migrate(src_node, dst_node, keys[keys.size() - 1], true, -1, stats);
+}
 
-    // 移动的数据的最大的key
-	*moved_max_key = keys[keys.size() - 1];
-	
-	// src的新key区间应该从移动后的最大的key开始
-	KeyRange new_src_range(*moved_max_key, max_key);
-	log_info("new src: %s", new_src_range.str().c_str());
-	// 修改src的key区间，这里修改的是src节点上的数据
-	s = src->set_kv_range(*moved_max_key, max_key);
-	if(!s.ok()){
-		log_error("src server set_kv_range error! %s", s.code().c_str());
+int64_t ClusterMigrate::migrate_range(Node *src_node, Node *dst_node, const std::string &split_key,
+	bool head, int speed, MigrateStats *stats)
+{
+	if(open(*src_node, *dst_node) == -1){
 		return -1;
 	}
+	return migrate(src_node, dst_node, split_key, head, speed, stats);
+}
 
-    // 真正开始迁移数据，bytes记录移动的数据的总大小
-	int64_t bytes = 0;
-	while(1){
-		// move key range
-		for(int i=0; i<(int)keys.size(); i++){
-			const std::string &key = keys[i];
-			// 移动单条数据
-			int ret = move_key(key);
+
+MigrateStream::MigrateStream(SSDBServer *serv){
+	this->serv = serv;
+	this->dst = NULL;
+	this->stats = NULL;
+	this->stime = 0;
+	this->last_report = 0;
+	this->speed = -1;
+	this->sent = 0;
+	this->last_deleted = 0;
+}
+
+MigrateStream::~MigrateStream(){
+	delete dst;
+}
+
+void MigrateStream::set_speed(int speed){
+	this->speed = speed;
+}
+
+int MigrateStream::connect(const std::string &ip, int port){
+	dst = init_client(ip, port);
+	if(dst == NULL){
+		log_error("failed to connect to %s:%d!", ip.c_str(), port);
+		return -1;
+	}
+	// 二进制协议下目标节点的多个工作线程可以同时执行不同的批次; 旧版本的
+	// 服务器不支持时使用文本协议, 仍然是流水线
+	if(!dst->protocol(2).ok()){
+		log_info("%s:%d does not support protocol v2", ip.c_str(), port);
+	}
+	return 0;
+}
+
+int MigrateStream::run(const KeyRange &range, MigrateStats *stats){
+	this->stats = stats;
+	stime = clock_mono_us() / 1000000.0;
+	last_report = stime;
+	SSDB *ssdb = serv->ssdb;
+
+	if(move_kv(range) == -1){
+		return -1;
+	}
+	for(int type=MIGRATE_HASH; type<=MIGRATE_QUEUE; type++){
+		std::string start = range.begin;
+		while(1){
+			std::vector<std::string> names;
+			int ret;
+			if(type == MIGRATE_HASH){
+				ret = ssdb->hlist(start, range.end, BATCH_ITEMS, &names);
+			}else if(type == MIGRATE_ZSET){
+				ret = ssdb->zlist(start, range.end, BATCH_ITEMS, &names);
+			}else{
+				ret = ssdb->qlist(start, range.end, BATCH_ITEMS, &names);
+			}
 			if(ret == -1){
-				log_error("move key %s error! %s", key.c_str(), s.code().c_str());
-				return -1;  
+				return -1;
 			}
-			bytes += ret;
+			if(names.empty()){
+				break;
+			}
+			for(int i=0; i<(int)names.size(); i++){
+				const std::string &name = names[i];
+				if(type == MIGRATE_HASH){
+					ret = move_hash(name);
+				}else if(type == MIGRATE_ZSET){
+					ret = (name == EXPIRATION_LIST_KEY)? 0 : move_zset(name);
+				}else{
+					ret = move_queue(name);
+				}
+				if(ret == -1){
+					return -1;
+				}
+			}
+			start = names[names.size() - 1];
 		}
-		
-		// keys已经全部移动完，清理
-		keys.clear();
+	}
+	if(drain() == -1){
+		return -1;
+	}
+	report(true);
+	return 0;
+}
+
+int MigrateStream::move_kv(const KeyRange &range){
+	SSDB *ssdb = serv->ssdb;
+	// 没有设置过过期时间时不用逐个查询
+	bool has_ttl = ssdb->zsize(EXPIRATION_LIST_KEY) > 0;
+	std::string start = range.begin;
+	while(1){
+		std::vector<std::string> req;
+		req.push_back("multi_set");
+		Batch batch;
+		batch.type = MIGRATE_KV;
+		batch.bytes = 0;
+		int num = 0;
 
-        // 确保要迁移的数据区间没有剩余的数据，如果还有，继续迁移，知道指定区间的数据
-        // 都迁移完为止
-		s = src->keys("", *moved_max_key, num_keys, &keys);
-		if(!s.ok()){
-			log_error("response error: %s", s.code().c_str());
+		KIterator *it = ssdb->scan(start, range.end, BATCH_ITEMS);
+		while(it->next()){
+			num ++;
+			start = it->key;
+			int64_t ttl = has_ttl? serv->expiration->get_ttl(it->key) : -1;
+			if(ttl > 0){
+				std::vector<std::string> r;
+				r.push_back("setx");
+				r.push_back(it->key);
+				r.push_back(it->val);
+				r.push_back(str(ttl));
+				Batch b;
+				b.type = MIGRATE_KV_TTL;
+				b.data.push_back(it->key);
+				b.data.push_back(it->val);
+				b.bytes = it->key.size() + it->val.size();
+				if(send(r, &b) == -1){
+					delete it;
+					return -1;
+				}
+				continue;
+			}
+			req.push_back(it->key);
+			req.push_back(it->val);
+			batch.data.push_back(it->key);
+			batch.data.push_back(it->val);
+			batch.bytes += it->key.size() + it->val.size();
+			if(batch.bytes >= BATCH_BYTES){
+				break;
+			}
+		}
+		delete it;
+		if(num == 0){
+			break;
+		}
+		if(!batch.data.empty() && send(req, &batch) == -1){
 			return -1;
 		}
-		if(keys.empty()){
+	}
+	return 0;
+}
+
+int MigrateStream::move_hash(const std::string &name){
+	std::string start;
+	while(1){
+		std::vector<std::string> req;
+		req.push_back("multi_hset");
+		req.push_back(name);
+		Batch batch;
+		batch.type = MIGRATE_HASH;
+		batch.name = name;
+		batch.bytes = 0;
+
+		HIterator *it = serv->ssdb->hscan(name, start, "", BATCH_ITEMS);
+		while(it->next()){
+			start = it->key;
+			req.push_back(it->key);
+			req.push_back(it->val);
+			batch.data.push_back(it->key);
+			batch.data.push_back(it->val);
+			batch.bytes += it->key.size() + it->val.size();
+			if(batch.bytes >= BATCH_BYTES){
+				break;
+			}
+		}
+		delete it;
+		if(batch.data.empty()){
 			break;
 		}
+		if(send(req, &batch) == -1){
+			return -1;
+		}
 	}
-	return bytes;
+	return 0;
 }
 
-// 从一个节点向另一个节点迁移指定数量的KV数据
-// 将src中的前num_keys条数据迁移到dst中
-int64_t ClusterMigrate::migrate_kv_data(Node *src_node, Node *dst_node, int num_keys){
-    // 连接两个节点
-	src = init_client(src_node->ip, src_node->port);
-	if(src == NULL){
-		log_error("failed to connect to server!");
-		return -1;
+int MigrateStream::move_zset(const std::string &name){
+	std::string key_start, score_start;
+	while(1){
+		std::vector<std::string> req;
+		req.push_back("multi_zset");
+		req.push_back(name);
+		Batch batch;
+		batch.type = MIGRATE_ZSET;
+		batch.name = name;
+		batch.bytes = 0;
+
+		ZIterator *it = serv->ssdb->zscan(name, key_start, score_start, "", BATCH_ITEMS);
+		while(it->next()){
+			key_start = it->key;
+			score_start = it->score;
+			req.push_back(it->key);
+			req.push_back(it->score);
+			batch.data.push_back(it->key);
+			batch.data.push_back(it->score);
+			batch.bytes += it->key.size() + it->score.size();
+			if(batch.bytes >= BATCH_BYTES){
+				break;
+			}
+		}
+		delete it;
+		if(batch.data.empty()){
+			break;
+		}
+		if(send(req, &batch) == -1){
+			return -1;
+		}
 	}
-	dst = init_client(dst_node->ip, dst_node->port);
-	if(dst == NULL){
-		log_error("failed to connect to server!");
+	return 0;
+}
+
+// 元素在确认之后从队列头部删除, 所以一个队列同时只有一批在等待确认,
+// 每次都从头部开始取
+int MigrateStream::move_queue(const std::string &name){
+	bool pushed = false;
+	while(1){
+		if(drain() == -1){
+			return -1;
+		}
+		// 队列头部被其它客户端修改了, 留给下一遍
+		if(pushed && last_deleted == 0){
+			break;
+		}
+		std::vector<std::string> items;
+		if(serv->ssdb->qslice(name, 0, BATCH_ITEMS - 1, &items) == -1){
+			return -1;
+		}
+		if(items.empty()){
+			break;
+		}
+		std::vector<std::string> req;
+		req.push_back("qpush_back");
+		req.push_back(name);
+		Batch batch;
+		batch.type = MIGRATE_QUEUE;
+		batch.name = name;
+		batch.items = items.size();
+		batch.bytes = 0;
+		for(int i=0; i<(int)items.size(); i++){
+			req.push_back(items[i]);
+			batch.bytes += items[i].size();
+		}
+		batch.data.swap(items);
+		if(send(req, &batch) == -1){
+			return -1;
+		}
+		pushed = true;
+	}
+	return 0;
+}
+
+int MigrateStream::send(const std::vector<std::string> &req, Batch *batch){
+	while(pending.size() >= MAX_PENDING){
+		if(recv() == -1){
+			return -1;
+		}
+	}
+	int64_t id = dst->send_request(req);
+	if(id == -1){
+		log_error("dst server error!");
 		return -1;
 	}
-	
-	// 检查版本支持
-	if(check_version(src) == -1){
+	if(batch->type != MIGRATE_QUEUE){
+		batch->items = batch->data.size() / 2;
+	}
+	Batch &b = pending[id];
+	b.type = batch->type;
+	b.name.swap(batch->name);
+	b.data.swap(batch->data);
+	b.items = batch->items;
+	b.bytes = batch->bytes;
+
+	// 限速, 和主从同步的 sync_speed 一样以 MB/s 为单位
+	sent += batch->bytes;
+	if(speed > 0){
+		double expect = (double)sent / (speed * 1024 * 1024);
+		double elapsed = clock_mono_us() / 1000000.0 - stime;
+		if(expect > elapsed){
+			usleep((expect - elapsed) * 1000 * 1000);
+		}
+	}
+	return 0;
+}
+
+int MigrateStream::recv(){
+	int64_t id;
+	const std::vector<std::string> *resp = dst->recv_response(&id);
+	if(resp == NULL){
+		log_error("dst server error!");
 		return -1;
 	}
-	if(check_version(dst) == -1){
+	std::map<int64_t, Batch>::iterator it = pending.find(id);
+	if(it == pending.end()){
+		log_error("unexpected response id: %" PRId64, id);
 		return -1;
 	}
-	
-	ssdb::Status s;
-	// 原来两个节点各自的key区间
-	KeyRange src_range = src_node->range;
-	KeyRange dst_range = dst_node->range;
-	
-	log_info("old src %s", src_range.str().c_str());
-	log_info("old dst %s", dst_range.str().c_str());
-
-	std::string moved_max_key;
-	int64_t bytes;
-	// 将src的前num_keys条数据迁移到dst中
-	bytes = move_range(src_range.end, &moved_max_key, num_keys);
-	if(bytes == -1){
+	if(resp->empty() || resp->at(0) != "ok"){
+		log_error("dst server error! %s", resp->empty()? "" : resp->at(0).c_str());
 		return -1;
 	}
-	if(bytes == 0){
-		return 0;
+	const Batch &batch = it->second;
+	last_deleted = del(batch);
+	if(last_deleted == -1){
+		log_error("delete migrated data error!");
+		return -1;
 	}
+	stats->keys += batch.items;
+	stats->bytes += batch.bytes;
+	stats->batches ++;
+	pending.erase(it);
+	report(false);
+	return 0;
+}
 
-	// update key range
-	// 更新src节点的range，这里更新的是运行迁移的节点的信息
-	src_node->range = KeyRange(moved_max_key, src_range.end);
-	{
-	    // 更新目标节点的key区间信息
-		dst_node->range = KeyRange(dst_range.begin, moved_max_key);
-		log_info("new dst: %s", dst_node->range.str().c_str());
-		ssdb::Status s = dst->set_kv_range(dst_node->range.begin, dst_node->range.end);
-		if(!s.ok()){
-			log_fatal("dst server set_kv_range error!");
+int MigrateStream::drain(){
+	while(!pending.empty()){
+		if(recv() == -1){
 			return -1;
 		}
 	}
-	return bytes;
+	return 0;
+}
+
+// 目标节点已经写入, 删除本节点的这一批数据. 每一批在一个事务中删除,
+// 扫描之后被修改过的数据不删除, 它们留在本节点, 下一遍再迁移
+int MigrateStream::del(const Batch &batch){
+	SSDB *ssdb = serv->ssdb;
+	int ret;
+	if(batch.type == MIGRATE_QUEUE){
+		ret = ssdb->qpop_front_eq(batch.name, batch.data);
+	}else{
+		std::vector<Bytes> kvs;
+		for(int i=0; i<(int)batch.data.size(); i++){
+			kvs.push_back(batch.data[i]);
+		}
+		if(batch.type == MIGRATE_HASH){
+			ret = ssdb->multi_hdel_eq(batch.name, kvs);
+		}else if(batch.type == MIGRATE_ZSET){
+			ret = ssdb->multi_zdel_eq(batch.name, kvs);
+		}else{
+			Locking l(&serv->expiration->mutex);
+			ret = ssdb->multi_del_eq(kvs);
+			if(ret == 1 && batch.type == MIGRATE_KV_TTL){
+				// del_ttl() 在 fast_keys 为空时不删除过期列表中的 key,
+				// 迁移走的 key 不能留下过期时间
+				serv->expiration->del_ttl(kvs[0]);
+				ssdb->zdel(EXPIRATION_LIST_KEY, kvs[0]);
+			}
+		}
+	}
+	if(ret == -1){
+		return -1;
+	}
+	if(ret < batch.items){
+		log_debug("%" PRId64 " migrated items changed, not deleted", batch.items - ret);
+	}
+	return ret;
+}
+
+void MigrateStream::report(bool done){
+	double now = clock_mono_us() / 1000000.0;
+	stats->time = now - stime;
+	if(!done && now - last_report < REPORT_INTERVAL){
+		return;
+	}
+	last_report = now;
+	log_info("migrate %s: %" PRId64 " keys, %" PRId64 " batches, %.2f MB, %.2f MB/s",
+		done? "done" : "progress",
+		stats->keys, stats->batches, stats->bytes / 1024.0 / 1024.0,
+		stats->time > 0? stats->bytes / stats->time / 1024 / 1024 : 0);
 }
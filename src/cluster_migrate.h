@@ -8,11 +8,13 @@ found in the LICENSE file.
 
 #include "include.h"
 #include <string>
+#include <map>
 #include "cluster.h"
 
 namespace ssdb{
 	class Client;
 };
+class SSDBServer;
 
 // 用于进行集群中节点之间的数据迁移
 class ClusterMigrate
@@ -22,11 +24,17 @@ public:
 	~ClusterMigrate();
 	
 	// 完成后, src.range 和 dst.range 会被改变
-	int64_t migrate_kv_data(Node *src, Node *dst, int num_keys);
+	int64_t migrate_kv_data(Node *src, Node *dst, int num_keys, MigrateStats *stats);
+	// 迁移 src 在 split_key 之前(head)或者之后的数据到相邻的 dst, 返回迁移
+	// 的字节数. speed: MB/s, -1 表示不限制
+	int64_t migrate_range(Node *src, Node *dst, const std::string &split_key,
+		bool head, int speed, MigrateStats *stats);
 	
 private:
-	int move_key(const std::string &key);
-	int64_t move_range(const std::string &max_key, std::string *moved_max_key, int num_keys);
+	int open(const Node &src_node, const Node &dst_node);
+	int64_t migrate(Node *src_node, Node *dst_node, const std::string &split_key,
+		bool head, int speed, MigrateStats *stats);
+	int64_t move_range(const Node &dst_node, const KeyRange &range, int speed, MigrateStats *stats);
 
 	int get_key_range(ssdb::Client *client, KeyRange *range);
 	int set_key_range(ssdb::Client *client, const KeyRange &range);
@@ -36,4 +44,55 @@ private:
 	ssdb::Client *dst;
 };
 
+// 在源节点上执行(migrate_range 命令), 遍历本节点的一个区间, 把数据用批量
+// 写命令(multi_set, multi_hset, multi_zset, qpush_back)以流水线的方式推送
+// 到目标节点, 每一批收到确认之后再删除本节点的这些数据(只删除没有被修改
+// 过的). 中断之后重新执行可以继续迁移剩下的数据.
+class MigrateStream
+{
+public:
+	MigrateStream(SSDBServer *serv);
+	~MigrateStream();
+	// MB/s, -1 表示不限制
+	void set_speed(int speed);
+	int connect(const std::string &ip, int port);
+	// 迁移 (start, end] 中的 kv, 以及名字在这个区间中的 hash, zset 和 queue
+	int run(const KeyRange &range, MigrateStats *stats);
+
+private:
+	struct Batch{
+		int type;
+		std::string name;
+		// 发送的数据, 收到确认之后, 本节点中没有被修改过的才删除. kv 和
+		// hash 是 key, value 对, zset 是 key, score 对, queue 是元素
+		std::vector<std::string> data;
+		int64_t items;
+		int64_t bytes;
+	};
+
+	SSDBServer *serv;
+	ssdb::Client *dst;
+	// 已发送, 还没有收到确认的批次, 按请求的 id
+	std::map<int64_t, Batch> pending;
+	MigrateStats *stats;
+	double stime;
+	double last_report;
+	int speed;
+	// 已发送的字节数, 用于限速
+	int64_t sent;
+	// 最近确认的一批在本节点删除的个数
+	int64_t last_deleted;
+
+	int move_kv(const KeyRange &range);
+	int move_hash(const std::string &name);
+	int move_zset(const std::string &name);
+	int move_queue(const std::string &name);
+	int send(const std::vector<std::string> &req, Batch *batch);
+	int recv();
+	int drain();
+	// 返回删除的个数, -1: 出错
+	int del(const Batch &batch);
+	void report(bool done);
+};
+
 #endif
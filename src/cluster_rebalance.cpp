@@ -0,0 +1,331 @@
+/*
+Copyright (c) 2012-2015 The SSDB Authors. All rights reserved.
+Use of this source code is governed by a BSD-style license that can be
+found in the LICENSE file.
+*/
+#include <math.h>
+#include "cluster_rebalance.h"
+#include "cluster_migrate.h"
+#include "ssdb/ssdb.h"
+#include "util/log.h"
+#include "SSDB_client.h"
+
+// GetApproximateSizes 小于这个大小的区间(或者数据还在 memtable 中, 不包括在
+// 内)遍历得到准确的大小, 所以遍历的数据量最多是这个大小加上 memtable
+#define RANGE_SCAN_BYTES	(16 * 1024 * 1024)
+// 采样请求速率的间隔(秒)
+#define SAMPLE_INTERVAL		1
+// 一次最多迁移节点数据的比例
+#define MAX_MOVE_RATIO		0.9
+
+int64_t kv_range_size(SSDB *ssdb, const KeyRange &range){
+	int64_t size = ssdb->kv_size(range.begin, range.end);
+	if(size >= RANGE_SCAN_BYTES){
+		return size;
+	}
+	size = 0;
+	KIterator *it = ssdb->scan(range.begin, range.end, UINT64_MAX);
+	while(it->next()){
+		size += it->key.size() + it->val.size();
+	}
+	delete it;
+	return size;
+}
+
+// 把 a 和 b 当成同样长度的大端整数, 返回 (a + b) / 2
+static std::string key_mid(const std::string &a, const std::string &b){
+	int len = (int)std::max(a.size(), b.size()) + 1;
+	std::string ret(len, '\0');
+	int carry = 0;
+	for(int i=len-1; i>=0; i--){
+		int x = (i < (int)a.size()? (unsigned char)a[i] : 0)
+			+ (i < (int)b.size()? (unsigned char)b[i] : 0) + carry;
+		ret[i] = (char)(x & 0xff);
+		carry = x >> 8;
+	}
+	for(int i=0; i<len; i++){
+		int x = (unsigned char)ret[i] + (carry << 8);
+		ret[i] = (char)(x >> 1);
+		carry = x & 1;
+	}
+	while(!ret.empty() && ret[ret.size() - 1] == '\0'){
+		ret.resize(ret.size() - 1);
+	}
+	return ret;
+}
+
+int kv_range_split(SSDB *ssdb, const KeyRange &range, int64_t bytes, std::string *key){
+	int64_t total = kv_range_size(ssdb, range);
+	if(bytes <= 0 || bytes >= total){
+		return 0;
+	}
+	std::string lo = range.begin;
+	// 和 kv_range_size() 用同样的方法计算大小
+	if((int64_t)ssdb->kv_size(range.begin, range.end) < RANGE_SCAN_BYTES){
+		int64_t size = 0;
+		KIterator *it = ssdb->scan(range.begin, range.end, UINT64_MAX);
+		while(size < bytes && it->next()){
+			size += it->key.size() + it->val.size();
+			lo = it->key;
+		}
+		delete it;
+	}else{
+		// 在 (begin, hi] 中二分查找
+		std::string hi = range.end;
+		if(hi.empty()){
+			KIterator *it = ssdb->rscan("", range.begin, 1);
+			if(it->next()){
+				hi = it->key;
+			}
+			delete it;
+		}
+		for(int i=0; i<64; i++){
+			std::string mid = key_mid(lo, hi);
+			if(mid <= lo || mid >= hi){
+				break;
+			}
+			if((int64_t)ssdb->kv_size(range.begin, mid) < bytes){
+				lo = mid;
+			}else{
+				hi = mid;
+			}
+		}
+		// 取 lo 之后的第一个 key
+		KIterator *it = ssdb->scan(lo, range.end, 1);
+		if(it->next()){
+			lo = it->key;
+		}
+		delete it;
+	}
+	if(lo == range.begin || lo == range.end){
+		return 0;
+	}
+	*key = lo;
+	return 1;
+}
+
+ClusterRebalance::ClusterRebalance(const RebalanceOptions &opt, Cluster *cluster){
+	this->opt = opt;
+	this->cluster = cluster;
+}
+
+ClusterRebalance::~ClusterRebalance(){
+	std::map<int, ssdb::Client *>::iterator it;
+	for(it=clients.begin(); it!=clients.end(); it++){
+		delete it->second;
+	}
+}
+
+ssdb::Client* ClusterRebalance::client(const Node &node){
+	std::map<int, ssdb::Client *>::iterator it = clients.find(node.id);
+	if(it != clients.end()){
+		return it->second;
+	}
+	ssdb::Client *c = ssdb::Client::connect(node.ip, node.port);
+	if(c == NULL){
+		log_error("failed to connect to %s:%d!", node.ip.c_str(), node.port);
+		return NULL;
+	}
+	clients[node.id] = c;
+	return c;
+}
+
+int ClusterRebalance::range_stats(const Node &node, int64_t *bytes, int64_t *calls){
+	ssdb::Client *c = client(node);
+	if(c == NULL){
+		return -1;
+	}
+	const std::vector<std::string> *resp;
+	resp = c->request("range_stats", node.range.begin, node.range.end);
+	if(!resp || resp->size() < 3 || resp->at(0) != "ok"){
+		log_error("%s:%d range_stats error!", node.ip.c_str(), node.port);
+		return -1;
+	}
+	*bytes = str_to_int64(resp->at(1));
+	*calls = str_to_int64(resp->at(2));
+	return 0;
+}
+
+int ClusterRebalance::measure(const std::vector<Node *> &nodes, std::vector<Load> *loads){
+	int n = (int)nodes.size();
+	std::vector<int64_t> calls(n);
+	int64_t total_bytes = 0;
+	double total_qps = 0;
+	loads->resize(n);
+	for(int i=0; i<n; i++){
+		Load &load = loads->at(i);
+		load.qps = 0;
+		if(range_stats(*nodes[i], &load.bytes, &calls[i]) == -1){
+			return -1;
+		}
+		total_bytes += load.bytes;
+	}
+	if(opt.rate_weight > 0){
+		// 请求速率是整个节点的, 所以每个节点只能有一个区间
+		sleep(SAMPLE_INTERVAL);
+		for(int i=0; i<n; i++){
+			Load &load = loads->at(i);
+			int64_t bytes, c;
+			if(range_stats(*nodes[i], &bytes, &c) == -1){
+				return -1;
+			}
+			load.qps = (double)(c - calls[i]) / SAMPLE_INTERVAL;
+			total_qps += load.qps;
+		}
+	}
+
+	double w = total_qps > 0? opt.rate_weight : 0;
+	for(int i=0; i<n; i++){
+		Load &load = loads->at(i);
+		load.share = 0;
+		if(total_bytes > 0){
+			load.share += (1 - w) * load.bytes / total_bytes;
+		}
+		if(total_qps > 0){
+			load.share += w * load.qps / total_qps;
+		}
+		log_info("node %d %s: %" PRId64 " bytes, %.1f qps, load %.3f",
+			nodes[i]->id, nodes[i]->range.str().c_str(), load.bytes, load.qps, load.share);
+	}
+	return 0;
+}
+
+bool ClusterRebalance::balanced(const std::vector<Load> &loads){
+	double avg = 1.0 / loads.size();
+	for(int i=0; i<(int)loads.size(); i++){
+		if(fabs(loads[i].share - avg) > avg * opt.tolerance){
+			return false;
+		}
+	}
+	return true;
+}
+
+// 节点排成一行, 第 i 个节点和第 i+1 个节点之间需要移动的负载是前 i+1
+// 个节点超出平均值的部分, 为正时从 i 的尾部移到 i+1, 为负时从 i+1 的头部
+// 移到 i. 负载按节点内的数据均匀分布换算成字节数.
+void ClusterRebalance::plan(const std::vector<Node *> &nodes, const std::vector<Load> &loads,
+	std::vector<RebalanceMove> *moves)
+{
+	double avg = 1.0 / loads.size();
+	double flow = 0;
+	for(int i=0; i<(int)loads.size() - 1; i++){
+		flow += loads[i].share - avg;
+		if(fabs(flow) < avg * opt.tolerance / 2){
+			continue;
+		}
+		int src = flow > 0? i : i + 1;
+		int dst = flow > 0? i + 1 : i;
+		const Load &load = loads[src];
+		if(load.share <= 0 || load.bytes <= 0){
+			continue;
+		}
+		double ratio = std::min(fabs(flow) / load.share, MAX_MOVE_RATIO);
+		RebalanceMove move;
+		move.src_id = nodes[src]->id;
+		move.dst_id = nodes[dst]->id;
+		move.head = (dst < src);
+		move.bytes = (int64_t)(load.bytes * ratio);
+		moves->push_back(move);
+	}
+}
+
+// 按 src 当前的区间找到分割点, 然后迁移
+int ClusterRebalance::execute(const std::vector<Node *> &nodes, RebalanceMove *move){
+	Node *src = NULL;
+	Node *dst = NULL;
+	for(int i=0; i<(int)nodes.size(); i++){
+		if(nodes[i]->id == move->src_id){
+			src = nodes[i];
+		}
+		if(nodes[i]->id == move->dst_id){
+			dst = nodes[i];
+		}
+	}
+	if(!src || !dst){
+		return -1;
+	}
+
+	int64_t bytes, calls;
+	if(range_stats(*src, &bytes, &calls) == -1){
+		return -1;
+	}
+	int64_t head_bytes = move->head? move->bytes : bytes - move->bytes;
+	ssdb::Client *c = client(*src);
+	const std::vector<std::string> *resp;
+	resp = c->request("range_split", src->range.begin, src->range.end, str(head_bytes));
+	if(!resp || resp->empty()){
+		return -1;
+	}
+	if(resp->at(0) == "not_found"){
+		move->bytes = 0;
+		return 0;
+	}
+	if(resp->size() < 2 || resp->at(0) != "ok"){
+		log_error("%s:%d range_split error!", src->ip.c_str(), src->port);
+		return -1;
+	}
+	move->split_key = resp->at(1);
+	if(opt.dry_run){
+		return 0;
+	}
+
+	log_info("move %" PRId64 " bytes from node %d to %d, split: %s",
+		move->bytes, src->id, dst->id, str_escape(move->split_key).c_str());
+	ClusterMigrate migrate;
+	MigrateStats stats;
+	int64_t ret = migrate.migrate_range(src, dst, move->split_key, move->head, opt.speed, &stats);
+	// 出错时 src 的区间也可能已经缩小了. 先缩小 src 再扩大 dst, 区间不会重叠
+	if(cluster){
+		if(cluster->set_kv_range(src->id, src->range) == -1
+			|| cluster->set_kv_range(dst->id, dst->range) == -1)
+		{
+			log_error("after rebalance, save node %d or %d failed!", src->id, dst->id);
+			return -1;
+		}
+	}
+	if(ret == -1){
+		return -1;
+	}
+	move->bytes = ret;
+	return 0;
+}
+
+int ClusterRebalance::run(const std::vector<Node *> &nodes, std::vector<RebalanceMove> *moves){
+	if(nodes.size() < 2){
+		return 0;
+	}
+	for(int i=0; i<(int)nodes.size() - 1; i++){
+		if(nodes[i]->range.end != nodes[i + 1]->range.begin){
+			log_error("node %d and %d are not adjacent", nodes[i]->id, nodes[i + 1]->id);
+			return -1;
+		}
+	}
+	for(int round=0; round<opt.max_rounds; round++){
+		std::vector<Load> loads;
+		if(measure(nodes, &loads) == -1){
+			return -1;
+		}
+		if(balanced(loads)){
+			log_info("cluster balanced after %d round(s)", round);
+			break;
+		}
+		std::vector<RebalanceMove> round_moves;
+		plan(nodes, loads, &round_moves);
+
+		int64_t moved = 0;
+		for(int i=0; i<(int)round_moves.size(); i++){
+			RebalanceMove &move = round_moves[i];
+			if(execute(nodes, &move) == -1){
+				return -1;
+			}
+			if(move.bytes > 0){
+				moves->push_back(move);
+				moved += move.bytes;
+			}
+		}
+		if(opt.dry_run || moved == 0){
+			break;
+		}
+	}
+	return 0;
+}
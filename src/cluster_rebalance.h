@@ -0,0 +1,89 @@
+/*
+Copyright (c) 2012-2015 The SSDB Authors. All rights reserved.
+Use of this source code is governed by a BSD-style license that can be
+found in the LICENSE file.
+*/
+#ifndef SSDB_CLUSTER_REBALANCE_H_
+#define SSDB_CLUSTER_REBALANCE_H_
+
+#include "include.h"
+#include <string>
+#include <vector>
+#include <map>
+#include "cluster.h"
+
+namespace ssdb{
+	class Client;
+};
+class SSDB;
+
+// 在节点上执行(range_stats, range_split 命令)
+// (start, end] 中 kv 的大概字节数
+int64_t kv_range_size(SSDB *ssdb, const KeyRange &range);
+// 找到 key, 使 (range.begin, key] 中 kv 的字节数大约为 bytes, 返回 0 表示找不到
+int kv_range_split(SSDB *ssdb, const KeyRange &range, int64_t bytes, std::string *key);
+
+struct RebalanceOptions{
+	// 每个节点的负载和平均负载的差, 不超过平均负载的这个比例时认为已经平衡
+	double tolerance;
+	// 负载中请求速率所占的比例, 0 表示只按数据量平衡
+	double rate_weight;
+	// 迁移的速度限制, MB/s, -1 表示不限制
+	int speed;
+	int max_rounds;
+	// 只返回第一轮的迁移计划, 不执行
+	bool dry_run;
+
+	RebalanceOptions(){
+		tolerance = 0.1;
+		rate_weight = 0;
+		speed = -1;
+		max_rounds = 5;
+		dry_run = false;
+	}
+};
+
+struct RebalanceMove{
+	int src_id;
+	int dst_id;
+	// 迁移 src 的头部 (begin, split_key] 或者尾部 (split_key, end]
+	std::string split_key;
+	bool head;
+	// 计划时是估算的字节数, 执行后是实际迁移的字节数
+	int64_t bytes;
+};
+
+// 按各节点的数据量(GetApproximateSizes)和请求速率计算负载, 在相邻的节点之间
+// 迁移数据, 直到每个节点的负载都在平均值的 tolerance 范围之内
+class ClusterRebalance
+{
+public:
+	// 每次迁移之后更新 cluster 中的区间, cluster 为 NULL 时不更新
+	ClusterRebalance(const RebalanceOptions &opt, Cluster *cluster);
+	~ClusterRebalance();
+
+	// nodes 是按区间排好序的, 首尾相接的节点, 迁移后会修改它们的区间
+	int run(const std::vector<Node *> &nodes, std::vector<RebalanceMove> *moves);
+
+private:
+	struct Load{
+		int64_t bytes;
+		double qps;
+		// 在整个集群中所占的比例
+		double share;
+	};
+
+	RebalanceOptions opt;
+	Cluster *cluster;
+	std::map<int, ssdb::Client *> clients;
+
+	ssdb::Client* client(const Node &node);
+	int range_stats(const Node &node, int64_t *bytes, int64_t *calls);
+	int measure(const std::vector<Node *> &nodes, std::vector<Load> *loads);
+	bool balanced(const std::vector<Load> &loads);
+	void plan(const std::vector<Node *> &nodes, const std::vector<Load> &loads,
+		std::vector<RebalanceMove> *moves);
+	int execute(const std::vector<Node *> &nodes, RebalanceMove *move);
+};
+
+#endif
@@ -7,7 +7,11 @@ found in the LICENSE file.
 #include <fcntl.h>
 #include <string.h>
 #include <stdarg.h>
+#include <poll.h>
+#include <sys/time.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 
 #include "link.h"
 
@@ -17,7 +21,11 @@ found in the LICENSE file.
 #define MAX_PACKET_SIZE		32 * 1024 * 1024
 // 空缓冲区的大小，为啥不是0呢？这是个最初的缓冲区大小。buffer可以自己增加和缩小的，
 // 初始先初始化的小一点，避免浪费
-#define ZERO_BUFFER_SIZE	8
+// 缓冲区在有数据时才从内存池分配, 见 Link::shrink() 和 release_buffers()
+#define ZERO_BUFFER_SIZE	0
+
+#include "link_parse.cpp"
+#include "link_v2.cpp"
 
 // 这是什么？用到再看
 int Link::min_recv_buf = 8 * 1024;
@@ -31,10 +39,20 @@ Link::Link(bool is_server){
 	sock = -1;
 	noblock_ = false;
 	error_ = false;
+	unix_ = false;
+	proto_ = PROTO_TEXT;
+	recv_id = 0;
+	inflight = 0;
+	busy = false;
+	tracking = false;
 	remote_ip[0] = '\0';
 	remote_port = -1;
 	auth = false;
 	ignore_key_range = false;
+	pipeline_size = 0;
+	input_limit = 0;
+	paused = false;
+	timer.data = this;
 	
 	if(is_server){
 	    // 为啥server模式要将缓冲区初始化成空指针？
@@ -82,6 +100,14 @@ void Link::keepalive(bool enable){
 	::setsockopt(sock, SOL_SOCKET, SO_KEEPALIVE, (void *)&opt, sizeof(opt));
 }
 
+void Link::timeout(int ms){
+	struct timeval tv;
+	tv.tv_sec = ms / 1000;
+	tv.tv_usec = (ms % 1000) * 1000;
+	::setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (void *)&tv, sizeof(tv));
+	::setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, (void *)&tv, sizeof(tv));
+}
+
 // 设置socket属性
 void Link::noblock(bool enable){
 	noblock_ = enable;
@@ -96,7 +122,47 @@ void Link::noblock(bool enable){
 // 连接，这应该是在client中用到的吧，用于根据ip和端口连接server
 // 这是个static函数
 // 如果连接服务器成功，返回一个Link对象指针
-Link* Link::connect(const char *ip, int port){
+// 非阻塞地连接, 最多等待 timeout_ms, 连上后恢复为阻塞模式
+static int connect_timeout(int sock, const struct sockaddr *addr, socklen_t len, int timeout_ms){
+	int flags = fcntl(sock, F_GETFL, 0);
+	if(flags == -1 || fcntl(sock, F_SETFL, flags | O_NONBLOCK) == -1){
+		return -1;
+	}
+	if(::connect(sock, addr, len) == -1){
+		if(errno != EINPROGRESS){
+			return -1;
+		}
+		struct pollfd pfd;
+		pfd.fd = sock;
+		pfd.events = POLLOUT;
+		int ret;
+		do{
+			ret = ::poll(&pfd, 1, timeout_ms);
+		}while(ret == -1 && errno == EINTR);
+		if(ret == -1){
+			return -1;
+		}
+		if(ret == 0){
+			errno = ETIMEDOUT;
+			return -1;
+		}
+		int err = 0;
+		socklen_t errlen = sizeof(err);
+		if(getsockopt(sock, SOL_SOCKET, SO_ERROR, &err, &errlen) == -1){
+			return -1;
+		}
+		if(err){
+			errno = err;
+			return -1;
+		}
+	}
+	return fcntl(sock, F_SETFL, flags);
+}
+
+Link* Link::connect(const char *ip, int port, int timeout_ms){
+	if(ip[0] == '/'){
+		return Link::connect_unix(ip);
+	}
 	Link *link;
 	int sock = -1;
 
@@ -112,7 +178,11 @@ Link* Link::connect(const char *ip, int port){
 		goto sock_err;
 	}
 	// 使用之前创建的socket去连接服务器
-	if(::connect(sock, (struct sockaddr *)&addr, sizeof(addr)) == -1){
+	if(timeout_ms > 0){
+		if(connect_timeout(sock, (struct sockaddr *)&addr, sizeof(addr), timeout_ms) == -1){
+			goto sock_err;
+		}
+	}else if(::connect(sock, (struct sockaddr *)&addr, sizeof(addr)) == -1){
 		goto sock_err;
 	}
 
@@ -132,6 +202,92 @@ sock_err:
 	return NULL;
 }
 
+static int unix_addr(const char *path, struct sockaddr_un *addr){
+	bzero(addr, sizeof(*addr));
+	addr->sun_family = AF_UNIX;
+	if(strlen(path) >= sizeof(addr->sun_path)){
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	strcpy(addr->sun_path, path);
+	return 0;
+}
+
+Link* Link::connect_unix(const char *path){
+	Link *link;
+	int sock = -1;
+	struct sockaddr_un addr;
+	if(unix_addr(path, &addr) == -1){
+		return NULL;
+	}
+	if((sock = ::socket(AF_UNIX, SOCK_STREAM, 0)) == -1){
+		goto sock_err;
+	}
+	if(::connect(sock, (struct sockaddr *)&addr, sizeof(addr)) == -1){
+		goto sock_err;
+	}
+	link = new Link();
+	link->sock = sock;
+	link->unix_ = true;
+	snprintf(link->remote_ip, sizeof(link->remote_ip), "unix");
+	link->remote_port = 0;
+	return link;
+sock_err:
+	if(sock >= 0){
+		::close(sock);
+	}
+	return NULL;
+}
+
+Link* Link::listen_unix(const char *path, int mode){
+	Link *link;
+	int sock = -1;
+	int ret;
+	mode_t old_mask;
+	struct stat st;
+	struct sockaddr_un addr;
+	if(unix_addr(path, &addr) == -1){
+		return NULL;
+	}
+	// 上次没有正常退出时留下的. 只删除 socket 文件, 配置错了不能删掉别的文件
+	if(::lstat(path, &st) == 0){
+		if(!S_ISSOCK(st.st_mode)){
+			errno = EEXIST;
+			return NULL;
+		}
+		if(::unlink(path) == -1){
+			return NULL;
+		}
+	}else if(errno != ENOENT){
+		return NULL;
+	}
+	if((sock = ::socket(AF_UNIX, SOCK_STREAM, 0)) == -1){
+		goto sock_err;
+	}
+	// bind() 创建文件时就使用指定的权限, 不要在 chmod() 之前被其它用户连上
+	old_mask = ::umask(~mode & 0777);
+	ret = ::bind(sock, (struct sockaddr *)&addr, sizeof(addr));
+	::umask(old_mask);
+	if(ret == -1){
+		goto sock_err;
+	}
+	if(::listen(sock, 1024) == -1){
+		goto sock_err;
+	}
+
+	link = new Link(true);
+	link->sock = sock;
+	link->unix_ = true;
+	snprintf(link->remote_ip, sizeof(link->remote_ip), "unix");
+	link->remote_port = 0;
+	return link;
+sock_err:
+	if(sock >= 0){
+		::close(sock);
+	}
+	return NULL;
+}
+
 // 监听某个ip及端口，server模式用到
 Link* Link::listen(const char *ip, int port){
 	Link *link;
@@ -175,11 +331,12 @@ sock_err:
 Link* Link::accept(){
 	Link *link;
 	int client_sock;
-	struct sockaddr_in addr;
-	socklen_t addrlen = sizeof(addr);
+	struct sockaddr_storage ss;
+	socklen_t addrlen = sizeof(ss);
+	struct sockaddr_in *addr = (struct sockaddr_in *)&ss;
 
     // 开始接收客户端连接。如果操作失败且错误不是特定的错误，则一直循环来accept
-	while((client_sock = ::accept(sock, (struct sockaddr *)&addr, &addrlen)) == -1){
+	while((client_sock = ::accept(sock, (struct sockaddr *)&ss, &addrlen)) == -1){
 		if(errno != EINTR){
 			//log_error("socket %d accept failed: %s", sock, strerror(errno));
 			return NULL;
@@ -197,10 +354,16 @@ Link* Link::accept(){
     // 创建新连接
 	link = new Link();
 	link->sock = client_sock;
+	if(this->unix_){
+		link->unix_ = true;
+		snprintf(link->remote_ip, sizeof(link->remote_ip), "unix");
+		link->remote_port = 0;
+		return link;
+	}
 	link->keepalive(true);
-	inet_ntop(AF_INET, &addr.sin_addr, link->remote_ip, sizeof(link->remote_ip));
+	inet_ntop(AF_INET, &addr->sin_addr, link->remote_ip, sizeof(link->remote_ip));
 	// 保存客户端地址
-	link->remote_port = ntohs(addr.sin_port);
+	link->remote_port = ntohs(addr->sin_port);
 	return link;
 }
 
@@ -256,10 +419,6 @@ int Link::read(){
 // 数据，此时不能把输出缓冲区中所有数据都写完。在NetworkServer中已经处理了此种情况，如果
 // 没有全部写完，将继续监听数据流出事件并继续写直到写完
 int Link::write(){
-    // 这里为啥也要grow？这里不会操作output
-	if(output->total() == ZERO_BUFFER_SIZE){
-		output->grow();
-	}
 	int ret = 0;
 	int want;
 	while((want = output->size()) > 0){
@@ -300,11 +459,34 @@ int Link::flush(){
 		if(ret == -1){
 			return -1;
 		}
+		// 阻塞模式下没有写出数据, 说明设置了 SO_SNDTIMEO 并且超时了
+		if(ret == 0 && !noblock_){
+			return -1;
+		}
 		len += ret;
 	}
 	return len;
 }
 
+void Link::shrink(){
+	// 每个请求之后都会调用, 不要每次都释放再分配最小的缓冲区
+	if(input && input->total() > Link::min_recv_buf){
+		input->release();
+	}
+	if(output && output->total() > Link::min_send_buf){
+		output->release();
+	}
+}
+
+void Link::release_buffers(){
+	if(input){
+		input->release();
+	}
+	if(output){
+		output->release();
+	}
+}
+
 // 接收数据，从输入缓冲区中读取数据，并写入到Bytes数组返回
 const std::vector<Bytes>* Link::recv(){
 	this->recv_data.clear();
@@ -320,105 +502,49 @@ const std::vector<Bytes>* Link::recv(){
 	int size = input->size();
 	char *head = input->data();
 	
-	// Redis protocol supports
-	// 支持redis协议
-	if(head[0] == '*'){
+	if(proto_ == PROTO_V2){
+		parsed = Link::parse_frame(head, size, &this->recv_id, &this->recv_data, &this->recv_ints);
+	}else if(head[0] == '*'){
+		// Redis protocol supports
+		// 支持redis协议
 		if(redis == NULL){
 			redis = new RedisLink();
 		}
 		// 调用RedisLink方法来解析数据，解析到Bytes数组
 		// 解析成功则返回
 		const std::vector<Bytes> *ret = redis->recv_req(input);
+		// 输入缓冲区在 recv_req() 中扩大
+		if(input_limit > 0 && input->total() > input_limit){
+			return NULL;
+		}
 		if(ret){
 			this->recv_data = *ret;
 			return &this->recv_data;
 		}else{
 			return NULL;
 		}
+	}else{
+		// 按 CPU 支持的指令集选择解析器, 所有解析器的结果是一样的
+		parsed = Link::parse(head, size, &this->recv_data, Link::parser_level());
 	}
-
-	// ignore leading empty lines
-	// 忽略空行
-	while(size > 0 && (head[0] == '\n' || head[0] == '\r')){
-		head ++;
-		size --;
-		parsed ++;
+	if(parsed == -1){
+		//log_warn("bad format");
+		return NULL;
 	}
-
-    // 下面的解析过程和RedisLink基本是一样的
-	while(size > 0){
-	    // 找到body的开始位置，\n之后
-		char *body = (char *)memchr(head, '\n', size);
-		if(body == NULL){
-			break;
-		}
-		body ++;
-
-		int head_len = body - head;
-		// 没有更多数据，直接返回，不过还是要把已经解析的记录下来
-		// 数据后面的head区域为\n或者\r\n表示一个数据包结束了，此时
-		// 可以返回了
-		if(head_len == 1 || (head_len == 2 && head[0] == '\r')){
-			// packet end
-			parsed += head_len;
-			input->decr(parsed);
-			// 正确读取到数据的返回在这里
-			return &this->recv_data;;
-		}
-		if(head[0] < '0' || head[0] > '9'){
-			//log_warn("bad format");
-			return NULL;
-		}
-
-        // 读HEAD部分
-		char head_str[20];
-		if(head_len > (int)sizeof(head_str) - 1){
-			return NULL;
-		}
-		memcpy(head_str, head, head_len - 1); // no '\n'
-		head_str[head_len - 1] = '\0';
-
-        // 获取数据内容的长度
-		int body_len = atoi(head_str);
-		if(body_len < 0){
-			//log_warn("bad format");
-			return NULL;
-		}
-		//log_debug("size: %d, head_len: %d, body_len: %d", size, head_len, body_len);
-		size -= head_len + body_len;
-		if(size < 0){
-			break;
-		}
-
-        // 读取body
-		this->recv_data.push_back(Bytes(body, body_len));
-
-        // 更新head指针和parsed记录
-		head += head_len + body_len;
-		parsed += head_len + body_len;
-		// 跳过body后面的\n或者\r\n
-		if(size > 0 && head[0] == '\n'){
-			head += 1;
-			size -= 1;
-			parsed += 1;
-		}else if(size > 1 && head[0] == '\r' && head[1] == '\n'){
-			head += 2;
-			size -= 2;
-			parsed += 2;
-		}else{
-			break;
-		}
-		// 达到了数据包的最大范围，不读取
-		if(parsed > MAX_PACKET_SIZE){
-			 //log_warn("fd: %d, exceed max packet size, parsed: %d", this->sock, parsed);
-			 return NULL;
-		}
+	if(parsed > 0){
+		// 正确读取到数据的返回在这里
+		input->decr(parsed);
+		return &this->recv_data;
 	}
 
     // 更新输入缓冲区大小
 	if(input->space() == 0){
 		input->nice();
 		if(input->space() == 0){
+			if(input_limit > 0 && input->total() >= input_limit){
+				//log_warn("fd: %d, input buffer exceeds limit %d", this->sock, input_limit);
+				return NULL;
+			}
 			if(input->grow() == -1){
 				//log_error("fd: %d, unable to resize input buffer!", this->sock);
 				return NULL;
@@ -433,6 +559,21 @@ const std::vector<Bytes>* Link::recv(){
 	return &this->recv_data;
 }
 
+int Link::parse_next(int index, std::vector<Bytes> *out){
+	if(proto_ != PROTO_TEXT || input->empty()){
+		return 0;
+	}
+	char *head = input->data();
+	if(head[0] == '*'){
+		// 和 recv() 一样, 以 '*' 开头的是 redis 协议
+		if(redis == NULL){
+			return 0;
+		}
+		return redis->parse_next(input, index, out);
+	}
+	return Link::parse(head, input->size(), out, Link::parser_level());
+}
+
 // 发送响应，将字符串数组中的数据发送到输出缓冲区 
 int Link::send(const std::vector<std::string> &resp){
 	if(resp.empty()){
@@ -442,6 +583,9 @@ int Link::send(const std::vector<std::string> &resp){
 	if(this->redis){
 		return this->redis->send_resp(this->output, resp);
 	}
+	if(proto_ == PROTO_V2){
+		return this->send_frame(this->recv_id, resp);
+	}
 	
 	for(int i=0; i<resp.size(); i++){
 		output->append_record(resp[i]);
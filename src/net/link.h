@@ -15,6 +15,7 @@ found in the LICENSE file.
 #include "../util/bytes.h"
 
 #include "link_redis.h"
+#include "timer_wheel.h"
 
 // 表示一个客户端的链接？看看再回来做更多解释
 //
@@ -28,6 +29,12 @@ class Link{
 		bool noblock_;
 		// 是否出现错误
 		bool error_;
+		// 是否是 unix socket
+		bool unix_;
+		// 协议, PROTO_TEXT 或者 PROTO_V2
+		int proto_;
+		// v2 协议中整数字段转换成的文本, recv_data 指向它
+		std::string recv_ints;
 		// 接受到的数据
 		std::vector<Bytes> recv_data;
 
@@ -56,6 +63,26 @@ class Link{
 		// 创建时间，活跃时间
 		double create_time;
 		double active_time;
+		// 空闲超时的定时器, 见 NetworkServer::check_idle()
+		TimerNode timer;
+		// 输入缓冲区的上限(字节), 请求超过它时 recv() 返回错误, 0: 不限制
+		int input_limit;
+		// 输出缓冲区超过高水位, 暂停读取和处理请求
+		bool paused;
+
+		// 上一个收到的 v2 请求的 id, send() 用它作为响应的 id
+		uint32_t recv_id;
+		// 在工作线程中执行的 v2 请求数, 不为 0 时不能释放连接
+		int inflight;
+		// 文本协议的请求在工作线程中执行, 这时只有工作线程写输出缓冲区
+		bool busy;
+		// 开启了客户端缓存的失效通知, 见 tracking.h
+		bool tracking;
+
+		// 流水线: 和 last_recv() 一起交给同一个工作线程按顺序执行的后续
+		// 请求, 只使用前 pipeline_size 个, 见 NetworkServer::proc()
+		std::vector< std::vector<Bytes> > pipeline;
+		int pipeline_size;
 
         // 构造和析构函数
 		Link(bool is_server=false);
@@ -70,6 +97,9 @@ class Link{
 		void noblock(bool enable=true);
 		// 设置keepalive
 		void keepalive(bool enable=true);
+		// 阻塞模式下读写的超时(毫秒). 读超时 read() 返回 0, response() 返回 NULL;
+		// 写超时 flush() 返回 -1
+		void timeout(int ms);
 
         // 返回连接的文件描述符，再这里是socket的文件描述符
 		int fd() const{
@@ -84,10 +114,18 @@ class Link{
 			error_ = true;
 		}
 
-        // 连接
-		static Link* connect(const char *ip, int port);
+        // 连接. ip 以 '/' 开头时连接这个路径的 unix socket, 忽略 port.
+		// timeout_ms > 0 时, 超过这个时间没有连上返回 NULL(errno=ETIMEDOUT)
+		static Link* connect(const char *ip, int port, int timeout_ms=0);
+		static Link* connect_unix(const char *path);
 		// 监听，这肯定是server模式才使用的
 		static Link* listen(const char *ip, int port);
+		// 监听 unix socket, 已存在的 socket 文件会被删除, mode 是文件的权限
+		static Link* listen_unix(const char *path, int mode);
+		// unix socket 的连接, remote_ip 是 "unix"
+		bool is_unix() const{
+			return unix_;
+		}
 		// 开始接受请求
 		Link* accept();
 
@@ -100,6 +138,11 @@ class Link{
 		// REQUIRES: nonblock
 		// 将网络输出缓冲区的数据发送出去
 		int flush();
+		// 把变大了的空缓冲区的内存还给内存池, 最小的缓冲区留着给下一个请求用.
+		// 输入缓冲区释放之后, 之前收到的请求会失效.
+		void shrink();
+		// 把空的缓冲区全部还给内存池, 空闲的连接不占用缓冲区
+		void release_buffers();
 
 		/**
 		 * parse received data, and return -
@@ -110,6 +153,61 @@ class Link{
 		// 接收请求数据，每猜错的话这肯定是将输入缓冲区的数据进行解析，返回Bytes数组，应该会
 		// 调用RedisLink的方法来接收数据
 		const std::vector<Bytes>* recv();
+		/**
+		 * parse the next complete request in input buffer without consuming
+		 * it, as the index-th request of the pipeline, and return -
+		 * -1: error
+		 * 0: not ready, or protocol v2
+		 * >0: bytes of the request, call input->decr() to consume it
+		 * Unlike recv(), input buffer is never moved, so requests parsed
+		 * before stay valid. Rewritten arguments of redis requests are
+		 * kept per index until the index is parsed again.
+		 */
+		int parse_next(int index, std::vector<Bytes> *out);
+		// 接下来 send() 的是哪个请求的响应: -1 是 last_recv(), 其它是
+		// pipeline[index]. redis 协议的响应格式由请求决定
+		void select_request(int index){
+			if(redis){
+				redis->select(index);
+			}
+		}
+
+		// ssdb 协议的解析器, 见 link_parse.cpp
+		static const int PARSER_SCALAR	= 0;
+		static const int PARSER_SSE2	= 1;
+		static const int PARSER_AVX2	= 2;
+		// 运行时检测 CPU 支持的最快的解析器
+		static int parser_level();
+		static const char* parser_name(int level);
+		/**
+		 * parse one packet from data, fields are appended to out(pointing
+		 * into data), and return -
+		 * -1: error
+		 * 0: packet not ready
+		 * >0: bytes consumed by the packet
+		 */
+		static int parse(const char *data, int size, std::vector<Bytes> *out, int level);
+		// 二进制协议, 见 link_v2.cpp
+		static const int PROTO_TEXT		= 1;
+		static const int PROTO_V2		= 2;
+		static const int FIELD_BYTES	= 0;
+		static const int FIELD_INT		= 1;
+		int proto() const;
+		bool is_redis() const{
+			return redis != NULL;
+		}
+		// 之后收发的数据都使用这个协议, redis 协议的连接不能切换
+		int set_proto(int proto);
+		/**
+		 * parse one v2 frame from data, like parse(). The text of int
+		 * fields is stored in ints, which out points into.
+		 */
+		static int parse_frame(const char *data, int size, uint32_t *id,
+			std::vector<Bytes> *out, std::string *ints);
+		// 把一个响应(或请求)写成一帧
+		int send_frame(uint32_t id, const std::vector<std::string> &packet);
+		int send_frame(uint32_t id, const std::vector<Bytes> &packet);
+
 		// wait until a response received.
 		// 发送响应，应该是等待输出，并发送出去
 		const std::vector<Bytes>* response();
@@ -0,0 +1,246 @@
+/*
+Copyright (c) 2012-2014 The SSDB Authors. All rights reserved.
+Use of this source code is governed by a BSD-style license that can be
+found in the LICENSE file.
+*/
+// 本文件被 link.cpp 包含, 不单独编译.
+//
+// ssdb 协议的解析器. 一个数据包的格式为:
+//     |<- HEAD ->| \n |<- BODY ->| [\r]\n ... [\r]\n
+// 标量版本每个字段调用一次 memchr 查找换行; SIMD 版本一次比较 64 个字节,
+// 得到一个换行符位置的位图, 小字段很多的时候(multi_set/multi_hset)只需
+// 在位图上做位运算即可找到下一个字段头.
+//
+// 所有版本的解析结果必须完全一致(包括各种错误情况), 见 test_link_parse.cpp
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	#if (__GNUC__ * 100 + __GNUC_MINOR__) >= 409
+		#define LINK_PARSE_SIMD 1
+		#include <immintrin.h>
+	#endif
+#endif
+
+// 解析字段头中的长度, 与原来的 atoi() 结果一致.
+// 调用者已经保证 p[0] 是数字, 并且 len <= 18, 所以 int64 不会溢出,
+// 最后转换成 int 的行为和 atoi()(即 (int)strtol()) 相同
+static inline int parse_head_len(const char *p, int len){
+	int64_t n = 0;
+	for(int i=0; i<len; i++){
+		unsigned char d = (unsigned char)p[i] - '0';
+		if(d > 9){
+			break;
+		}
+		n = n * 10 + d;
+	}
+	return (int)n;
+}
+
+// 标量版本的换行查找
+struct LfScanScalar{
+	const char *data;
+	int size;
+
+	LfScanScalar(const char *data, int size){
+		this->data = data;
+		this->size = size;
+	}
+	// 返回 pos 之后(含)第一个 '\n' 的偏移, 没有则返回 -1
+	int next(int pos){
+		const char *p = (const char *)memchr(data + pos, '\n', size - pos);
+		if(p == NULL){
+			return -1;
+		}
+		return (int)(p - data);
+	}
+};
+
+#ifdef LINK_PARSE_SIMD
+__attribute__((target("sse2")))
+static inline uint64_t lf_mask64_sse2(const char *p){
+	const __m128i lf = _mm_set1_epi8('\n');
+	uint64_t m0 = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p +  0)), lf));
+	uint64_t m1 = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + 16)), lf));
+	uint64_t m2 = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + 32)), lf));
+	uint64_t m3 = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + 48)), lf));
+	return m0 | (m1 << 16) | (m2 << 32) | (m3 << 48);
+}
+
+__attribute__((target("avx2")))
+static inline uint64_t lf_mask64_avx2(const char *p){
+	const __m256i lf = _mm256_set1_epi8('\n');
+	uint64_t m0 = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(p +  0)), lf));
+	uint64_t m1 = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(p + 32)), lf));
+	return m0 | (m1 << 32);
+}
+
+struct LfMaskSse2{
+	static inline uint64_t mask(const char *p){
+		return lf_mask64_sse2(p);
+	}
+};
+
+struct LfMaskAvx2{
+	static inline uint64_t mask(const char *p){
+		return lf_mask64_avx2(p);
+	}
+};
+
+// SIMD 版本的换行查找. 缓存一个 64 字节窗口的换行位图, 窗口内的查找
+// 只需移位和 ctz; 不足 64 字节的尾部用 memchr, 不会越过 size 读内存
+template<class M>
+struct LfScanSimd{
+	const char *data;
+	int size;
+	int base;
+	uint64_t mask;
+
+	LfScanSimd(const char *data, int size){
+		this->data = data;
+		this->size = size;
+		this->base = -64;
+		this->mask = 0;
+	}
+	int next(int pos){
+		while(pos < size){
+			if(pos < base || pos >= base + 64){
+				if(size - pos < 64){
+					const char *p = (const char *)memchr(data + pos, '\n', size - pos);
+					if(p == NULL){
+						return -1;
+					}
+					return (int)(p - data);
+				}
+				base = pos;
+				mask = M::mask(data + base);
+			}
+			uint64_t m = mask >> (pos - base);
+			if(m){
+				return pos + __builtin_ctzll(m);
+			}
+			pos = base + 64;
+		}
+		return -1;
+	}
+};
+#endif
+
+// 解析器的主体, 与 Link::recv() 原来的逐字段解析逻辑一一对应, 只把
+// 换行查找和长度解析换成了 S 提供的版本
+template<class S>
+static inline int parse_packet(const char *data, int size, std::vector<Bytes> *out){
+	S scan(data, size);
+	int parsed = 0;
+	const char *head = data;
+
+	// ignore leading empty lines
+	while(size > 0 && (head[0] == '\n' || head[0] == '\r')){
+		head ++;
+		size --;
+		parsed ++;
+	}
+
+	while(size > 0){
+		int lf = scan.next(parsed);
+		if(lf == -1){
+			break;
+		}
+		const char *body = data + lf + 1;
+
+		int head_len = body - head;
+		if(head_len == 1 || (head_len == 2 && head[0] == '\r')){
+			// packet end
+			parsed += head_len;
+			return parsed;
+		}
+		if(head[0] < '0' || head[0] > '9'){
+			return -1;
+		}
+		// 原来的实现中字段头必须能放进 char[20]
+		if(head_len > 19){
+			return -1;
+		}
+		int body_len = parse_head_len(head, head_len - 1);
+		if(body_len < 0){
+			return -1;
+		}
+		size -= head_len + body_len;
+		if(size < 0){
+			break;
+		}
+
+		out->push_back(Bytes(body, body_len));
+
+		head += head_len + body_len;
+		parsed += head_len + body_len;
+		if(size > 0 && head[0] == '\n'){
+			head += 1;
+			size -= 1;
+			parsed += 1;
+		}else if(size > 1 && head[0] == '\r' && head[1] == '\n'){
+			head += 2;
+			size -= 2;
+			parsed += 2;
+		}else{
+			break;
+		}
+		if(parsed > MAX_PACKET_SIZE){
+			return -1;
+		}
+	}
+	return 0;
+}
+
+#ifdef LINK_PARSE_SIMD
+// 整个解析循环按 avx2 编译, 以便窗口位图的计算能被内联
+__attribute__((target("avx2")))
+static int parse_packet_avx2(const char *data, int size, std::vector<Bytes> *out){
+	return parse_packet< LfScanSimd<LfMaskAvx2> >(data, size, out);
+}
+
+static int parse_packet_sse2(const char *data, int size, std::vector<Bytes> *out){
+	return parse_packet< LfScanSimd<LfMaskSse2> >(data, size, out);
+}
+#endif
+
+int Link::parser_level(){
+	static int level = -1;
+	if(level == -1){
+		int n = PARSER_SCALAR;
+#ifdef LINK_PARSE_SIMD
+		__builtin_cpu_init();
+		if(__builtin_cpu_supports("sse2")){
+			n = PARSER_SSE2;
+		}
+		if(__builtin_cpu_supports("avx2")){
+			n = PARSER_AVX2;
+		}
+#endif
+		level = n;
+	}
+	return level;
+}
+
+const char* Link::parser_name(int level){
+	switch(level){
+		case PARSER_SSE2:
+			return "sse2";
+		case PARSER_AVX2:
+			return "avx2";
+	}
+	return "scalar";
+}
+
+int Link::parse(const char *data, int size, std::vector<Bytes> *out, int level){
+	if(level > parser_level()){
+		level = parser_level();
+	}
+#ifdef LINK_PARSE_SIMD
+	if(level == PARSER_AVX2){
+		return parse_packet_avx2(data, size, out);
+	}
+	if(level == PARSER_SSE2){
+		return parse_packet_sse2(data, size, out);
+	}
+#endif
+	return parse_packet<LfScanScalar>(data, size, out);
+}
@@ -4,7 +4,8 @@ Use of this source code is governed by a BSD-style license that can be
 found in the LICENSE file.
 */
 #include "link_redis.h"
-#include <map>
+#include <limits.h>
+#include "../util/perfect_hash.h"
 
 // 返回结果类型
 enum REPLY{
@@ -36,7 +37,9 @@ enum STRATEGY{
 };
 
 static bool inited = false;
-static std::map<std::string, RedisRequestDesc> cmd_table;
+// redis 命令名到请求描述的无冲突哈希表, 查找时忽略大小写, 不需要先把命令
+// 名复制成小写的 std::string
+static PerfectHash<RedisRequestDesc> cmd_table(true);
 
 // 这应该是个redis命令和ssdb命令的对应关系表？当然也包括了其他的请求相关信息，
 // 比如返回值结果类型之类的
@@ -128,138 +131,145 @@ static RedisCommand_raw cmds_raw[] = {
 	{STRATEGY_AUTO, 	NULL,			NULL,			0}
 };
 
-int RedisLink::convert_req(){
-    // 初始化请求表，用cmds_ras更新cmd_table
+static void init_cmd_table(){
+	std::vector<std::string> keys;
+	std::vector<RedisRequestDesc> vals;
+	// 注意这里的指针操作，用指针遍历数组，值的学习
+	RedisCommand_raw *def = &cmds_raw[0];
+	while(def->redis_cmd != NULL){
+		RedisRequestDesc desc;
+		desc.strategy = def->strategy;
+		desc.redis_cmd = def->redis_cmd;
+		desc.ssdb_cmd = def->ssdb_cmd;
+		desc.reply_type = def->reply_type;
+		keys.push_back(desc.redis_cmd);
+		vals.push_back(desc);
+		def += 1;
+	}
+	cmd_table.build(keys, vals);
+}
+
+// 保存一个改写过的参数, 返回指向它的 Bytes
+Bytes RedisLink::push_str(std::deque<std::string> *strs, const std::string &s){
+	strs->push_back(s);
+	const std::string &ref = strs->back();
+	return Bytes(ref.data(), ref.size());
+}
+
+// 把 args 中的 redis 请求转换成 ssdb 请求, 放到 out 中. 参数的顺序
+// 调整只是调整 Bytes 的顺序, 不复制数据
+int RedisLink::convert_req(const std::vector<Bytes> &args, std::vector<Bytes> *out,
+		std::deque<std::string> *strs, const RedisRequestDesc **desc){
 	if(!inited){
 		inited = true;
-		
-		// 注意这里的指针操作，用指针遍历数组，值的学习
-		RedisCommand_raw *def = &cmds_raw[0];
-		while(def->redis_cmd != NULL){
-			RedisRequestDesc desc;
-			desc.strategy = def->strategy;
-			desc.redis_cmd = def->redis_cmd;
-			desc.ssdb_cmd = def->ssdb_cmd;
-			desc.reply_type = def->reply_type;
-			cmd_table[desc.redis_cmd] = desc;
-			def += 1;
-		}
+		init_cmd_table();
 	}
 	
-	this->req_desc = NULL;
-	
-	std::map<std::string, RedisRequestDesc>::iterator it;
-	// 在命令表中查看当前命令对应的请求描述对象
-	it = cmd_table.find(cmd);
-	if(it == cmd_table.end()){
-	    // 再cmd_table中没有找到，直接把请求返回了？
-		recv_string.push_back(cmd);
-		for(int i=1; i<recv_bytes.size(); i++){
-			recv_string.push_back(recv_bytes[i].String());
+	out->clear();
+	strs->clear();
+	const RedisRequestDesc *req_desc = cmd_table.find(args[0].data(), args[0].size());
+	*desc = req_desc;
+	if(req_desc == NULL){
+		// 不认识的命令, 原样转给 ssdb, 命令名转成小写
+		std::string cmd = args[0].String();
+		strtolower(&cmd);
+		out->push_back(push_str(strs, cmd));
+		for(int i=1; i<args.size(); i++){
+			out->push_back(args[i]);
 		}
 		return 0;
 	}
-	// 找到请求描述对象的指针
-	this->req_desc = &(it->second);
+	// 下面的处理中，对于ssdb和redis的命令参数定义不同的，从redis命令到ssdb的命令
+	// 进行了转换，并作了默认参数的添加的操作
+	out->push_back(req_desc->ssdb_cmd);
 
-    // 下面的处理中，对于ssdb和redis的命令参数定义不同的，从redis命令到ssdb的命令
-    // 进行了转换，并作了默认参数的添加的操作
-    //
-    // 转换后的的命令放入recv_string中，估计后续要把这个当作请求参数来作处理
-	if(this->req_desc->strategy == STRATEGY_HKEYS
-			||  this->req_desc->strategy == STRATEGY_HVALS
+	if(req_desc->strategy == STRATEGY_HKEYS
+			||  req_desc->strategy == STRATEGY_HVALS
 	){
-		recv_string.push_back(req_desc->ssdb_cmd);
-		if(recv_bytes.size() == 2){
-			recv_string.push_back(recv_bytes[1].String());
-			recv_string.push_back("");
-			recv_string.push_back("");
-			recv_string.push_back("2000000000");
+		if(args.size() == 2){
+			out->push_back(args[1]);
+			out->push_back("");
+			out->push_back("");
+			out->push_back("2000000000");
 		}
 		return 0;
 	}
-	if(this->req_desc->strategy == STRATEGY_SETEX){
-		recv_string.push_back(req_desc->ssdb_cmd);
-		if(recv_bytes.size() == 4){
-			recv_string.push_back(recv_bytes[1].String());
-			recv_string.push_back(recv_bytes[3].String());
-			recv_string.push_back(recv_bytes[2].String());
+	if(req_desc->strategy == STRATEGY_SETEX){
+		if(args.size() == 4){
+			out->push_back(args[1]);
+			out->push_back(args[3]);
+			out->push_back(args[2]);
 		}
 		return 0;
 	}
-	if(this->req_desc->strategy == STRATEGY_ZADD){
-		recv_string.push_back(req_desc->ssdb_cmd);
-		if(recv_bytes.size() >= 2){
-			recv_string.push_back(recv_bytes[1].String());
-			for(int i=2; i<=recv_bytes.size()-2; i+=2){
-				recv_string.push_back(recv_bytes[i+1].String());
-				recv_string.push_back(recv_bytes[i].String());
+	if(req_desc->strategy == STRATEGY_ZADD){
+		if(args.size() >= 2){
+			out->push_back(args[1]);
+			for(int i=2; i<=(int)args.size()-2; i+=2){
+				out->push_back(args[i+1]);
+				out->push_back(args[i]);
 			}
 		}
 		return 0;
 	}
-	if(this->req_desc->strategy == STRATEGY_ZINCRBY){
-		recv_string.push_back(req_desc->ssdb_cmd);
-		if(recv_bytes.size() == 4){
-			recv_string.push_back(recv_bytes[1].String());
-			recv_string.push_back(recv_bytes[3].String());
-			recv_string.push_back(recv_bytes[2].String());
+	if(req_desc->strategy == STRATEGY_ZINCRBY){
+		if(args.size() == 4){
+			out->push_back(args[1]);
+			out->push_back(args[3]);
+			out->push_back(args[2]);
 		}
 		return 0;
 	}
-	if(this->req_desc->strategy == STRATEGY_REMRANGEBYRANK
-		|| this->req_desc->strategy == STRATEGY_REMRANGEBYSCORE)
+	if(req_desc->strategy == STRATEGY_REMRANGEBYRANK
+		|| req_desc->strategy == STRATEGY_REMRANGEBYSCORE)
 	{
-		recv_string.push_back(req_desc->ssdb_cmd);
-		if(recv_bytes.size() >= 4){
-			recv_string.push_back(recv_bytes[1].String());
-			recv_string.push_back(recv_bytes[2].String());
-			recv_string.push_back(recv_bytes[3].String());
+		if(args.size() >= 4){
+			out->push_back(args[1]);
+			out->push_back(args[2]);
+			out->push_back(args[3]);
 		}
 		return 0;
 	}
-	if(this->req_desc->strategy == STRATEGY_ZRANGE
-		|| this->req_desc->strategy == STRATEGY_ZREVRANGE)
+	if(req_desc->strategy == STRATEGY_ZRANGE
+		|| req_desc->strategy == STRATEGY_ZREVRANGE)
 	{
-		recv_string.push_back(req_desc->ssdb_cmd);
-		if(recv_bytes.size() >= 4){
-			int64_t start = recv_bytes[2].Int64();
-			int64_t end = recv_bytes[3].Int64();
+		if(args.size() >= 4){
+			int64_t start = args[2].Int64();
+			int64_t end = args[3].Int64();
 			
 			if((start >= 0 && end >= 0) || end == -1){
 				int64_t size;
 				if(end == -1){
 					size = -1;
 				}else{
-					if(this->req_desc->strategy == STRATEGY_REMRANGEBYSCORE){
+					if(req_desc->strategy == STRATEGY_REMRANGEBYSCORE){
 						size = end;
 					}else{
 						size = end - start + 1;
 					}
 				}
-				recv_string.push_back(recv_bytes[1].String());
-				recv_string.push_back(recv_bytes[2].String());
-				recv_string.push_back(str(size));
+				out->push_back(args[1]);
+				out->push_back(args[2]);
+				out->push_back(push_str(strs, str(size)));
 			}
 		}
-		if(recv_bytes.size() > 4){
-			std::string s = recv_bytes[4].String();
+		if(args.size() > 4){
+			std::string s = args[4].String();
 			strtolower(&s);
-			recv_string.push_back(s);
+			out->push_back(push_str(strs, s));
 		}
 		return 0;
 	}
-	if(this->req_desc->strategy == STRATEGY_ZRANGEBYSCORE || this->req_desc->strategy == STRATEGY_ZREVRANGEBYSCORE){
-		recv_string.push_back(req_desc->ssdb_cmd);
+	if(req_desc->strategy == STRATEGY_ZRANGEBYSCORE || req_desc->strategy == STRATEGY_ZREVRANGEBYSCORE){
 		std::string name, smin, smax, withscores, offset, count;
-		if(recv_bytes.size() >= 4){
-			name = recv_bytes[1].String();
-			smin = recv_bytes[2].String();
-			smax = recv_bytes[3].String();
+		if(args.size() >= 4){
+			name = args[1].String();
+			smin = args[2].String();
+			smax = args[3].String();
 			
 			bool after_limit = false;
-			for(int i=4; i<recv_bytes.size(); i++){
-				std::string s = recv_bytes[i].String();
+			for(int i=4; i<args.size(); i++){
+				std::string s = args[i].String();
 				if(after_limit){
 					if(offset.empty()){
 						offset = s;
@@ -280,73 +290,72 @@ int RedisLink::convert_req(){
 			return 0;
 		}
 		
-		recv_string.push_back(name);
-		recv_string.push_back("");
+		out->push_back(args[1]);
+		out->push_back("");
 		
 		if(smin == "-inf" || smin == "+inf"){
-			recv_string.push_back("");
+			out->push_back("");
 		}else{
 			if(smin[0] == '('){
 				std::string tmp(smin.data() + 1, smin.size() - 1);
 				char buf[32];
-				if(this->req_desc->strategy == STRATEGY_ZRANGEBYSCORE){
+				if(req_desc->strategy == STRATEGY_ZRANGEBYSCORE){
 					snprintf(buf, sizeof(buf), "%d", str_to_int(tmp) + 1);
 				}else{
 					snprintf(buf, sizeof(buf), "%d", str_to_int(tmp) - 1);
 				}
 				smin = buf;
 			}
-			recv_string.push_back(smin);
+			out->push_back(push_str(strs, smin));
 		}
 		if(smax == "-inf" || smax == "+inf"){
-			recv_string.push_back("");
+			out->push_back("");
 		}else{
 			if(smax[0] == '('){
 				std::string tmp(smax.data() + 1, smax.size() - 1);
 				char buf[32];
-				if(this->req_desc->strategy == STRATEGY_ZRANGEBYSCORE){
+				if(req_desc->strategy == STRATEGY_ZRANGEBYSCORE){
 					snprintf(buf, sizeof(buf), "%d", str_to_int(tmp) - 1);
 				}else{
 					snprintf(buf, sizeof(buf), "%d", str_to_int(tmp) + 1);
 				}
 				smax = buf;
 			}
-			recv_string.push_back(smax);
+			out->push_back(push_str(strs, smax));
 		}
 		if(offset.empty()){
-			recv_string.push_back("0");
+			out->push_back("0");
 		}else{
-			recv_string.push_back(offset);
+			out->push_back(push_str(strs, offset));
 		}
 		if(count.empty()){
-			recv_string.push_back("2000000000");
+			out->push_back("2000000000");
 		}else{
-			recv_string.push_back(count);
+			out->push_back(push_str(strs, count));
 		}
 
-		recv_string.push_back(withscores);
+		out->push_back(push_str(strs, withscores));
 		return 0;
 	}
 
-	recv_string.push_back(req_desc->ssdb_cmd);
-	for(int i=1; i<recv_bytes.size(); i++){
-		recv_string.push_back(recv_bytes[i].String());
+	for(int i=1; i<args.size(); i++){
+		out->push_back(args[i]);
 	}
-	
 	return 0;
 }
 
 // 接受请求，请求的数据放到input表示的buffer中，在此函数中将解析buffer中的请求数据，格式化
 // 为Bytes数组（vector），并且在处理过程中，如果请求是redis请求，会将其转换成ssdb请求。
 const std::vector<Bytes>* RedisLink::recv_req(Buffer *input){
-    // 解析请求，将输入数据解析到recv_bytes
+    // 解析请求，将输入数据解析到args
 	int ret = this->parse_req(input);
 	// 返回-1，说明解析错误了
 	if(ret == -1){
 		return NULL;
 	}
-	// 如果是空的，是什么情况？协议错误？不是redis协议？这里需要再确定
-	if(recv_bytes.empty()){
+	// 请求还没有接收完整
+	if(ret == 0){
+		recv_bytes.clear();
 		if(input->space() == 0){
 			input->nice();
 			if(input->space() == 0){
@@ -360,27 +369,46 @@ const std::vector<Bytes>* RedisLink::recv_req(Buffer *input){
 		return &recv_bytes;
 	}
 
-    // 获取命令，第1个参数即为命令
-	cmd = recv_bytes[0].String();
-	// 转换成小写
-	strtolower(&cmd);
-	
-	// 清除recv_string
-	recv_string.clear();
-	
-	// 将redis命令请求转换为ssdb命令请求，这一步会将recv_bytes中的命令转换放到recv_string中
-	this->convert_req();
+	// 将redis命令请求转换为ssdb命令请求，这一步会将args中的命令转换放到recv_bytes中
+	convert_req(args, &recv_bytes, &recv_string, &recv_desc);
+	req_desc = recv_desc;
+	return &recv_bytes;
+}
+
 
-    // 下面又将recv_string中的数据转换到recv_bytes中，并返回
-	// Bytes don't hold memory, so we firstly copy Bytes into string and store
-	// in a vector of string, then create Bytes-es prointing to strings
-	recv_bytes.clear();
-	for(int i=0; i<recv_string.size(); i++){
-		std::string *str = &recv_string[i];
-		recv_bytes.push_back(Bytes(str->data(), str->size()));
+// 整数转成十进制字符串, 返回长度, buf 至少 21 字节
+static inline int format_int(char *buf, int64_t n){
+	char tmp[24];
+	int len = 0;
+	uint64_t u = n < 0? (uint64_t)(-(n + 1)) + 1 : (uint64_t)n;
+	do{
+		tmp[len++] = '0' + (char)(u % 10);
+		u /= 10;
+	}while(u);
+	int i = 0;
+	if(n < 0){
+		buf[i++] = '-';
 	}
-	
-	return &recv_bytes;
+	while(len > 0){
+		buf[i++] = tmp[--len];
+	}
+	return i;
+}
+
+// 输出 "<type><n>\r\n", 如 "*3\r\n", "$5\r\n"
+static inline void append_len(Buffer *output, char type, int n){
+	char buf[32];
+	buf[0] = type;
+	int len = 1 + format_int(buf + 1, n);
+	buf[len++] = '\r';
+	buf[len++] = '\n';
+	output->append(buf, len);
+}
+
+static inline void append_bulk(Buffer *output, const std::string &val){
+	append_len(output, '$', (int)val.size());
+	output->append(val.data(), (int)val.size());
+	output->append("\r\n", 2);
 }
 
 // 将输出内容resp写到输出缓冲区output中
@@ -438,41 +466,33 @@ int RedisLink::send_resp(Buffer *output, const std::vector<std::string> &resp){
 			//log_error("bad response for multi_(h)get");
 			return 0;
 		}
-		char buf[32];
-		std::vector<std::string>::const_iterator req_it, resp_it;
+		const std::vector<Bytes> &req = *req_args;
+		std::vector<Bytes>::const_iterator req_it;
+		std::vector<std::string>::const_iterator resp_it;
 		if(req_desc->strategy == STRATEGY_MGET){
-			req_it = recv_string.begin() + 1;
-			snprintf(buf, sizeof(buf), "*%d\r\n", (int)recv_string.size() - 1);
+			req_it = req.begin() + 1;
+			append_len(output, '*', (int)req.size() - 1);
 		}else{
-			req_it = recv_string.begin() + 2;
-			snprintf(buf, sizeof(buf), "*%d\r\n", (int)recv_string.size() - 2);
+			req_it = req.begin() + 2;
+			append_len(output, '*', (int)req.size() - 2);
 		}
-		output->append(buf);
 		
 		resp_it = resp.begin() + 1;
 
-		while(req_it != recv_string.end()){
-			const std::string &req_key = *req_it;
+		while(req_it != req.end()){
+			const Bytes &req_key = *req_it;
 			req_it ++;
 			if(resp_it == resp.end()){
 				output->append("$-1\r\n");
 				continue;
 			}
 			const std::string &resp_key = *resp_it;
-			//log_debug("%s %s", req_key.c_str(), resp_key.c_str());
-			if(req_key != resp_key){
+			if(req_key != Bytes(resp_key)){
 				output->append("$-1\r\n");
 				// loop until we find value to the requested key
 				continue;
 			}
-				
-			const std::string &val = *(resp_it + 1);
-			char buf[32];
-			snprintf(buf, sizeof(buf), "$%d\r\n", (int)val.size());
-			output->append(buf);
-			output->append(val.data(), val.size());
-			output->append("\r\n");
-				
+			append_bulk(output, *(resp_it + 1));
 			resp_it += 2;
 		}
 
@@ -480,12 +500,7 @@ int RedisLink::send_resp(Buffer *output, const std::vector<std::string> &resp){
 	}
 	if(req_desc->reply_type == REPLY_BULK){
 		if(resp.size() >= 2){
-			const std::string &val = resp[1];
-			char buf[32];
-			snprintf(buf, sizeof(buf), "$%d\r\n", (int)val.size());
-			output->append(buf);
-			output->append(val.data(), val.size());
-			output->append("\r\n");
+			append_bulk(output, resp[1]);
 		}else{
 			output->append("$0\r\n");
 		}
@@ -495,9 +510,9 @@ int RedisLink::send_resp(Buffer *output, const std::vector<std::string> &resp){
 	if(req_desc->reply_type == REPLY_INT){
 		if(resp.size() >= 2){
 			const std::string &val = resp[1];
-			output->append(":");
+			output->append(':');
 			output->append(val.data(), val.size());
-			output->append("\r\n");
+			output->append("\r\n", 2);
 		}else{
 			output->append("$0\r\n");
 		}
@@ -507,31 +522,22 @@ int RedisLink::send_resp(Buffer *output, const std::vector<std::string> &resp){
 	if(req_desc->reply_type == REPLY_MULTI_BULK){
 		bool withscores = true;
 		if(req_desc->strategy == STRATEGY_ZRANGE || req_desc->strategy == STRATEGY_ZREVRANGE){
-			if(recv_string.size() < 5 || recv_string[4] != "withscores"){
+			if(req_args->size() < 5 || req_args->at(4) != "withscores"){
 				withscores = false;
 			}
 		}
 		if(req_desc->strategy == STRATEGY_ZRANGEBYSCORE || req_desc->strategy == STRATEGY_ZREVRANGEBYSCORE){
-			if(recv_string[recv_string.size() - 1] != "withscores"){
+			if(req_args->empty() || req_args->back() != "withscores"){
 				withscores = false;
 			}
 		}
-		{
-			char buf[32];
-			if(withscores){
-				snprintf(buf, sizeof(buf), "*%d\r\n", (int)resp.size() - 1);
-			}else{
-				snprintf(buf, sizeof(buf), "*%d\r\n", ((int)resp.size() - 1)/2);
-			}
-			output->append(buf);
+		if(withscores){
+			append_len(output, '*', (int)resp.size() - 1);
+		}else{
+			append_len(output, '*', ((int)resp.size() - 1)/2);
 		}
 		for(int i=1; i<resp.size(); i++){
-			const std::string &val = resp[i];
-			char buf[32];
-			snprintf(buf, sizeof(buf), "$%d\r\n", (int)val.size());
-			output->append(buf);
-			output->append(val.data(), val.size());
-			output->append("\r\n");
+			append_bulk(output, resp[i]);
 			if(!withscores){
 				i += 1;
 			}
@@ -543,69 +549,145 @@ int RedisLink::send_resp(Buffer *output, const std::vector<std::string> &resp){
 	return 0;
 }
 
-// 解析请求。将input表示的buffer中的数据读取到recv_bytes中
+// 解析 "<type><n>\r\n" 形式的行, p 指向 type 字符, lf 指向 '\n'.
+// 返回 -1 表示格式错误
+static inline int parse_len_line(const char *p, const char *lf, char type, int64_t *n){
+	if(p[0] != type){
+		return -1;
+	}
+	const char *e = lf;
+	if(e > p + 1 && e[-1] == '\r'){
+		e --;
+	}
+	p ++;
+	if(p == e || e - p > 18){
+		return -1;
+	}
+	bool neg = false;
+	if(*p == '-'){
+		neg = true;
+		p ++;
+		if(p == e){
+			return -1;
+		}
+	}
+	int64_t v = 0;
+	for(; p < e; p++){
+		if(*p < '0' || *p > '9'){
+			return -1;
+		}
+		v = v * 10 + (*p - '0');
+	}
+	*n = neg? -v : v;
+	return 0;
+}
+
+// 解析请求。将input表示的buffer中的一个完整请求解析到args中.
+// 返回 1: 解析完成; 0: 数据不完整, 下次从断点继续; -1: 格式错误
 int RedisLink::parse_req(Buffer *input){
-	recv_bytes.clear();
+	args.clear();
 
-	int parsed = 0;
+	char *data = input->data();
 	int size = input->size();
-	char *ptr = input->data();
-	
-	//dump(ptr, size);
 	
 	// 第一个字符必须为*
-	// 这是redis的命令的协议？
-	if(ptr[0] != '*'){
+	if(parse_argc == 0 && (size == 0 || data[0] != '*')){
 		return -1;
 	}
 
-	int num_args = 0;	
-	while(size > 0){
-        // memchr: 从ptr所指的前size个字符中查找换行符\n
-		char *lf = (char *)memchr(ptr, '\n', size);
+	while(1){
+		char *ptr = data + parse_pos;
+		int remain = size - parse_pos;
+		char *lf = (char *)memchr(ptr, '\n', remain);
 		if(lf == NULL){
 			break;
 		}
-		lf += 1;
-		size -= (lf - ptr);
-		parsed += (lf - ptr);
-		
-		int len = (int)strtol(ptr + 1, NULL, 10); // ptr + 1: skip '$' or '*'
-		if(errno == EINVAL){
-			return -1;
-		}
-		ptr = lf;
-		if(len < 0){
-			return -1;
-		}
-		if(num_args == 0){
-			if(len <= 0){
+		int64_t len;
+		if(parse_argc == 0){
+			// "*<argc>\r\n"
+			if(parse_len_line(ptr, lf, '*', &len) == -1 || len <= 0 || len > 1024 * 1024){
 				return -1;
 			}
-			num_args = len;
+			parse_argc = (int)len;
+			parse_pos += (lf + 1 - ptr);
+			parse_args.clear();
 			continue;
 		}
-		
-		if(len > size - 2){
+		// "$<len>\r\n<data>\r\n"
+		if(parse_len_line(ptr, lf, '$', &len) == -1 || len < 0 || len > INT_MAX){
+			return -1;
+		}
+		int head_len = lf + 1 - ptr;
+		if(len + 2 > remain - head_len){
 			break;
 		}
-		
-		recv_bytes.push_back(Bytes(ptr, len));
-		
-		ptr += len + 2;
-		size -= len + 2;
-		parsed += len + 2;
-
-		num_args --;
-		if(num_args == 0){
-		    // 到这里解析成功，将缓冲区数据删除（这里通过重置指针和改变缓冲区大小）
-			input->decr(parsed);
+		parse_args.push_back(std::make_pair(parse_pos + head_len, (int)len));
+		parse_pos += head_len + (int)len + 2;
+		if((int)parse_args.size() == parse_argc){
+			for(int i=0; i<(int)parse_args.size(); i++){
+				args.push_back(Bytes(data + parse_args[i].first, parse_args[i].second));
+			}
+			// 到这里解析成功，将缓冲区数据删除（这里通过重置指针和改变缓冲区大小）
+			input->decr(parse_pos);
+			parse_argc = 0;
+			parse_pos = 0;
+			parse_args.clear();
 			return 1;
 		}
 	}
-	
-	// 到这里的话解析失败，清除已解析数据，返回错误状态码
-	// 这里应该是解析失败吧？否则为什么要清除recv_bytes?
-	recv_bytes.clear();
 	return 0;
 }
+
+// 解析 data 开头的一个完整请求, 参数放到 args 中.
+// 返回请求的字节数; 0: 数据不完整; -1: 格式错误
+static int parse_packet(const char *data, int size, std::vector<Bytes> *args){
+	args->clear();
+	if(size == 0 || data[0] != '*'){
+		return -1;
+	}
+	const char *lf = (const char *)memchr(data, '\n', size);
+	if(lf == NULL){
+		return 0;
+	}
+	int64_t argc;
+	if(parse_len_line(data, lf, '*', &argc) == -1 || argc <= 0 || argc > 1024 * 1024){
+		return -1;
+	}
+	int pos = lf + 1 - data;
+	for(int i=0; i<argc; i++){
+		const char *ptr = data + pos;
+		int remain = size - pos;
+		lf = (const char *)memchr(ptr, '\n', remain);
+		if(lf == NULL){
+			return 0;
+		}
+		int64_t len;
+		if(parse_len_line(ptr, lf, '$', &len) == -1 || len < 0 || len > INT_MAX){
+			return -1;
+		}
+		int head_len = lf + 1 - ptr;
+		if(len + 2 > remain - head_len){
+			return 0;
+		}
+		args->push_back(Bytes(ptr + head_len, (int)len));
+		pos += head_len + (int)len + 2;
+	}
+	return pos;
+}
+
+int RedisLink::parse_next(Buffer *input, int index, std::vector<Bytes> *out){
+	if(parse_argc != 0 || input->empty()){
+		return 0;
+	}
+	int len = parse_packet(input->data(), input->size(), &next_args);
+	if(len <= 0){
+		return len;
+	}
+	while((int)pipeline.size() <= index){
+		pipeline.push_back(RedisPipelineReq());
+	}
+	RedisPipelineReq *p = &pipeline[index];
+	convert_req(next_args, &p->args, &p->strs, &p->desc);
+	out->assign(p->args.begin(), p->args.end());
+	return len;
+}
@@ -8,6 +8,7 @@ found in the LICENSE file.
 
 #include <vector>
 #include <string>
+#include <deque>
 #include "../util/bytes.h"
 
 // 请求描述？
@@ -23,42 +24,91 @@ struct RedisRequestDesc
 	int reply_type;
 };
 
+// 流水线中预先解析的一个请求的转换结果, 见 RedisLink::parse_next()
+struct RedisPipelineReq
+{
+	const RedisRequestDesc *desc;
+	// 转换后的请求, send_resp() 用它输出 mget 等的响应
+	std::vector<Bytes> args;
+	// 需要改写的参数的存储
+	std::deque<std::string> strs;
+};
+
 // 表示一个redis连接？
 //
 // 大致了解了这个类的功能，主要功能就是将redis协议的请求转换成ssdb的请求，转换过程中可能
 // 需要针对命令的参数/返回结果等做一些处理。请求转换的过程是将输入缓冲区中的数据转换成Bytes
 // 数组，以供后续处理。响应转换的过程是将string数组中表示的输出内容放到输出缓冲区中。在
 // 这里没有处理任何网络相关的功能和流程，只是进行输入输出的转换以及格式解析和处理。
+//
+// 请求的解析是流式的: 一个请求没有接收完整时记住已经解析的参数, 下次读到
+// 更多数据后从断点继续, 不会重复扫描大的 bulk. 解析出的参数直接指向输入
+// 缓冲区, 只有需要改写的参数(如 zrange 的 size)才会复制.
 class RedisLink
 {
 private:
-    // 命令
-	std::string cmd;
-	// 请求描述
-	RedisRequestDesc *req_desc;
+	// 请求描述和转换后的请求, send_resp() 按它们输出响应, 由 select() 切换
+	const RedisRequestDesc *req_desc;
+	const std::vector<Bytes> *req_args;
+	// recv_req() 返回的请求的描述
+	const RedisRequestDesc *recv_desc;
+	// parse_next() 解析的请求, deque 在扩大时不会移动已有的元素
+	std::deque<RedisPipelineReq> pipeline;
+	std::vector<Bytes> next_args;
 
-    // 这个需要看，是请求吗？
-    //
-    // 存储解析完毕的请求数据，最终请求解析完毕后会把recv_bytes返回
+	// 转换成 ssdb 命令后的请求, 返回给 Link::recv()
 	std::vector<Bytes> recv_bytes;
-	// 这个不知道是什么
-	//
-	// 在从redis命令切换为ssdb命令的过程中，使用recv_string作为中间存储，最终返回解析
-	// 后的请求时会再次将recv_string中的内容放到recv_bytes中去返回
-	std::vector<std::string> recv_string;
+	// 需要改写的参数的存储, deque 在 push_back 时不会移动已有的元素,
+	// 所以指向这里的 Bytes 一直有效
+	std::deque<std::string> recv_string;
+
+	// 解析状态. 参数在输入缓冲区中的位置用相对于 input->data() 的偏移
+	// 记录, 因为在两次 read 之间缓冲区可能被 nice()/grow() 移动
+	int parse_argc;  // 请求的参数个数, 0 表示还没读到 "*N\r\n"
+	int parse_pos;   // 当前请求已经解析的字节数
+	std::vector<std::pair<int, int> > parse_args;
+	// 当前请求的原始参数, 指向输入缓冲区
+	std::vector<Bytes> args;
+
 	// 解析请求
 	int parse_req(Buffer *input);
-	// 转换请求
-	int convert_req();
+	// 转换请求, 结果放到 out 中, 改写的参数保存在 strs 中
+	static int convert_req(const std::vector<Bytes> &args, std::vector<Bytes> *out,
+		std::deque<std::string> *strs, const RedisRequestDesc **desc);
+
+	static Bytes push_str(std::deque<std::string> *strs, const std::string &s);
 	
 public:
 	RedisLink(){
 	    // 请其描述对象的指针，会再convert_req函数中被赋值
 		req_desc = NULL;
+		req_args = &recv_bytes;
+		recv_desc = NULL;
+		parse_argc = 0;
+		parse_pos = 0;
 	}
 	
 	// 接受请求
 	const std::vector<Bytes>* recv_req(Buffer *input);
+	/**
+	 * 解析输入缓冲区开头的下一个完整请求, 转换后放到 out 中, 不移动缓冲区.
+	 * 转换结果保存在第 index 个槽中, 直到下一次用这个槽解析. 返回 -
+	 * -1: 格式错误
+	 * 0: 数据不完整, 或者 recv_req() 有没解析完的请求
+	 * >0: 请求的字节数, 由调用者 input->decr()
+	 */
+	int parse_next(Buffer *input, int index, std::vector<Bytes> *out);
+	// 接下来 send_resp() 输出的是哪个请求的响应: -1 是 recv_req() 返回的
+	// 请求, 其它是 parse_next() 的第 index 个槽
+	void select(int index){
+		if(index < 0){
+			req_desc = recv_desc;
+			req_args = &recv_bytes;
+		}else{
+			req_desc = pipeline[index].desc;
+			req_args = &pipeline[index].args;
+		}
+	}
 	// 发送响应
 	int send_resp(Buffer *output, const std::vector<std::string> &resp);
 };
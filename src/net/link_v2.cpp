@@ -0,0 +1,189 @@
+/*
+Copyright (c) 2012-2014 The SSDB Authors. All rights reserved.
+Use of this source code is governed by a BSD-style license that can be
+found in the LICENSE file.
+*/
+// 二进制协议(v2), 由 link.cpp 包含.
+//
+// 用 "proto 2" 命令切换, 服务器用文本协议回复 "ok 2" 之后, 这个连接上双向
+// 都使用帧. 整数都是网络字节序:
+//
+//   frame: size(u32) id(u32) count(u32) field * count
+//   field: type(u8) 之后是
+//          FIELD_BYTES: len(u32) data
+//          FIELD_INT:   value(i64)
+//
+// size 是 size 字段之后的字节数, 响应的 id 和请求的相同. 同一个连接上的
+// 响应可能不按请求的顺序返回, 客户端按 id 对应. 整数字段读取时转换成
+// 十进制的字符串, 所以命令不需要区分两种字段; 写出时规范的十进制整数
+// (没有前导的 0 和 '+', 最多 18 位)写成整数字段.
+
+#define V2_HEADER_SIZE		12
+#define V2_MAX_INT_DIGITS	18
+
+static inline uint32_t v2_get32(const char *p){
+	uint32_t v;
+	memcpy(&v, p, 4);
+	return ntohl(v);
+}
+
+static inline void v2_put32(char *p, uint32_t v){
+	v = htonl(v);
+	memcpy(p, &v, 4);
+}
+
+// 能写成整数字段的字符串, 转换回来和原来的完全一样
+static inline bool v2_is_int(const char *p, int size, int64_t *val){
+	if(size == 0 || size > V2_MAX_INT_DIGITS + 1){
+		return false;
+	}
+	const char *end = p + size;
+	bool neg = false;
+	if(*p == '-'){
+		neg = true;
+		p ++;
+		if(p == end || *p == '0'){
+			return false;
+		}
+	}
+	if(end - p > V2_MAX_INT_DIGITS || (*p == '0' && end - p > 1)){
+		return false;
+	}
+	int64_t v = 0;
+	for(; p < end; p++){
+		if(*p < '0' || *p > '9'){
+			return false;
+		}
+		v = v * 10 + (*p - '0');
+	}
+	*val = neg? -v : v;
+	return true;
+}
+
+int Link::proto() const{
+	return proto_;
+}
+
+int Link::set_proto(int proto){
+	if(proto != PROTO_TEXT && proto != PROTO_V2){
+		return -1;
+	}
+	if(redis){
+		return -1;
+	}
+	proto_ = proto;
+	return 0;
+}
+
+int Link::parse_frame(const char *data, int size, uint32_t *id, std::vector<Bytes> *out, std::string *ints){
+	if(size < V2_HEADER_SIZE){
+		return 0;
+	}
+	uint32_t body = v2_get32(data);
+	if(body < V2_HEADER_SIZE - 4 || body > MAX_PACKET_SIZE){
+		return -1;
+	}
+	if((uint32_t)size - 4 < body){
+		return 0;
+	}
+	const char *begin = data + V2_HEADER_SIZE;
+	const char *end = data + 4 + body;
+	*id = v2_get32(data + 4);
+	uint32_t count = v2_get32(data + 8);
+	if(count == 0){
+		return -1;
+	}
+	// 第一遍检查格式并数出整数字段, 整数的文本放在 ints 里, 先留够空间,
+	// 之后不会重新分配
+	int num_ints = 0;
+	const char *p = begin;
+	for(uint32_t i=0; i<count; i++){
+		if(end - p < 5){
+			return -1;
+		}
+		if(*p == FIELD_BYTES){
+			uint32_t len = v2_get32(p + 1);
+			p += 5;
+			if((uint32_t)(end - p) < len){
+				return -1;
+			}
+			p += len;
+		}else if(*p == FIELD_INT){
+			if(end - p < 9){
+				return -1;
+			}
+			p += 9;
+			num_ints ++;
+		}else{
+			return -1;
+		}
+	}
+	if(p != end){
+		return -1;
+	}
+	ints->clear();
+	ints->reserve(num_ints * (V2_MAX_INT_DIGITS + 2));
+
+	p = begin;
+	for(uint32_t i=0; i<count; i++){
+		if(*p == FIELD_BYTES){
+			uint32_t len = v2_get32(p + 1);
+			out->push_back(Bytes(p + 5, len));
+			p += 5 + len;
+		}else{
+			uint64_t v = ((uint64_t)v2_get32(p + 1) << 32) | v2_get32(p + 5);
+			p += 9;
+			char buf[24];
+			int len = snprintf(buf, sizeof(buf), "%" PRId64, (int64_t)v);
+			const char *s = ints->data() + ints->size();
+			ints->append(buf, len);
+			out->push_back(Bytes(s, len));
+		}
+	}
+	return (int)body + 4;
+}
+
+// 帧的大小等写完所有字段之后才知道, 先留出位置
+int Link::send_frame(uint32_t id, const std::vector<Bytes> &packet){
+	if(packet.empty()){
+		return 0;
+	}
+	int start = output->size();
+	char head[V2_HEADER_SIZE];
+	v2_put32(head + 4, id);
+	v2_put32(head + 8, packet.size());
+	if(output->append(head, sizeof(head)) == -1){
+		return -1;
+	}
+	for(int i=0; i<(int)packet.size(); i++){
+		const Bytes &s = packet[i];
+		char buf[9];
+		int64_t v;
+		if(v2_is_int(s.data(), s.size(), &v)){
+			buf[0] = FIELD_INT;
+			v2_put32(buf + 1, (uint32_t)((uint64_t)v >> 32));
+			v2_put32(buf + 5, (uint32_t)v);
+			if(output->append(buf, 9) == -1){
+				return -1;
+			}
+		}else{
+			buf[0] = FIELD_BYTES;
+			v2_put32(buf + 1, s.size());
+			if(output->append(buf, 5) == -1 || output->append(s) == -1){
+				return -1;
+			}
+		}
+	}
+	// append() 可能移动了缓冲区, 最后再写大小
+	v2_put32(output->data() + start, output->size() - start - 4);
+	return 0;
+}
+
+int Link::send_frame(uint32_t id, const std::vector<std::string> &packet){
+	std::vector<Bytes> tmp;
+	tmp.reserve(packet.size());
+	for(int i=0; i<(int)packet.size(); i++){
+		tmp.push_back(Bytes(packet[i]));
+	}
+	return send_frame(id, tmp);
+}
@@ -0,0 +1,69 @@
+/*
+Copyright (c) 2012-2014 The SSDB Authors. All rights reserved.
+Use of this source code is governed by a BSD-style license that can be
+found in the LICENSE file.
+*/
+#include "pool_sizer.h"
+
+// 线程忙碌时间的比例超过它才增加线程, 低于 SHRINK_UTIL 时认为空闲
+#define GROW_UTIL		0.75
+#define SHRINK_UTIL		0.25
+// 进程的 CPU 使用率超过它时不再增加线程
+#define CPU_SATURATED	0.90
+
+PoolSizer::PoolSizer(){
+	min_ = 1;
+	max_ = 1;
+	wait_total = 0;
+	wait_count = 0;
+	last_busy_us = 0;
+	idle_rounds = 0;
+	avg_wait_ = 0;
+	utilization_ = 0;
+}
+
+int PoolSizer::set_range(int min, int max){
+	if(min < 1 || min > max){
+		return -1;
+	}
+	min_ = min;
+	max_ = max;
+	idle_rounds = 0;
+	return 0;
+}
+
+int PoolSizer::clamp(int size) const{
+	if(size < min_){
+		return min_;
+	}
+	if(size > max_){
+		return max_;
+	}
+	return size;
+}
+
+int PoolSizer::adjust(int size, uint64_t busy_us, double interval_us, double cpu){
+	avg_wait_ = wait_count? wait_total / wait_count : 0;
+	utilization_ = 0;
+	if(interval_us > 0 && size > 0){
+		utilization_ = (busy_us - last_busy_us) / (interval_us * size);
+	}
+	last_busy_us = busy_us;
+	wait_total = 0;
+	wait_count = 0;
+
+	if(avg_wait_ >= GROW_WAIT && utilization_ >= GROW_UTIL && cpu < CPU_SATURATED){
+		idle_rounds = 0;
+		int step = size / 4;
+		return clamp(size + (step > 1? step : 1));
+	}
+	if(utilization_ < SHRINK_UTIL && avg_wait_ < GROW_WAIT / 4.0){
+		if(++idle_rounds >= SHRINK_ROUNDS){
+			idle_rounds = 0;
+			return clamp(size - 1);
+		}
+	}else{
+		idle_rounds = 0;
+	}
+	return clamp(size);
+}
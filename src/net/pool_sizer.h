@@ -0,0 +1,65 @@
+/*
+Copyright (c) 2012-2014 The SSDB Authors. All rights reserved.
+Use of this source code is governed by a BSD-style license that can be
+found in the LICENSE file.
+*/
+#ifndef NET_POOL_SIZER_H_
+#define NET_POOL_SIZER_H_
+
+#include <inttypes.h>
+
+// 根据任务的排队时间和线程的忙碌程度, 在 [min, max] 之间调整工作池的线程数.
+//
+// - 平均排队时间超过 GROW_WAIT, 线程大多在忙, 并且 CPU 还没有用满时增加
+//   线程(每次增加 1/4, 至少 1 个); CPU 用满时加线程只会让排队更久;
+// - 线程连续 SHRINK_ROUNDS 个周期都很闲时减少 1 个线程.
+//
+// 只在主线程中使用, 不加锁.
+class PoolSizer{
+	public:
+		static const int GROW_WAIT		= 2; // ms
+		static const int SHRINK_ROUNDS	= 10;
+
+		PoolSizer();
+		// min > max 或者 min < 1 时返回 -1
+		int set_range(int min, int max);
+		int min() const{
+			return min_;
+		}
+		int max() const{
+			return max_;
+		}
+		// 把线程数限制在 [min, max] 之间
+		int clamp(int size) const;
+
+		// 每个完成的任务调用一次
+		void add_wait(double ms){
+			wait_total += ms;
+			wait_count ++;
+		}
+
+		// 每个周期调用一次, 返回新的线程数.
+		// busy_us: 工作池的 busy_time(); interval_us: 周期的长度;
+		// cpu: 这个周期中进程的 CPU 使用率, 按所有 CPU 计算, 0-1
+		int adjust(int size, uint64_t busy_us, double interval_us, double cpu);
+
+		// 上一个周期的统计
+		double avg_wait() const{
+			return avg_wait_;
+		}
+		double utilization() const{
+			return utilization_;
+		}
+
+	private:
+		int min_;
+		int max_;
+		double wait_total;
+		int64_t wait_count;
+		uint64_t last_busy_us;
+		int idle_rounds;
+		double avg_wait_;
+		double utilization_;
+};
+
+#endif
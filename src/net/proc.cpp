@@ -7,6 +7,103 @@ found in the LICENSE file.
 #include "server.h"
 #include "../util/log.h"
 
+static int next_stat_slot = 0;
+
+// 当前线程的统计槽
+static inline int stat_slot(){
+	static __thread int slot = -1;
+	if(slot == -1){
+		slot = __sync_fetch_and_add(&next_stat_slot, 1) % COMMAND_STAT_SLOTS;
+	}
+	return slot;
+}
+
+Command::Command(){
+	flags = 0;
+	cost = COST_POINT;
+	proc = NULL;
+	proc_batch = NULL;
+	void *p = NULL;
+	if(posix_memalign(&p, 64, sizeof(CommandStat) * COMMAND_STAT_SLOTS) != 0){
+		fprintf(stderr, "%s %d alloc command stats error!\n", __FILE__, __LINE__);
+		exit(1);
+	}
+	stats = (CommandStat *)p;
+	memset(stats, 0, sizeof(CommandStat) * COMMAND_STAT_SLOTS);
+	for(int i=0; i<COMMAND_STAT_SLOTS; i++){
+		hists[i] = NULL;
+	}
+}
+
+Command::~Command(){
+	free(stats);
+	for(int i=0; i<COMMAND_STAT_SLOTS; i++){
+		delete hists[i];
+	}
+}
+
+void Command::add_stat(double time_wait, double time_proc){
+	int slot = stat_slot();
+	CommandStat *st = &stats[slot];
+	__sync_fetch_and_add(&st->calls, 1);
+	__sync_fetch_and_add(&st->time_wait, (uint64_t)(time_wait * 1000));
+	__sync_fetch_and_add(&st->time_proc, (uint64_t)(time_proc * 1000));
+
+	CommandHistogram *h = __atomic_load_n(&hists[slot], __ATOMIC_ACQUIRE);
+	if(h == NULL){
+		h = new CommandHistogram();
+		// 共用槽的线程可能同时分配
+		if(!__sync_bool_compare_and_swap(&hists[slot], (CommandHistogram *)NULL, h)){
+			delete h;
+			h = __atomic_load_n(&hists[slot], __ATOMIC_ACQUIRE);
+		}
+	}
+	h->wait.add((uint64_t)(time_wait * 1000));
+	h->proc.add((uint64_t)(time_proc * 1000));
+}
+
+void Command::get_histogram(Histogram *wait, Histogram *proc) const{
+	wait->reset();
+	proc->reset();
+	for(int i=0; i<COMMAND_STAT_SLOTS; i++){
+		CommandHistogram *h = __atomic_load_n(&hists[i], __ATOMIC_ACQUIRE);
+		if(h){
+			wait->merge(h->wait);
+			proc->merge(h->proc);
+		}
+	}
+}
+
+void Command::reset_histogram(){
+	for(int i=0; i<COMMAND_STAT_SLOTS; i++){
+		CommandHistogram *h = __atomic_load_n(&hists[i], __ATOMIC_ACQUIRE);
+		if(h){
+			h->wait.reset();
+			h->proc.reset();
+		}
+	}
+}
+
+uint64_t Command::calls() const{
+	uint64_t ret = 0;
+	for(int i=0; i<COMMAND_STAT_SLOTS; i++){
+		ret += stats[i].calls;
+	}
+	return ret;
+}
+
+void Command::get_stat(uint64_t *calls, double *time_wait, double *time_proc) const{
+	uint64_t c = 0, w = 0, p = 0;
+	for(int i=0; i<COMMAND_STAT_SLOTS; i++){
+		c += stats[i].calls;
+		w += stats[i].time_wait;
+		p += stats[i].time_proc;
+	}
+	*calls = c;
+	*time_wait = w / 1000.0;
+	*time_proc = p / 1000.0;
+}
+
 ProcMap::ProcMap(){
 }
 
@@ -26,6 +123,13 @@ void ProcMap::set_proc(const std::string &c, proc_t proc){
 	this->set_proc(c, "t", proc);
 }
 
+void ProcMap::set_batch_proc(const std::string &c, proc_batch_t proc){
+	Command *cmd = this->get_proc(c);
+	if(cmd){
+		cmd->proc_batch = proc;
+	}
+}
+
 void ProcMap::set_proc(const std::string &c, const char *sflags, proc_t proc){
 	Command *cmd = this->get_proc(c);
 	if(!cmd){
@@ -39,6 +143,7 @@ void ProcMap::set_proc(const std::string &c, const char *sflags, proc_t proc){
 	cmd->proc = proc;
 	// 设置命令的flag，表示命令是一个读命令，写命令，后台命令还是线程命令
 	cmd->flags = 0;
+	cmd->cost = Command::COST_POINT;
 	for(const char *p=sflags; *p!='\0'; p++){
 		switch(*p){
 			case 'r':
@@ -53,12 +158,38 @@ void ProcMap::set_proc(const std::string &c, const char *sflags, proc_t proc){
 			case 't':
 				cmd->flags |= Command::FLAG_THREAD;
 				break;
+			case 'm':
+				cmd->cost = Command::COST_MULTI;
+				break;
+			case 's':
+				cmd->cost = Command::COST_SCAN;
+				break;
+			case 'a':
+				cmd->cost = Command::COST_ADMIN;
+				break;
 		}
 	}
 }
 
+void ProcMap::build_index(){
+	std::vector<std::string> keys;
+	std::vector<Command *> vals;
+	proc_map_t::iterator it;
+	for(it=proc_map.begin(); it!=proc_map.end(); it++){
+		keys.push_back(it->second->name);
+		vals.push_back(it->second);
+	}
+	if(index.build(keys, vals) == -1){
+		log_error("build command index failed");
+	}
+}
+
 // 根据命令获取处理命令
 Command* ProcMap::get_proc(const Bytes &str){
+	Command * const *cmd = index.find(str.data(), str.size());
+	if(cmd){
+		return *cmd;
+	}
 	proc_map_t::iterator it = proc_map.find(str);
 	if(it != proc_map.end()){
 		return it->second;
@@ -9,6 +9,8 @@ found in the LICENSE file.
 #include <vector>
 #include "resp.h"
 #include "../util/bytes.h"
+#include "../util/perfect_hash.h"
+#include "../util/histogram.h"
 
 class Link;
 class NetworkServer;
@@ -25,6 +27,29 @@ class NetworkServer;
 typedef std::vector<Bytes> Request;
 // 请求处理函数
 typedef int (*proc_t)(NetworkServer *net, Link *link, const Request &req, Response *resp);
+// 一次处理一个连接的一批流水线请求, resps 中的响应与 reqs 一一对应
+typedef int (*proc_batch_t)(NetworkServer *net, Link *link,
+	const std::vector<const Request *> &reqs, std::vector<Response> *resps);
+
+// 命令统计的槽数. 每个线程第一次更新统计时分到一个槽, 各线程只写自己的
+// 槽, 互不竞争; 读取时(info)把所有槽加起来. 线程数超过槽数时会共用槽,
+// 所以更新使用原子操作
+#define COMMAND_STAT_SLOTS	32
+
+// 一个线程对一个命令的统计, 占满一个 cache line, 避免伪共享
+struct CommandStat{
+	uint64_t calls;
+	uint64_t time_wait; // us
+	uint64_t time_proc; // us
+	char padding[64 - 3 * sizeof(uint64_t)];
+};
+
+// 一个线程对一个命令的延迟分布, 和 CommandStat 使用同样的槽, 第一次
+// 使用时分配
+struct CommandHistogram{
+	Histogram wait;
+	Histogram proc;
+};
 
 // 定义一个命令
 struct Command{
@@ -34,21 +59,50 @@ struct Command{
 	static const int FLAG_BACKEND	= (1 << 2);
 	static const int FLAG_THREAD	= (1 << 3);
 
+	// 开销类别, 注册时用 flag 字符指定: 默认是 point, 'm' multi, 's' scan,
+	// 'a' admin. 读线程池按类别调度, scan 和 admin 只能占用一部分线程;
+	// admin 类的写命令不使用写线程, 见 NetworkServer::writer_of()
+	static const int COST_POINT		= 0;
+	static const int COST_MULTI		= 1;
+	static const int COST_SCAN		= 2;
+	static const int COST_ADMIN		= 3;
+
 	std::string name;
 	int flags;
+	int cost;
 	// 处理此命令的函数
 	proc_t proc;
-	uint64_t calls;
-	double time_wait;
-	double time_proc;
+	// 可选. 工作线程收到的一批请求都有同一个 proc_batch 时, 整批交给它
+	// 处理(如 ssdb-proxy 先转发所有请求再等待响应), 否则逐个调用 proc
+	proc_batch_t proc_batch;
 	
-	Command(){
-		flags = 0;
-		proc = NULL;
-		calls = 0;
-		time_wait = 0;
-		time_proc = 0;
-	}
+	Command();
+	~Command();
+
+	// 记录一次调用, 时间单位为毫秒, 可以在任意线程中调用
+	void add_stat(double time_wait, double time_proc);
+	// 汇总所有线程的统计
+	uint64_t calls() const;
+	void get_stat(uint64_t *calls, double *time_wait, double *time_proc) const;
+	// 汇总所有线程的等待时间和处理时间的分布, 单位为微秒
+	void get_histogram(Histogram *wait, Histogram *proc) const;
+	void reset_histogram();
+
+private:
+	CommandStat *stats;
+	CommandHistogram *hists[COMMAND_STAT_SLOTS];
+	// No copying allowed
+	Command(const Command&);
+	void operator=(const Command&);
+};
+
+// v2 协议的请求. 请求在工作线程中执行时, 连接可能还在接收和处理其它请求,
+// 输入缓冲区会变化, 所以复制一份; 响应也先放在这里, 由主线程写到输出缓冲区
+struct ProcRequest{
+	uint32_t id;
+	std::string data;
+	Request req;
+	Response resp;
 };
 
 // 一个处理请求的job
@@ -60,9 +114,13 @@ struct ProcJob{
 	Link *link;
 	// 处理请求的命令
 	Command *cmd;
-	double stime;
+	// 开始处理的时间, clock_cycles()
+	uint64_t stime;
+	// ms
 	double time_wait;
 	double time_proc;
+	// v2 协议的请求, 其它为 NULL, 请求是 link->last_recv()
+	ProcRequest *preq;
 	
 	ProcJob(){
 		result = 0;
@@ -72,6 +130,7 @@ struct ProcJob{
 		stime = 0;
 		time_wait = 0;
 		time_proc = 0;
+		preq = NULL;
 	}
 };
 
@@ -111,11 +170,16 @@ struct BytesHash{
 
 
 // 定义请求处理的映射关系，管理命令的处理函数
+//
+// 命令注册完之后(NetworkServer::serve() 开始时)调用 build_index(), 用当时
+// 所有的命令构造一个无冲突哈希表, 之后查找命令只需要一次哈希和一次比较.
+// 之后再动态注册的命令不在这个表中, 查找时回退到 proc_map.
 class ProcMap
 {
 private:
     // 具体的命令映射
 	proc_map_t proc_map;
+	PerfectHash<Command *> index;
 
 public:
 	ProcMap();
@@ -124,7 +188,11 @@ public:
 	void set_proc(const std::string &cmd, const char *sflags, proc_t proc);
 	// 设置命令的处理函数
 	void set_proc(const std::string &cmd, proc_t proc);
+	// 设置命令的批处理函数, 命令必须已经注册
+	void set_batch_proc(const std::string &cmd, proc_batch_t proc);
 	Command* get_proc(const Bytes &str);
+	// 用当前注册的命令构造无冲突哈希表
+	void build_index();
 	
 	// 迭代器来获取所有命令
 	proc_map_t::iterator begin(){
@@ -9,24 +9,51 @@ found in the LICENSE file.
 #include "../util/config.h"
 #include "../util/log.h"
 #include "../util/ip_filter.h"
+#include "../util/clock.h"
 #include "link.h"
 #include <vector>
+#include <algorithm>
+#include <sys/resource.h>
+#ifdef __linux__
+	#include <sys/timerfd.h>
+	#define HAVE_TIMERFD 1
+#endif
 
 static DEF_PROC(ping);
 static DEF_PROC(info);
 static DEF_PROC(auth);
+static DEF_PROC(latency);
+static DEF_PROC(slowlog);
+static DEF_PROC(config);
+static DEF_PROC(client);
+static DEF_PROC(proto);
+static DEF_PROC(tracking);
 
 // 时钟周期
 #define TICK_INTERVAL          100 // ms
 // 隔多久汇报一次状态，这里定义的是每隔5分钟汇报一次状态
 #define STATUS_REPORT_TICKS    (300 * 1000/TICK_INTERVAL) // second
+// 流水线中一次连续处理(或者交给工作线程)的最大请求数
+#define PIPELINE_BATCH_SIZE    128
+// 多久调整一次工作池的线程数
+#define POOL_ADJUST_TICKS      (1000/TICK_INTERVAL)
+// 连接空闲多久(秒)后释放它的缓冲区
+#define BUFFER_IDLE_SECONDS    1
+// 输出缓冲区的高水位的默认值, MB
+#define OUTPUT_HIGH_MB         4
+// 输入缓冲区的上限的默认值, MB, 能容纳最大的请求(32MB)
+#define INPUT_LIMIT_MB         64
+// 一个 v2 协议的连接最多同时有多少个请求在工作线程中, 超过时暂停读取
+#define V2_MAX_INFLIGHT        1024
+// 客户端缓存, 每个连接最多跟踪的 key 数
+#define TRACKING_MAX_KEYS      100000
 static const int READER_THREADS = 10;
 static const int WRITER_THREADS = 1;
+// 执行管理类写命令(如 migrate_range)的线程数
+static const int ADMIN_WRITER_THREADS = 1;
 
 // 用全局静态变量来处理退出信号
 volatile bool quit = false;
-// 这个是用来干什么的？
-volatile uint32_t g_ticks = 0;
 
 // 注册对信号的处理，这里只要设置全局标志就可以了
 void signal_handler(int sig){
@@ -36,11 +63,6 @@ void signal_handler(int sig){
 			quit = true;
 			break;
 		}
-		// 每次接收到时钟信号均将计数器增加，用于判断命令执行是否超时？
-		case SIGALRM:{
-			g_ticks ++;
-			break;
-		}
 	}
 }
 
@@ -48,13 +70,28 @@ void signal_handler(int sig){
 NetworkServer::NetworkServer(){
 	num_readers = READER_THREADS;
 	num_writers = WRITER_THREADS;
+	num_scan_readers = -1;
+	reader = NULL;
+	writer = NULL;
+	admin_writer = NULL;
+	sizer_time = 0;
+	sizer_cpu = 0;
 	
 	tick_interval = TICK_INTERVAL;
 	status_report_ticks = STATUS_REPORT_TICKS;
+	ticks = 0;
+	last_tick_us = 0;
+	timer_fd = -1;
 
 	//conf = NULL;
 	serv_link = NULL;
+	unix_link = NULL;
 	link_count = 0;
+	idle_timeout = 0;
+	input_limit = INPUT_LIMIT_MB * 1024 * 1024;
+	output_high = OUTPUT_HIGH_MB * 1024 * 1024;
+	output_limit = 0;
+	tracking = NULL;
 
     // 初始化事件相关
 	fdes = new Fdevents();
@@ -64,40 +101,47 @@ NetworkServer::NetworkServer(){
 	proc_map.set_proc("ping", "r", proc_ping);
 	proc_map.set_proc("info", "r", proc_info);
 	proc_map.set_proc("auth", "r", proc_auth);
+	proc_map.set_proc("latency", "r", proc_latency);
+	proc_map.set_proc("slowlog", "r", proc_slowlog);
+	proc_map.set_proc("config", "r", proc_config);
+	proc_map.set_proc("client", "r", proc_client);
+	proc_map.set_proc("proto", "r", proc_proto);
+	proc_map.set_proc("tracking", "r", proc_tracking);
 
     // 设置信号处理
 	signal(SIGPIPE, SIG_IGN);
 	signal(SIGINT, signal_handler);
 	signal(SIGTERM, signal_handler);
-#ifndef __CYGWIN__
-    // 设置定时期和时钟信号的处理函数
-	signal(SIGALRM, signal_handler);
-	{
-		struct itimerval tv;
-		// it_interval用于指定每隔多久发送一次信号
-		// 这里指定的是每隔100毫秒发送一次时钟信号，可以理解成对于程序来说，时钟时间
-		// 是100ms一次
-		tv.it_interval.tv_sec = (TICK_INTERVAL / 1000);
-		tv.it_interval.tv_usec = (TICK_INTERVAL % 1000) * 1000;
-		// it_value指定第一次发送信号距离现在的时间
-		tv.it_value.tv_sec = 1;
-		tv.it_value.tv_usec = 0;
-		// 设置定时信号，这里使用真实时钟
-		setitimer(ITIMER_REAL, &tv, NULL);
-	}
-#endif
+	// 时钟周期由事件循环中的定时器驱动, 见 serve(), 不使用 SIGALRM,
+	// 信号会打断所有线程中的系统调用
 }
 	
 NetworkServer::~NetworkServer(){
 	//delete conf;
 	delete serv_link;
+	if(unix_link){
+		delete unix_link;
+		::unlink(unix_path.c_str());
+	}
 	delete fdes;
+	if(timer_fd != -1){
+		::close(timer_fd);
+	}
 	delete ip_filter;
 
-	writer->stop();
-	delete writer;
-	reader->stop();
-	delete reader;
+	if(writer){
+		writer->stop();
+		delete writer;
+	}
+	if(admin_writer){
+		admin_writer->stop();
+		delete admin_writer;
+	}
+	if(reader){
+		reader->stop();
+		delete reader;
+	}
+	delete tracking;
 }
 
 NetworkServer* NetworkServer::init(const char *conf_file, int num_readers, int num_writers){
@@ -176,6 +220,23 @@ NetworkServer* NetworkServer::init(const Config &conf, int num_readers, int num_
 		}
 		log_info("server listen on %s:%d", ip, port);
 
+		const char *path = conf.get_str("server.unixsocket");
+		if(path[0] != '\0'){
+			int mode = 0770;
+			const char *perm = conf.get_str("server.unixsocketperm");
+			if(perm[0] != '\0'){
+				mode = (int)strtol(perm, NULL, 8);
+			}
+			serv->unix_link = Link::listen_unix(path, mode);
+			if(serv->unix_link == NULL){
+				log_fatal("error opening unix socket %s! %s", path, strerror(errno));
+				fprintf(stderr, "error opening unix socket %s! %s\n", path, strerror(errno));
+				exit(1);
+			}
+			serv->unix_path = path;
+			log_info("server listen on unix socket %s, perm: %04o", path, mode);
+		}
+
 		std::string password;
 		password = conf.get_str("server.auth");
 		if(password.size() && (password.size() < 32 || password == "very-strong-password")){
@@ -194,48 +255,197 @@ NetworkServer* NetworkServer::init(const Config &conf, int num_readers, int num_
 			serv->password = password;
 		}
 	}
+
+	if(conf.get("server.scan_readers")){
+		serv->num_scan_readers = conf.get_num("server.scan_readers");
+	}
+
+	{ // 线程数的范围, 没有配置时线程数固定
+		int r_min = serv->num_readers, r_max = serv->num_readers;
+		int w_min = serv->num_writers, w_max = serv->num_writers;
+		if(conf.get("server.readers_min")){
+			r_min = conf.get_num("server.readers_min");
+		}
+		if(conf.get("server.readers_max")){
+			r_max = conf.get_num("server.readers_max");
+		}
+		if(conf.get("server.writers_min")){
+			w_min = conf.get_num("server.writers_min");
+		}
+		if(conf.get("server.writers_max")){
+			w_max = conf.get_num("server.writers_max");
+		}
+		if(r_max > WORKER_POOL_MAX_WORKERS || w_max > WORKER_POOL_MAX_WORKERS
+			|| serv->reader_sizer.set_range(r_min, r_max) == -1
+			|| serv->writer_sizer.set_range(w_min, w_max) == -1)
+		{
+			log_fatal("invalid readers_min/max or writers_min/max");
+			fprintf(stderr, "invalid readers_min/max or writers_min/max\n");
+			exit(1);
+		}
+		serv->num_readers = serv->reader_sizer.clamp(serv->num_readers);
+		serv->num_writers = serv->writer_sizer.clamp(serv->num_writers);
+		log_info("readers: %d-%d, writers: %d-%d", r_min, r_max, w_min, w_max);
+	}
+
+	{ // 空闲超时和缓冲区的限制
+		if(conf.get("server.idle_timeout")){
+			serv->idle_timeout = conf.get_num("server.idle_timeout");
+		}
+		if(conf.get("server.client_input_limit")){
+			serv->input_limit = conf.get_num("server.client_input_limit") * 1024 * 1024;
+		}
+		if(conf.get("server.client_output_high")){
+			serv->output_high = conf.get_num("server.client_output_high") * 1024 * 1024;
+		}
+		if(conf.get("server.client_output_limit")){
+			serv->output_limit = conf.get_num("server.client_output_limit") * 1024 * 1024;
+		}
+		if(serv->idle_timeout < 0 || serv->input_limit < 0
+			|| serv->output_high < 0 || serv->output_limit < 0)
+		{
+			log_fatal("invalid idle_timeout or client_input_limit/output_high/output_limit");
+			fprintf(stderr, "invalid idle_timeout or client_input_limit/output_high/output_limit\n");
+			exit(1);
+		}
+		log_info("idle_timeout: %d s, client input limit: %d MB, output high: %d MB, output limit: %d MB",
+			serv->idle_timeout, serv->input_limit/1024/1024,
+			serv->output_high/1024/1024, serv->output_limit/1024/1024);
+	}
+
+	{ // slowlog
+		double threshold = SlowLog::DEFAULT_THRESHOLD;
+		int max_len = SlowLog::DEFAULT_MAX_LEN;
+		if(conf.get("server.slowlog_threshold")){
+			threshold = conf.get_num("server.slowlog_threshold");
+		}
+		if(conf.get("server.slowlog_max_len")){
+			max_len = conf.get_num("server.slowlog_max_len");
+		}
+		serv->slowlog.set_threshold(threshold);
+		serv->slowlog.set_max_len(max_len);
+		log_info("slowlog threshold: %.0f ms, max_len: %d", threshold, max_len);
+	}
+
+	{ // 客户端缓存, 每个连接最多跟踪的 key 数
+		int max_keys = TRACKING_MAX_KEYS;
+		if(conf.get("server.tracking_max_keys")){
+			max_keys = conf.get_num("server.tracking_max_keys");
+		}
+		if(max_keys <= 0){
+			log_fatal("invalid tracking_max_keys");
+			fprintf(stderr, "invalid tracking_max_keys\n");
+			exit(1);
+		}
+		serv->tracking = new Tracking(max_keys);
+		log_info("tracking_max_keys: %d", max_keys);
+	}
 	return serv;
 }
 
 // 开始提供服务
 void NetworkServer::serve(){
+	// 命令都已注册, 构造命令查找表
+	proc_map.build_index();
+
     // 创建写工作池和读工作池，并调用start开始工作
 	writer = new ProcWorkerPool("writer");
 	writer->start(num_writers);
+	// 管理类的写命令可能运行几个小时, 使用单独的线程, 不占用写线程. 它们
+	// 的写操作在 Transaction 中, 持有 binlog 的锁, 不依赖写线程的串行化
+	admin_writer = new ProcWorkerPool("admin_writer");
+	admin_writer->start(ADMIN_WRITER_THREADS);
 
-	reader = new ProcWorkerPool("reader");
+	// scan 和 admin 类的命令最多占用 num_scan_readers 个读线程(默认 1/3),
+	// 其余的线程总是可以处理 point 和 multi 类的命令
+	reader = new ProcReaderPool("reader");
+	reader->set_class(Command::COST_POINT, "point", false);
+	reader->set_class(Command::COST_MULTI, "multi", false);
+	reader->set_class(Command::COST_SCAN, "scan", true);
+	reader->set_class(Command::COST_ADMIN, "admin", true);
+	if(num_scan_readers <= 0){
+		num_scan_readers = num_readers / 3;
+	}
+	reader->set_heavy_threads(num_scan_readers);
 	reader->start(num_readers);
+	log_info("readers: %d, scan readers: %d, writers: %d",
+		num_readers, num_scan_readers, num_writers);
 
     // ready_list_t是网络连接列表
 	ready_list_t ready_list;
 	ready_list_t ready_list_2;
 	ready_list_t::iterator it;
 	const Fdevents::events_t *events;
+	std::vector<ProcJob> done_jobs;
 
     // 使用事件监听器开始监听各个文件描述符上的事件，将各个对象作为数据传入事件监听器中，在
     // 事件触发时将会把数据带回来，也就是把连接对象的指针或者工作池的指针带回来
     // 对于server link，也就是服务器监听的连接，我们关心数据流入的事件
 	fdes->set(serv_link->fd(), FDEVENT_IN, 0, serv_link);
+	if(unix_link){
+		fdes->set(unix_link->fd(), FDEVENT_IN, 0, unix_link);
+	}
 	// 对于读工作池和写工作池，也只关心数据流入的事件
 	fdes->set(this->reader->fd(), FDEVENT_IN, 0, this->reader);
 	fdes->set(this->writer->fd(), FDEVENT_IN, 0, this->writer);
+	fdes->set(this->admin_writer->fd(), FDEVENT_IN, 0, this->admin_writer);
+	fdes->set(this->tracking->fd(), FDEVENT_IN, 0, this->tracking);
 	// TODO 为啥数据长度是0？
+
+	// 时钟周期的定时器
+#ifdef HAVE_TIMERFD
+	timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if(timer_fd != -1){
+		struct itimerspec ts;
+		ts.it_interval.tv_sec = TICK_INTERVAL / 1000;
+		ts.it_interval.tv_nsec = (TICK_INTERVAL % 1000) * 1000000;
+		ts.it_value = ts.it_interval;
+		timerfd_settime(timer_fd, 0, &ts, NULL);
+		fdes->set(timer_fd, FDEVENT_IN, 0, &this->timer_fd);
+	}else{
+		log_error("timerfd_create error: %s", strerror(errno));
+	}
+#endif
+	clock_tick();
+	last_tick_us = clock_mono_us();
 	
-	uint32_t last_ticks = g_ticks;
+	uint32_t last_ticks = ticks;
+	uint32_t adjust_ticks = ticks;
 	
 	// 没有接收到退出信号的情况下，无限循环处理请求
 	while(!quit){
+		// 关闭空闲超时的连接. ready_list_2 中的连接可能刚刚又收到了请求
+		if(idle_timeout > 0 && timers.now() != ticks){
+			this->check_idle(ready_list_2);
+		}
+		// 没有 timerfd 时, 每次循环检查是否过了一个时钟周期, 事件等待的
+		// 超时时间(50ms)保证检查的间隔
+		if(timer_fd == -1){
+			uint64_t now = clock_mono_us();
+			if(now - last_tick_us >= TICK_INTERVAL * 1000){
+				this->tick((now - last_tick_us) / (TICK_INTERVAL * 1000));
+				last_tick_us = now;
+			}
+		}
 		// status report
 		// 需要汇报的时候，把连接状态写到日志里
-		if((uint32_t)(g_ticks - last_ticks) >= STATUS_REPORT_TICKS){
-			last_ticks = g_ticks;
+		if((uint32_t)(ticks - last_ticks) >= STATUS_REPORT_TICKS){
+			last_ticks = ticks;
 			log_info("server running, links: %d", this->link_count);
 		}
+		if((uint32_t)(ticks - adjust_ticks) >= POOL_ADJUST_TICKS){
+			adjust_ticks = ticks;
+			this->adjust_pools();
+			this->release_idle_buffers();
+		}
 		
 		// ready_list中存储的是需要立即处理的客户端连接，ready_list_2中存储的是
 		// 在向客户端发送响应后还需要进行处理的客户端连接（也就是发送完响应后立即就有了新的请求）。
 		ready_list.swap(ready_list_2);
 		ready_list_2.clear();
+		if(!closing_links.empty()){
+			this->reap_links(ready_list);
+		}
 		
 		// 从事件监听器获取已经raedy的事件
 		// ready_list非空说明还有一些上一次处理后产生的新的请求需要处理，这时不等待
@@ -254,13 +464,20 @@ void NetworkServer::serve(){
 		for(int i=0; i<(int)events->size(); i++){
 		    // 获取事件指针
 			const Fdevent *fde = events->at(i);
-			if(fde->data.ptr == serv_link){
+			if(fde->data.ptr == &this->timer_fd){
+				uint64_t n;
+				if(::read(timer_fd, &n, sizeof(n)) == sizeof(n)){
+					this->tick((uint32_t)n);
+				}
+			}else if(fde->data.ptr == serv_link || (unix_link && fde->data.ptr == unix_link)){
 			    // 如果是服务器连接事件
 			    // 接收连接，接收连接也就是创建了一个新的服务端和客户端之间的连接，注意
 			    // 将这个连接和服务器监听的连接区分开来
-				Link *link = accept_link();
+				Link *link = accept_link((Link *)fde->data.ptr);
 				if(link){
-					this->link_count ++;				
+					this->link_count ++;
+					links.insert(link);
+					start_timer(link);
 					log_debug("new link from %s:%d, fd: %d, links: %d",
 						link->remote_ip, link->remote_port, link->fd(), this->link_count);
 					// 设置事件监听，开始监听客户端连接的数据流入的事件
@@ -268,19 +485,50 @@ void NetworkServer::serve(){
 	                // TODO 为啥数据长度是1？
 					fdes->set(link->fd(), FDEVENT_IN, 1, link);
 				}
-			}else if(fde->data.ptr == this->reader || fde->data.ptr == this->writer){
+			}else if(fde->data.ptr == this->tracking){
+				// 有失效通知要推送
+				tracking->take_ready(&tracking_links);
+				for(int j=0; j<(int)tracking_links.size(); j++){
+					Link *link = tracking_links[j];
+					if(!link->busy && !link->error()){
+						this->push_tracking(link);
+					}
+				}
+			}else if(fde->data.ptr == this->reader || fde->data.ptr == this->writer
+				|| fde->data.ptr == this->admin_writer)
+			{
 			    // 如果是工作池的事件
 			    // 获取工作池指针，也就是事件的数据
-				ProcWorkerPool *worker = (ProcWorkerPool *)fde->data.ptr;
-				ProcJob job;
-				// 拿出待处理的任务
-				if(worker->pop(&job) == 0){
-					log_fatal("reading result from workers error!");
-					exit(0);
+				// 一次唤醒取走所有已完成的任务
+				done_jobs.clear();
+				PoolSizer *sizer;
+				if(fde->data.ptr == this->reader){
+					reader->pop_all(&done_jobs);
+					sizer = &reader_sizer;
+				}else if(fde->data.ptr == this->writer){
+					writer->pop_all(&done_jobs);
+					sizer = &writer_sizer;
+				}else{
+					admin_writer->pop_all(&done_jobs);
+					sizer = NULL;
+				}
+				for(int j=0; j<(int)done_jobs.size(); j++){
+					// scan/admin 类命令的排队时间由 scan_readers 决定, 加线程没有用
+					if(sizer && done_jobs[j].cmd->cost <= Command::COST_MULTI){
+						sizer->add_wait(done_jobs[j].time_wait);
+					}
+					if(done_jobs[j].preq){
+						proc_result_v2(&done_jobs[j]);
+						continue;
+					}
+					done_jobs[j].link->busy = false;
+					// 处理任务
+					if(proc_result(&done_jobs[j], &ready_list) == PROC_ERROR){
+						//
+					}
 				}
-				// 处理任务
-				if(proc_result(&job, &ready_list) == PROC_ERROR){
-					//
+				if(!v2_links.empty()){
+					this->flush_v2_links(&ready_list);
 				}
 			}else{
 			    // 其他情况下，是客户端连接的数据，也就是请求命令，处理之
@@ -298,46 +546,86 @@ void NetworkServer::serve(){
 		    // 拿到连接
 			Link *link = *it;
 			if(link->error()){
-				this->link_count --;
-				fdes->del(link->fd());
-				delete link;
+				this->close_link(link);
+				continue;
+			}
+			// v2 协议的连接在暂停之前可能已经在 ready_list 中
+			if(link->paused){
 				continue;
 			}
 
-            // 把输入数据封装成请求对象，在recv中会将输入缓冲区的数据读取出来，并解析成请求对象
-            // 请求对象实际上就是个Bytes数组
-            // 在link中也保存了请求数据，所以这的request对象没用到，直接从link里读取了
-			const Request *req = link->recv();
-			if(req == NULL){
-				log_warn("fd: %d, link parse error, delete link", link->fd());
-				this->link_count --;
-				fdes->del(link->fd());
-				delete link;
+			// 客户端可能一次发送了多个请求(流水线). 直接运行的命令连续处理
+			// 输入缓冲区中所有完整的请求, 响应都追加到输出缓冲区, 最后一次
+			// 写到网络; 遇到线程命令时交给工作池(后续同类请求也一并交给它,
+			// 见 proc()), 剩下的请求等工作线程返回后再处理.
+			ProcJob job;
+			int num = 0;
+			bool parse_error = false;
+			while(num < PIPELINE_BATCH_SIZE){
+	            // 把输入数据封装成请求对象，在recv中会将输入缓冲区的数据读取出来，并解析成请求对象
+	            // 请求对象实际上就是个Bytes数组
+	            // 在link中也保存了请求数据，所以这的request对象没用到，直接从link里读取了
+				const Request *req = link->recv();
+				if(req == NULL){
+					parse_error = true;
+					break;
+				}
+				if(req->empty()){
+					break;
+				}
+				// 记录一个时间
+				link->active_time = clock_coarse();
+
+	            // 创建一个任务
+				job = ProcJob();
+				job.link = link;
+				// 处理任务。如果是线程任务，则将任务放到工作池中。如果是直接运行的命令，则运行
+				// 处理函数，并将结果发送到输出缓冲区中
+				this->proc(&job);
+				num ++;
+				if(job.result != PROC_OK){
+					break;
+				}
+				// 响应太多, 先写出去再处理后面的请求
+				if(output_high > 0 && link->output->size() >= output_high){
+					break;
+				}
+				if(link->inflight >= V2_MAX_INFLIGHT){
+					break;
+				}
+			}
+			if(parse_error){
+				if(input_limit > 0 && link->input->total() >= input_limit){
+					log_warn("fd: %d, %s:%d, input buffer exceeds %d MB, delete link",
+						link->fd(), link->remote_ip, link->remote_port, input_limit/1024/1024);
+				}else{
+					log_warn("fd: %d, link parse error, delete link", link->fd());
+				}
+				this->close_link(link);
 				continue;
 			}
-			// 没有输入数据，为啥还需要重新监听输入连接呢？？ TODO
-			if(req->empty()){
+			// 没有完整的请求, 继续等待输入
+			if(num == 0){
 				fdes->set(link->fd(), FDEVENT_IN, 1, link);
 				continue;
 			}
-			
-			// 记录一个时间
-			link->active_time = millitime();
-
-            // 创建一个任务
-			ProcJob job;
-			job.link = link;
-			// 处理任务。如果是线程任务，则将任务放到工作池中。如果是直接运行的命令，则运行
-			// 处理函数，并将结果发送到输出缓冲区中，等待下一次事件触发的时候处理
-			this->proc(&job);
 			// 如果是线程命令，没必要再监听客户端连接的事件了，将监听删除
+			// 工作线程处理的时间不算空闲, 返回之后重新计时
 			if(job.result == PROC_THREAD){
+				link->busy = true;
 				fdes->del(link->fd());
+				timers.del(&link->timer);
 				continue;
 			}
 			// 如果是后台运行的命令，不仅不需要再监听事件，连连接数量也减少了
 			if(job.result == PROC_BACKEND){
+				if(link->tracking){
+					tracking->disable(link);
+					link->tracking = false;
+				}
 				fdes->del(link->fd());
+				timers.del(&link->timer);
+				links.erase(link);
 				this->link_count --;
 				continue;
 			}
@@ -352,21 +640,23 @@ void NetworkServer::serve(){
 }
 
 // 接收客户端的连接请求，并创建一个新的客户端连接返回。注意将客户端连接和服务端的连接区分开来
-Link* NetworkServer::accept_link(){
-	Link *link = serv_link->accept();
+Link* NetworkServer::accept_link(Link *listener){
+	Link *link = listener->accept();
 	if(link == NULL){
 		log_error("accept failed! %s", strerror(errno));
 		return NULL;
 	}
-	if(!ip_filter->check_pass(link->remote_ip)){
-		log_debug("ip_filter deny link from %s:%d", link->remote_ip, link->remote_port);
-		delete link;
-		return NULL;
+	if(!link->is_unix()){
+		if(!ip_filter->check_pass(link->remote_ip)){
+			log_debug("ip_filter deny link from %s:%d", link->remote_ip, link->remote_port);
+			delete link;
+			return NULL;
+		}
+		link->nodelay();
 	}
-				
-	link->nodelay();
 	link->noblock();
-	link->create_time = millitime();
+	link->input_limit = input_limit;
+	link->create_time = clock_coarse();
 	link->active_time = link->create_time;
 	return link;
 }
@@ -384,15 +674,14 @@ int NetworkServer::proc_result(ProcJob *job, ready_list_t *ready_list){
 	Link *link = job->link;
 	int len;
 			
-	if(job->cmd){
-		job->cmd->calls += 1;
-		job->cmd->time_wait += job->time_wait;
-		job->cmd->time_proc += job->time_proc;
-	}
 	if(job->result == PROC_ERROR){
 		log_info("fd: %d, proc error, delete link", link->fd());
 		goto proc_err;
 	}
+	// 在工作线程中时没有推送的失效通知, 跟在响应之后
+	if(link->tracking){
+		this->push_tracking(link);
+	}
 	
 	// 将输出缓冲区的数据写到网络传输，也就是把响应结果发送出去了
 	len = link->write();
@@ -402,13 +691,44 @@ int NetworkServer::proc_result(ProcJob *job, ready_list_t *ready_list){
 		goto proc_err;
 	}
 
+	if(output_limit > 0 && link->output->size() > output_limit){
+		log_warn("fd: %d, %s:%d, output buffer exceeds %d MB, delete link",
+			link->fd(), link->remote_ip, link->remote_port, output_limit/1024/1024);
+		goto proc_err;
+	}
+	if(!link->timer.active()){
+		start_timer(link);
+	}
+	// v2 协议的连接在工作线程中的请求太多, 等返回一部分之后再继续, 见
+	// flush_v2_links()
+	if(link->inflight >= V2_MAX_INFLIGHT){
+		link->paused = true;
+		fdes->clr(link->fd(), FDEVENT_IN);
+		if(!link->output->empty()){
+			fdes->set(link->fd(), FDEVENT_OUT, 1, link);
+		}
+		return PROC_OK;
+	}
+
     // 输出缓冲区非空，说明没有发送完？为啥还要继续监听数据流出的事件？
     // 这时监听数据流出的事件，当socket重新变成非block、可写的状态的时候，再
     // 继续将输出缓冲区中的数据写到socket，直到全部写完。
 	if(!link->output->empty()){
 		fdes->set(link->fd(), FDEVENT_OUT, 1, link);
+		// 客户端读得太慢, 暂停读取和处理它的请求, 不让输出缓冲区继续增长.
+		// 输出写到低水位以下时恢复, 见 proc_client_event()
+		if(output_high > 0 && link->output->size() >= output_high){
+			link->paused = true;
+			fdes->clr(link->fd(), FDEVENT_IN);
+			return PROC_OK;
+		}
+	}else{
+		// 之前暂停过的连接可能还在监听数据流出
+		fdes->clr(link->fd(), FDEVENT_OUT);
 	}
 	if(link->input->empty()){
+		// 请求都已处理完, 把空的缓冲区还给内存池
+		link->shrink();
 	    // 输入已经为空，继续监听数据流入事件
 		fdes->set(link->fd(), FDEVENT_IN, 1, link);
 	}else{
@@ -419,10 +739,76 @@ int NetworkServer::proc_result(ProcJob *job, ready_list_t *ready_list){
 	return PROC_OK;
 
 proc_err:
-	this->link_count --;
+	this->close_link(link);
+	return PROC_ERROR;
+}
+
+void NetworkServer::close_link(Link *link){
+	if(link->tracking){
+		tracking->disable(link);
+		link->tracking = false;
+	}
 	fdes->del(link->fd());
+	timers.del(&link->timer);
+	if(link->proto() == Link::PROTO_V2){
+		link->mark_error();
+		closing_links.insert(link);
+		return;
+	}
+	this->link_count --;
+	links.erase(link);
 	delete link;
-	return PROC_ERROR;
+}
+
+// pending 中的连接还会被处理一次(再次调用 close_link()), 等下一次循环
+void NetworkServer::reap_links(const ready_list_t &pending){
+	std::set<Link *>::iterator it = closing_links.begin();
+	while(it != closing_links.end()){
+		Link *link = *it;
+		if(link->inflight > 0 || std::find(pending.begin(), pending.end(), link) != pending.end()){
+			it ++;
+			continue;
+		}
+		closing_links.erase(it++);
+		this->link_count --;
+		links.erase(link);
+		delete link;
+	}
+}
+
+// 文本协议的推送插在两个响应之间, v2 协议的推送的 id 是 0. 在下一次
+// 可写时写到网络
+void NetworkServer::push_tracking(Link *link){
+	if(!tracking->take(link, &tracking_packet)){
+		return;
+	}
+	int ret;
+	if(link->proto() == Link::PROTO_V2){
+		ret = link->send_frame(0, tracking_packet);
+	}else{
+		ret = link->send(tracking_packet);
+	}
+	if(ret == -1){
+		link->mark_error();
+		return;
+	}
+	fdes->set(link->fd(), FDEVENT_OUT, 1, link);
+}
+
+bool NetworkServer::can_resume(const Link *link) const{
+	if(output_high > 0 && link->output->size() > output_high / 2){
+		return false;
+	}
+	return link->inflight <= V2_MAX_INFLIGHT / 2;
+}
+
+void NetworkServer::resume_link(Link *link, ready_list_t *ready_list){
+	link->paused = false;
+	if(link->input->empty()){
+		fdes->set(link->fd(), FDEVENT_IN, 1, link);
+	}else{
+		ready_list->push_back(link);
+	}
 }
 
 /*
@@ -484,11 +870,24 @@ int NetworkServer::proc_client_event(const Fdevent *fde, ready_list_t *ready_lis
 		if(len <= 0){
 			log_debug("fd: %d, write: %d, delete link", link->fd(), len);
 			link->mark_error();
+			// 暂停的连接不在 ready_list 中, 也不监听数据流入, 在这里交给
+			// ready_list 关闭
+			if(link->paused){
+				link->paused = false;
+				fdes->clr(link->fd(), FDEVENT_OUT);
+				ready_list->push_back(link);
+			}
 			return 0;
 		}
+		link->active_time = clock_coarse();
 		// 如果已经写完的话，不需要在关心这个文件描述符的数据流出事件了
 		if(link->output->empty()){
 			fdes->clr(link->fd(), FDEVENT_OUT);
+			link->shrink();
+		}
+		// 输出降到低水位以下, 恢复处理请求
+		if(link->paused && can_resume(link)){
+			resume_link(link, ready_list);
 		}
 	}
 	return 0;
@@ -501,7 +900,7 @@ int NetworkServer::proc_client_event(const Fdevent *fde, ready_list_t *ready_lis
 void NetworkServer::proc(ProcJob *job){
 	job->serv = this;
 	job->result = PROC_OK;
-	job->stime = millitime();
+	job->stime = clock_cycles();
 
     // 获取到之前从客户端连接读取到的数据
 	const Request *req = job->link->last_recv();
@@ -525,25 +924,48 @@ void NetworkServer::proc(ProcJob *job){
 			break;
 		}
 		job->cmd = cmd;
+
+		// v2 协议的连接同时有多个请求在执行, 线程命令各自交给工作线程,
+		// 不等待它们返回; 连接不能交给后台线程
+		if(job->link->proto() == Link::PROTO_V2){
+			if(cmd->flags & Command::FLAG_BACKEND){
+				resp.push_back("client_error");
+				resp.push_back("command not supported by protocol v2");
+				break;
+			}
+			if(cmd->flags & Command::FLAG_THREAD){
+				this->proc_v2(job, cmd, *req);
+				return;
+			}
+		}
 		
 		// 如果是在线程中运行的命令，则将命令添加的读工作池或者写工作池就可以了，
 		// 接下来工作池中会去处理对应的命令
+		// 输入缓冲区中紧接着的、由同一个工作池处理的请求一起交给工作线程,
+		// 只需要一次入队和一次唤醒
 		if(cmd->flags & Command::FLAG_THREAD){
+			this->collect_pipeline(job->link, cmd);
 			if(cmd->flags & Command::FLAG_WRITE){
 				job->result = PROC_THREAD;
-				writer->push(*job);
+				this->writer_of(cmd)->push(*job);
 			}else{
 				job->result = PROC_THREAD;
-				reader->push(*job);
+				reader->push(*job, cmd->cost);
 			}
 			return;
 		}
 
         // 直接运行的命令，调用命令处理函数，获取到返回结果，放到resp中
 		proc_t p = cmd->proc;
-		job->time_wait = 1000 * (millitime() - job->stime);
+		uint64_t now = clock_cycles();
+		job->time_wait = clock_cycles_to_ms(now - job->stime);
 		job->result = (*p)(this, job->link, *req, &resp);
-		job->time_proc = 1000 * (millitime() - job->stime) - job->time_wait;
+		job->time_proc = clock_cycles_to_ms(clock_cycles() - now);
+		// 统计在执行命令的线程中更新, 见 Command::add_stat()
+		cmd->add_stat(job->time_wait, job->time_proc);
+		if(slowlog.need_log(job->time_wait, job->time_proc)){
+			slowlog.add(job->link, *req, job->time_wait, job->time_proc);
+		}
 	}while(0);
 	
 	// 将执行结果发送出去，在send中会将数据发送到输出缓冲区，下一个时钟周期则会将数据发送到网络
@@ -560,6 +982,275 @@ void NetworkServer::proc(ProcJob *job){
 	}
 }
 
+// 写命令由写线程执行, 管理类的写命令由 admin_writer 执行
+ProcWorkerPool* NetworkServer::writer_of(const Command *cmd){
+	if(cmd->cost == Command::COST_ADMIN){
+		return admin_writer;
+	}
+	return writer;
+}
+
+// 从输入缓冲区中取出紧接在当前请求之后、与 cmd 由同一个工作池处理(并且
+// 开销类别相同)的完整请求, 放到 link->pipeline 中. 请求指向输入缓冲区, 在工作线程
+// 返回之前输入缓冲区不会被读写, 所以一直有效. redis 请求改写过的参数保存在
+// RedisLink 中, 见 Link::parse_next().
+void NetworkServer::collect_pipeline(Link *link, const Command *cmd){
+	link->pipeline_size = 0;
+	if(this->need_auth && link->auth == false){
+		return;
+	}
+	const int mask = Command::FLAG_THREAD | Command::FLAG_WRITE;
+	while(link->pipeline_size < PIPELINE_BATCH_SIZE - 1){
+		if((int)link->pipeline.size() <= link->pipeline_size){
+			link->pipeline.resize(link->pipeline_size + 1);
+		}
+		Request *req = &link->pipeline[link->pipeline_size];
+		req->clear();
+		int len = link->parse_next(link->pipeline_size, req);
+		// 不完整的或者出错的请求留给 recv() 处理
+		if(len <= 0 || req->empty()){
+			break;
+		}
+		const Command *c = proc_map.get_proc(req->at(0));
+		if(!c || (c->flags & mask) != (cmd->flags & mask) || c->cost != cmd->cost){
+			break;
+		}
+		link->input->decr(len);
+		link->pipeline_size ++;
+	}
+}
+
+
+void NetworkServer::proc_v2(ProcJob *job, Command *cmd, const Request &req){
+	Link *link = job->link;
+	ProcRequest *preq = new ProcRequest();
+	preq->id = link->recv_id;
+	int size = 0;
+	for(int i=0; i<(int)req.size(); i++){
+		size += req[i].size();
+	}
+	// 预留空间之后 data 不会被重新分配, req 指向它
+	preq->data.reserve(size);
+	preq->req.reserve(req.size());
+	for(int i=0; i<(int)req.size(); i++){
+		const char *p = preq->data.data() + preq->data.size();
+		preq->data.append(req[i].data(), req[i].size());
+		preq->req.push_back(Bytes(p, req[i].size()));
+	}
+	job->preq = preq;
+	job->result = PROC_THREAD;
+	link->inflight ++;
+	if(cmd->flags & Command::FLAG_WRITE){
+		this->writer_of(cmd)->push(*job);
+	}else{
+		reader->push(*job, cmd->cost);
+	}
+	job->preq = NULL;
+	job->result = PROC_OK;
+}
+
+void NetworkServer::proc_result_v2(ProcJob *job){
+	Link *link = job->link;
+	ProcRequest *preq = job->preq;
+	link->inflight --;
+	if(!link->error()){
+		if(job->result == PROC_ERROR || link->send_frame(preq->id, preq->resp.resp) == -1){
+			log_info("fd: %d, proc error, delete link", link->fd());
+			this->close_link(link);
+		}else{
+			if(log_level() >= Logger::LEVEL_DEBUG){
+				log_debug("w:%.3f,p:%.3f, id: %u, req: %s, resp: %s",
+					job->time_wait, job->time_proc, preq->id,
+					serialize_req(preq->req).c_str(),
+					serialize_req(preq->resp.resp).c_str());
+			}
+			v2_links.push_back(link);
+		}
+	}
+	delete preq;
+}
+
+// 一个连接可能在 v2_links 中出现多次, 之后的 write() 什么也不做
+void NetworkServer::flush_v2_links(ready_list_t *ready_list){
+	for(int i=0; i<(int)v2_links.size(); i++){
+		Link *link = v2_links[i];
+		if(link->error()){
+			continue;
+		}
+		if(link->write() < 0){
+			log_debug("fd: %d, write error, delete link", link->fd());
+			this->close_link(link);
+			continue;
+		}
+		if(output_limit > 0 && link->output->size() > output_limit){
+			log_warn("fd: %d, %s:%d, output buffer exceeds %d MB, delete link",
+				link->fd(), link->remote_ip, link->remote_port, output_limit/1024/1024);
+			this->close_link(link);
+			continue;
+		}
+		if(!link->output->empty()){
+			fdes->set(link->fd(), FDEVENT_OUT, 1, link);
+			if(!link->paused && output_high > 0 && link->output->size() >= output_high){
+				link->paused = true;
+				fdes->clr(link->fd(), FDEVENT_IN);
+			}
+		}
+		if(link->paused && can_resume(link)){
+			resume_link(link, ready_list);
+		}
+	}
+	v2_links.clear();
+}
+
+void NetworkServer::start_timer(Link *link){
+	if(idle_timeout > 0){
+		timers.add(&link->timer, (uint64_t)idle_timeout * 1000 / TICK_INTERVAL);
+	}
+}
+
+void NetworkServer::check_idle(const ready_list_t &pending){
+	expired_timers.clear();
+	timers.advance(ticks, &expired_timers);
+	double now = clock_coarse();
+	for(int i=0; i<(int)expired_timers.size(); i++){
+		Link *link = (Link *)expired_timers[i]->data;
+		double idle = now - link->active_time;
+		if(idle < idle_timeout){
+			// 期间有过请求, 按最后活跃的时间重新计时
+			timers.add(&link->timer, (uint64_t)((idle_timeout - idle) * 1000 / TICK_INTERVAL));
+			continue;
+		}
+		// 还有请求要处理, 或者有 v2 请求在工作线程中
+		if(link->inflight > 0 || std::find(pending.begin(), pending.end(), link) != pending.end()){
+			start_timer(link);
+			continue;
+		}
+		log_info("fd: %d, %s:%d, idle %d s, delete link",
+			link->fd(), link->remote_ip, link->remote_port, (int)idle);
+		this->close_link(link);
+	}
+}
+
+void NetworkServer::tick(uint32_t n){
+	ticks += n;
+	clock_tick();
+}
+
+void NetworkServer::release_idle_buffers(){
+	double now = clock_coarse();
+	std::set<Link *>::iterator it;
+	for(it=links.begin(); it!=links.end(); it++){
+		Link *link = *it;
+		// 工作线程可能正在写输出缓冲区
+		if(link->busy || link->inflight > 0){
+			continue;
+		}
+		if(now - link->active_time >= BUFFER_IDLE_SECONDS){
+			link->release_buffers();
+		}
+	}
+}
+
+void NetworkServer::adjust_pools(){
+	double now = clock_mono_us() / 1000000.0;
+	struct rusage ru;
+	getrusage(RUSAGE_SELF, &ru);
+	double cpu_time = ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1000000.0
+		+ ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1000000.0;
+	if(sizer_time == 0){
+		sizer_time = now;
+		sizer_cpu = cpu_time;
+		return;
+	}
+	double interval = now - sizer_time;
+	if(interval <= 0){
+		return;
+	}
+	static const long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	double cpu = (cpu_time - sizer_cpu) / interval / (num_cpus > 0? num_cpus : 1);
+	sizer_time = now;
+	sizer_cpu = cpu_time;
+
+	int size = reader->size();
+	int n = reader_sizer.adjust(size, reader->busy_time(), interval * 1000000, cpu);
+	if(n != size){
+		n = reader->resize(n);
+		log_info("readers: %d -> %d, wait: %.3f ms, util: %.2f, cpu: %.2f",
+			size, n, reader_sizer.avg_wait(), reader_sizer.utilization(), cpu);
+	}
+	size = writer->size();
+	n = writer_sizer.adjust(size, writer->busy_time(), interval * 1000000, cpu);
+	if(n != size){
+		n = writer->resize(n);
+		log_info("writers: %d -> %d, wait: %.3f ms, util: %.2f, cpu: %.2f",
+			size, n, writer_sizer.avg_wait(), writer_sizer.utilization(), cpu);
+	}
+}
+
+void NetworkServer::resize_pools(){
+	if(reader == NULL){
+		return;
+	}
+	int size = reader->size();
+	if(reader_sizer.clamp(size) != size){
+		reader->resize(reader_sizer.clamp(size));
+		log_info("readers: %d -> %d", size, reader->size());
+	}
+	size = writer->size();
+	if(writer_sizer.clamp(size) != size){
+		writer->resize(writer_sizer.clamp(size));
+		log_info("writers: %d -> %d", size, writer->size());
+	}
+}
+
+std::vector<std::string> NetworkServer::pool_info() const{
+	std::vector<std::string> ret;
+	if(reader == NULL){
+		return ret;
+	}
+	char buf[128];
+	snprintf(buf, sizeof(buf), "threads: %d\tmin: %d\tmax: %d\twait: %.3f\tutil: %.2f",
+		reader->size(), reader_sizer.min(), reader_sizer.max(),
+		reader_sizer.avg_wait(), reader_sizer.utilization());
+	ret.push_back("readers");
+	ret.push_back(buf);
+	snprintf(buf, sizeof(buf), "threads: %d\tmin: %d\tmax: %d\twait: %.3f\tutil: %.2f",
+		writer->size(), writer_sizer.min(), writer_sizer.max(),
+		writer_sizer.avg_wait(), writer_sizer.utilization());
+	ret.push_back("writers");
+	ret.push_back(buf);
+	std::vector<std::string> tmp = reader->info();
+	ret.insert(ret.end(), tmp.begin(), tmp.end());
+	return ret;
+}
+
+std::vector<std::string> NetworkServer::client_list() const{
+	std::vector<std::string> ret;
+	double now = clock_coarse();
+	std::set<Link *>::const_iterator it;
+	for(it = links.begin(); it != links.end(); it++){
+		const Link *link = *it;
+		// 在工作线程中的连接的缓冲区可能正在变化, 只用于查看
+		const char *flags = "-";
+		if(link->paused){
+			flags = "paused";
+		}else if(!link->timer.active() && idle_timeout > 0){
+			flags = "busy";
+		}
+		char buf[256];
+		snprintf(buf, sizeof(buf),
+			"addr: %s:%d\tfd: %d\tage: %d\tidle: %d\t"
+			"input: %d\tinput_mem: %d\toutput: %d\toutput_mem: %d\t"
+			"proto: %d\tinflight: %d\tflags: %s",
+			link->remote_ip, link->remote_port, link->fd(),
+			(int)(now - link->create_time), (int)(now - link->active_time),
+			link->input->size(), link->input->total(),
+			link->output->size(), link->output->total(),
+			link->proto(), link->inflight, flags);
+		ret.push_back(buf);
+	}
+	return ret;
+}
 
 /* built-in procs */
 
@@ -580,11 +1271,221 @@ static int proc_info(NetworkServer *net, Link *link, const Request &req, Respons
 		proc_map_t::iterator it;
 		for(it=net->proc_map.begin(); it!=net->proc_map.end(); it++){
 			Command *cmd = it->second;
-			calls += cmd->calls;
+			calls += cmd->calls();
 		}
 		resp->push_back("total_calls");
 		resp->add(calls);
 	}
+	{
+		std::vector<std::string> tmp = net->pool_info();
+		for(int i=0; i<(int)tmp.size(); i++){
+			resp->push_back(tmp[i]);
+		}
+	}
+	return 0;
+}
+
+// client list
+static int proc_client(NetworkServer *net, Link *link, const Request &req, Response *resp){
+	if(req.size() != 2 || req[1] != "list"){
+		resp->push_back("client_error");
+		resp->push_back("usage: client list");
+		return 0;
+	}
+	resp->push_back("ok");
+	std::vector<std::string> tmp = net->client_list();
+	for(int i=0; i<(int)tmp.size(); i++){
+		resp->push_back(tmp[i]);
+	}
+	return 0;
+}
+
+// proto 2
+// 切换到二进制协议(v2), 见 link_v2.cpp. 回复仍然使用文本协议
+// (send(Bytes, Bytes) 不分帧), 之后的请求和响应都是帧
+static int proc_proto(NetworkServer *net, Link *link, const Request &req, Response *resp){
+	if(req.size() != 2 || req[1] != "2"){
+		resp->push_back("client_error");
+		resp->push_back("usage: proto 2");
+		return 0;
+	}
+	if(link->proto() == Link::PROTO_V2){
+		resp->push_back("ok");
+		resp->push_back("2");
+		return 0;
+	}
+	if(link->set_proto(Link::PROTO_V2) == -1){
+		resp->push_back("client_error");
+		resp->push_back("protocol v2 not supported by this link");
+		return 0;
+	}
+	link->send("ok", "2");
+	return 0;
+}
+
+// tracking on|off
+// 开启之后, 连接读取过的 key 被修改时, 服务器推送失效通知, 见 tracking.h
+static int proc_tracking(NetworkServer *net, Link *link, const Request &req, Response *resp){
+	if(req.size() != 2 || (req[1] != "on" && req[1] != "off")){
+		resp->push_back("client_error");
+		resp->push_back("usage: tracking on|off");
+		return 0;
+	}
+	if(link->is_redis()){
+		resp->push_back("client_error");
+		resp->push_back("tracking not supported by redis protocol");
+		return 0;
+	}
+	if(req[1] == "on"){
+		net->tracking->enable(link);
+		link->tracking = true;
+	}else{
+		link->tracking = false;
+		net->tracking->disable(link);
+	}
+	resp->push_back("ok");
+	return 0;
+}
+
+// latency [name|reset]
+// 各命令等待时间和处理时间的分位数, 单位为微秒
+static int proc_latency(NetworkServer *net, Link *link, const Request &req, Response *resp){
+	if(req.size() > 1 && req[1] == "reset"){
+		proc_map_t::iterator it;
+		for(it=net->proc_map.begin(); it!=net->proc_map.end(); it++){
+			it->second->reset_histogram();
+		}
+		resp->push_back("ok");
+		return 0;
+	}
+	resp->push_back("ok");
+	// 每个线程有自己的直方图, 读取时合并, 见 Command::get_histogram()
+	Histogram w, p;
+	proc_map_t::iterator it;
+	for(it=net->proc_map.begin(); it!=net->proc_map.end(); it++){
+		Command *cmd = it->second;
+		if(req.size() > 1 && req[1] != cmd->name){
+			continue;
+		}
+		if(cmd->calls() == 0){
+			continue;
+		}
+		cmd->get_histogram(&w, &p);
+		if(w.count() == 0){
+			continue;
+		}
+		char buf[512];
+		snprintf(buf, sizeof(buf),
+			"calls: %" PRIu64 "\t"
+			"wait_p50: %" PRIu64 "\twait_p99: %" PRIu64 "\twait_p999: %" PRIu64 "\twait_max: %" PRIu64 "\t"
+			"proc_p50: %" PRIu64 "\tproc_p99: %" PRIu64 "\tproc_p999: %" PRIu64 "\tproc_max: %" PRIu64,
+			w.count(),
+			w.percentile(50), w.percentile(99), w.percentile(99.9), w.max(),
+			p.percentile(50), p.percentile(99), p.percentile(99.9), p.max());
+		resp->push_back("cmd." + cmd->name);
+		resp->push_back(buf);
+	}
+	return 0;
+}
+
+// slowlog [get [num]|len|reset]
+static int proc_slowlog(NetworkServer *net, Link *link, const Request &req, Response *resp){
+	std::string action = "get";
+	if(req.size() > 1){
+		action = req[1].String();
+	}
+	if(action == "len"){
+		resp->push_back("ok");
+		resp->add(net->slowlog.size());
+	}else if(action == "reset"){
+		net->slowlog.reset();
+		resp->push_back("ok");
+	}else if(action == "get"){
+		int num = 10;
+		if(req.size() > 2){
+			num = req[2].Int();
+		}
+		std::vector<SlowLogEntry> entries;
+		net->slowlog.get(num, &entries);
+		resp->push_back("ok");
+		for(int i=0; i<(int)entries.size(); i++){
+			const SlowLogEntry &e = entries[i];
+			char buf[256];
+			snprintf(buf, sizeof(buf),
+				"id: %" PRId64 "\ttime: %" PRId64 "\tclient: %s\twait: %.3f\tproc: %.3f\treq: ",
+				e.id, e.time, e.client.c_str(), e.time_wait, e.time_proc);
+			resp->push_back(buf + e.req);
+		}
+	}else{
+		resp->push_back("client_error");
+		resp->push_back("usage: slowlog [get [num]|len|reset]");
+	}
+	return 0;
+}
+
+// config get [name] | config set name value
+// 运行中可以修改的配置项
+static int proc_config(NetworkServer *net, Link *link, const Request &req, Response *resp){
+	std::string action;
+	if(req.size() > 1){
+		action = req[1].String();
+	}
+	if(action == "get"){
+		std::string name;
+		if(req.size() > 2){
+			name = req[2].String();
+		}
+		resp->push_back("ok");
+		const char *names[] = {"readers_min", "readers_max", "writers_min", "writers_max",
+			"slowlog_threshold", "slowlog_max_len"};
+		double values[] = {
+			(double)net->reader_sizer.min(), (double)net->reader_sizer.max(),
+			(double)net->writer_sizer.min(), (double)net->writer_sizer.max(),
+			net->slowlog.get_threshold(), (double)net->slowlog.get_max_len()};
+		for(int i=0; i<(int)(sizeof(names)/sizeof(names[0])); i++){
+			if(!name.empty() && name != names[i]){
+				continue;
+			}
+			resp->push_back(names[i]);
+			resp->add(str(values[i]));
+		}
+		return 0;
+	}
+	if(action != "set" || req.size() != 4){
+		resp->push_back("client_error");
+		resp->push_back("usage: config get [name] | config set name value");
+		return 0;
+	}
+	std::string name = req[2].String();
+	if(name == "slowlog_threshold"){
+		net->slowlog.set_threshold(req[3].Double());
+	}else if(name == "slowlog_max_len"){
+		net->slowlog.set_max_len(req[3].Int());
+	}else if(name == "readers_min" || name == "readers_max"
+		|| name == "writers_min" || name == "writers_max")
+	{
+		PoolSizer *sizer = name[0] == 'r'? &net->reader_sizer : &net->writer_sizer;
+		int min = sizer->min();
+		int max = sizer->max();
+		int val = req[3].Int();
+		if(name.compare(name.size() - 3, 3, "min") == 0){
+			min = val;
+		}else{
+			max = val;
+		}
+		if(max > WORKER_POOL_MAX_WORKERS || sizer->set_range(min, max) == -1){
+			resp->push_back("client_error");
+			resp->push_back("invalid value");
+			return 0;
+		}
+		net->resize_pools();
+		log_info("config set %s %d", name.c_str(), val);
+	}else{
+		resp->push_back("client_error");
+		resp->push_back("unknown config: " + name);
+		return 0;
+	}
+	resp->push_back("ok");
 	return 0;
 }
 
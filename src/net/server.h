@@ -9,10 +9,15 @@ found in the LICENSE file.
 #include "../include.h"
 #include <string>
 #include <vector>
+#include <set>
 
 #include "fde.h"
 #include "proc.h"
 #include "worker.h"
+#include "slowlog.h"
+#include "pool_sizer.h"
+#include "timer_wheel.h"
+#include "tracking.h"
 
 class Link;
 class Config;
@@ -30,33 +35,99 @@ private:
 	int tick_interval;
 	// 这个不知道是什么
 	int status_report_ticks;
+	// 经过的时钟周期数, 由定时器驱动
+	uint32_t ticks;
+	uint64_t last_tick_us;
+	// 定时器(timerfd), 不支持时为 -1
+	int timer_fd;
+	// 过了 n 个时钟周期, 更新缓存的时间
+	void tick(uint32_t n);
 
 	//Config *conf;
 	// 服务端的连接对象指针
 	Link *serv_link;
+	// unix socket 的监听连接和路径, 没有配置时为 NULL. 从它接收的连接
+	// 不经过 ip_filter, 由文件的权限控制访问
+	Link *unix_link;
+	std::string unix_path;
 	// IP过滤器，应该用于访问限制
 	IpFilter *ip_filter;
 	// 事件对象指针
 	Fdevents *fdes;
+	// 所有的客户端连接, 包括在工作线程中的, 交给后台线程的不算
+	std::set<Link *> links;
+
+	// 空闲超过 idle_timeout 秒的连接被关闭, 0: 不关闭
+	int idle_timeout;
+	// 空闲超时的时间轮, 以时钟周期计时. 在工作线程中的连接不计时
+	TimerWheel timers;
+	std::vector<TimerNode *> expired_timers;
+	// 关闭空闲超时的连接, pending 中的连接还有请求要处理, 不关闭
+	void check_idle(const ready_list_t &pending);
+	void start_timer(Link *link);
+
+	// 每个连接的输入缓冲区的上限, 0: 不限制
+	int input_limit;
+	// 输出缓冲区超过 output_high 时暂停读取和处理这个连接的请求, 降到一半
+	// 以下时恢复; 超过 output_limit 时关闭连接. 0: 不限制
+	int output_high;
+	int output_limit;
+
+	// 从事件监听和连接列表中删除, 并释放连接
+	void close_link(Link *link);
+	// v2 协议的连接可能有请求在工作线程中, 或者重复出现在 ready_list 中,
+	// close_link() 只标记出错, 在下一次循环开始时释放, 见 reap_links()
+	std::set<Link *> closing_links;
+	void reap_links(const ready_list_t &pending);
+	// 工作线程返回了响应的 v2 连接, 处理完一批任务之后一起写到网络
+	ready_list_t v2_links;
+	void flush_v2_links(ready_list_t *ready_list);
+	// 把失效通知写到连接的输出缓冲区, 见 tracking.h. 文本协议的连接在
+	// 工作线程中时不写, 等返回之后再写
+	std::vector<Link *> tracking_links;
+	std::vector<std::string> tracking_packet;
+	void push_tracking(Link *link);
+	// 暂停的连接可以恢复处理请求
+	bool can_resume(const Link *link) const;
+	void resume_link(Link *link, ready_list_t *ready_list);
 
     // 接收客户端请求？
-	Link* accept_link();
+	Link* accept_link(Link *listener);
 	// 处理请求？
 	int proc_result(ProcJob *job, ready_list_t *ready_list);
+	// 工作线程执行完的 v2 请求, 把响应写到输出缓冲区
+	void proc_result_v2(ProcJob *job);
 	// 处理客户端事件
 	int proc_client_event(const Fdevent *fde, ready_list_t *ready_list);
 
     // 处理请求
 	void proc(ProcJob *job);
+	// 收集流水线中可以和当前请求一起交给工作线程的请求
+	void collect_pipeline(Link *link, const Command *cmd);
+	// 把 v2 协议的请求交给工作线程, 连接继续处理后面的请求
+	void proc_v2(ProcJob *job, Command *cmd, const Request &req);
 
     // 读线程数量
 	int num_readers;
 	// 写线程数量
 	int num_writers;
+	// 可以同时执行 scan/admin 类命令的读线程数
+	int num_scan_readers;
 	// 用于读操作的工作池
 	ProcWorkerPool *writer;
+	// 执行管理类写命令(开销类别为 admin 的写命令)的工作池
+	ProcWorkerPool *admin_writer;
+	ProcWorkerPool* writer_of(const Command *cmd);
 	// 用于写操作的工作池
-	ProcWorkerPool *reader;
+	ProcReaderPool *reader;
+
+	// 上次调整线程数的时间和进程的 CPU 时间, 秒
+	double sizer_time;
+	double sizer_cpu;
+	// 每秒调用一次, 根据排队时间和 CPU 使用率调整工作池的线程数
+	void adjust_pools();
+	// 每秒调用一次, 释放空闲了一段时间的连接的缓冲区
+	void release_idle_buffers();
 
     // 私有构造函数，初始化全部从init函数来初始化
 	NetworkServer();
@@ -76,6 +147,13 @@ public:
 	bool need_auth;
 	// 密码
 	std::string password;
+	// 慢请求日志
+	SlowLog slowlog;
+	// 客户端缓存的失效通知
+	Tracking *tracking;
+	// 读/写工作池线程数的范围, 见 resize_pools()
+	PoolSizer reader_sizer;
+	PoolSizer writer_sizer;
 
 	~NetworkServer();
 
@@ -84,6 +162,12 @@ public:
 	static NetworkServer* init(const Config &conf, int num_readers=-1, int num_writers=-1);
 	// 开始工作，开始接收请求
 	void serve();
+	// 修改了 reader_sizer/writer_sizer 的范围之后调用, 立即把线程数调整到范围内
+	void resize_pools();
+	// 工作池的线程数, 以及读线程池中各类命令的排队数和延迟, key-value 列表
+	std::vector<std::string> pool_info() const;
+	// 每个客户端连接一行: 地址, 连接时长, 空闲时间, 缓冲区大小等
+	std::vector<std::string> client_list() const;
 };
 
 
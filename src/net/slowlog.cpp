@@ -0,0 +1,77 @@
+/*
+Copyright (c) 2012-2014 The SSDB Authors. All rights reserved.
+Use of this source code is governed by a BSD-style license that can be
+found in the LICENSE file.
+*/
+#include <time.h>
+#include "slowlog.h"
+#include "link.h"
+
+SlowLog::SlowLog(){
+	threshold = DEFAULT_THRESHOLD;
+	max_len = DEFAULT_MAX_LEN;
+	next_id = 0;
+	head = 0;
+}
+
+void SlowLog::set_threshold(double threshold){
+	this->threshold = threshold;
+}
+
+void SlowLog::set_max_len(int max_len){
+	if(max_len < 1){
+		max_len = 1;
+	}
+	Locking l(&mutex);
+	this->max_len = max_len;
+	ring.clear();
+	head = 0;
+}
+
+void SlowLog::add(const Link *link, const Request &req, double time_wait, double time_proc){
+	SlowLogEntry entry;
+	entry.time = time(NULL);
+	if(!req.empty()){
+		entry.cmd = req[0].String();
+	}
+	// 序列化放在锁外面
+	entry.req = serialize_req(req);
+	char buf[INET_ADDRSTRLEN + 16];
+	snprintf(buf, sizeof(buf), "%s:%d", link->remote_ip, link->remote_port);
+	entry.client = buf;
+	entry.time_wait = time_wait;
+	entry.time_proc = time_proc;
+
+	Locking l(&mutex);
+	entry.id = next_id ++;
+	if((int)ring.size() < max_len){
+		ring.push_back(entry);
+	}else{
+		ring[head] = entry;
+	}
+	head = (head + 1) % max_len;
+}
+
+void SlowLog::get(int num, std::vector<SlowLogEntry> *entries){
+	Locking l(&mutex);
+	int size = (int)ring.size();
+	if(num > size || num < 0){
+		num = size;
+	}
+	// head 前面一个是最新的
+	for(int i=0; i<num; i++){
+		int pos = (head - 1 - i + size) % size;
+		entries->push_back(ring[pos]);
+	}
+}
+
+int SlowLog::size(){
+	Locking l(&mutex);
+	return (int)ring.size();
+}
+
+void SlowLog::reset(){
+	Locking l(&mutex);
+	ring.clear();
+	head = 0;
+}
@@ -0,0 +1,70 @@
+/*
+Copyright (c) 2012-2014 The SSDB Authors. All rights reserved.
+Use of this source code is governed by a BSD-style license that can be
+found in the LICENSE file.
+*/
+#ifndef NET_SLOWLOG_H_
+#define NET_SLOWLOG_H_
+
+#include <inttypes.h>
+#include <string>
+#include <vector>
+#include "proc.h"
+#include "../util/thread.h"
+
+class Link;
+
+// 慢请求的记录
+struct SlowLogEntry{
+	int64_t id;
+	int64_t time; // unix time, second
+	std::string cmd;
+	std::string req; // serialize_req() 的结果
+	std::string client; // ip:port
+	double time_wait; // ms
+	double time_proc; // ms
+};
+
+// 慢请求日志, 等待时间加处理时间超过阈值的请求记录在一个固定大小的
+// 环形缓冲区中, 满了之后覆盖最老的记录.
+//
+// 慢请求很少, 所以 add() 直接加锁; 是否需要记录的判断不加锁.
+class SlowLog{
+	private:
+		Mutex mutex;
+		double threshold; // ms
+		int max_len;
+		int64_t next_id;
+		// 下一个写入的位置
+		int head;
+		std::vector<SlowLogEntry> ring;
+
+		// No copying allowed
+		SlowLog(const SlowLog&);
+		void operator=(const SlowLog&);
+	public:
+		static const int DEFAULT_MAX_LEN = 128;
+		static const int DEFAULT_THRESHOLD = 10; // ms
+
+		SlowLog();
+		// threshold < 0 表示不记录
+		void set_threshold(double threshold);
+		void set_max_len(int max_len);
+		double get_threshold() const{
+			return threshold;
+		}
+		int get_max_len() const{
+			return max_len;
+		}
+
+		bool need_log(double time_wait, double time_proc) const{
+			return threshold >= 0 && time_wait + time_proc >= threshold;
+		}
+		void add(const Link *link, const Request &req, double time_wait, double time_proc);
+		// 最新的 num 条记录, 新的在前
+		void get(int num, std::vector<SlowLogEntry> *entries);
+		int size();
+		void reset();
+};
+
+#endif
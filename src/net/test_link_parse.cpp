@@ -0,0 +1,296 @@
+/*
+Copyright (c) 2012-2014 The SSDB Authors. All rights reserved.
+Use of this source code is governed by a BSD-style license that can be
+found in the LICENSE file.
+*/
+// 差分模糊测试: 用随机生成(以及随机破坏)的数据包, 比较 Link::parse() 的
+// 各个版本与原来 Link::recv() 中的解析逻辑, 返回值和解析出的字段必须完全一致.
+// 另外检查 v2 协议的帧: 写出再解析回来的字段不变, 截断和破坏的帧不会越界.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#include "link.h"
+
+#define MAX_PACKET_SIZE		32 * 1024 * 1024
+
+// 原来 Link::recv() 中的解析逻辑, 原样保留作为参照
+static int parse_reference(char *data, int size, std::vector<Bytes> *out){
+	int parsed = 0;
+	char *head = data;
+
+	while(size > 0 && (head[0] == '\n' || head[0] == '\r')){
+		head ++;
+		size --;
+		parsed ++;
+	}
+
+	while(size > 0){
+		char *body = (char *)memchr(head, '\n', size);
+		if(body == NULL){
+			break;
+		}
+		body ++;
+
+		int head_len = body - head;
+		if(head_len == 1 || (head_len == 2 && head[0] == '\r')){
+			parsed += head_len;
+			return parsed;
+		}
+		if(head[0] < '0' || head[0] > '9'){
+			return -1;
+		}
+
+		char head_str[20];
+		if(head_len > (int)sizeof(head_str) - 1){
+			return -1;
+		}
+		memcpy(head_str, head, head_len - 1); // no '\n'
+		head_str[head_len - 1] = '\0';
+
+		int body_len = atoi(head_str);
+		if(body_len < 0){
+			return -1;
+		}
+		size -= head_len + body_len;
+		if(size < 0){
+			break;
+		}
+
+		out->push_back(Bytes(body, body_len));
+
+		head += head_len + body_len;
+		parsed += head_len + body_len;
+		if(size > 0 && head[0] == '\n'){
+			head += 1;
+			size -= 1;
+			parsed += 1;
+		}else if(size > 1 && head[0] == '\r' && head[1] == '\n'){
+			head += 2;
+			size -= 2;
+			parsed += 2;
+		}else{
+			break;
+		}
+		if(parsed > MAX_PACKET_SIZE){
+			 return -1;
+		}
+	}
+	return 0;
+}
+
+static const char *alphabet = "0123456789\r\n-+ abcz";
+
+static std::string random_packet(){
+	std::string ret;
+	int leading = rand() % 4 == 0? rand() % 3 : 0;
+	for(int i=0; i<leading; i++){
+		ret.append(rand() % 2? "\n" : "\r\n");
+	}
+	int num = rand() % 8 == 0? rand() % 300 : rand() % 6;
+	for(int i=0; i<num; i++){
+		int len;
+		switch(rand() % 4){
+			case 0:
+				len = 0;
+				break;
+			case 1:
+				len = rand() % 200;
+				break;
+			default:
+				len = rand() % 12;
+				break;
+		}
+		char buf[32];
+		snprintf(buf, sizeof(buf), "%d", len);
+		ret.append(buf);
+		ret.append(rand() % 3? "\n" : "\r\n");
+		for(int j=0; j<len; j++){
+			// body 中也可能含有换行符
+			ret.push_back(rand() % 5? 'a' + rand() % 26 : alphabet[rand() % strlen(alphabet)]);
+		}
+		ret.append(rand() % 3? "\n" : "\r\n");
+	}
+	ret.append(rand() % 2? "\n" : "\r\n");
+	return ret;
+}
+
+static void mutate(std::string *s){
+	int n = rand() % 4;
+	for(int i=0; i<n && !s->empty(); i++){
+		int pos = rand() % s->size();
+		switch(rand() % 5){
+			case 0:
+				(*s)[pos] = alphabet[rand() % strlen(alphabet)];
+				break;
+			case 1:
+				s->erase(pos, 1);
+				break;
+			case 2:
+				s->insert(pos, 1, alphabet[rand() % strlen(alphabet)]);
+				break;
+			case 3:
+				// 超长或者溢出的字段头
+				s->insert(pos, "99999999999999999");
+				break;
+			case 4:
+				s->insert(pos, "2147483648");
+				break;
+		}
+	}
+	if(rand() % 3 == 0){
+		// 截断
+		s->resize(rand() % (s->size() + 1));
+	}
+}
+
+static int check(const std::string &packet, int level){
+	// 拷贝到恰好大小的堆内存中, 让越界读取更容易暴露
+	int size = (int)packet.size();
+	char *data = (char *)malloc(size + 1);
+	memcpy(data, packet.data(), size);
+
+	std::vector<Bytes> r1, r2;
+	int ret1 = parse_reference(data, size, &r1);
+	int ret2 = Link::parse(data, size, &r2, level);
+	bool ok = (ret1 == ret2);
+	if(ok && ret1 > 0){
+		ok = (r1.size() == r2.size());
+		for(int i=0; ok && i<(int)r1.size(); i++){
+			ok = (r1[i].data() == r2[i].data() && r1[i].size() == r2[i].size());
+		}
+	}
+	if(!ok){
+		fprintf(stderr, "mismatch, parser: %s, ref: %d, got: %d, packet: %s\n",
+			Link::parser_name(level), ret1, ret2,
+			str_escape(packet).c_str());
+	}
+	free(data);
+	return ok? 0 : -1;
+}
+
+// 随机的字段写成一帧, 解析回来必须相同; 截断的帧未就绪, 破坏的帧不能越界
+static int check_frame(){
+	std::vector<std::string> fields;
+	int num = rand() % 8 + 1;
+	for(int i=0; i<num; i++){
+		char buf[32];
+		switch(rand() % 4){
+			case 0:
+				snprintf(buf, sizeof(buf), "%" PRId64, (int64_t)rand() * rand() * (rand()%2? 1 : -1));
+				fields.push_back(buf);
+				break;
+			case 1:
+				snprintf(buf, sizeof(buf), "0%d", rand() % 100);
+				fields.push_back(buf);
+				break;
+			default:
+				fields.push_back(random_packet().substr(0, rand() % 64));
+				break;
+		}
+	}
+	uint32_t id = (uint32_t)rand();
+	Link link;
+	link.send_frame(id, fields);
+	std::string frame(link.output->data(), link.output->size());
+
+	int errors = 0;
+	std::vector<Bytes> out;
+	std::string ints;
+	uint32_t rid = 0;
+	int ret = Link::parse_frame(frame.data(), (int)frame.size(), &rid, &out, &ints);
+	bool ok = (ret == (int)frame.size() && rid == id && out.size() == fields.size());
+	for(int i=0; ok && i<(int)fields.size(); i++){
+		ok = (out[i] == Bytes(fields[i]));
+	}
+	if(!ok){
+		fprintf(stderr, "frame mismatch, ret: %d, frame: %s\n", ret, str_escape(frame).c_str());
+		errors ++;
+	}
+
+	std::string tmp = frame.substr(0, rand() % frame.size());
+	out.clear();
+	if(Link::parse_frame(tmp.data(), (int)tmp.size(), &rid, &out, &ints) != 0){
+		fprintf(stderr, "truncated frame is ready, frame: %s\n", str_escape(tmp).c_str());
+		errors ++;
+	}
+
+	tmp = frame;
+	tmp[rand() % tmp.size()] = (char)rand();
+	char *data = (char *)malloc(tmp.size());
+	memcpy(data, tmp.data(), tmp.size());
+	out.clear();
+	Link::parse_frame(data, (int)tmp.size(), &rid, &out, &ints);
+	for(int i=0; i<(int)out.size(); i++){
+		const char *p = out[i].data();
+		bool in_frame = (p >= data && p + out[i].size() <= data + tmp.size());
+		bool in_ints = (p >= ints.data() && p + out[i].size() <= ints.data() + ints.size());
+		if(!in_frame && !in_ints){
+			fprintf(stderr, "field out of bounds, frame: %s\n", str_escape(tmp).c_str());
+			errors ++;
+			break;
+		}
+	}
+	free(data);
+	return errors;
+}
+
+int main(int argc, char **argv){
+	int rounds = 200000;
+	unsigned int seed = time(NULL);
+	if(argc > 1){
+		rounds = atoi(argv[1]);
+	}
+	if(argc > 2){
+		seed = (unsigned int)atoi(argv[2]);
+	}
+	srand(seed);
+	printf("seed: %u, rounds: %d, cpu parser: %s\n",
+		seed, rounds, Link::parser_name(Link::parser_level()));
+
+	int errors = 0;
+	for(int i=0; i<rounds; i++){
+		std::string packet = random_packet();
+		if(i % 2){
+			mutate(&packet);
+		}
+		for(int level=Link::PARSER_SCALAR; level<=Link::parser_level(); level++){
+			if(check(packet, level) == -1){
+				errors ++;
+			}
+		}
+	}
+
+	for(int i=0; i<rounds / 10; i++){
+		errors += check_frame();
+	}
+
+	// MAX_PACKET_SIZE
+	{
+		std::string packet;
+		char buf[32];
+		int len = 1024 * 1024;
+		std::string body(len, 'x');
+		for(int i=0; i<40; i++){
+			snprintf(buf, sizeof(buf), "%d\n", len);
+			packet.append(buf);
+			packet.append(body);
+			packet.append("\n");
+		}
+		packet.append("\n");
+		for(int level=Link::PARSER_SCALAR; level<=Link::parser_level(); level++){
+			if(check(packet, level) == -1){
+				errors ++;
+			}
+		}
+	}
+
+	if(errors){
+		printf("FAILED, %d errors\n", errors);
+		return 1;
+	}
+	printf("OK\n");
+	return 0;
+}
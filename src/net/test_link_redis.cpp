@@ -0,0 +1,120 @@
+/*
+Copyright (c) 2012-2014 The SSDB Authors. All rights reserved.
+Use of this source code is governed by a BSD-style license that can be
+found in the LICENSE file.
+*/
+// RedisLink 流水线的响应: 一次读到的多个请求依次 select() 之后, send_resp()
+// 必须按各自的参数输出(mget 的 key, zrange 的 withscores), 不能用第一个请求的.
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "link.h"
+
+static int failed = 0;
+
+#define CHECK(cond) do{ \
+		if(!(cond)){ \
+			printf("FAILED %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+			failed ++; \
+		} \
+	}while(0)
+
+static std::string redis_req(const std::vector<std::string> &args){
+	char buf[32];
+	snprintf(buf, sizeof(buf), "*%d\r\n", (int)args.size());
+	std::string s = buf;
+	for(int i=0; i<(int)args.size(); i++){
+		snprintf(buf, sizeof(buf), "$%d\r\n", (int)args[i].size());
+		s.append(buf);
+		s.append(args[i]);
+		s.append("\r\n");
+	}
+	return s;
+}
+
+static std::vector<std::string> split(const char *s){
+	std::vector<std::string> ret;
+	std::string item;
+	for(const char *p=s; ; p++){
+		if(*p == ' ' || *p == '\0'){
+			if(!item.empty()){
+				ret.push_back(item);
+				item.clear();
+			}
+			if(*p == '\0'){
+				break;
+			}
+		}else{
+			item.push_back(*p);
+		}
+	}
+	return ret;
+}
+
+struct Case{
+	const char *req;
+	// ssdb 的响应, 各项用空格分开
+	const char *resp;
+	const char *expect;
+};
+
+static const Case cases[] = {
+	{"mget k1 k2", "ok k1 v1 k2 v2", "*2\r\n$2\r\nv1\r\n$2\r\nv2\r\n"},
+	{"mget k3 k4", "ok k3 v3 k4 v4", "*2\r\n$2\r\nv3\r\n$2\r\nv4\r\n"},
+	{"mget k4", "ok k4 v4", "*1\r\n$2\r\nv4\r\n"},
+	{"hmget h f2 f1", "ok f1 x1", "*2\r\n$-1\r\n$2\r\nx1\r\n"},
+	{"zrange z 0 -1 withscores", "ok a 1 b 2", "*4\r\n$1\r\na\r\n$1\r\n1\r\n$1\r\nb\r\n$1\r\n2\r\n"},
+	{"zrange z 0 -1", "ok a 1 b 2", "*2\r\n$1\r\na\r\n$1\r\nb\r\n"},
+	{"zrangebyscore z 0 9 withscores", "ok a 1", "*2\r\n$1\r\na\r\n$1\r\n1\r\n"},
+	{"zrangebyscore z 0 9", "ok a 1", "*1\r\n$1\r\na\r\n"},
+};
+static const int NUM_CASES = sizeof(cases) / sizeof(cases[0]);
+
+// 从第 first 个开始的所有请求一次读到, 第一个由 recv_req() 读取, 其余的
+// 用 parse_next() 解析, 然后按顺序输出响应, 与服务器处理流水线的顺序相同
+static void test_pipeline(int first){
+	RedisLink redis;
+	Buffer input(1024);
+	for(int i=0; i<NUM_CASES; i++){
+		input.append(redis_req(split(cases[(first + i) % NUM_CASES].req)).c_str());
+	}
+
+	const std::vector<Bytes> *req = redis.recv_req(&input);
+	CHECK(req != NULL && !req->empty());
+
+	std::vector<Bytes> out;
+	int n = 0;
+	while(1){
+		int len = redis.parse_next(&input, n, &out);
+		if(len <= 0){
+			break;
+		}
+		input.decr(len);
+		n ++;
+	}
+	CHECK(n == NUM_CASES - 1);
+
+	for(int i=-1; i<n; i++){
+		const Case &c = cases[(first + 1 + i) % NUM_CASES];
+		Buffer output(1024);
+		redis.select(i);
+		redis.send_resp(&output, split(c.resp));
+		std::string got(output.data(), output.size());
+		if(got != c.expect){
+			printf("FAILED %s: got %s\n", c.req, got.c_str());
+			failed ++;
+		}
+	}
+}
+
+int main(int argc, char **argv){
+	for(int i=0; i<NUM_CASES; i++){
+		test_pipeline(i);
+	}
+	if(failed){
+		printf("%d checks failed\n", failed);
+		return 1;
+	}
+	printf("all tests passed\n");
+	return 0;
+}
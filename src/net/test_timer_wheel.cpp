@@ -0,0 +1,94 @@
+/*
+Copyright (c) 2012-2014 The SSDB Authors. All rights reserved.
+Use of this source code is governed by a BSD-style license that can be
+found in the LICENSE file.
+*/
+// 随机加入/删除定时器, 和逐个检查到期时间的结果比较, 每个定时器必须在
+// 到期的那个周期(跳过多个周期时是跳到的周期)被取出, 并且只取出一次.
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <vector>
+#include "timer_wheel.h"
+
+int main(int argc, char **argv){
+	int rounds = 100000;
+	unsigned int seed = time(NULL);
+	if(argc > 1){
+		rounds = atoi(argv[1]);
+	}
+	if(argc > 2){
+		seed = (unsigned int)atoi(argv[2]);
+	}
+	srand(seed);
+	printf("seed: %u, rounds: %d\n", seed, rounds);
+
+	const int num = 1000;
+	TimerWheel wheel(64);
+	std::vector<TimerNode> nodes(num);
+	// 期望的到期周期, 0: 不在时间轮中
+	std::vector<uint64_t> expect(num, 0);
+	std::vector<TimerNode *> expired;
+	uint64_t now = 0;
+	int errors = 0;
+
+	for(int i=0; i<rounds; i++){
+		int n = rand() % num;
+		switch(rand() % 4){
+			case 0:
+			case 1:{
+				// 有的超过一圈
+				uint64_t ticks = rand() % 200;
+				wheel.add(&nodes[n], ticks);
+				expect[n] = now + (ticks? ticks : 1);
+				break;
+			}
+			case 2:
+				wheel.del(&nodes[n]);
+				expect[n] = 0;
+				break;
+			case 3:{
+				// 偶尔跳过一圈以上
+				now += (rand() % 50 == 0)? 100 + rand() % 100 : 1 + rand() % 3;
+				expired.clear();
+				wheel.advance(now, &expired);
+				for(int j=0; j<(int)expired.size(); j++){
+					int k = expired[j] - &nodes[0];
+					if(expect[k] == 0 || expect[k] > now){
+						printf("error: node %d expired at %d, expect %d\n",
+							k, (int)now, (int)expect[k]);
+						errors ++;
+					}
+					expect[k] = 0;
+				}
+				for(int k=0; k<num; k++){
+					if(expect[k] && expect[k] <= now){
+						printf("error: node %d not expired at %d, expect %d\n",
+							k, (int)now, (int)expect[k]);
+						errors ++;
+						expect[k] = 0;
+						wheel.del(&nodes[k]);
+					}
+				}
+				break;
+			}
+		}
+	}
+	int active = 0;
+	for(int k=0; k<num; k++){
+		if(expect[k]){
+			active ++;
+		}
+	}
+	if(active != wheel.size()){
+		printf("error: size %d, expect %d\n", wheel.size(), active);
+		errors ++;
+	}
+
+	if(errors){
+		printf("FAILED, %d errors\n", errors);
+		return 1;
+	}
+	printf("OK\n");
+	return 0;
+}
@@ -0,0 +1,68 @@
+/*
+Copyright (c) 2012-2014 The SSDB Authors. All rights reserved.
+Use of this source code is governed by a BSD-style license that can be
+found in the LICENSE file.
+*/
+#include "timer_wheel.h"
+
+TimerWheel::TimerWheel(int num_slots){
+	slots = new TimerNode[num_slots];
+	for(int i=0; i<num_slots; i++){
+		slots[i].prev = slots[i].next = &slots[i];
+	}
+	mask = num_slots - 1;
+	now_ = 0;
+	size_ = 0;
+}
+
+TimerWheel::~TimerWheel(){
+	delete[] slots;
+}
+
+void TimerWheel::add(TimerNode *node, uint64_t ticks){
+	this->del(node);
+	if(ticks == 0){
+		ticks = 1;
+	}
+	node->expire = now_ + ticks;
+	TimerNode *head = &slots[node->expire & mask];
+	node->prev = head->prev;
+	node->next = head;
+	head->prev->next = node;
+	head->prev = node;
+	size_ ++;
+}
+
+void TimerWheel::del(TimerNode *node){
+	if(!node->active()){
+		return;
+	}
+	node->prev->next = node->next;
+	node->next->prev = node->prev;
+	node->prev = node->next = NULL;
+	size_ --;
+}
+
+void TimerWheel::advance(uint64_t now, std::vector<TimerNode *> *expired){
+	if(now <= now_){
+		return;
+	}
+	// 跳过了一圈以上时, 每个槽只需要检查一次
+	uint64_t steps = now - now_;
+	if(steps > (uint64_t)mask + 1){
+		steps = mask + 1;
+	}
+	for(uint64_t i=1; i<=steps; i++){
+		TimerNode *head = &slots[(now_ + i) & mask];
+		TimerNode *node = head->next;
+		while(node != head){
+			TimerNode *next = node->next;
+			if(node->expire <= now){
+				this->del(node);
+				expired->push_back(node);
+			}
+			node = next;
+		}
+	}
+	now_ = now;
+}
@@ -0,0 +1,67 @@
+/*
+Copyright (c) 2012-2014 The SSDB Authors. All rights reserved.
+Use of this source code is governed by a BSD-style license that can be
+found in the LICENSE file.
+*/
+#ifndef NET_TIMER_WHEEL_H_
+#define NET_TIMER_WHEEL_H_
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <vector>
+
+// 定时器, 嵌入到需要定时的对象中(见 Link::timer), 不需要另外分配内存
+struct TimerNode{
+	TimerNode *prev;
+	TimerNode *next;
+	// 到期的时钟周期
+	uint64_t expire;
+	void *data;
+
+	TimerNode(){
+		prev = next = NULL;
+		expire = 0;
+		data = NULL;
+	}
+	// 是否在时间轮中
+	bool active() const{
+		return prev != NULL;
+	}
+};
+
+// 时间轮, 用时钟周期计时. 每个槽是一个双向链表, 加入和删除都是 O(1),
+// 每个周期只检查一个槽. 超过一圈的定时器留在槽中, 转到它到期的那一圈
+// 才取出.
+//
+// 不加锁, 只在主线程中使用.
+class TimerWheel{
+	public:
+		static const int DEFAULT_SLOTS = 1024;
+
+		// num_slots 必须是 2 的幂
+		TimerWheel(int num_slots=DEFAULT_SLOTS);
+		~TimerWheel();
+
+		// 当前的时钟周期
+		uint64_t now() const{
+			return now_;
+		}
+		int size() const{
+			return size_;
+		}
+		// 在 ticks 个周期之后到期, 至少 1 个周期; 已经在时间轮中的先删除
+		void add(TimerNode *node, uint64_t ticks);
+		// 不在时间轮中时什么也不做
+		void del(TimerNode *node);
+		// 前进到第 now 个周期, 到期的定时器从时间轮中删除, 追加到 expired
+		void advance(uint64_t now, std::vector<TimerNode *> *expired);
+
+	private:
+		// 每个槽的链表头
+		TimerNode *slots;
+		int mask;
+		uint64_t now_;
+		int size_;
+};
+
+#endif
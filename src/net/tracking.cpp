@@ -0,0 +1,140 @@
+/*
+Copyright (c) 2012-2015 The SSDB Authors. All rights reserved.
+Use of this source code is governed by a BSD-style license that can be
+found in the LICENSE file.
+*/
+#include "tracking.h"
+
+Tracking::Tracking(int max_keys){
+	this->max_keys = max_keys;
+	this->num_links = 0;
+	this->num_pushed = 0;
+}
+
+Tracking::~Tracking(){
+	std::map<Link *, TrackingLink *>::iterator it;
+	for(it = tlinks.begin(); it != tlinks.end(); it++){
+		delete it->second;
+	}
+}
+
+void Tracking::enable(Link *link){
+	Locking l(&mutex);
+	if(tlinks.find(link) != tlinks.end()){
+		return;
+	}
+	TrackingLink *tl = new TrackingLink();
+	tl->flush_all = false;
+	tlinks[link] = tl;
+	num_links = (int)tlinks.size();
+}
+
+void Tracking::disable(Link *link){
+	Locking l(&mutex);
+	std::map<Link *, TrackingLink *>::iterator it = tlinks.find(link);
+	if(it == tlinks.end()){
+		return;
+	}
+	untrack_all(link, it->second);
+	delete it->second;
+	tlinks.erase(it);
+	ready.erase(link);
+	num_links = (int)tlinks.size();
+}
+
+// 调用者持有 mutex
+void Tracking::untrack_all(Link *link, TrackingLink *tl){
+	std::set<std::string>::iterator it;
+	for(it = tl->keys.begin(); it != tl->keys.end(); it++){
+		std::map<std::string, std::set<Link *> >::iterator t = table.find(*it);
+		if(t == table.end()){
+			continue;
+		}
+		t->second.erase(link);
+		if(t->second.empty()){
+			table.erase(t);
+		}
+	}
+	tl->keys.clear();
+}
+
+void Tracking::track(Link *link, const std::string &key){
+	Locking l(&mutex);
+	std::map<Link *, TrackingLink *>::iterator it = tlinks.find(link);
+	if(it == tlinks.end()){
+		return;
+	}
+	TrackingLink *tl = it->second;
+	if(tl->keys.find(key) != tl->keys.end()){
+		return;
+	}
+	if((int)tl->keys.size() >= max_keys){
+		untrack_all(link, tl);
+		tl->pending.clear();
+		tl->flush_all = true;
+		ready.insert(link);
+		wakeup.notify();
+	}
+	tl->keys.insert(key);
+	table[key].insert(link);
+}
+
+void Tracking::invalidate(const std::vector<std::string> &keys){
+	Locking l(&mutex);
+	if(table.empty()){
+		return;
+	}
+	bool notify = false;
+	for(int i=0; i<(int)keys.size(); i++){
+		std::map<std::string, std::set<Link *> >::iterator it = table.find(keys[i]);
+		if(it == table.end()){
+			continue;
+		}
+		std::set<Link *>::iterator l;
+		for(l = it->second.begin(); l != it->second.end(); l++){
+			TrackingLink *tl = tlinks[*l];
+			tl->keys.erase(keys[i]);
+			if(!tl->flush_all){
+				tl->pending.push_back(keys[i]);
+			}
+			ready.insert(*l);
+		}
+		table.erase(it);
+		notify = true;
+	}
+	if(notify){
+		wakeup.notify();
+	}
+}
+
+void Tracking::take_ready(std::vector<Link *> *links){
+	Locking l(&mutex);
+	wakeup.clear();
+	links->assign(ready.begin(), ready.end());
+	ready.clear();
+}
+
+bool Tracking::take(Link *link, std::vector<std::string> *packet){
+	Locking l(&mutex);
+	std::map<Link *, TrackingLink *>::iterator it = tlinks.find(link);
+	if(it == tlinks.end()){
+		return false;
+	}
+	TrackingLink *tl = it->second;
+	if(!tl->flush_all && tl->pending.empty()){
+		return false;
+	}
+	packet->clear();
+	packet->push_back("invalidate");
+	if(!tl->flush_all){
+		for(int i=0; i<(int)tl->pending.size(); i++){
+			const std::string &key = tl->pending[i];
+			packet->push_back(key.substr(0, 1));
+			packet->push_back(key.substr(1));
+		}
+	}
+	tl->pending.clear();
+	tl->flush_all = false;
+	num_pushed ++;
+	return true;
+}
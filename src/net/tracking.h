@@ -0,0 +1,82 @@
+/*
+Copyright (c) 2012-2015 The SSDB Authors. All rights reserved.
+Use of this source code is governed by a BSD-style license that can be
+found in the LICENSE file.
+*/
+#ifndef NET_TRACKING_H_
+#define NET_TRACKING_H_
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include "../util/thread.h"
+
+class Link;
+
+// 客户端缓存的失效通知(tracking 命令). 开启了 tracking 的连接读取过的
+// key 被修改时, 服务器向连接推送一条消息:
+//     invalidate type key type key ...
+// 读取一次只推送一次, 之后连接再读取这个 key 才会继续跟踪. type 是数据
+// 类型(k: kv, h: hash). 连接跟踪的 key 超过 max_keys 时, 推送不带 key 的
+// invalidate(清空所有缓存), 并重新开始跟踪.
+//
+// track() 在执行读命令的线程中调用, invalidate() 在提交写操作的线程中
+// 调用, 其它方法在主线程中调用. 推送的消息由主线程写到连接.
+class Tracking{
+public:
+	Tracking(int max_keys);
+	~Tracking();
+
+	// 有消息需要推送时可读
+	int fd(){
+		return wakeup.fd();
+	}
+
+	// key 是 type + key
+	void track(Link *link, const std::string &key);
+	void invalidate(const std::vector<std::string> &keys);
+
+	void enable(Link *link);
+	// 连接关闭之前必须调用
+	void disable(Link *link);
+	// 取出有消息的连接, 并清除 fd 的可读状态
+	void take_ready(std::vector<Link *> *links);
+	// 取出要推送给连接的消息, 没有则返回 false
+	bool take(Link *link, std::vector<std::string> *packet);
+
+	// 开启了 tracking 的连接数, 不加锁读取
+	int links() const{
+		return num_links;
+	}
+	int keys(){
+		Locking l(&mutex);
+		return (int)table.size();
+	}
+	uint64_t pushed() const{
+		return num_pushed;
+	}
+
+private:
+	struct TrackingLink{
+		std::set<std::string> keys;
+		// 要推送的 key
+		std::vector<std::string> pending;
+		// 推送清空所有缓存的消息
+		bool flush_all;
+	};
+	int max_keys;
+	Mutex mutex;
+	WakeupFd wakeup;
+	std::map<Link *, TrackingLink *> tlinks;
+	// key => 跟踪它的连接
+	std::map<std::string, std::set<Link *> > table;
+	// 有消息要推送的连接
+	std::set<Link *> ready;
+	volatile int num_links;
+	uint64_t num_pushed;
+
+	void untrack_all(Link *link, TrackingLink *tl);
+};
+
+#endif
@@ -6,7 +6,9 @@ found in the LICENSE file.
 #include "worker.h"
 #include "link.h"
 #include "proc.h"
+#include "server.h"
 #include "../util/log.h"
+#include "../util/clock.h"
 #include "../include.h"
 
 ProcWorker::ProcWorker(const std::string &name){
@@ -17,28 +19,122 @@ void ProcWorker::init(){
 	log_debug("%s %d init", this->name.c_str(), this->id);
 }
 
+// 执行一个请求, 响应放到 resp 中. 只有批中的第一个请求(first)在任务
+// 队列中等待过, 之后的请求紧接着前一个执行, 它们的等待时间记为 0, 否则
+// 前面请求的处理时间会被算成排队, 让统计, slowlog 和 PoolSizer 误以为
+// 线程不够. job->time_wait 是任务的排队时间, job->time_proc 是整批的
+// 处理时间. 返回这个请求的处理时间
+static double exec_req(ProcJob *job, Command *cmd, const Request &req, Response *resp, bool first){
+	proc_t p = cmd->proc;
+	uint64_t now = clock_cycles();
+	double time_wait = 0;
+	if(first){
+		// 主线程和工作线程的计数可能有很小的偏差
+		job->time_wait = now > job->stime? clock_cycles_to_ms(now - job->stime) : 0;
+		job->time_proc = 0;
+		time_wait = job->time_wait;
+	}
+	job->result = (*p)(job->serv, job->link, req, resp);
+	double time_proc = clock_cycles_to_ms(clock_cycles() - now);
+	job->time_proc += time_proc;
+	cmd->add_stat(time_wait, time_proc);
+	if(job->serv->slowlog.need_log(time_wait, time_proc)){
+		job->serv->slowlog.add(job->link, req, time_wait, time_proc);
+	}
+	return time_proc;
+}
+
+// 执行一个请求, 把响应追加到连接的输出缓冲区
+static void proc_req(ProcJob *job, Command *cmd, const Request &req, bool first){
+	Response resp;
+	double time_proc = exec_req(job, cmd, req, &resp, first);
+	if(job->link->send(resp.resp) == -1){
+		job->result = PROC_ERROR;
+	}else{
+		log_debug("w:%.3f,p:%.3f, req: %s, resp: %s",
+			first? job->time_wait : 0, time_proc,
+			serialize_req(req).c_str(),
+			serialize_req(resp.resp).c_str());
+	}
+}
+
+// 批中的请求都有同一个 proc_batch 时, 整批一次执行, 每个请求的处理时间
+// 记为整批的平均值. 返回 -1 表示不能整批执行
+static int proc_batch(ProcJob *job){
+	Link *link = job->link;
+	proc_batch_t pb = job->cmd->proc_batch;
+	if(pb == NULL || link->pipeline_size == 0){
+		return -1;
+	}
+	std::vector<const Request *> reqs;
+	std::vector<Command *> cmds;
+	reqs.push_back(link->last_recv());
+	cmds.push_back(job->cmd);
+	for(int i=0; i<link->pipeline_size; i++){
+		Command *cmd = job->serv->proc_map.get_proc(link->pipeline[i][0]);
+		if(cmd->proc_batch != pb){
+			return -1;
+		}
+		reqs.push_back(&link->pipeline[i]);
+		cmds.push_back(cmd);
+	}
+
+	uint64_t now = clock_cycles();
+	job->time_wait = now > job->stime? clock_cycles_to_ms(now - job->stime) : 0;
+	std::vector<Response> resps(reqs.size());
+	job->result = (*pb)(job->serv, link, reqs, &resps);
+	job->time_proc = clock_cycles_to_ms(clock_cycles() - now);
+
+	double time_proc = job->time_proc / reqs.size();
+	for(int i=0; i<(int)reqs.size(); i++){
+		double time_wait = (i == 0)? job->time_wait : 0;
+		cmds[i]->add_stat(time_wait, time_proc);
+		if(job->serv->slowlog.need_log(time_wait, time_proc)){
+			job->serv->slowlog.add(link, *reqs[i], time_wait, time_proc);
+		}
+		if(job->result == PROC_ERROR){
+			continue;
+		}
+		// 第 0 个是 last_recv(), 之后是 pipeline
+		link->select_request(i - 1);
+		if(link->send(resps[i].resp) == -1){
+			job->result = PROC_ERROR;
+		}
+	}
+	return 0;
+}
+
 // 处理任务
 // 这个函数是在线程中在工作池中被调用，用于处理客户端请求，步骤如下：
 // 1. 从客户端连接中获取请求数据；
 // 2. 通过命令找到处理函数；
 // 3. 传入请求数据，调用处理函数，获取返回结果；
 // 4. 将返回结果发送到输出缓冲区，结束；
+// 流水线中随后的请求(link->pipeline)按顺序执行, 响应由主线程一次写出.
 int ProcWorker::proc(ProcJob *job){
-	const Request *req = job->link->last_recv();
-	Response resp;
-	
-	proc_t p = job->cmd->proc;
-	job->time_wait = 1000 * (millitime() - job->stime);
-	job->result = (*p)(job->serv, job->link, *req, &resp);
-	job->time_proc = 1000 * (millitime() - job->stime) - job->time_wait;
-
-	if(job->link->send(resp.resp) == -1){
-		job->result = PROC_ERROR;
-	}else{
-		log_debug("w:%.3f,p:%.3f, req: %s, resp: %s",
-			job->time_wait, job->time_proc,
-			serialize_req(*req).c_str(),
-			serialize_req(resp.resp).c_str());
+	// v2 协议的请求单独执行, 连接的缓冲区由主线程使用, 见 NetworkServer::proc()
+	if(job->preq){
+		exec_req(job, job->cmd, job->preq->req, &job->preq->resp, true);
+		return 0;
+	}
+	Link *link = job->link;
+	if(proc_batch(job) == 0){
+		link->select_request(-1);
+		link->pipeline_size = 0;
+		return 0;
+	}
+	link->select_request(-1);
+	proc_req(job, job->cmd, *link->last_recv(), true);
+	for(int i=0; i<link->pipeline_size; i++){
+		if(job->result == PROC_ERROR){
+			break;
+		}
+		const Request &req = link->pipeline[i];
+		Command *cmd = job->serv->proc_map.get_proc(req[0]);
+		link->select_request(i);
+		proc_req(job, cmd, req, false);
 	}
+	link->select_request(-1);
+	link->pipeline_size = 0;
 	return 0;
 }
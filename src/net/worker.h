@@ -8,6 +8,7 @@ found in the LICENSE file.
 
 #include <string>
 #include "../util/thread.h"
+#include "../util/stealing_pool.h"
 #include "proc.h"
 
 // WARN: pipe latency is about 20 us, it is really slow!
@@ -23,5 +24,7 @@ public:
 
 // 起个别名，方便一点
 typedef WorkerPool<ProcWorker, ProcJob> ProcWorkerPool;
+// 读线程池按命令的开销类别调度, 见 Command::cost
+typedef StealingPool<ProcWorker, ProcJob> ProcReaderPool;
 
 #endif
@@ -7,6 +7,8 @@ found in the LICENSE file.
 #include "serv.h"
 #include "net/proc.h"
 #include "net/server.h"
+#include "cluster_migrate.h"
+#include "cluster_rebalance.h"
 
 int proc_cluster_kv_node_list(NetworkServer *net, Link *link, const Request &req, Response *resp){
 	SSDBServer *serv = (SSDBServer *)net->data;
@@ -124,11 +126,124 @@ int proc_cluster_migrate_kv_data(NetworkServer *net, Link *link, const Request &
 	int src_id = req[1].Int();
 	int dst_id = req[2].Int();
 	int num_keys = req[3].Int();
-	int64_t ret = cluster->migrate_kv_data(src_id, dst_id, num_keys);
+	MigrateStats stats;
+	int64_t ret = cluster->migrate_kv_data(src_id, dst_id, num_keys, &stats);
 	if(ret == -1){
 		resp->add("error");
 	}else{
+		// 迁移的字节数, key 的个数和用时(秒)
 		resp->reply_int(0, ret);
+		resp->add(stats.keys);
+		resp->add(stats.time);
+	}
+	return 0;
+}
+
+// 由 cluster_migrate_kv_data 发给源节点: migrate_range ip port key_start key_end [speed]
+// 把本节点 (key_start, key_end] 中的数据推送到目标节点, 然后删除. speed: MB/s
+int proc_migrate_range(NetworkServer *net, Link *link, const Request &req, Response *resp){
+	SSDBServer *serv = (SSDBServer *)net->data;
+	CHECK_NUM_PARAMS(5);
+
+	std::string ip = req[1].String();
+	int port = req[2].Int();
+	KeyRange range(req[3].String(), req[4].String());
+	log_info("migrate %s to %s:%d", range.str().c_str(), ip.c_str(), port);
+
+	MigrateStream stream(serv);
+	if(req.size() > 5){
+		stream.set_speed(req[5].Int());
+	}
+	if(stream.connect(ip, port) == -1){
+		resp->push_back("error");
+		resp->push_back("connect failed");
+		return 0;
+	}
+	MigrateStats stats;
+	if(stream.run(range, &stats) == -1){
+		resp->push_back("error");
+		return 0;
+	}
+	resp->push_back("ok");
+	resp->add(stats.keys);
+	resp->add(stats.bytes);
+	resp->add(stats.time);
+	return 0;
+}
+
+// cluster_rebalance [tolerance] [speed] [rate_weight] [dry_run]
+// 返回每次迁移的 src_id, dst_id, split_key 和字节数
+int proc_cluster_rebalance(NetworkServer *net, Link *link, const Request &req, Response *resp){
+	SSDBServer *serv = (SSDBServer *)net->data;
+	Cluster *cluster = serv->cluster;
+
+	RebalanceOptions opt;
+	if(req.size() > 1){
+		opt.tolerance = str_to_double(req[1].data(), req[1].size());
+	}
+	if(req.size() > 2){
+		opt.speed = req[2].Int();
+	}
+	if(req.size() > 3){
+		opt.rate_weight = str_to_double(req[3].data(), req[3].size());
+	}
+	if(req.size() > 4){
+		opt.dry_run = (req[4] == "dry_run");
+	}
+	if(opt.tolerance <= 0 || opt.rate_weight < 0 || opt.rate_weight > 1){
+		resp->push_back("client_error");
+		return 0;
+	}
+
+	std::vector<RebalanceMove> moves;
+	int ret = cluster->rebalance(opt, &moves);
+	if(ret == -1){
+		resp->push_back("error");
+		return 0;
+	}
+	resp->push_back("ok");
+	for(int i=0; i<(int)moves.size(); i++){
+		const RebalanceMove &move = moves[i];
+		resp->add(move.src_id);
+		resp->add(move.dst_id);
+		resp->push_back(move.split_key);
+		resp->add(move.bytes);
+	}
+	return 0;
+}
+
+// range_stats key_start key_end
+// 返回本节点区间中 kv 的大概字节数, 以及处理过的请求总数(用于计算请求速率)
+int proc_range_stats(NetworkServer *net, Link *link, const Request &req, Response *resp){
+	SSDBServer *serv = (SSDBServer *)net->data;
+	CHECK_NUM_PARAMS(3);
+
+	KeyRange range(req[1].String(), req[2].String());
+	int64_t calls = 0;
+	proc_map_t::iterator it;
+	for(it=net->proc_map.begin(); it!=net->proc_map.end(); it++){
+		calls += it->second->calls();
+	}
+	resp->push_back("ok");
+	resp->add(kv_range_size(serv->ssdb, range));
+	resp->add(calls);
+	return 0;
+}
+
+// range_split key_start key_end bytes
+// 返回 key, 使 (key_start, key] 中 kv 的字节数大约为 bytes
+int proc_range_split(NetworkServer *net, Link *link, const Request &req, Response *resp){
+	SSDBServer *serv = (SSDBServer *)net->data;
+	CHECK_NUM_PARAMS(4);
+
+	KeyRange range(req[1].String(), req[2].String());
+	std::string key;
+	int ret = kv_range_split(serv->ssdb, range, req[3].Int64(), &key);
+	if(ret == 0){
+		resp->push_back("not_found");
+	}else{
+		resp->push_back("ok");
+		resp->push_back(key);
 	}
 	return 0;
 }
@@ -110,6 +110,7 @@ int proc_multi_hget(NetworkServer *net, Link *link, const Request &req, Response
 	resp->push_back("ok");
 	Request::const_iterator it=req.begin() + 1;
 	const Bytes name = *it;
+	TRACK_KEY(DataType::HASH, name);
 	it ++;
 	for(; it!=req.end(); it+=1){
 		const Bytes &key = *it;
@@ -145,6 +146,7 @@ int proc_hget(NetworkServer *net, Link *link, const Request &req, Response *resp
 	CHECK_NUM_PARAMS(3);
 	SSDBServer *serv = (SSDBServer *)net->data;
 
+	TRACK_KEY(DataType::HASH, req[1]);
 	std::string val;
 	int ret = serv->ssdb->hget(req[1], req[2], &val);
 	resp->reply_get(ret, &val);
@@ -12,6 +12,7 @@ int proc_get(NetworkServer *net, Link *link, const Request &req, Response *resp)
 	SSDBServer *serv = (SSDBServer *)net->data;
 	CHECK_NUM_PARAMS(2);
 	CHECK_KV_KEY_RANGE(1);
+	TRACK_KEY(DataType::KV, req[1]);
 
 	std::string val;
 	int ret = serv->ssdb->get(req[1], &val);
@@ -177,6 +178,7 @@ int proc_multi_get(NetworkServer *net, Link *link, const Request &req, Response
 
 	resp->push_back("ok");
 	for(int i=1; i<req.size(); i++){
+		TRACK_KEY(DataType::KV, req[i]);
 		std::string val;
 		int ret = serv->ssdb->get(req[i], &val);
 		if(ret == 1){
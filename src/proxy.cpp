@@ -0,0 +1,451 @@
+/*
+Copyright (c) 2012-2015 The SSDB Authors. All rights reserved.
+Use of this source code is governed by a BSD-style license that can be
+found in the LICENSE file.
+*/
+#include <algorithm>
+#include "proxy.h"
+#include "proxy_backend.h"
+#include "net/server.h"
+#include "net/link.h"
+#include "util/config.h"
+#include "util/log.h"
+#include "util/clock.h"
+
+// 两次加载区间表的最小间隔(秒), 避免大量请求同时遇到 out_of_range 时重复加载
+#define MIN_RELOAD_INTERVAL	0.1
+
+ProxyServer::ProxyServer(const Config &conf, NetworkServer *net){
+	net->data = this;
+	this->reg_procs(net);
+
+	cluster_ip = conf.get_str("cluster.ip");
+	cluster_port = conf.get_num("cluster.port");
+	auth = conf.get_str("cluster.auth");
+	num_conns = conf.get_num("cluster.connections");
+	if(num_conns <= 0){
+		num_conns = 2;
+	}
+	refresh_interval = conf.get_num("cluster.refresh_interval");
+	if(refresh_interval <= 0){
+		refresh_interval = 5;
+	}
+	connect_timeout = conf.get_num("cluster.connect_timeout");
+	if(connect_timeout <= 0){
+		connect_timeout = 3000;
+	}
+	timeout = conf.get_num("cluster.timeout");
+	if(timeout <= 0){
+		timeout = 10000;
+	}
+	log_info("cluster: %s:%d, connections: %d, refresh_interval: %d, timeout: %d/%d ms",
+		cluster_ip.c_str(), cluster_port, num_conns, refresh_interval, connect_timeout, timeout);
+
+	last_reload = 0;
+	if(this->load() == -1){
+		log_error("failed to load key ranges from %s:%d", cluster_ip.c_str(), cluster_port);
+	}
+
+	thread_quit = false;
+	int err = pthread_create(&tid, NULL, &ProxyServer::_run_thread, this);
+	if(err != 0){
+		log_fatal("can't create thread: %s", strerror(err));
+		exit(0);
+	}
+}
+
+ProxyServer::~ProxyServer(){
+	thread_quit = true;
+	pthread_join(tid, NULL);
+
+	std::map<std::string, Backend *>::iterator it;
+	for(it=backends.begin(); it!=backends.end(); it++){
+		delete it->second;
+	}
+	log_debug("ProxyServer finalized");
+}
+
+void* ProxyServer::_run_thread(void *arg){
+	ProxyServer *proxy = (ProxyServer *)arg;
+	double last = clock_mono_us() / 1000000.0;
+	while(!proxy->thread_quit){
+		usleep(100 * 1000);
+		double now = clock_mono_us() / 1000000.0;
+		if(now - last >= proxy->refresh_interval){
+			last = now;
+			proxy->reload();
+		}
+	}
+	return (void *)NULL;
+}
+
+bool ProxyServer::route_less(const Route &a, const Route &b){
+	return a.range.begin < b.range.begin;
+}
+
+// 从控制节点读取 cluster_kv_node_list
+int ProxyServer::load(){
+	Link *link = Link::connect(cluster_ip.c_str(), cluster_port, connect_timeout);
+	if(link == NULL){
+		return -1;
+	}
+	link->timeout(timeout);
+	const std::vector<Bytes> *resp = NULL;
+	if(!auth.empty()){
+		resp = link->request("auth", auth);
+		if(!resp || resp->empty() || resp->at(0) != "ok"){
+			delete link;
+			return -1;
+		}
+	}
+	resp = link->request("cluster_kv_node_list");
+	if(!resp || resp->empty() || resp->at(0) != "ok" || (resp->size() - 1) % 7 != 0){
+		delete link;
+		return -1;
+	}
+
+	// 每个节点: 6 id status begin end ip port
+	std::vector<Route> list;
+	Locking l(&mutex);
+	for(int i=1; i + 7<=(int)resp->size(); i+=7){
+		if(resp->at(i + 2).Int() != Node::SERVING){
+			continue;
+		}
+		Route r;
+		r.id = resp->at(i + 1).Int();
+		r.range = KeyRange(resp->at(i + 3).String(), resp->at(i + 4).String());
+		std::string ip = resp->at(i + 5).String();
+		int port = resp->at(i + 6).Int();
+		std::string addr = ip + ":" + str(port);
+		std::map<std::string, Backend *>::iterator it = backends.find(addr);
+		if(it == backends.end()){
+			log_info("new node %d %s, %s", r.id, addr.c_str(), r.range.str().c_str());
+			r.backend = new Backend(ip, port, auth, num_conns, connect_timeout, timeout);
+			backends[addr] = r.backend;
+		}else{
+			r.backend = it->second;
+		}
+		list.push_back(r);
+	}
+	delete link;
+
+	std::sort(list.begin(), list.end(), route_less);
+	bool changed = (list.size() != routes.size());
+	for(int i=0; !changed && i<(int)list.size(); i++){
+		if(list[i].range.begin != routes[i].range.begin || list[i].range.end != routes[i].range.end
+			|| list[i].backend != routes[i].backend)
+		{
+			changed = true;
+		}
+	}
+	if(changed){
+		log_info("key ranges changed, %d node(s)", (int)list.size());
+		routes.swap(list);
+	}
+	return 0;
+}
+
+int ProxyServer::reload(){
+	Locking l(&reload_mutex);
+	double now = clock_mono_us() / 1000000.0;
+	if(now - last_reload < MIN_RELOAD_INTERVAL){
+		return 0;
+	}
+	last_reload = now;
+	int ret = this->load();
+	if(ret == -1){
+		log_error("failed to load key ranges from %s:%d", cluster_ip.c_str(), cluster_port);
+	}
+	return ret;
+}
+
+// 区间是 (begin, end], 空的 begin 和 end 表示没有限制
+Backend* ProxyServer::route(const Bytes &key){
+	Locking l(&mutex);
+	// 找到最后一个 begin < key 的区间
+	int lo = 0, hi = (int)routes.size();
+	while(lo < hi){
+		int mid = (lo + hi) / 2;
+		if(Bytes(routes[mid].range.begin).compare(key) < 0){
+			lo = mid + 1;
+		}else{
+			hi = mid;
+		}
+	}
+	if(lo == 0){
+		return NULL;
+	}
+	const Route &r = routes[lo - 1];
+	if(!r.range.end.empty() && Bytes(r.range.end).compare(key) < 0){
+		return NULL;
+	}
+	return r.backend;
+}
+
+void ProxyServer::node_list(std::vector<std::string> *list){
+	Locking l(&mutex);
+	for(int i=0; i<(int)routes.size(); i++){
+		const Route &r = routes[i];
+		list->push_back("6");
+		list->push_back(str(r.id));
+		list->push_back(str(Node::SERVING));
+		list->push_back(r.range.begin);
+		list->push_back(r.range.end);
+		list->push_back(r.backend->ip);
+		list->push_back(str(r.backend->port));
+	}
+}
+
+/* 命令 */
+
+// 最多尝试 tries 次, 区间表过期时重新加载再试
+static int forward(ProxyServer *proxy, const Request &req, ProxyCall *call, int tries){
+	for(int i=0; i<tries; i++){
+		Backend *backend = proxy->route(req[1]);
+		if(backend == NULL){
+			call->resp.clear();
+			call->resp.push_back("error");
+			call->resp.push_back("no node for key");
+			return 0;
+		}
+		if(backend->request(req, call) == -1){
+			return -1;
+		}
+		if(call->resp.empty() || call->resp[0] != "out_of_range"){
+			break;
+		}
+		proxy->reload();
+	}
+	return 0;
+}
+
+// 第一个参数是 key(或者 hash, zset, queue 的名字)的命令
+static int proc_forward(NetworkServer *net, Link *link, const Request &req, Response *resp){
+	ProxyServer *proxy = (ProxyServer *)net->data;
+	if(req.size() < 2){
+		resp->push_back("client_error");
+		resp->push_back("wrong number of arguments");
+		return 0;
+	}
+	ProxyCall call;
+	if(forward(proxy, req, &call, 2) == -1){
+		resp->push_back("error");
+		resp->push_back("backend error");
+		return 0;
+	}
+	resp->resp.swap(call.resp);
+	return 0;
+}
+
+// 流水线中的一批转发命令: 先全部发送, 再按顺序等待响应, 一批请求只需要
+// 等待一次往返. 发给同一个节点的请求使用同一个连接, 节点按发送的顺序执行.
+// 返回 out_of_range 的请求在重新加载区间表之后单独再转发一次
+static int proc_forward_batch(NetworkServer *net, Link *link,
+		const std::vector<const Request *> &reqs, std::vector<Response> *resps)
+{
+	ProxyServer *proxy = (ProxyServer *)net->data;
+	std::vector<ProxyCall> calls(reqs.size());
+	std::vector<Backend *> backends;
+	std::vector<BackendConn *> conns;
+	for(int i=0; i<(int)reqs.size(); i++){
+		const Request &req = *reqs[i];
+		if(req.size() < 2){
+			continue;
+		}
+		Backend *backend = proxy->route(req[1]);
+		if(backend == NULL){
+			continue;
+		}
+		int n = (int)(std::find(backends.begin(), backends.end(), backend) - backends.begin());
+		if(n == (int)backends.size()){
+			backends.push_back(backend);
+			conns.push_back(backend->conn());
+		}
+		conns[n]->send(req, &calls[i]);
+	}
+
+	for(int i=0; i<(int)reqs.size(); i++){
+		const Request &req = *reqs[i];
+		ProxyCall &call = calls[i];
+		Response *resp = &resps->at(i);
+		if(call.conn == NULL){
+			// 参数错误或者没有节点, 由 proc_forward 返回错误
+			proc_forward(net, link, req, resp);
+			continue;
+		}
+		call.conn->wait(&call);
+		if(call.ret == 0 && !call.resp.empty() && call.resp[0] == "out_of_range"){
+			proxy->reload();
+			if(forward(proxy, req, &call, 1) == -1){
+				call.ret = -1;
+			}
+		}
+		if(call.ret == -1){
+			resp->push_back("error");
+			resp->push_back("backend error");
+			continue;
+		}
+		resp->resp.swap(call.resp);
+	}
+	return 0;
+}
+
+// 参数 req[1...] 按 key 所在的节点拆分, 每个 key 占 stride 个参数, 同时
+// 发送给各个节点, 再等待所有的响应. 有节点返回 out_of_range 时重新加载
+// 区间表, 再执行一次. 返回 -1 表示出错, 错误信息在 resp 中
+static int multi_request(ProxyServer *proxy, const Request &req, int stride,
+	std::vector<ProxyCall> *calls, Response *resp)
+{
+	if(req.size() < 2 || (req.size() - 1) % stride != 0){
+		resp->push_back("client_error");
+		resp->push_back("wrong number of arguments");
+		return -1;
+	}
+	for(int retry=0; retry<2; retry++){
+		std::vector<Backend *> nodes;
+		std::vector< std::vector<Bytes> > reqs;
+		for(int i=1; i<(int)req.size(); i+=stride){
+			Backend *backend = proxy->route(req[i]);
+			if(backend == NULL){
+				resp->push_back("error");
+				resp->push_back("no node for key");
+				return -1;
+			}
+			int n = (int)(std::find(nodes.begin(), nodes.end(), backend) - nodes.begin());
+			if(n == (int)nodes.size()){
+				nodes.push_back(backend);
+				reqs.push_back(std::vector<Bytes>(1, req[0]));
+			}
+			for(int j=0; j<stride; j++){
+				reqs[n].push_back(req[i + j]);
+			}
+		}
+
+		calls->clear();
+		calls->resize(nodes.size());
+		for(int i=0; i<(int)nodes.size(); i++){
+			nodes[i]->send(reqs[i], &calls->at(i));
+		}
+		bool stale = false;
+		bool failed = false;
+		for(int i=0; i<(int)nodes.size(); i++){
+			ProxyCall &call = calls->at(i);
+			nodes[i]->wait(&call);
+			if(call.ret == -1){
+				failed = true;
+			}else if(call.resp.empty() || call.resp[0] != "ok"){
+				stale = stale || (!call.resp.empty() && call.resp[0] == "out_of_range");
+				failed = true;
+			}
+		}
+		if(!failed){
+			return 0;
+		}
+		if(!stale || retry > 0){
+			break;
+		}
+		proxy->reload();
+	}
+	// 返回第一个出错的节点的响应
+	for(int i=0; i<(int)calls->size(); i++){
+		ProxyCall &call = calls->at(i);
+		if(call.ret == -1){
+			resp->push_back("error");
+			resp->push_back("backend error");
+			return -1;
+		}
+		if(call.resp.empty() || call.resp[0] != "ok"){
+			resp->resp = call.resp;
+			return -1;
+		}
+	}
+	return -1;
+}
+
+// multi_get, multi_exists, multi_hsize, multi_zsize: 响应是 key-value 列表,
+// 按请求中 key 的顺序合并
+static int proc_multi_kv(NetworkServer *net, Link *link, const Request &req, Response *resp){
+	ProxyServer *proxy = (ProxyServer *)net->data;
+	std::vector<ProxyCall> calls;
+	if(multi_request(proxy, req, 1, &calls, resp) == -1){
+		return 0;
+	}
+	std::map<std::string, std::string> kvs;
+	for(int i=0; i<(int)calls.size(); i++){
+		const std::vector<std::string> &r = calls[i].resp;
+		for(int j=1; j + 1<(int)r.size(); j+=2){
+			kvs[r[j]] = r[j + 1];
+		}
+	}
+	resp->push_back("ok");
+	for(int i=1; i<(int)req.size(); i++){
+		std::map<std::string, std::string>::iterator it = kvs.find(req[i].String());
+		if(it != kvs.end()){
+			resp->push_back(it->first);
+			resp->push_back(it->second);
+		}
+	}
+	return 0;
+}
+
+// multi_set, multi_del: 响应是处理的 key 的个数, 合并时相加
+static int proc_multi_count(NetworkServer *net, Link *link, const Request &req, Response *resp){
+	ProxyServer *proxy = (ProxyServer *)net->data;
+	int stride = (req[0] == "multi_set")? 2 : 1;
+	std::vector<ProxyCall> calls;
+	if(multi_request(proxy, req, stride, &calls, resp) == -1){
+		return 0;
+	}
+	int64_t num = 0;
+	for(int i=0; i<(int)calls.size(); i++){
+		const std::vector<std::string> &r = calls[i].resp;
+		if(r.size() > 1){
+			num += str_to_int64(r[1]);
+		}
+	}
+	resp->reply_int(0, num);
+	return 0;
+}
+
+static int proc_cluster_kv_node_list(NetworkServer *net, Link *link, const Request &req, Response *resp){
+	ProxyServer *proxy = (ProxyServer *)net->data;
+	resp->push_back("ok");
+	proxy->node_list(&resp->resp);
+	return 0;
+}
+
+// 按第一个参数转发的命令
+static const char *forward_cmds[] = {
+	"get", "set", "del", "setx", "setnx", "getset", "getbit", "setbit", "countbit",
+	"substr", "getrange", "strlen", "bitcount", "incr", "decr", "exists", "ttl", "expire",
+
+	"hsize", "hget", "hset", "hdel", "hincr", "hdecr", "hclear", "hgetall", "hscan",
+	"hrscan", "hkeys", "hvals", "hexists", "multi_hexists", "multi_hget", "multi_hset",
+	"multi_hdel",
+
+	"zrank", "zrrank", "zrange", "zrrange", "zsize", "zget", "zset", "zdel", "zincr",
+	"zdecr", "zclear", "zscan", "zrscan", "zkeys", "zcount", "zsum", "zavg",
+	"zremrangebyrank", "zremrangebyscore", "zexists", "multi_zexists", "multi_zget",
+	"multi_zset", "multi_zdel", "zpop_front", "zpop_back",
+
+	"qsize", "qfront", "qback", "qpush", "qpush_front", "qpush_back", "qpop",
+	"qpop_front", "qpop_back", "qtrim_front", "qtrim_back", "qfix", "qclear",
+	"qslice", "qrange", "qget", "qset",
+	NULL
+};
+
+// 转发的命令都在读线程池中执行: 代理没有本地数据, 写命令不需要串行执行,
+// 线程大部分时间在等待节点的响应
+void ProxyServer::reg_procs(NetworkServer *net){
+	for(int i=0; forward_cmds[i]; i++){
+		net->proc_map.set_proc(forward_cmds[i], "rt", proc_forward);
+		net->proc_map.set_batch_proc(forward_cmds[i], proc_forward_batch);
+	}
+	net->proc_map.set_proc("multi_get", "rtm", proc_multi_kv);
+	net->proc_map.set_proc("multi_exists", "rtm", proc_multi_kv);
+	net->proc_map.set_proc("multi_hsize", "rtm", proc_multi_kv);
+	net->proc_map.set_proc("multi_zsize", "rtm", proc_multi_kv);
+	net->proc_map.set_proc("multi_set", "rtm", proc_multi_count);
+	net->proc_map.set_proc("multi_del", "rtm", proc_multi_count);
+	net->proc_map.set_proc("cluster_kv_node_list", "r", proc_cluster_kv_node_list);
+}
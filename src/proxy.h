@@ -0,0 +1,76 @@
+/*
+Copyright (c) 2012-2015 The SSDB Authors. All rights reserved.
+Use of this source code is governed by a BSD-style license that can be
+found in the LICENSE file.
+*/
+#ifndef SSDB_PROXY_H_
+#define SSDB_PROXY_H_
+
+#include "include.h"
+#include <string>
+#include <vector>
+#include <map>
+#include "cluster.h"
+#include "util/bytes.h"
+#include "util/thread.h"
+
+class Config;
+class NetworkServer;
+class Backend;
+
+// 集群的代理. 从控制节点(保存集群信息, 接收 cluster_* 命令的节点)加载各节点
+// 的 key 区间, 把请求转发到 key 所在的节点. 所有客户端共用到每个节点的
+// 少量连接, multi_get/multi_set/multi_del 等命令按节点拆分, 再合并响应.
+class ProxyServer
+{
+public:
+	ProxyServer(const Config &conf, NetworkServer *net);
+	~ProxyServer();
+
+	// 返回 key 所在节点, 没有节点时返回 NULL
+	Backend* route(const Bytes &key);
+	// 重新加载区间表, 在节点返回 out_of_range 时调用. 刚加载过时什么也不做
+	int reload();
+	// 和 cluster_kv_node_list 的格式相同
+	void node_list(std::vector<std::string> *list);
+
+private:
+	struct Route{
+		int id;
+		KeyRange range;
+		Backend *backend;
+	};
+	static bool route_less(const Route &a, const Route &b);
+
+	std::string cluster_ip;
+	int cluster_port;
+	// 节点的密码
+	std::string auth;
+	// 到每个节点的连接数
+	int num_conns;
+	// 秒
+	int refresh_interval;
+	// 毫秒, 连接节点和等待节点读写的超时
+	int connect_timeout;
+	int timeout;
+
+	// 保护 routes 和 backends
+	Mutex mutex;
+	// 按区间排序, 只有 SERVING 的节点
+	std::vector<Route> routes;
+	// ip:port => Backend, 节点下线之后也保留, 直到退出
+	std::map<std::string, Backend *> backends;
+
+	// 同时只有一个线程加载
+	Mutex reload_mutex;
+	double last_reload;
+	int load();
+
+	volatile bool thread_quit;
+	pthread_t tid;
+	static void* _run_thread(void *arg);
+
+	void reg_procs(NetworkServer *net);
+};
+
+#endif
@@ -0,0 +1,200 @@
+/*
+Copyright (c) 2012-2015 The SSDB Authors. All rights reserved.
+Use of this source code is governed by a BSD-style license that can be
+found in the LICENSE file.
+*/
+#include <sys/socket.h>
+#include "proxy_backend.h"
+#include "net/link.h"
+#include "util/log.h"
+
+BackendConn::BackendConn(const std::string &ip, int port, const std::string &auth,
+		int connect_timeout, int timeout){
+	this->ip = ip;
+	this->port = port;
+	this->auth = auth;
+	this->connect_timeout = connect_timeout;
+	this->timeout = timeout;
+	this->link = NULL;
+	this->quit = false;
+	pthread_mutex_init(&send_mutex, NULL);
+	pthread_mutex_init(&mutex, NULL);
+	pthread_cond_init(&cond, NULL);
+
+	int err = pthread_create(&tid, NULL, &BackendConn::_run_thread, this);
+	if(err != 0){
+		log_fatal("can't create thread: %s", strerror(err));
+		exit(0);
+	}
+}
+
+BackendConn::~BackendConn(){
+	pthread_mutex_lock(&mutex);
+	quit = true;
+	if(link){
+		::shutdown(link->fd(), SHUT_RDWR);
+	}
+	pthread_cond_broadcast(&cond);
+	pthread_mutex_unlock(&mutex);
+	pthread_join(tid, NULL);
+
+	delete link;
+	pthread_cond_destroy(&cond);
+	pthread_mutex_destroy(&mutex);
+	pthread_mutex_destroy(&send_mutex);
+}
+
+// 调用者持有 send_mutex 和 mutex
+int BackendConn::connect(){
+	Link *l = Link::connect(ip.c_str(), port, connect_timeout);
+	if(l == NULL){
+		log_error("failed to connect to %s:%d: %s", ip.c_str(), port, strerror(errno));
+		return -1;
+	}
+	l->nodelay();
+	l->timeout(timeout);
+	if(!auth.empty()){
+		const std::vector<Bytes> *resp = l->request("auth", auth);
+		if(!resp || resp->empty() || resp->at(0) != "ok"){
+			log_error("%s:%d auth error", ip.c_str(), port);
+			delete l;
+			return -1;
+		}
+	}
+	link = l;
+	return 0;
+}
+
+// 调用者持有 mutex
+void BackendConn::fail_all(){
+	while(!calls.empty()){
+		ProxyCall *call = calls.front();
+		calls.pop_front();
+		call->ret = -1;
+		call->done = true;
+	}
+}
+
+int BackendConn::send(const std::vector<Bytes> &req, ProxyCall *call){
+	call->conn = this;
+	call->done = false;
+	pthread_mutex_lock(&send_mutex);
+	pthread_mutex_lock(&mutex);
+	if(link == NULL && connect() == -1){
+		pthread_mutex_unlock(&mutex);
+		pthread_mutex_unlock(&send_mutex);
+		call->ret = -1;
+		call->done = true;
+		return -1;
+	}
+	// 先排队再发送, 响应可能在 flush() 返回之前到达
+	calls.push_back(call);
+	Link *l = link;
+	pthread_cond_broadcast(&cond);
+	pthread_mutex_unlock(&mutex);
+
+	// 持有 send_mutex 时接收线程不会释放 link
+	if(l->send(req) == -1 || l->flush() == -1){
+		log_error("%s:%d write error or timeout", ip.c_str(), port);
+		// 接收线程会读取出错, 让所有等待的请求失败
+		::shutdown(l->fd(), SHUT_RDWR);
+	}
+	pthread_mutex_unlock(&send_mutex);
+	return 0;
+}
+
+void BackendConn::wait(ProxyCall *call){
+	pthread_mutex_lock(&mutex);
+	while(!call->done){
+		pthread_cond_wait(&cond, &mutex);
+	}
+	pthread_mutex_unlock(&mutex);
+}
+
+void* BackendConn::_run_thread(void *arg){
+	BackendConn *conn = (BackendConn *)arg;
+	conn->run();
+	return (void *)NULL;
+}
+
+// 只有这个线程读取和释放 link, 读取时不持有 mutex, 发送的线程可以同时
+// 写入输出缓冲区. 释放 link 之前先 shutdown, 让阻塞在写的发送线程返回,
+// 然后按 send_mutex, mutex 的顺序加锁
+void BackendConn::run(){
+	pthread_mutex_lock(&mutex);
+	while(!quit){
+		if(calls.empty() || link == NULL){
+			pthread_cond_wait(&cond, &mutex);
+			continue;
+		}
+		Link *l = link;
+		pthread_mutex_unlock(&mutex);
+		const std::vector<Bytes> *resp = l->response();
+
+		if(resp == NULL){
+			::shutdown(l->fd(), SHUT_RDWR);
+			pthread_mutex_lock(&send_mutex);
+			pthread_mutex_lock(&mutex);
+			if(!quit){
+				log_error("%s:%d connection error or timeout", ip.c_str(), port);
+			}
+			link = NULL;
+			delete l;
+			fail_all();
+			pthread_mutex_unlock(&send_mutex);
+		}else{
+			pthread_mutex_lock(&mutex);
+			ProxyCall *call = calls.front();
+			calls.pop_front();
+			call->resp.clear();
+			for(int i=0; i<(int)resp->size(); i++){
+				call->resp.push_back(resp->at(i).String());
+			}
+			call->ret = 0;
+			call->done = true;
+		}
+		pthread_cond_broadcast(&cond);
+	}
+	fail_all();
+	pthread_mutex_unlock(&mutex);
+}
+
+
+Backend::Backend(const std::string &ip, int port, const std::string &auth, int num_conns,
+		int connect_timeout, int timeout){
+	this->ip = ip;
+	this->port = port;
+	this->next = 0;
+	for(int i=0; i<num_conns; i++){
+		conns.push_back(new BackendConn(ip, port, auth, connect_timeout, timeout));
+	}
+}
+
+Backend::~Backend(){
+	for(int i=0; i<(int)conns.size(); i++){
+		delete conns[i];
+	}
+}
+
+BackendConn* Backend::conn(){
+	unsigned int n = __sync_fetch_and_add(&next, 1);
+	return conns[n % conns.size()];
+}
+
+int Backend::send(const std::vector<Bytes> &req, ProxyCall *call){
+	return this->conn()->send(req, call);
+}
+
+void Backend::wait(ProxyCall *call){
+	if(call->conn){
+		call->conn->wait(call);
+	}
+}
+
+int Backend::request(const std::vector<Bytes> &req, ProxyCall *call){
+	if(send(req, call) == -1){
+		return -1;
+	}
+	wait(call);
+	return call->ret;
+}
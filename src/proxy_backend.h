@@ -0,0 +1,94 @@
+/*
+Copyright (c) 2012-2015 The SSDB Authors. All rights reserved.
+Use of this source code is governed by a BSD-style license that can be
+found in the LICENSE file.
+*/
+#ifndef SSDB_PROXY_BACKEND_H_
+#define SSDB_PROXY_BACKEND_H_
+
+#include "include.h"
+#include <string>
+#include <vector>
+#include <deque>
+#include "util/bytes.h"
+#include "util/thread.h"
+
+class Link;
+class BackendConn;
+
+// 一次转发的请求, send() 之后用 wait() 等待响应, 可以先发送多个再等待
+struct ProxyCall{
+	std::vector<std::string> resp;
+	// 0: 成功, -1: 连接出错
+	int ret;
+	bool done;
+	// 发送请求的连接
+	BackendConn *conn;
+
+	ProxyCall(){
+		ret = 0;
+		done = false;
+		conn = NULL;
+	}
+};
+
+// 到一个节点的连接, 由多个工作线程共用. 请求以流水线的方式发送, 响应由
+// 这个连接的接收线程按顺序交给等待的请求
+class BackendConn
+{
+public:
+	BackendConn(const std::string &ip, int port, const std::string &auth,
+		int connect_timeout, int timeout);
+	~BackendConn();
+	int send(const std::vector<Bytes> &req, ProxyCall *call);
+	void wait(ProxyCall *call);
+
+private:
+	std::string ip;
+	int port;
+	std::string auth;
+	// 毫秒, 节点卡住时请求超时失败, 不会一直占用工作线程
+	int connect_timeout;
+	int timeout;
+	// 连接出错后由接收线程释放, 下一个请求重新连接
+	Link *link;
+	bool quit;
+	pthread_t tid;
+	// 串行化发送和连接, 在 mutex 之前加锁. 写 socket 时只持有这个锁, 节点
+	// 不读取时接收线程仍然可以取得 mutex, 交付响应
+	pthread_mutex_t send_mutex;
+	// 保护 link 和 calls, cond 在响应到达或者有新的请求时通知
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	// 已发送, 等待响应的请求, 按发送的顺序
+	std::deque<ProxyCall *> calls;
+
+	int connect();
+	void fail_all();
+	static void* _run_thread(void *arg);
+	void run();
+};
+
+// 到一个节点的一组连接
+class Backend
+{
+public:
+	Backend(const std::string &ip, int port, const std::string &auth, int num_conns,
+		int connect_timeout, int timeout);
+	~Backend();
+	std::string ip;
+	int port;
+	int send(const std::vector<Bytes> &req, ProxyCall *call);
+	void wait(ProxyCall *call);
+	// 发送并等待响应
+	int request(const std::vector<Bytes> &req, ProxyCall *call);
+	// 轮流选择一个连接. 一个连接上的请求由节点按发送的顺序执行
+	BackendConn* conn();
+
+private:
+	std::vector<BackendConn *> conns;
+	// 轮流使用各个连接
+	volatile unsigned int next;
+};
+
+#endif
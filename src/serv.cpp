@@ -128,6 +128,10 @@ DEF_PROC(cluster_kv_node_list);
 DEF_PROC(cluster_set_kv_range);
 DEF_PROC(cluster_set_kv_status);
 DEF_PROC(cluster_migrate_kv_data);
+DEF_PROC(migrate_range);
+DEF_PROC(cluster_rebalance);
+DEF_PROC(range_stats);
+DEF_PROC(range_split);
 
 
 // 用于注册命令处理汉书的宏
@@ -151,15 +155,15 @@ void SSDBServer::reg_procs(NetworkServer *net){
 	REG_PROC(bitcount, "r");
 	REG_PROC(incr, "wt");
 	REG_PROC(decr, "wt");
-	REG_PROC(scan, "rt");
-	REG_PROC(rscan, "rt");
-	REG_PROC(keys, "rt");
-	REG_PROC(rkeys, "rt");
+	REG_PROC(scan, "rts");
+	REG_PROC(rscan, "rts");
+	REG_PROC(keys, "rts");
+	REG_PROC(rkeys, "rts");
 	REG_PROC(exists, "r");
 	REG_PROC(multi_exists, "r");
-	REG_PROC(multi_get, "rt");
-	REG_PROC(multi_set, "wt");
-	REG_PROC(multi_del, "wt");
+	REG_PROC(multi_get, "rtm");
+	REG_PROC(multi_set, "wtm");
+	REG_PROC(multi_del, "wtm");
 	REG_PROC(ttl, "r");
 	REG_PROC(expire, "wt");
 
@@ -170,25 +174,25 @@ void SSDBServer::reg_procs(NetworkServer *net){
 	REG_PROC(hincr, "wt");
 	REG_PROC(hdecr, "wt");
 	REG_PROC(hclear, "wt");
-	REG_PROC(hgetall, "rt");
-	REG_PROC(hscan, "rt");
-	REG_PROC(hrscan, "rt");
-	REG_PROC(hkeys, "rt");
-	REG_PROC(hvals, "rt");
-	REG_PROC(hlist, "rt");
-	REG_PROC(hrlist, "rt");
+	REG_PROC(hgetall, "rts");
+	REG_PROC(hscan, "rts");
+	REG_PROC(hrscan, "rts");
+	REG_PROC(hkeys, "rts");
+	REG_PROC(hvals, "rts");
+	REG_PROC(hlist, "rts");
+	REG_PROC(hrlist, "rts");
 	REG_PROC(hexists, "r");
 	REG_PROC(multi_hexists, "r");
 	REG_PROC(multi_hsize, "r");
-	REG_PROC(multi_hget, "rt");
-	REG_PROC(multi_hset, "wt");
-	REG_PROC(multi_hdel, "wt");
+	REG_PROC(multi_hget, "rtm");
+	REG_PROC(multi_hset, "wtm");
+	REG_PROC(multi_hdel, "wtm");
 
 	// because zrank may be extremly slow, execute in a seperate thread
-	REG_PROC(zrank, "rt");
-	REG_PROC(zrrank, "rt");
-	REG_PROC(zrange, "rt");
-	REG_PROC(zrrange, "rt");
+	REG_PROC(zrank, "rts");
+	REG_PROC(zrrank, "rts");
+	REG_PROC(zrange, "rts");
+	REG_PROC(zrrange, "rts");
 	REG_PROC(zsize, "r");
 	REG_PROC(zget, "rt");
 	REG_PROC(zset, "wt");
@@ -196,22 +200,22 @@ void SSDBServer::reg_procs(NetworkServer *net){
 	REG_PROC(zincr, "wt");
 	REG_PROC(zdecr, "wt");
 	REG_PROC(zclear, "wt");
-	REG_PROC(zscan, "rt");
-	REG_PROC(zrscan, "rt");
-	REG_PROC(zkeys, "rt");
-	REG_PROC(zlist, "rt");
-	REG_PROC(zrlist, "rt");
-	REG_PROC(zcount, "rt");
-	REG_PROC(zsum, "rt");
-	REG_PROC(zavg, "rt");
+	REG_PROC(zscan, "rts");
+	REG_PROC(zrscan, "rts");
+	REG_PROC(zkeys, "rts");
+	REG_PROC(zlist, "rts");
+	REG_PROC(zrlist, "rts");
+	REG_PROC(zcount, "rts");
+	REG_PROC(zsum, "rts");
+	REG_PROC(zavg, "rts");
 	REG_PROC(zremrangebyrank, "wt");
 	REG_PROC(zremrangebyscore, "wt");
 	REG_PROC(zexists, "r");
 	REG_PROC(multi_zexists, "r");
 	REG_PROC(multi_zsize, "r");
-	REG_PROC(multi_zget, "rt");
-	REG_PROC(multi_zset, "wt");
-	REG_PROC(multi_zdel, "wt");
+	REG_PROC(multi_zget, "rtm");
+	REG_PROC(multi_zset, "wtm");
+	REG_PROC(multi_zdel, "wtm");
 	REG_PROC(zpop_front, "wt");
 	REG_PROC(zpop_back, "wt");
 
@@ -228,10 +232,10 @@ void SSDBServer::reg_procs(NetworkServer *net){
 	REG_PROC(qtrim_back, "wt");
 	REG_PROC(qfix, "wt");
 	REG_PROC(qclear, "wt");
-	REG_PROC(qlist, "rt");
-	REG_PROC(qrlist, "rt");
-	REG_PROC(qslice, "rt");
-	REG_PROC(qrange, "rt");
+	REG_PROC(qlist, "rts");
+	REG_PROC(qrlist, "rts");
+	REG_PROC(qslice, "rts");
+	REG_PROC(qrange, "rts");
 	REG_PROC(qget, "r");
 	REG_PROC(qset, "wt");
 
@@ -244,7 +248,7 @@ void SSDBServer::reg_procs(NetworkServer *net){
 	REG_PROC(dbsize, "r");
 	// doing compaction in a reader thread, because we have only one
 	// writer thread(for performance reason); we don't want to block writes
-	REG_PROC(compact, "rt");
+	REG_PROC(compact, "rta");
 
 	REG_PROC(ignore_key_range, "r");
 	REG_PROC(get_key_range, "r");
@@ -256,10 +260,43 @@ void SSDBServer::reg_procs(NetworkServer *net){
 	REG_PROC(cluster_kv_node_list, "r");
 	REG_PROC(cluster_set_kv_range, "r");
 	REG_PROC(cluster_set_kv_status, "r");
-	REG_PROC(cluster_migrate_kv_data, "r");
+	REG_PROC(cluster_migrate_kv_data, "rta");
+	// 会删除本节点的数据, 是写命令. admin 类的写命令由单独的线程执行,
+	// 迁移期间写线程仍然处理其它写命令
+	REG_PROC(migrate_range, "wta");
+	REG_PROC(cluster_rebalance, "rta");
+	REG_PROC(range_stats, "rts");
+	REG_PROC(range_split, "rts");
 }
 
 
+// 写操作提交之后, 把修改过的 kv 和 hash 的 key 转成 tracking 的 key
+static void tracking_hook(const std::vector<std::string> &keys, void *arg){
+	Tracking *tracking = (Tracking *)arg;
+	if(tracking->links() == 0){
+		return;
+	}
+	std::vector<std::string> tkeys;
+	std::string name, field;
+	for(int i=0; i<(int)keys.size(); i++){
+		const std::string &key = keys[i];
+		if(key.empty()){
+			continue;
+		}
+		if(key[0] == DataType::KV){
+			tkeys.push_back(key);
+		}else if(key[0] == DataType::HASH){
+			if(decode_hash_key(key, &name, &field) == -1){
+				continue;
+			}
+			tkeys.push_back(std::string(1, DataType::HASH) + name);
+		}
+	}
+	if(!tkeys.empty()){
+		tracking->invalidate(tkeys);
+	}
+}
+
 SSDBServer::SSDBServer(SSDB *ssdb, SSDB *meta, const Config &conf, NetworkServer *net){
 	this->ssdb = (SSDBImpl *)ssdb;
 	this->meta = meta;
@@ -269,6 +306,8 @@ SSDBServer::SSDBServer(SSDB *ssdb, SSDB *meta, const Config &conf, NetworkServer
 	net->data = this;
 	// 注册处理函数，会将各个命令的处理函数注册到网络服务器
 	this->reg_procs(net);
+	// 被修改的 key 推送失效通知给客户端缓存
+	this->ssdb->binlogs->set_commit_hook(tracking_hook, net->tracking);
 
     // 同步速度？看看在那里用到吧
 	int sync_speed = conf.get_num("replication.sync_speed");
@@ -505,11 +544,17 @@ int proc_info(NetworkServer *net, Link *link, const Request &req, Response *resp
 		proc_map_t::iterator it;
 		for(it=net->proc_map.begin(); it!=net->proc_map.end(); it++){
 			Command *cmd = it->second;
-			calls += cmd->calls;
+			calls += cmd->calls();
 		}
 		resp->push_back("total_calls");
 		resp->add(calls);
 	}
+	{
+		std::vector<std::string> tmp = net->pool_info();
+		for(int i=0; i<(int)tmp.size(); i++){
+			resp->push_back(tmp[i]);
+		}
+	}
 	
 	{
 		uint64_t size = serv->ssdb->size();
@@ -522,6 +567,28 @@ int proc_info(NetworkServer *net, Link *link, const Request &req, Response *resp
 		resp->push_back("binlogs");
 		resp->push_back(s);
 	}
+	if(net->tracking->links() > 0){
+		char buf[128];
+		snprintf(buf, sizeof(buf), "links: %d\tkeys: %d\tpushed: %" PRIu64,
+			net->tracking->links(), net->tracking->keys(), net->tracking->pushed());
+		resp->push_back("tracking");
+		resp->push_back(buf);
+	}
+	if(Logger::shared()->is_async()){
+		resp->push_back("log_dropped");
+		resp->push_back(str(log_dropped()));
+	}
+	{
+		BufferPoolStats st;
+		buffer_pool_stats(&st);
+		int64_t total = st.hits + st.misses;
+		char buf[256];
+		snprintf(buf, sizeof(buf),
+			"hits: %" PRId64 "\tmisses: %" PRId64 "\thit_rate: %.3f\tused: %" PRId64 "\tcached: %" PRId64,
+			st.hits, st.misses, total? (double)st.hits / total : 0.0, st.used, st.cached);
+		resp->push_back("buffer_pool");
+		resp->push_back(buf);
+	}
 	{
 		std::vector<std::string> syncs = serv->backend_sync->stats();
 		std::vector<std::string>::iterator it;
@@ -615,10 +682,13 @@ int proc_info(NetworkServer *net, Link *link, const Request &req, Response *resp
 		proc_map_t::iterator it;
 		for(it=net->proc_map.begin(); it!=net->proc_map.end(); it++){
 			Command *cmd = it->second;
+			uint64_t calls;
+			double time_wait, time_proc;
+			cmd->get_stat(&calls, &time_wait, &time_proc);
 			resp->push_back("cmd." + cmd->name);
 			char buf[128];
 			snprintf(buf, sizeof(buf), "calls: %" PRIu64 "\ttime_wait: %.0f\ttime_proc: %.0f",
-				cmd->calls, cmd->time_wait, cmd->time_proc);
+				calls, time_wait, time_proc);
 			resp->push_back(buf);
 		}
 	}
@@ -59,6 +59,13 @@ public:
 		} \
 	}while(0)
 
+// 连接开启了 tracking 时, 跟踪读取的 key, 必须在读取之前调用
+#define TRACK_KEY(type, key) do{ \
+		if(link->tracking){ \
+			net->tracking->track(link, std::string(1, type) + (key).String()); \
+		} \
+	}while(0)
+
 #define CHECK_NUM_PARAMS(n) do{ \
 		if(req.size() < n){ \
 			resp->push_back("client_error"); \
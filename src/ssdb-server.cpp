@@ -48,6 +48,7 @@ void MyApplication::run(){
 	log_info("log_level        : %s", Logger::shared()->level_name().c_str());
 	log_info("log_output       : %s", Logger::shared()->output_name().c_str());
 	log_info("log_rotate_size  : %" PRId64, Logger::shared()->rotate_size());
+	log_info("log_async        : %s", Logger::shared()->is_async()? "yes" : "no");
 
 	log_info("main_db          : %s", data_db_dir.c_str());
 	log_info("meta_db          : %s", meta_db_dir.c_str());
@@ -91,6 +92,8 @@ void MyApplication::run(){
 	net->serve();
 	
 	// 释放资源
+	// 同步线程还可能写入数据, 先取消失效通知
+	server->ssdb->binlogs->set_commit_hook(NULL, NULL);
 	delete net;
 	delete server;
 	delete meta_db;
@@ -176,6 +176,8 @@ BinlogQueue::BinlogQueue(leveldb::DB *db, bool enabled){
 	// 队列空间
 	this->capacity = LOG_QUEUE_SIZE;
 	this->enabled = enabled;
+	this->commit_hook = NULL;
+	this->commit_hook_arg = NULL;
 	
 	Binlog log;
 	// 从leveldb中查找之前最大的序列号
@@ -240,6 +242,7 @@ void BinlogQueue::begin(){
 	tran_seq = last_seq;
 	// 清理batch操作
 	batch.Clear();
+	tran_keys.clear();
 }
 
 // 会滚，将事务序列号置0
@@ -258,12 +261,25 @@ leveldb::Status BinlogQueue::commit(){
 		last_seq = tran_seq;
 		// 重置事务序列号
 		tran_seq = 0;
+		if(commit_hook && !tran_keys.empty()){
+			commit_hook(tran_keys, commit_hook_arg);
+		}
 	}
+	tran_keys.clear();
 	return s;
 }
 
+void BinlogQueue::set_commit_hook(commit_hook_t hook, void *arg){
+	Locking l(&this->mutex);
+	this->commit_hook = hook;
+	this->commit_hook_arg = arg;
+}
+
 // 添加一条日志到队列中
 void BinlogQueue::add_log(char type, char cmd, const leveldb::Slice &key){
+	if(commit_hook){
+		tran_keys.push_back(key.ToString());
+	}
 	if(!enabled){
 		return;
 	}
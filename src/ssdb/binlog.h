@@ -7,6 +7,7 @@ found in the LICENSE file.
 #define SSDB_BINLOG_H_
 
 #include <string>
+#include <vector>
 #include "leveldb/db.h"
 #include "leveldb/options.h"
 #include "leveldb/slice.h"
@@ -78,6 +79,17 @@ private:
 		
 	void merge();
 	bool enabled;
+
+public:
+	// 事务提交成功之后, 以事务修改的 key(编码之后的)调用. 在提交事务的
+	// 线程中调用, 这时还持有 mutex
+	typedef void (*commit_hook_t)(const std::vector<std::string> &keys, void *arg);
+private:
+	commit_hook_t commit_hook;
+	void *commit_hook_arg;
+	// 当前事务修改的 key, 只在设置了 commit_hook 时记录(不管是否开启了 binlog)
+	std::vector<std::string> tran_keys;
+
 public:
     // 线程锁
 	Mutex mutex;
@@ -93,6 +105,8 @@ public:
 	void Delete(const leveldb::Slice& key);
 	void add_log(char type, char cmd, const leveldb::Slice &key);
 	void add_log(char type, char cmd, const std::string &key);
+	// hook 为 NULL 时取消
+	void set_commit_hook(commit_hook_t hook, void *arg);
 		
 	int get(uint64_t seq, Binlog *log) const;
 	int update(uint64_t seq, char type, char cmd, const std::string &key);
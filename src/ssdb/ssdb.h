@@ -29,6 +29,9 @@ public:
 
 	//void flushdb();
 	virtual uint64_t size() = 0;
+	// (start, end] 中的 kv 在磁盘上的大概字节数, end 为空表示到最后.
+	// 不包括还在 memtable 中的数据
+	virtual uint64_t kv_size(const Bytes &start, const Bytes &end) = 0;
 	virtual std::vector<std::string> info() = 0;
 	virtual void compact() = 0;
 	virtual int key_range(std::vector<std::string> *keys) = 0;
@@ -50,6 +53,9 @@ public:
 	virtual int incr(const Bytes &key, int64_t by, int64_t *new_val, char log_type=BinlogType::SYNC) = 0;
 	virtual int multi_set(const std::vector<Bytes> &kvs, int offset=0, char log_type=BinlogType::SYNC) = 0;
 	virtual int multi_del(const std::vector<Bytes> &keys, int offset=0, char log_type=BinlogType::SYNC) = 0;
+	// 用于迁移数据: kvs 是 key, value 对, 只删除值仍然是 value 的 key,
+	// 在一个事务中完成. 返回删除的个数
+	virtual int multi_del_eq(const std::vector<Bytes> &kvs, char log_type=BinlogType::SYNC) = 0;
 	virtual int setbit(const Bytes &key, int bitoffset, int on, char log_type=BinlogType::SYNC) = 0;
 	virtual int getbit(const Bytes &key, int bitoffset) = 0;
 	
@@ -65,6 +71,8 @@ public:
 	virtual int hdel(const Bytes &name, const Bytes &key, char log_type=BinlogType::SYNC) = 0;
 	// -1: error, 1: ok, 0: value is not an integer or out of range
 	virtual int hincr(const Bytes &name, const Bytes &key, int64_t by, int64_t *new_val, char log_type=BinlogType::SYNC) = 0;
+	// 同 multi_del_eq()
+	virtual int multi_hdel_eq(const Bytes &name, const std::vector<Bytes> &kvs, char log_type=BinlogType::SYNC) = 0;
 
 	virtual int64_t hsize(const Bytes &name) = 0;
 	virtual int64_t hclear(const Bytes &name) = 0;
@@ -82,6 +90,8 @@ public:
 	virtual int zdel(const Bytes &name, const Bytes &key, char log_type=BinlogType::SYNC) = 0;
 	// -1: error, 1: ok, 0: value is not an integer or out of range
 	virtual int zincr(const Bytes &name, const Bytes &key, int64_t by, int64_t *new_val, char log_type=BinlogType::SYNC) = 0;
+	// 同 multi_del_eq(), kvs 是 key, score 对
+	virtual int multi_zdel_eq(const Bytes &name, const std::vector<Bytes> &kvs, char log_type=BinlogType::SYNC) = 0;
 	
 	virtual int64_t zsize(const Bytes &name) = 0;
 	/**
@@ -116,6 +126,9 @@ public:
 	// @return 0: empty queue, 1: item popped, -1: error
 	virtual int qpop_front(const Bytes &name, std::string *item, char log_type=BinlogType::SYNC) = 0;
 	virtual int qpop_back(const Bytes &name, std::string *item, char log_type=BinlogType::SYNC) = 0;
+	// 依次弹出和 items 相同的头部元素, 遇到不同的停止, 在一个事务中完成.
+	// 返回弹出的个数
+	virtual int qpop_front_eq(const Bytes &name, const std::vector<std::string> &items, char log_type=BinlogType::SYNC) = 0;
 	virtual int qfix(const Bytes &name) = 0;
 	virtual int qlist(const Bytes &name_s, const Bytes &name_e, uint64_t limit,
 			std::vector<std::string> *list) = 0;
@@ -154,6 +154,21 @@ uint64_t SSDBImpl::size(){
 	return sizes[0];
 }
 
+uint64_t SSDBImpl::kv_size(const Bytes &start, const Bytes &end){
+	std::string s = encode_kv_key(start);
+	std::string e;
+	if(end.empty()){
+		e.append(1, DataType::KV + 1);
+	}else{
+		e = encode_kv_key(end);
+	}
+	leveldb::Range ranges[1];
+	ranges[0] = leveldb::Range(s, e);
+	uint64_t sizes[1];
+	db->GetApproximateSizes(ranges, 1, sizes);
+	return sizes[0];
+}
+
 // 返回数据库相关的信息，都是leveldb相关的状态信息
 std::vector<std::string> SSDBImpl::info(){
 	//  "leveldb.num-files-at-level<N>" - return the number of files at level <N>,
@@ -46,6 +46,7 @@ public:
 
 	//void flushdb();
 	virtual uint64_t size();
+	virtual uint64_t kv_size(const Bytes &start, const Bytes &end);
 	virtual std::vector<std::string> info();
 	virtual void compact();
 	virtual int key_range(std::vector<std::string> *keys);
@@ -66,6 +67,9 @@ public:
 	virtual int incr(const Bytes &key, int64_t by, int64_t *new_val, char log_type=BinlogType::SYNC);
 	virtual int multi_set(const std::vector<Bytes> &kvs, int offset=0, char log_type=BinlogType::SYNC);
 	virtual int multi_del(const std::vector<Bytes> &keys, int offset=0, char log_type=BinlogType::SYNC);
+	// 用于迁移数据: kvs 是 key, value 对, 只删除值仍然是 value 的 key,
+	// 在一个事务中完成. 返回删除的个数
+	virtual int multi_del_eq(const std::vector<Bytes> &kvs, char log_type=BinlogType::SYNC);
 	virtual int setbit(const Bytes &key, int bitoffset, int on, char log_type=BinlogType::SYNC);
 	virtual int getbit(const Bytes &key, int bitoffset);
 	
@@ -81,6 +85,8 @@ public:
 	virtual int hdel(const Bytes &name, const Bytes &key, char log_type=BinlogType::SYNC);
 	// -1: error, 1: ok, 0: value is not an integer or out of range
 	virtual int hincr(const Bytes &name, const Bytes &key, int64_t by, int64_t *new_val, char log_type=BinlogType::SYNC);
+	// 同 multi_del_eq()
+	virtual int multi_hdel_eq(const Bytes &name, const std::vector<Bytes> &kvs, char log_type=BinlogType::SYNC);
 	//int multi_hset(const Bytes &name, const std::vector<Bytes> &kvs, int offset=0, char log_type=BinlogType::SYNC);
 	//int multi_hdel(const Bytes &name, const std::vector<Bytes> &keys, int offset=0, char log_type=BinlogType::SYNC);
 
@@ -100,6 +106,8 @@ public:
 	virtual int zdel(const Bytes &name, const Bytes &key, char log_type=BinlogType::SYNC);
 	// -1: error, 1: ok, 0: value is not an integer or out of range
 	virtual int zincr(const Bytes &name, const Bytes &key, int64_t by, int64_t *new_val, char log_type=BinlogType::SYNC);
+	// 同 multi_del_eq(), kvs 是 key, score 对
+	virtual int multi_zdel_eq(const Bytes &name, const std::vector<Bytes> &kvs, char log_type=BinlogType::SYNC);
 	//int multi_zset(const Bytes &name, const std::vector<Bytes> &kvs, int offset=0, char log_type=BinlogType::SYNC);
 	//int multi_zdel(const Bytes &name, const std::vector<Bytes> &keys, int offset=0, char log_type=BinlogType::SYNC);
 	
@@ -136,6 +144,9 @@ public:
 	// @return 0: empty queue, 1: item popped, -1: error
 	virtual int qpop_front(const Bytes &name, std::string *item, char log_type=BinlogType::SYNC);
 	virtual int qpop_back(const Bytes &name, std::string *item, char log_type=BinlogType::SYNC);
+	// 依次弹出和 items 相同的头部元素, 遇到不同的停止, 在一个事务中完成.
+	// 返回弹出的个数
+	virtual int qpop_front_eq(const Bytes &name, const std::vector<std::string> &items, char log_type=BinlogType::SYNC);
 	virtual int qfix(const Bytes &name);
 	virtual int qlist(const Bytes &name_s, const Bytes &name_e, uint64_t limit,
 			std::vector<std::string> *list);
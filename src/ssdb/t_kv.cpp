@@ -59,6 +59,37 @@ int SSDBImpl::multi_del(const std::vector<Bytes> &keys, int offset, char log_typ
 	return keys.size() - offset;
 }
 
+int SSDBImpl::multi_del_eq(const std::vector<Bytes> &kvs, char log_type){
+	Transaction trans(binlogs);
+
+	int num = 0;
+	for(int i=0; i+1<(int)kvs.size(); i+=2){
+		const Bytes &key = kvs[i];
+		std::string val;
+		// 在事务中检查, 其它写操作不能在检查和删除之间修改
+		int ret = this->get(key, &val);
+		if(ret == -1){
+			return -1;
+		}
+		if(ret == 0 || kvs[i + 1] != Bytes(val)){
+			continue;
+		}
+		std::string buf = encode_kv_key(key);
+		binlogs->Delete(buf);
+		binlogs->add_log(log_type, BinlogCommand::KDEL, buf);
+		num ++;
+	}
+	if(num == 0){
+		return 0;
+	}
+	leveldb::Status s = binlogs->commit();
+	if(!s.ok()){
+		log_error("multi_del_eq error: %s", s.ToString().c_str());
+		return -1;
+	}
+	return num;
+}
+
 // 单次操作也要加事务？应该是为了保证操作日志吧，为了保证主从同步？
 int SSDBImpl::set(const Bytes &key, const Bytes &val, char log_type){
 	if(key.empty()){
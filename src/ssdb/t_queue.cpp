@@ -389,6 +389,54 @@ int SSDBImpl::qpop_back(const Bytes &name, std::string *item, char log_type){
 	return _qpop(name, item, QBACK_SEQ, log_type);
 }
 
+int SSDBImpl::qpop_front_eq(const Bytes &name, const std::vector<std::string> &items, char log_type){
+	Transaction trans(binlogs);
+
+	uint64_t seq;
+	int ret = qget_uint64(this->db, name, QFRONT_SEQ, &seq);
+	if(ret != 1){
+		return ret;
+	}
+	int64_t size = this->qsize(name);
+	if(size == -1){
+		return -1;
+	}
+	int num = 0;
+	while(num < (int)items.size() && num < size){
+		std::string item;
+		ret = qget_by_seq(this->db, name, seq, &item);
+		if(ret == -1){
+			return -1;
+		}
+		if(ret == 0 || item != items[num]){
+			break;
+		}
+		qdel_one(this, name, seq);
+		binlogs->add_log(log_type, BinlogCommand::QPOP_FRONT, name.String());
+		seq ++;
+		num ++;
+	}
+	if(num == 0){
+		return 0;
+	}
+	// qsize 读的是事务之前的值, 只能修改一次
+	size = incr_qsize(this, name, -num);
+	if(size == -1){
+		return -1;
+	}
+	if(size > 0){
+		if(qset_one(this, name, QFRONT_SEQ, Bytes(&seq, sizeof(seq))) == -1){
+			return -1;
+		}
+	}
+	leveldb::Status s = binlogs->commit();
+	if(!s.ok()){
+		log_error("qpop_front_eq error: %s", s.ToString().c_str());
+		return -1;
+	}
+	return num;
+}
+
 // 根据迭代器获取所有队列的名称
 static void get_qnames(Iterator *it, std::vector<std::string> *list){
 	while(it->next()){
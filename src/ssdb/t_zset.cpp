@@ -60,6 +60,39 @@ int SSDBImpl::zdel(const Bytes &name, const Bytes &key, char log_type){
 	return ret;
 }
 
+int SSDBImpl::multi_zdel_eq(const Bytes &name, const std::vector<Bytes> &kvs, char log_type){
+	Transaction trans(binlogs);
+
+	int num = 0;
+	for(int i=0; i+1<(int)kvs.size(); i+=2){
+		std::string score;
+		int ret = this->zget(name, kvs[i], &score);
+		if(ret == -1){
+			return -1;
+		}
+		if(ret == 0 || kvs[i + 1] != Bytes(score)){
+			continue;
+		}
+		if(zdel_one(this, name, kvs[i], log_type) == -1){
+			return -1;
+		}
+		num ++;
+	}
+	if(num == 0){
+		return 0;
+	}
+	// zsize 读的是事务之前的值, 只能修改一次
+	if(incr_zsize(this, name, -num) == -1){
+		return -1;
+	}
+	leveldb::Status s = binlogs->commit();
+	if(!s.ok()){
+		log_error("multi_zdel_eq error: %s", s.ToString().c_str());
+		return -1;
+	}
+	return num;
+}
+
 // 增加value的值
 int SSDBImpl::zincr(const Bytes &name, const Bytes &key, int64_t by, int64_t *new_val, char log_type){
     // 开始事务
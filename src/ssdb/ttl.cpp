@@ -7,9 +7,9 @@ found in the LICENSE file.
 #include <time.h>
 #include "../include.h"
 #include "../util/log.h"
+#include "../util/clock.h"
 #include "ttl.h"
 
-#define EXPIRATION_LIST_KEY "\xff\xff\xff\xff\xff|EXPIRE_LIST|KV"
 #define BATCH_SIZE    1000
 
 ExpirationHandler::ExpirationHandler(SSDB *ssdb){
@@ -47,7 +47,7 @@ void ExpirationHandler::stop(){
 }
 
 int ExpirationHandler::set_ttl(const Bytes &key, int64_t ttl){
-	int64_t expired = time_ms() + ttl * 1000;
+	int64_t expired = clock_wall_ms() + ttl * 1000;
 	char data[30];
 	int size = snprintf(data, sizeof(data), "%" PRId64, expired);
 	if(size <= 0){
@@ -89,7 +89,7 @@ int64_t ExpirationHandler::get_ttl(const Bytes &key){
 	std::string score;
 	if(ssdb->zget(this->list_name, key, &score) == 1){
 		int64_t ex = str_to_int64(score);
-		return (ex - time_ms())/1000;
+		return (ex - clock_wall_ms())/1000;
 	}
 	return -1;
 }
@@ -131,7 +131,7 @@ void ExpirationHandler::expire_loop(){
 	if(this->fast_keys.front(&key, &score)){
 		this->first_timeout = score;
 		
-		if(score <= time_ms()){
+		if(score <= clock_wall_ms()){
 			log_debug("expired %s", key.c_str());
 			ssdb->del(key);
 			ssdb->zdel(this->list_name, key);
@@ -144,7 +144,7 @@ void* ExpirationHandler::thread_func(void *arg){
 	ExpirationHandler *handler = (ExpirationHandler *)arg;
 	
 	while(!handler->thread_quit){
-		if(handler->first_timeout > time_ms()){
+		if(handler->first_timeout > clock_wall_ms()){
 			usleep(10 * 1000);
 			continue;
 		}
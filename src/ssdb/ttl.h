@@ -11,6 +11,9 @@ found in the LICENSE file.
 #include "../util/sorted_set.h"
 #include <string>
 
+// 保存过期时间的 zset 的名字, 迁移等遍历 zset 的地方要跳过它
+#define EXPIRATION_LIST_KEY "\xff\xff\xff\xff\xff|EXPIRE_LIST|KV"
+
 // TODO 用到再看
 class ExpirationHandler
 {
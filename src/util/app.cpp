@@ -153,6 +153,14 @@ void Application::init(){
 	if(app_args.is_daemon){
 		daemonize();
 	}
+
+	// 异步日志的后台线程, 也必须在 daemonize() 之后创建
+	if(strcmp(conf->get_str("logger.async"), "yes") == 0){
+		if(log_start_async() == -1){
+			fprintf(stderr, "error starting async logger\n");
+			exit(1);
+		}
+	}
 }
 
 // 读取进程id
@@ -4,18 +4,216 @@ Use of this source code is governed by a BSD-style license that can be
 found in the LICENSE file.
 */
 #include "bytes.h"
+#include <pthread.h>
 
-// 构造缓冲区，分配内存空间
+/* Buffer 的内存池 */
+
+// 每个线程有一个小的前端缓存, 分配和释放不加锁; 前端缓存满了或空了时,
+// 和所有线程共享的中心缓存成批交换内存块. 缓冲区常常在工作线程中分配
+// (写响应), 在主线程中释放, 中心缓存让这些块回到分配它们的线程.
+
+// 和 Buffer::grow() 的增长方式一致: 8K, 64K, 512K, 然后每次翻倍
+static const int POOL_CLASSES = 6;
+static const int pool_sizes[POOL_CLASSES] = {
+	8 * 1024, 64 * 1024, 512 * 1024, 1024 * 1024, 2 * 1024 * 1024, 4 * 1024 * 1024,
+};
+// 每个线程为每一级缓存的内存块数, 每一级最多 512K-4MB
+static const int pool_limits[POOL_CLASSES] = {64, 8, 2, 1, 1, 1};
+// 中心缓存每一级的内存块数, 每一级最多 4MB
+static const int central_limits[POOL_CLASSES] = {512, 64, 8, 4, 2, 1};
+#define POOL_MAX_BLOCKS		64
+#define CENTRAL_MAX_BLOCKS	512
+
+// 统计在每个线程中累加, 不使用原子操作, 读取时把所有线程的加起来.
+// 一个线程分配的块可能在另一个线程中释放, 所以单个线程的 used 没有意义
+struct BufferCache{
+	int count[POOL_CLASSES];
+	char *blocks[POOL_CLASSES][POOL_MAX_BLOCKS];
+	BufferPoolStats stats;
+	BufferCache *prev;
+	BufferCache *next;
+};
+
+static __thread BufferCache *pool_cache = NULL;
+static pthread_key_t pool_key;
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+// 所有线程的缓存, 以及已退出的线程的统计
+static BufferCache *pool_caches = NULL;
+static BufferPoolStats pool_retired = {0, 0, 0, 0};
+
+// 中心缓存, 由 central_mutex 保护
+static pthread_mutex_t central_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int central_count[POOL_CLASSES];
+static char *central_blocks[POOL_CLASSES][CENTRAL_MAX_BLOCKS];
+static int64_t central_cached = 0;
+
+// 前端缓存和中心缓存之间一次交换的块数
+static inline int pool_batch(int c){
+	return pool_limits[c] > 1? pool_limits[c] / 2 : 1;
+}
+
+// 把前端缓存中的 num 个块放到中心缓存, 放不下的释放
+static void pool_flush(BufferCache *cache, int c, int num){
+	pthread_mutex_lock(&central_mutex);
+	while(num > 0 && cache->count[c] > 0){
+		char *p = cache->blocks[c][--cache->count[c]];
+		cache->stats.cached -= pool_sizes[c];
+		if(central_count[c] < central_limits[c]){
+			central_blocks[c][central_count[c]++] = p;
+			central_cached += pool_sizes[c];
+		}else{
+			free(p);
+		}
+		num --;
+	}
+	pthread_mutex_unlock(&central_mutex);
+}
+
+// 从中心缓存取最多 num 个块到前端缓存, 返回取到的个数
+static int pool_refill(BufferCache *cache, int c, int num){
+	int n = 0;
+	pthread_mutex_lock(&central_mutex);
+	while(n < num && central_count[c] > 0 && cache->count[c] < pool_limits[c]){
+		cache->blocks[c][cache->count[c]++] = central_blocks[c][--central_count[c]];
+		central_cached -= pool_sizes[c];
+		cache->stats.cached += pool_sizes[c];
+		n ++;
+	}
+	pthread_mutex_unlock(&central_mutex);
+	return n;
+}
+
+// 线程退出时把它缓存的内存还给中心缓存
+static void pool_cache_free(void *arg){
+	BufferCache *cache = (BufferCache *)arg;
+	for(int c=0; c<POOL_CLASSES; c++){
+		pool_flush(cache, c, cache->count[c]);
+	}
+	pthread_mutex_lock(&pool_mutex);
+	pool_retired.hits += cache->stats.hits;
+	pool_retired.misses += cache->stats.misses;
+	pool_retired.used += cache->stats.used;
+	pool_retired.cached += cache->stats.cached;
+	if(cache->prev){
+		cache->prev->next = cache->next;
+	}else{
+		pool_caches = cache->next;
+	}
+	if(cache->next){
+		cache->next->prev = cache->prev;
+	}
+	pthread_mutex_unlock(&pool_mutex);
+	free(cache);
+	pool_cache = NULL;
+}
+
+static void pool_init(){
+	pthread_key_create(&pool_key, pool_cache_free);
+}
+
+static BufferCache* pool_get_cache(){
+	if(pool_cache == NULL){
+		pthread_once(&pool_once, pool_init);
+		BufferCache *cache = (BufferCache *)calloc(1, sizeof(BufferCache));
+		if(cache == NULL){
+			return NULL;
+		}
+		pthread_mutex_lock(&pool_mutex);
+		cache->next = pool_caches;
+		if(pool_caches){
+			pool_caches->prev = cache;
+		}
+		pool_caches = cache;
+		pthread_mutex_unlock(&pool_mutex);
+		pthread_setspecific(pool_key, cache);
+		pool_cache = cache;
+	}
+	return pool_cache;
+}
+
+static int pool_class(int size){
+	for(int c=0; c<POOL_CLASSES; c++){
+		if(size <= pool_sizes[c]){
+			return c;
+		}
+	}
+	return -1;
+}
+
+// 分配至少 *size 字节, *size 被设为实际的大小. 超过最大一级的直接 malloc
+static char* pool_alloc(int *size){
+	BufferCache *cache = pool_get_cache();
+	int c = pool_class(*size);
+	if(c != -1){
+		*size = pool_sizes[c];
+		if(cache && (cache->count[c] > 0 || pool_refill(cache, c, pool_batch(c)) > 0)){
+			cache->stats.hits ++;
+			cache->stats.used += *size;
+			cache->stats.cached -= *size;
+			return cache->blocks[c][--cache->count[c]];
+		}
+	}
+	char *p = (char *)malloc(*size);
+	if(p && cache){
+		cache->stats.misses ++;
+		cache->stats.used += *size;
+	}
+	return p;
+}
+
+static void pool_free(char *p, int size){
+	if(p == NULL){
+		return;
+	}
+	BufferCache *cache = pool_get_cache();
+	if(cache){
+		cache->stats.used -= size;
+	}
+	int c = pool_class(size);
+	if(cache && c != -1 && size == pool_sizes[c]){
+		if(cache->count[c] == pool_limits[c]){
+			pool_flush(cache, c, pool_batch(c));
+		}
+		cache->blocks[c][cache->count[c]++] = p;
+		cache->stats.cached += size;
+		return;
+	}
+	free(p);
+}
+
+void buffer_pool_stats(BufferPoolStats *stats){
+	pthread_mutex_lock(&pool_mutex);
+	*stats = pool_retired;
+	for(BufferCache *cache = pool_caches; cache; cache = cache->next){
+		// 其它线程正在修改, 只是近似值
+		stats->hits += cache->stats.hits;
+		stats->misses += cache->stats.misses;
+		stats->used += cache->stats.used;
+		stats->cached += cache->stats.cached;
+	}
+	pthread_mutex_unlock(&pool_mutex);
+	// 已退出的线程的 cached 是它交给中心缓存的, 不重复计算
+	stats->cached -= pool_retired.cached;
+	pthread_mutex_lock(&central_mutex);
+	stats->cached += central_cached;
+	pthread_mutex_unlock(&central_mutex);
+}
+
+// 构造缓冲区，分配内存空间. total 为 0 时在第一次写入数据时才分配
 Buffer::Buffer(int total){
 	size_ = 0;
 	total_ = origin_total = total;
-	buf = (char *)malloc(total);
+	buf = NULL;
+	if(total > 0){
+		buf = pool_alloc(&total_);
+	}
 	data_ = buf;
 }
 
 // 删除缓冲区，释放内存空间
 Buffer::~Buffer(){
-	free(buf);
+	pool_free(buf, total_);
 }
 
 // 如果有效数据小于一般，就把有效数据搬到前面来，这样后面的空闲区域可以继续使用。
@@ -45,18 +243,31 @@ int Buffer::grow(){ // 扩大缓冲区
 		n = 2 * total_;
 	}
 	//log_debug("Buffer resize %d => %d", total_, n);
-	// 重新申请内存空间，在这个操作里想必会把原来内存空间的数据拷贝过去
-	char *p = (char *)realloc(buf, n);
+	// 从内存池中分配新的内存, 只拷贝有效数据, 放到开头
+	char *p = pool_alloc(&n);
 	if(p == NULL){
 		return -1;
 	}
+	if(size_ > 0){
+		memcpy(p, data_, size_);
+	}
+	pool_free(buf, total_);
 	// 重新设置指针以及数据大小，注意这个过程size不变
-	data_ = p + (data_ - buf);
+	data_ = p;
 	buf = p;
 	total_ = n;
 	return total_;
 }
 
+void Buffer::release(){
+	if(size_ > 0 || buf == NULL){
+		return;
+	}
+	pool_free(buf, total_);
+	buf = data_ = NULL;
+	total_ = 0;
+}
+
 // 返回分析数据，就是总大小，数据占用大小，空闲大小等
 std::string Buffer::stats() const{
 	char str[1024 * 32];
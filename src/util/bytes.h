@@ -138,6 +138,18 @@ bool operator<=(const Bytes &x, const Bytes &y){
 
 
 // 定义缓冲区，这是程序的缓冲区，注意和网络socket的缓冲区区分开来
+// Buffer 的内存来自按大小分级的内存池(见 bytes.cpp), 每个线程缓存
+// 少量释放的内存块, 多余的放到所有线程共享的中心缓存. 统计是所有线程的总和.
+struct BufferPoolStats{
+	// 分配时从缓存中取到, 和没有取到(调用 malloc)的次数
+	int64_t hits;
+	int64_t misses;
+	// 分配出去的和缓存着的内存, 字节
+	int64_t used;
+	int64_t cached;
+};
+void buffer_pool_stats(BufferPoolStats *stats);
+
 class Buffer{
 	private:
 	    // buf和data有啥区别？各自是用来干吗的？
@@ -204,6 +216,8 @@ class Buffer{
 		void nice();
 		// 扩大缓冲区
 		int grow();
+		// 缓冲区为空时把内存还给内存池, 之后写入数据时重新分配
+		void release();
 
 		std::string stats() const;
 		// 从缓冲区读取数据，放到Bytes中
@@ -0,0 +1,103 @@
+/*
+Copyright (c) 2012-2014 The SSDB Authors. All rights reserved.
+Use of this source code is governed by a BSD-style license that can be
+found in the LICENSE file.
+*/
+#include "clock.h"
+#if defined(__x86_64__) || defined(__i386__)
+	#include <cpuid.h>
+#endif
+
+bool g_clock_use_tsc = false;
+
+static int64_t coarse_ms = 0;
+static uint64_t cycles_per_ms = 1000000;
+// 校准 TSC 的起点
+static uint64_t base_cycles = 0;
+static uint64_t base_ns = 0;
+
+static inline uint64_t mono_ns(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static inline int64_t realtime_ms(){
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// 只有频率恒定(不随降频和休眠变化)的 TSC 才能用来计时
+static bool has_invariant_tsc(){
+#if defined(__x86_64__) || defined(__i386__)
+	unsigned int eax, ebx, ecx, edx;
+	if(__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx)){
+		return (edx & (1 << 8)) != 0;
+	}
+#endif
+	return false;
+}
+
+// 启动时用 1ms 粗略地校准一次, 之后每次 clock_tick() 用更长的时间段校准
+static struct ClockInit{
+	ClockInit(){
+		if(!has_invariant_tsc()){
+			return;
+		}
+		g_clock_use_tsc = true;
+		base_cycles = clock_cycles();
+		base_ns = mono_ns();
+		uint64_t ns;
+		do{
+			ns = mono_ns();
+		}while(ns - base_ns < 1000000);
+		cycles_per_ms = (uint64_t)((clock_cycles() - base_cycles) * 1000000.0 / (ns - base_ns));
+		if(cycles_per_ms == 0){
+			g_clock_use_tsc = false;
+			cycles_per_ms = 1000000;
+		}
+	}
+}clock_init;
+
+double clock_coarse(){
+	return clock_coarse_ms() / 1000.0;
+}
+
+int64_t clock_coarse_ms(){
+	int64_t ms = __atomic_load_n(&coarse_ms, __ATOMIC_RELAXED);
+	if(ms == 0){
+		return realtime_ms();
+	}
+	return ms;
+}
+
+void clock_tick(){
+	__atomic_store_n(&coarse_ms, realtime_ms(), __ATOMIC_RELAXED);
+	if(g_clock_use_tsc){
+		uint64_t ns = mono_ns() - base_ns;
+		// 校准的时间段越长越准确, 1 秒以内的不用
+		if(ns >= 1000000000){
+			uint64_t n = (uint64_t)((clock_cycles() - base_cycles) * 1000000.0 / ns);
+			__atomic_store_n(&cycles_per_ms, n, __ATOMIC_RELAXED);
+		}
+	}
+}
+
+int64_t clock_wall_ms(){
+#ifdef CLOCK_REALTIME_COARSE
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+	return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+#else
+	return realtime_ms();
+#endif
+}
+
+uint64_t clock_mono_us(){
+	return mono_ns() / 1000;
+}
+
+uint64_t clock_cycles_per_ms(){
+	return __atomic_load_n(&cycles_per_ms, __ATOMIC_RELAXED);
+}
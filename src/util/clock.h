@@ -0,0 +1,57 @@
+/*
+Copyright (c) 2012-2014 The SSDB Authors. All rights reserved.
+Use of this source code is governed by a BSD-style license that can be
+found in the LICENSE file.
+*/
+#ifndef UTIL_CLOCK_H_
+#define UTIL_CLOCK_H_
+
+#include <inttypes.h>
+#include <time.h>
+#include <sys/time.h>
+
+// 时钟, 按开销从低到高:
+//
+// - clock_coarse(), clock_coarse_ms(): 缓存的墙上时间, 只读一个变量.
+//   由事件循环的定时器调用 clock_tick() 更新, 精度是定时器的周期, 只在
+//   有事件循环的进程中使用; 第一次 clock_tick() 之前取当前时间.
+// - clock_wall_ms(): 墙上时间, CLOCK_REALTIME_COARSE, 精度是内核的
+//   tick(1-4ms), 通过 vDSO 读取, 没有系统调用, 不依赖 clock_tick().
+// - clock_cycles(): CPU 的时钟周期计数(TSC), 用于测量请求的耗时,
+//   用 clock_cycles_to_ms() 转换. CPU 不支持恒定频率的 TSC 时使用
+//   CLOCK_MONOTONIC 的纳秒数.
+// - clock_mono_us(): CLOCK_MONOTONIC, 通过 vDSO 读取.
+
+// 秒
+double clock_coarse();
+int64_t clock_coarse_ms();
+// 更新缓存的时间, 同时校准 TSC 的频率
+void clock_tick();
+
+int64_t clock_wall_ms();
+uint64_t clock_mono_us();
+
+// CPU 支持恒定频率的 TSC 时为 true, 见 clock.cpp
+extern bool g_clock_use_tsc;
+
+static inline uint64_t clock_cycles(){
+#if defined(__x86_64__) || defined(__i386__)
+	if(g_clock_use_tsc){
+		uint32_t lo, hi;
+		__asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+		return ((uint64_t)hi << 32) | lo;
+	}
+#endif
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// 每毫秒的周期数
+uint64_t clock_cycles_per_ms();
+
+static inline double clock_cycles_to_ms(uint64_t cycles){
+	return cycles / (double)clock_cycles_per_ms();
+}
+
+#endif
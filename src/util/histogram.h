@@ -0,0 +1,127 @@
+/*
+Copyright (c) 2012-2014 The SSDB Authors. All rights reserved.
+Use of this source code is governed by a BSD-style license that can be
+found in the LICENSE file.
+*/
+#ifndef UTIL_HISTOGRAM_H_
+#define UTIL_HISTOGRAM_H_
+
+#include <inttypes.h>
+#include <string.h>
+
+// 对数-线性分桶的直方图(类似 HdrHistogram), 用于统计延迟的分位数.
+//
+// 小于 16 的值每个值一个桶; 之后每个 2 的幂区间 [2^e, 2^(e+1)) 再均分
+// 成 16 个子桶, 所以任何值的相对误差不超过 1/16. 值的上限是 2^36,
+// 以微秒为单位大约是 19 个小时, 更大的值记到最后一个桶.
+//
+// add() 使用原子操作, 可以在多个线程中同时调用; 读取的结果不是严格的
+// 快照, 对统计来说足够了.
+class Histogram{
+	public:
+		static const int SUB_BITS	= 4;
+		static const int SUB_COUNT	= (1 << SUB_BITS);
+		static const int MAX_EXP	= 36;
+		static const int NUM_BUCKETS	= (MAX_EXP - SUB_BITS + 1) * SUB_COUNT;
+
+		Histogram(){
+			reset();
+		}
+
+		void reset(){
+			memset(buckets, 0, sizeof(buckets));
+			count_ = 0;
+			max_ = 0;
+		}
+
+		void add(uint64_t v){
+			__sync_fetch_and_add(&buckets[index(v)], 1);
+			__sync_fetch_and_add(&count_, 1);
+			uint64_t m = __atomic_load_n(&max_, __ATOMIC_RELAXED);
+			while(v > m){
+				uint64_t old = __sync_val_compare_and_swap(&max_, m, v);
+				if(old == m){
+					break;
+				}
+				m = old;
+			}
+		}
+
+		// 把 h 的数据加到这个直方图中, 不是原子操作, 用于合并多个线程
+		// 各自的直方图到一个局部的对象
+		void merge(const Histogram &h){
+			for(int i=0; i<NUM_BUCKETS; i++){
+				buckets[i] += h.buckets[i];
+			}
+			count_ += h.count_;
+			if(h.max_ > max_){
+				max_ = h.max_;
+			}
+		}
+
+		uint64_t count() const{
+			return count_;
+		}
+
+		uint64_t max() const{
+			return max_;
+		}
+
+		// p 取值 0-100, 返回该分位数所在的桶的上界(不超过 max)
+		uint64_t percentile(double p) const{
+			uint64_t total = 0;
+			for(int i=0; i<NUM_BUCKETS; i++){
+				total += buckets[i];
+			}
+			if(total == 0){
+				return 0;
+			}
+			uint64_t want = (uint64_t)(total * p / 100.0 + 0.5);
+			if(want == 0){
+				want = 1;
+			}
+			uint64_t n = 0;
+			for(int i=0; i<NUM_BUCKETS; i++){
+				n += buckets[i];
+				if(n >= want){
+					uint64_t v = upper(i);
+					return v < max_? v : max_;
+				}
+			}
+			return max_;
+		}
+
+		static int index(uint64_t v){
+			if(v < (uint64_t)SUB_COUNT){
+				return (int)v;
+			}
+			int e = 63 - __builtin_clzll(v);
+			if(e >= MAX_EXP){
+				return NUM_BUCKETS - 1;
+			}
+			int sub = (int)((v >> (e - SUB_BITS)) & (SUB_COUNT - 1));
+			return (e - SUB_BITS + 1) * SUB_COUNT + sub;
+		}
+
+		// 桶中最大的值
+		static uint64_t upper(int idx){
+			if(idx < SUB_COUNT){
+				return idx;
+			}
+			int e = idx / SUB_COUNT + SUB_BITS - 1;
+			int sub = idx % SUB_COUNT;
+			uint64_t lower = (uint64_t)(SUB_COUNT + sub) << (e - SUB_BITS);
+			return lower + ((uint64_t)1 << (e - SUB_BITS)) - 1;
+		}
+
+	private:
+		uint64_t buckets[NUM_BUCKETS];
+		uint64_t count_;
+		uint64_t max_;
+
+		// No copying allowed
+		Histogram(const Histogram&);
+		void operator=(const Histogram&);
+};
+
+#endif
@@ -4,6 +4,12 @@ Use of this source code is governed by a BSD-style license that can be
 found in the LICENSE file.
 */
 #include "log.h"
+#include "log_ring.h"
+
+// 后台线程没有日志可写时的等待时间
+#define ASYNC_FLUSH_INTERVAL	10 // ms
+// 缓冲区满时 error 和 fatal 日志最多等待的时间
+#define ASYNC_BLOCK_TIME		1000 // ms
 
 // 全局日志对象
 static Logger logger;
@@ -26,6 +32,14 @@ void set_log_level(int level){
 	logger.set_level(level);
 }
 
+int log_start_async(int buffer_size){
+	return logger.start_async(buffer_size);
+}
+
+uint64_t log_dropped(){
+	return logger.dropped();
+}
+
 // 写日志
 int log_write(int level, const char *fmt, ...){
 	va_list ap;
@@ -50,9 +64,18 @@ Logger::Logger(){
 	rotate_size_ = 0;
 	stats.w_curr = 0;
 	stats.w_total = 0;
+
+	ring = NULL;
+	writer_quit = 0;
+	dropped_ = 0;
+	pthread_mutex_init(&writer_mutex, NULL);
+	pthread_cond_init(&writer_cond, NULL);
 }
 
 Logger::~Logger(){
+	this->stop_async();
+	pthread_cond_destroy(&writer_cond);
+	pthread_mutex_destroy(&writer_mutex);
 	if(mutex){
 		pthread_mutex_destroy(mutex);
 		free(mutex);
@@ -182,6 +205,122 @@ void Logger::rotate(){
 	stats.w_curr = 0;
 }
 
+int Logger::start_async(int buffer_size){
+	if(ring){
+		return 0;
+	}
+	if(buffer_size <= 0){
+		buffer_size = ASYNC_BUFFER_SIZE;
+	}
+	// 之前同步写入的数据不能留在 FILE 的缓冲区中
+	fflush(fp);
+	writer_quit = 0;
+	LogRing *r = new LogRing(buffer_size);
+	ring = r;
+	int err = pthread_create(&writer_tid, NULL, &Logger::_run_writer, this);
+	if(err != 0){
+		ring = NULL;
+		delete r;
+		fprintf(stderr, "can't create log writer thread: %s\n", strerror(err));
+		return -1;
+	}
+	return 0;
+}
+
+void Logger::stop_async(){
+	if(!ring){
+		return;
+	}
+	pthread_mutex_lock(&writer_mutex);
+	writer_quit = 1;
+	pthread_cond_signal(&writer_cond);
+	pthread_mutex_unlock(&writer_mutex);
+	pthread_join(writer_tid, NULL);
+	// 停止之后别的线程可能还在 push(), 所以不释放缓冲区
+	LogRing *r = ring;
+	__atomic_store_n(&ring, (LogRing *)NULL, __ATOMIC_RELEASE);
+	std::string batch;
+	r->pop_all(&batch);
+	if(!batch.empty()){
+		this->write_out(batch.data(), (int)batch.size());
+	}
+}
+
+void Logger::wakeup_writer(){
+	pthread_mutex_lock(&writer_mutex);
+	pthread_cond_signal(&writer_cond);
+	pthread_mutex_unlock(&writer_mutex);
+}
+
+// 只在后台线程(或者同步模式下加锁之后)调用
+void Logger::write_out(const char *data, int len){
+	int fd = fileno(this->fp);
+	int done = 0;
+	while(done < len){
+		int ret = ::write(fd, data + done, len - done);
+		if(ret == -1){
+			if(errno == EINTR){
+				continue;
+			}
+			break;
+		}
+		done += ret;
+	}
+	stats.w_curr += len;
+	stats.w_total += len;
+	if(rotate_size_ > 0 && stats.w_curr > rotate_size_){
+		this->rotate();
+	}
+}
+
+// 后台线程: 定期把缓冲区中的日志一次写入文件, 日志文件的 rotate 也在
+// 这里做, 不会阻塞写日志的线程
+void* Logger::_run_writer(void *arg){
+	Logger *log = (Logger *)arg;
+	LogRing *ring = log->ring;
+	uint64_t reported = log->dropped_;
+	std::string batch;
+	while(1){
+		batch.clear();
+		ring->pop_all(&batch);
+		uint64_t dropped = log->dropped_;
+		if(dropped != reported){
+			char buf[128];
+			struct timeval tv;
+			gettimeofday(&tv, NULL);
+			time_t t = tv.tv_sec;
+			struct tm *tm = localtime(&t);
+			snprintf(buf, sizeof(buf), "%04d-%02d-%02d %02d:%02d:%02d.%03d [WARN ] "
+				"%" PRIu64 " log lines dropped, total: %" PRIu64 "\n",
+				tm->tm_year + 1900, tm->tm_mon + 1, tm->tm_mday,
+				tm->tm_hour, tm->tm_min, tm->tm_sec, (int)(tv.tv_usec/1000),
+				dropped - reported, dropped);
+			batch.append(buf);
+			reported = dropped;
+		}
+		if(!batch.empty()){
+			log->write_out(batch.data(), (int)batch.size());
+			continue;
+		}
+
+		pthread_mutex_lock(&log->writer_mutex);
+		if(log->writer_quit){
+			pthread_mutex_unlock(&log->writer_mutex);
+			break;
+		}
+		struct timeval now;
+		struct timespec ts;
+		gettimeofday(&now, NULL);
+		long nsec = now.tv_usec * 1000 + ASYNC_FLUSH_INTERVAL * 1000000L;
+		ts.tv_sec = now.tv_sec + nsec / 1000000000L;
+		ts.tv_nsec = nsec % 1000000000L;
+		pthread_cond_timedwait(&log->writer_cond, &log->writer_mutex, &ts);
+		pthread_mutex_unlock(&log->writer_mutex);
+	}
+	// 退出前缓冲区已经写空
+	return (void *)NULL;
+}
+
 int Logger::get_level(const char *levelname){
 	if(strcmp("trace", levelname) == 0){
 		return LEVEL_TRACE;
@@ -275,6 +414,30 @@ int Logger::logv(int level, const char *fmt, va_list ap){
 
     // 具体长度
 	len = ptr - buf;
+
+	// 异步模式, 放到缓冲区就返回
+	LogRing *ring = __atomic_load_n(&this->ring, __ATOMIC_ACQUIRE);
+	if(ring){
+		if(ring->push(buf, len)){
+			// 缓冲区用了一半以上, 不等后台线程自己醒来
+			if(ring->used() > ring->capacity() / 2){
+				this->wakeup_writer();
+			}
+			return len;
+		}
+		if(level <= LEVEL_ERROR){
+			for(int i=0; i<ASYNC_BLOCK_TIME; i++){
+				this->wakeup_writer();
+				usleep(1000);
+				if(ring->push(buf, len)){
+					return len;
+				}
+			}
+		}
+		__sync_fetch_and_add(&dropped_, 1);
+		return 0;
+	}
+
 	// change to write(), without locking?
 	// 如果线程安全，先加锁
 	if(this->mutex){
@@ -26,6 +26,8 @@ found in the LICENSE file.
 #include <pthread.h>
 #include <string>
 
+class LogRing;
+
 class Logger{
 	public:
 		static const int LEVEL_NONE		= (-1);
@@ -38,6 +40,8 @@ class Logger{
 		static const int LEVEL_TRACE	= 5;
 		static const int LEVEL_MAX		= 5;
 
+		static const int ASYNC_BUFFER_SIZE	= 4 * 1024 * 1024;
+
 		static int get_level(const char *levelname);
 		
 		static Logger* shared();
@@ -58,8 +62,20 @@ class Logger{
 			uint64_t w_total;
 		}stats;
 
+		// 异步模式下日志行放到 ring 中, 由后台线程写入文件, 见 start_async()
+		LogRing *ring;
+		pthread_t writer_tid;
+		pthread_mutex_t writer_mutex;
+		pthread_cond_t writer_cond;
+		int writer_quit;
+		// 缓冲区满时丢弃的行数
+		uint64_t dropped_;
+
 		void rotate();
 		void threadsafe();
+		void wakeup_writer();
+		void write_out(const char *data, int len);
+		static void* _run_writer(void *arg);
 	public:
 		Logger();
 		~Logger();
@@ -77,6 +93,19 @@ class Logger{
 			bool is_threadsafe=false, uint64_t rotate_size=0);
 		void close();
 
+		// 开启异步模式, buffer_size 为缓冲区的字节数. 必须在 fork()(daemonize)
+		// 之后调用. 缓冲区满时 warn 及以下级别的日志直接丢弃, error 和 fatal
+		// 最多等待 1 秒
+		int start_async(int buffer_size=ASYNC_BUFFER_SIZE);
+		// 写完缓冲区中的日志, 回到同步模式
+		void stop_async();
+		bool is_async() const{
+			return ring != NULL;
+		}
+		uint64_t dropped() const{
+			return dropped_;
+		}
+
 		int logv(int level, const char *fmt, va_list ap);
 
 		int trace(const char *fmt, ...);
@@ -93,6 +122,8 @@ int log_open(const char *filename, int level=Logger::LEVEL_DEBUG,
 	bool is_threadsafe=false, uint64_t rotate_size=0);
 int log_level();
 void set_log_level(int level);
+int log_start_async(int buffer_size=Logger::ASYNC_BUFFER_SIZE);
+uint64_t log_dropped();
 int log_write(int level, const char *fmt, ...);
 
 
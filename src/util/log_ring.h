@@ -0,0 +1,124 @@
+/*
+Copyright (c) 2012-2014 The SSDB Authors. All rights reserved.
+Use of this source code is governed by a BSD-style license that can be
+found in the LICENSE file.
+*/
+#ifndef UTIL_LOG_RING_H
+#define UTIL_LOG_RING_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+// 异步模式下的日志缓冲区, 多个线程写, 后台线程读, 写不加锁.
+//
+// 每条记录前面有一个头, 写入者先用 CAS 移动 reserve_pos 占用空间, 复制完
+// 数据后再设置头中的 state, 读取者按顺序读, 遇到没有写完的记录就停下.
+// 记录不跨越缓冲区的末尾, 放不下时末尾的空间用一条填充记录占掉. 记录的
+// 长度按头的长度对齐, 所以末尾剩下的空间总能放下填充记录的头.
+// 读过的空间清零之后才还给写入者, 所以没有写完的记录的 state 总是 0.
+class LogRing{
+	private:
+		struct Header{
+			uint32_t size; // 整条记录占用的空间, 包括头
+			uint32_t len; // 数据的长度
+			uint32_t state;
+			uint32_t padding;
+		};
+		enum{
+			EMPTY = 0,
+			DATA,
+			SKIP,
+		};
+		char *buf;
+		uint64_t mask;
+		char pad0[64];
+		uint64_t reserve_pos;
+		char pad1[64];
+		uint64_t read_pos;
+		char pad2[64];
+
+		Header* header(uint64_t pos){
+			return (Header *)(buf + (pos & mask));
+		}
+	public:
+		// size 会向上取整为 2 的幂
+		LogRing(int size){
+			uint64_t cap = 4096;
+			while(cap < (uint64_t)size){
+				cap <<= 1;
+			}
+			buf = (char *)calloc(1, cap);
+			mask = cap - 1;
+			reserve_pos = 0;
+			read_pos = 0;
+		}
+		~LogRing(){
+			free(buf);
+		}
+
+		// 已经使用的字节数
+		uint64_t used(){
+			return __atomic_load_n(&reserve_pos, __ATOMIC_RELAXED)
+				- __atomic_load_n(&read_pos, __ATOMIC_RELAXED);
+		}
+		uint64_t capacity(){
+			return mask + 1;
+		}
+
+		// 空间不足时返回 false
+		bool push(const char *data, int len){
+			uint64_t need = (sizeof(Header) + len + sizeof(Header) - 1) & ~(uint64_t)(sizeof(Header) - 1);
+			uint64_t pos, skip;
+			while(1){
+				pos = __atomic_load_n(&reserve_pos, __ATOMIC_RELAXED);
+				uint64_t off = pos & mask;
+				skip = off + need > mask + 1? mask + 1 - off : 0;
+				uint64_t rpos = __atomic_load_n(&read_pos, __ATOMIC_ACQUIRE);
+				if(pos + skip + need - rpos > mask + 1){
+					return false;
+				}
+				if(__sync_bool_compare_and_swap(&reserve_pos, pos, pos + skip + need)){
+					break;
+				}
+			}
+			if(skip){
+				Header *h = header(pos);
+				h->size = skip;
+				__atomic_store_n(&h->state, SKIP, __ATOMIC_RELEASE);
+				pos += skip;
+			}
+			Header *h = header(pos);
+			h->size = need;
+			h->len = len;
+			memcpy((char *)h + sizeof(Header), data, len);
+			__atomic_store_n(&h->state, DATA, __ATOMIC_RELEASE);
+			return true;
+		}
+
+		// 取出已经写完的记录, 追加到 out 中, 返回取出的记录数. 只有一个读取者
+		int pop_all(std::string *out){
+			int num = 0;
+			uint64_t pos = read_pos;
+			uint64_t end = __atomic_load_n(&reserve_pos, __ATOMIC_ACQUIRE);
+			while(pos < end){
+				Header *h = header(pos);
+				uint32_t state = __atomic_load_n(&h->state, __ATOMIC_ACQUIRE);
+				if(state == EMPTY){
+					break;
+				}
+				uint32_t size = h->size;
+				if(state == DATA){
+					out->append((char *)h + sizeof(Header), h->len);
+					num ++;
+				}
+				memset(h, 0, size);
+				pos += size;
+				__atomic_store_n(&read_pos, pos, __ATOMIC_RELEASE);
+			}
+			return num;
+		}
+};
+
+#endif
@@ -0,0 +1,137 @@
+/*
+Copyright (c) 2012-2014 The SSDB Authors. All rights reserved.
+Use of this source code is governed by a BSD-style license that can be
+found in the LICENSE file.
+*/
+#ifndef UTIL_PERFECT_HASH_H_
+#define UTIL_PERFECT_HASH_H_
+
+#include <inttypes.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+// 为一组固定的字符串构造无冲突的哈希表(perfect hash).
+//
+// build() 时搜索一个哈希种子, 使所有的 key 落在不同的槽里, 之后的查找
+// 只需要一次哈希和一次比较, 不需要处理冲突链. 种子的搜索是确定性的,
+// 同一组 key 每次得到的表都一样. 表构造之后是只读的, 可以被多个线程
+// 同时查找.
+//
+// nocase 为 true 时, 查找忽略 ASCII 字母的大小写(redis 命令名).
+template<class T>
+class PerfectHash{
+	public:
+		PerfectHash(bool nocase=false){
+			this->nocase = nocase;
+			this->seed = 0;
+			this->mask = 0;
+		}
+
+		// 返回 -1 表示 key 有重复, 无法构造
+		int build(const std::vector<std::string> &keys, const std::vector<T> &vals);
+
+		// 找不到返回 NULL
+		const T* find(const char *key, int len) const{
+			if(slots.empty()){
+				return NULL;
+			}
+			const Slot &slot = slots[hash(key, len, seed) & mask];
+			if(!slot.used || (int)slot.key.size() != len){
+				return NULL;
+			}
+			if(!equal(slot.key.data(), key, len)){
+				return NULL;
+			}
+			return &slot.val;
+		}
+
+		int size() const{
+			return (int)slots.size();
+		}
+
+	private:
+		struct Slot{
+			bool used;
+			std::string key;
+			T val;
+			Slot(){
+				used = false;
+			}
+		};
+		bool nocase;
+		uint32_t seed;
+		uint32_t mask;
+		std::vector<Slot> slots;
+
+		static inline unsigned char lower(unsigned char c){
+			return (c >= 'A' && c <= 'Z')? c + ('a' - 'A') : c;
+		}
+		// FNV-1a, 总是按小写计算, 这样 nocase 和区分大小写两种表可以共用
+		static inline uint32_t hash(const char *p, int len, uint32_t seed){
+			uint32_t h = 2166136261u ^ seed;
+			for(int i=0; i<len; i++){
+				h ^= lower((unsigned char)p[i]);
+				h *= 16777619u;
+			}
+			h ^= h >> 15;
+			return h;
+		}
+		bool equal(const char *a, const char *b, int len) const{
+			if(!nocase){
+				return memcmp(a, b, len) == 0;
+			}
+			for(int i=0; i<len; i++){
+				if(lower((unsigned char)a[i]) != lower((unsigned char)b[i])){
+					return false;
+				}
+			}
+			return true;
+		}
+};
+
+template<class T>
+int PerfectHash<T>::build(const std::vector<std::string> &keys, const std::vector<T> &vals){
+	int n = 8;
+	while(n < (int)keys.size() * 2){
+		n *= 2;
+	}
+	std::vector<int> owner;
+	// 槽的数量从 key 数量的 2 倍开始, 找不到合适的种子就加倍
+	for(; n <= (1 << 20); n *= 2){
+		for(uint32_t s=1; s<=4096; s++){
+			owner.assign(n, -1);
+			bool ok = true;
+			for(int i=0; i<(int)keys.size(); i++){
+				uint32_t h = hash(keys[i].data(), (int)keys[i].size(), s) & (n - 1);
+				if(owner[h] != -1){
+					const std::string &k = keys[owner[h]];
+					if(k.size() == keys[i].size() && equal(k.data(), keys[i].data(), (int)k.size())){
+						// 重复的 key
+						return -1;
+					}
+					ok = false;
+					break;
+				}
+				owner[h] = i;
+			}
+			if(!ok){
+				continue;
+			}
+			this->seed = s;
+			this->mask = n - 1;
+			slots.clear();
+			slots.resize(n);
+			for(int i=0; i<(int)keys.size(); i++){
+				Slot &slot = slots[hash(keys[i].data(), (int)keys[i].size(), s) & mask];
+				slot.used = true;
+				slot.key = keys[i];
+				slot.val = vals[i];
+			}
+			return 0;
+		}
+	}
+	return -1;
+}
+
+#endif
@@ -0,0 +1,442 @@
+/*
+Copyright (c) 2012-2014 The SSDB Authors. All rights reserved.
+Use of this source code is governed by a BSD-style license that can be
+found in the LICENSE file.
+*/
+#ifndef UTIL_STEALING_POOL_H_
+#define UTIL_STEALING_POOL_H_
+
+#include <deque>
+#include <string>
+#include <vector>
+#include "thread.h"
+#include "histogram.h"
+#include "strings.h"
+#include "clock.h"
+
+/**
+ * 带任务窃取的工作池, 接口与 WorkerPool 相同, W 和 JOB 的要求也相同.
+ *
+ * 每个任务属于一个类别(cls), 由调用者在 push() 时指定. 类别分为两种:
+ * - 轻任务: 按轮转放到各个线程自己的双端队列中, 线程从自己队列的头部
+ *   取任务, 自己的队列空了就从别的线程队列的尾部窃取;
+ * - 重任务(set_class() 时 heavy 为 true): 放在一个公共的队列中, 同时
+ *   最多只有 heavy_threads 个线程在执行重任务, 其余的线程总是可以处理
+ *   轻任务, 一批很慢的请求不会让快的请求排在它们后面.
+ * 线程每次取任务时先看重任务队列(没有超过限制的话), 所以重任务也不会
+ * 被持续的轻任务饿死.
+ *
+ * 每个类别统计排队的任务数, 以及排队时间和执行时间的分布, 见 info().
+ *
+ * 线程数可以用 resize() 调整. 多出来的线程处理完自己队列中的任务后退出,
+ * 之后放到它队列中的任务(如果有)会被别的线程窃取.
+ */
+template<class W, class JOB>
+class StealingPool{
+	public:
+		static const int MAX_CLASSES = 8;
+
+	private:
+		struct Item{
+			JOB job;
+			int cls;
+			uint64_t push_time; // clock_cycles()
+		};
+		// 每个线程的任务队列, 独占 cache line
+		struct Lane{
+			Mutex mutex;
+			std::deque<Item> items;
+			int size;
+			char padding[64];
+		};
+		struct Class{
+			std::string name;
+			bool heavy;
+			int queued;
+			uint64_t calls;
+			Histogram wait; // us
+			Histogram proc; // us
+		};
+
+		std::string name;
+		int heavy_threads;
+		bool started;
+		WorkerSlots slots;
+		uint64_t busy_us;
+
+		// 已经分配的队列, 线程退出后队列保留, 给之后的线程使用
+		Lane *lanes[WORKER_POOL_MAX_WORKERS];
+		int num_lanes;
+		unsigned int next_lane;
+
+		Mutex heavy_mutex;
+		std::deque<Item> heavy;
+		int heavy_size;
+		int heavy_active;
+
+		// 空闲线程在这里睡眠
+		pthread_mutex_t park_mutex;
+		pthread_cond_t park_cond;
+		int sleepers;
+		int closed;
+
+		Class classes[MAX_CLASSES];
+
+		SelectableRing<JOB> results;
+
+		static void* _run_worker(void *arg);
+
+		// own_only 为 true 时只从自己的队列中取
+		bool take(int id, Item *item, bool own_only=false);
+		bool take_heavy(Item *item);
+		void wakeup();
+
+		static uint64_t cycles_to_us(uint64_t cycles){
+			return (uint64_t)(clock_cycles_to_ms(cycles) * 1000);
+		}
+
+		// No copying allowed
+		StealingPool(const StealingPool&);
+		void operator=(const StealingPool&);
+	public:
+		StealingPool(const char *name="");
+		~StealingPool();
+
+		int fd(){
+			return results.fd();
+		}
+
+		// 在 start() 之前调用
+		void set_class(int cls, const char *name, bool heavy);
+		// 同时执行重任务的线程数上限, 在 start() 之前调用
+		void set_heavy_threads(int n);
+
+		int start(int num_workers);
+		// 和 WorkerPool::stop() 一样, 队列中的任务丢弃
+		int stop();
+		// 运行中调整线程数, 返回调整后的线程数
+		int resize(int num_workers);
+		int size() const{
+			return slots.size();
+		}
+		// 所有线程执行任务的总时间(微秒), 用于计算线程的忙碌程度
+		uint64_t busy_time() const{
+			return busy_us;
+		}
+
+		int push(JOB job, int cls=0);
+		int pop(JOB *job);
+		int pop_all(std::vector<JOB> *jobs);
+
+		// 返回 name.class, stats 这样的 key-value 列表
+		std::vector<std::string> info() const;
+};
+
+
+template<class W, class JOB>
+StealingPool<W, JOB>::StealingPool(const char *name) :
+	results(WORKER_POOL_QUEUE_SIZE)
+{
+	this->name = name;
+	this->heavy_threads = 1;
+	this->started = false;
+	this->busy_us = 0;
+	this->num_lanes = 0;
+	this->next_lane = 0;
+	this->heavy_size = 0;
+	this->heavy_active = 0;
+	this->sleepers = 0;
+	this->closed = 0;
+	pthread_mutex_init(&park_mutex, NULL);
+	pthread_cond_init(&park_cond, NULL);
+	for(int i=0; i<MAX_CLASSES; i++){
+		classes[i].name = str(i);
+		classes[i].heavy = false;
+		classes[i].queued = 0;
+		classes[i].calls = 0;
+	}
+}
+
+template<class W, class JOB>
+StealingPool<W, JOB>::~StealingPool(){
+	if(started){
+		stop();
+	}
+	for(int i=0; i<num_lanes; i++){
+		delete lanes[i];
+	}
+	pthread_cond_destroy(&park_cond);
+	pthread_mutex_destroy(&park_mutex);
+}
+
+template<class W, class JOB>
+void StealingPool<W, JOB>::set_class(int cls, const char *name, bool heavy){
+	if(cls < 0 || cls >= MAX_CLASSES){
+		return;
+	}
+	classes[cls].name = name;
+	classes[cls].heavy = heavy;
+}
+
+template<class W, class JOB>
+void StealingPool<W, JOB>::set_heavy_threads(int n){
+	this->heavy_threads = n < 1? 1 : n;
+}
+
+template<class W, class JOB>
+int StealingPool<W, JOB>::push(JOB job, int cls){
+	if(cls < 0 || cls >= MAX_CLASSES){
+		cls = 0;
+	}
+	Item item;
+	item.job = job;
+	item.cls = cls;
+	item.push_time = clock_cycles();
+	__sync_fetch_and_add(&classes[cls].queued, 1);
+
+	if(classes[cls].heavy){
+		Locking l(&heavy_mutex);
+		heavy.push_back(item);
+		__sync_fetch_and_add(&heavy_size, 1);
+	}else{
+		Lane *lane = lanes[__sync_fetch_and_add(&next_lane, 1) % slots.size()];
+		Locking l(&lane->mutex);
+		lane->items.push_back(item);
+		__sync_fetch_and_add(&lane->size, 1);
+	}
+	wakeup();
+	return 1;
+}
+
+// 与 _run_worker() 中 sleepers ++ 配对, 见 BlockingRing::push()
+template<class W, class JOB>
+void StealingPool<W, JOB>::wakeup(){
+	__sync_synchronize();
+	if(__atomic_load_n(&sleepers, __ATOMIC_RELAXED) > 0){
+		pthread_mutex_lock(&park_mutex);
+		pthread_cond_signal(&park_cond);
+		pthread_mutex_unlock(&park_mutex);
+	}
+}
+
+template<class W, class JOB>
+bool StealingPool<W, JOB>::take_heavy(Item *item){
+	if(__atomic_load_n(&heavy_size, __ATOMIC_RELAXED) == 0){
+		return false;
+	}
+	// 线程数减少之后, 重任务的名额也不超过线程数
+	int limit = heavy_threads;
+	if(limit > slots.size()){
+		limit = slots.size();
+	}
+	if(__atomic_load_n(&heavy_active, __ATOMIC_RELAXED) >= limit){
+		return false;
+	}
+	Locking l(&heavy_mutex);
+	if(heavy.empty() || heavy_active >= limit){
+		return false;
+	}
+	*item = heavy.front();
+	heavy.pop_front();
+	__sync_fetch_and_sub(&heavy_size, 1);
+	__sync_fetch_and_add(&heavy_active, 1);
+	return true;
+}
+
+template<class W, class JOB>
+bool StealingPool<W, JOB>::take(int id, Item *item, bool own_only){
+	if(!own_only && take_heavy(item)){
+		return true;
+	}
+	// 自己的队列, 从头部取
+	{
+		Lane *lane = lanes[id];
+		if(__atomic_load_n(&lane->size, __ATOMIC_RELAXED) > 0){
+			Locking l(&lane->mutex);
+			if(!lane->items.empty()){
+				*item = lane->items.front();
+				lane->items.pop_front();
+				__sync_fetch_and_sub(&lane->size, 1);
+				return true;
+			}
+		}
+	}
+	if(own_only){
+		return false;
+	}
+	// 从别的线程的队列尾部窃取, 包括已经退出的线程的队列
+	int n = __atomic_load_n(&num_lanes, __ATOMIC_ACQUIRE);
+	for(int i=1; i<n; i++){
+		Lane *lane = lanes[(id + i) % n];
+		if(__atomic_load_n(&lane->size, __ATOMIC_RELAXED) == 0){
+			continue;
+		}
+		Locking l(&lane->mutex);
+		if(!lane->items.empty()){
+			*item = lane->items.back();
+			lane->items.pop_back();
+			__sync_fetch_and_sub(&lane->size, 1);
+			return true;
+		}
+	}
+	return false;
+}
+
+template<class W, class JOB>
+void* StealingPool<W, JOB>::_run_worker(void *arg){
+	WorkerSlots::Arg *p = (WorkerSlots::Arg *)arg;
+	int id = p->id;
+	StealingPool *tp = (StealingPool *)p->pool;
+	delete p;
+
+	W w(tp->name);
+	typename WorkerPool<W, JOB>::Worker *worker = (typename WorkerPool<W, JOB>::Worker *)&w;
+	worker->id = id;
+	worker->init();
+	while(1){
+		Item item;
+		if(__atomic_load_n(&tp->closed, __ATOMIC_ACQUIRE)){
+			break;
+		}
+		// 线程数减少了, 处理完自己队列中的任务后退出
+		bool retiring = id >= tp->slots.size();
+		if(!tp->take(id, &item, retiring)){
+			if(retiring){
+				if(tp->slots.retire(id)){
+					break;
+				}
+				continue;
+			}
+			pthread_mutex_lock(&tp->park_mutex);
+			__sync_fetch_and_add(&tp->sleepers, 1);
+			bool got = tp->take(id, &item);
+			if(!got && (tp->closed || id >= tp->slots.size())){
+				__sync_fetch_and_sub(&tp->sleepers, 1);
+				pthread_mutex_unlock(&tp->park_mutex);
+				if(tp->closed){
+					break;
+				}
+				continue;
+			}
+			if(!got){
+				pthread_cond_wait(&tp->park_cond, &tp->park_mutex);
+			}
+			__sync_fetch_and_sub(&tp->sleepers, 1);
+			pthread_mutex_unlock(&tp->park_mutex);
+			if(!got){
+				continue;
+			}
+		}
+
+		Class *c = &tp->classes[item.cls];
+		__sync_fetch_and_sub(&c->queued, 1);
+		uint64_t stime = clock_cycles();
+		worker->proc(&item.job);
+		uint64_t etime = clock_cycles();
+		uint64_t proc_us = cycles_to_us(etime - stime);
+		__sync_fetch_and_add(&tp->busy_us, proc_us);
+		__sync_fetch_and_add(&c->calls, 1);
+		// 不同 CPU 上的计数可能有很小的偏差
+		c->wait.add(stime > item.push_time? cycles_to_us(stime - item.push_time) : 0);
+		c->proc.add(proc_us);
+
+		if(c->heavy){
+			__sync_fetch_and_sub(&tp->heavy_active, 1);
+			// 空出了一个重任务的名额, 让别的线程有机会去取
+			if(__atomic_load_n(&tp->heavy_size, __ATOMIC_RELAXED) > 0){
+				tp->wakeup();
+			}
+		}
+		tp->results.push(item.job);
+	}
+	worker->destroy();
+	return (void *)NULL;
+}
+
+template<class W, class JOB>
+int StealingPool<W, JOB>::start(int num_workers){
+	if(started){
+		return 0;
+	}
+	started = true;
+	resize(num_workers);
+	return 0;
+}
+
+template<class W, class JOB>
+int StealingPool<W, JOB>::resize(int num_workers){
+	if(!started){
+		return 0;
+	}
+	if(num_workers < 1){
+		num_workers = 1;
+	}
+	if(num_workers > WORKER_POOL_MAX_WORKERS){
+		num_workers = WORKER_POOL_MAX_WORKERS;
+	}
+	// 先分配队列, 再让 push() 看到新的线程数
+	while(num_lanes < num_workers){
+		Lane *lane = new Lane();
+		lane->size = 0;
+		lanes[num_lanes] = lane;
+		__atomic_store_n(&num_lanes, num_lanes + 1, __ATOMIC_RELEASE);
+	}
+	int old = slots.size();
+	int n = slots.resize(num_workers, &StealingPool::_run_worker, this);
+	if(n < old){
+		// 让多出来的线程从睡眠中返回, 然后退出
+		pthread_mutex_lock(&park_mutex);
+		pthread_cond_broadcast(&park_cond);
+		pthread_mutex_unlock(&park_mutex);
+	}
+	return n;
+}
+
+template<class W, class JOB>
+int StealingPool<W, JOB>::stop(){
+	if(!started){
+		return 0;
+	}
+	// 线程处理完手上的任务后退出, 队列中的任务不再处理
+	pthread_mutex_lock(&park_mutex);
+	__atomic_store_n(&closed, 1, __ATOMIC_RELEASE);
+	pthread_cond_broadcast(&park_cond);
+	pthread_mutex_unlock(&park_mutex);
+	slots.join_all();
+	started = false;
+	return 0;
+}
+
+template<class W, class JOB>
+int StealingPool<W, JOB>::pop(JOB *job){
+	return results.pop(job);
+}
+
+template<class W, class JOB>
+int StealingPool<W, JOB>::pop_all(std::vector<JOB> *jobs){
+	return results.pop_all(jobs);
+}
+
+template<class W, class JOB>
+std::vector<std::string> StealingPool<W, JOB>::info() const{
+	std::vector<std::string> ret;
+	for(int i=0; i<MAX_CLASSES; i++){
+		const Class &c = classes[i];
+		if(c.calls == 0 && c.queued == 0 && c.name == str(i)){
+			continue;
+		}
+		char buf[512];
+		snprintf(buf, sizeof(buf),
+			"queued: %d\tcalls: %" PRIu64 "\t"
+			"wait_p50: %" PRIu64 "\twait_p99: %" PRIu64 "\t"
+			"proc_p50: %" PRIu64 "\tproc_p99: %" PRIu64,
+			c.queued, c.calls,
+			c.wait.percentile(50), c.wait.percentile(99),
+			c.proc.percentile(50), c.proc.percentile(99));
+		ret.push_back(name + "." + c.name);
+		ret.push_back(buf);
+	}
+	return ret;
+}
+
+#endif
@@ -0,0 +1,95 @@
+/*
+Copyright (c) 2012-2014 The SSDB Authors. All rights reserved.
+Use of this source code is governed by a BSD-style license that can be
+found in the LICENSE file.
+*/
+// LogRing 的正确性检查, 特别是记录在缓冲区末尾回绕的情况.
+// 用 -fsanitize=address 编译可以检查越界写.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include "log_ring.h"
+
+static int failed = 0;
+
+#define CHECK(cond) do{ \
+		if(!(cond)){ \
+			printf("FAILED %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+			failed ++; \
+		} \
+	}while(0)
+
+static std::string make_data(int seq, int len){
+	std::string s;
+	for(int i=0; i<len; i++){
+		s.push_back('a' + (seq + i) % 26);
+	}
+	return s;
+}
+
+// 记录的长度不是头的整数倍, 末尾剩下 8 字节时回绕
+static void test_tail_gap(){
+	LogRing ring(4096);
+	int cap = (int)ring.capacity();
+	std::string out;
+	// 头 16 字节, 按 8 字节对齐时占用 cap - 8
+	std::string d1 = make_data(0, cap - 16 - 8);
+	CHECK(ring.push(d1.data(), (int)d1.size()));
+	CHECK(ring.pop_all(&out) == 1);
+	CHECK(out == d1);
+
+	for(int i=0; i<100; i++){
+		out.clear();
+		std::string d = make_data(i, 8 + i % 24);
+		CHECK(ring.push(d.data(), (int)d.size()));
+		CHECK(ring.pop_all(&out) == 1);
+		CHECK(out == d);
+	}
+}
+
+// 不同长度的记录写满再读空, 回绕很多次
+static void test_wrap_around(){
+	LogRing ring(4096);
+	int seq = 0;
+	for(int round=0; round<1000; round++){
+		std::string expect;
+		int pushed = 0;
+		while(1){
+			std::string d = make_data(seq, 1 + (seq * 7) % 200);
+			if(!ring.push(d.data(), (int)d.size())){
+				break;
+			}
+			expect.append(d);
+			seq ++;
+			pushed ++;
+		}
+		CHECK(pushed > 0);
+		CHECK(ring.used() <= ring.capacity());
+
+		std::string out;
+		CHECK(ring.pop_all(&out) == pushed);
+		CHECK(out == expect);
+		CHECK(ring.used() == 0);
+	}
+}
+
+// 比缓冲区大的记录放不进去
+static void test_too_large(){
+	LogRing ring(4096);
+	std::string d = make_data(0, (int)ring.capacity());
+	CHECK(!ring.push(d.data(), (int)d.size()));
+	std::string out;
+	CHECK(ring.pop_all(&out) == 0);
+}
+
+int main(int argc, char **argv){
+	test_tail_gap();
+	test_wrap_around();
+	test_too_large();
+	if(failed){
+		printf("%d checks failed\n", failed);
+		return 1;
+	}
+	printf("all tests passed\n");
+	return 0;
+}
@@ -0,0 +1,296 @@
+/*
+Copyright (c) 2012-2014 The SSDB Authors. All rights reserved.
+Use of this source code is governed by a BSD-style license that can be
+found in the LICENSE file.
+*/
+// WorkerPool 的正确性检查和任务往返延迟的微基准测试.
+// 同时测试原来的 Queue + SelectableQueue 方式作为对比.
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <vector>
+#include "thread.h"
+#include "stealing_pool.h"
+#include "histogram.h"
+
+static inline double microtime(){
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	return now.tv_sec * 1000000.0 + now.tv_usec;
+}
+
+class TestWorker : public WorkerPool<TestWorker, int>::Worker{
+	public:
+		TestWorker(const std::string &name){
+		}
+		int proc(int *job){
+			*job = -*job;
+			return 0;
+		}
+};
+
+// 原来的实现: 任务通过加锁的 Queue, 结果通过管道 SelectableQueue.
+// 原来的 stop() 用 pthread_cancel(), 不能安全地回收, 所以测试完之后
+// 线程留在那里, 对象也不释放
+class LegacyPool{
+	public:
+		Queue<int> jobs;
+		SelectableQueue<int> results;
+
+		static void* run(void *arg){
+			LegacyPool *p = (LegacyPool *)arg;
+			while(1){
+				int job;
+				if(p->jobs.pop(&job) == -1){
+					break;
+				}
+				job = -job;
+				p->results.push(job);
+			}
+			return NULL;
+		}
+		void start(int n){
+			for(int i=0; i<n; i++){
+				pthread_t tid;
+				pthread_create(&tid, NULL, &LegacyPool::run, this);
+			}
+		}
+};
+
+static int check_pool(int num_jobs){
+	WorkerPool<TestWorker, int> pool("test");
+	pool.start(4);
+	std::vector<char> seen(num_jobs + 1, 0);
+	// 一次放入比环大得多的任务, 覆盖溢出队列
+	for(int i=1; i<=num_jobs; i++){
+		pool.push(i);
+	}
+	int done = 0;
+	std::vector<int> results;
+	while(done < num_jobs){
+		struct pollfd pfd;
+		pfd.fd = pool.fd();
+		pfd.events = POLLIN;
+		poll(&pfd, 1, 1000);
+		results.clear();
+		pool.pop_all(&results);
+		for(int i=0; i<(int)results.size(); i++){
+			int v = -results[i];
+			if(v < 1 || v > num_jobs || seen[v]){
+				fprintf(stderr, "bad result: %d\n", results[i]);
+				return -1;
+			}
+			seen[v] = 1;
+		}
+		done += (int)results.size();
+	}
+	pool.stop();
+	return 0;
+}
+
+// 处理一个任务要 1ms
+class SlowWorker : public WorkerPool<SlowWorker, int>::Worker{
+	public:
+		SlowWorker(const std::string &name){
+		}
+		int proc(int *job){
+			usleep(1000);
+			*job = -*job;
+			return 0;
+		}
+};
+
+// stop() 不处理队列中剩下的任务: 线程做完手上的任务就退出
+template<class POOL>
+static int check_stop(POOL *pool, int num_jobs){
+	pool->start(2);
+	for(int i=1; i<=num_jobs; i++){
+		pool->push(i);
+	}
+	usleep(10 * 1000);
+	double stime = microtime();
+	pool->stop();
+	double ms = (microtime() - stime) / 1000;
+	std::vector<int> results;
+	pool->pop_all(&results);
+	if(ms > num_jobs / 4 || (int)results.size() >= num_jobs){
+		fprintf(stderr, "stop() drained the queue, %d/%d jobs done in %.1f ms\n",
+			(int)results.size(), num_jobs, ms);
+		return -1;
+	}
+	return 0;
+}
+
+// 一边放入任务一边调整线程数, 每个任务都要返回且只返回一次
+template<class POOL>
+static int check_resize(POOL *pool, int num_jobs){
+	static const int sizes[] = {1, 8, 2, 16, 1, 4};
+	const int num_sizes = sizeof(sizes)/sizeof(sizes[0]);
+	pool->start(4);
+	std::vector<char> seen(num_jobs + 1, 0);
+	std::vector<int> results;
+	int done = 0;
+	for(int i=1; i<=num_jobs; i++){
+		pool->push(i);
+		if(i % (num_jobs / num_sizes / 2) == 0){
+			int n = sizes[(i / (num_jobs / num_sizes / 2)) % num_sizes];
+			if(pool->resize(n) != n){
+				fprintf(stderr, "resize(%d) failed\n", n);
+				return -1;
+			}
+		}
+	}
+	while(done < num_jobs){
+		struct pollfd pfd;
+		pfd.fd = pool->fd();
+		pfd.events = POLLIN;
+		if(poll(&pfd, 1, 3000) == 0){
+			fprintf(stderr, "timeout, done: %d, size: %d\n", done, pool->size());
+			return -1;
+		}
+		results.clear();
+		pool->pop_all(&results);
+		for(int i=0; i<(int)results.size(); i++){
+			int v = -results[i];
+			if(v < 1 || v > num_jobs || seen[v]){
+				fprintf(stderr, "bad result: %d\n", results[i]);
+				return -1;
+			}
+			seen[v] = 1;
+		}
+		done += (int)results.size();
+	}
+	pool->stop();
+	return 0;
+}
+
+static void report(const char *name, const Histogram &h, double total_us){
+	printf("%-24s rounds: %8" PRIu64 "  avg: %7.2f us  p50: %5" PRIu64 " us  p99: %5" PRIu64 " us  p999: %5" PRIu64 " us\n",
+		name, h.count(), total_us / h.count(),
+		h.percentile(50), h.percentile(99), h.percentile(99.9));
+}
+
+// 每次只有一个任务在途: 测的是一次往返(入队, 唤醒, 处理, 返回, 唤醒)的延迟
+static void bench_new(int rounds, int workers){
+	WorkerPool<TestWorker, int> pool("bench");
+	pool.start(workers);
+	Histogram h;
+	std::vector<int> results;
+	double stime = microtime();
+	for(int i=1; i<=rounds; i++){
+		double t = microtime();
+		pool.push(i);
+		int job;
+		pool.pop(&job);
+		h.add((uint64_t)(microtime() - t));
+	}
+	report("ring+eventfd", h, microtime() - stime);
+	pool.stop();
+}
+
+static void bench_legacy(int rounds, int workers){
+	LegacyPool &pool = *(new LegacyPool());
+	pool.start(workers);
+	Histogram h;
+	double stime = microtime();
+	for(int i=1; i<=rounds; i++){
+		double t = microtime();
+		pool.jobs.push(i);
+		int job;
+		pool.results.pop(&job);
+		h.add((uint64_t)(microtime() - t));
+	}
+	report("mutex+pipe", h, microtime() - stime);
+}
+
+// 每次放入 batch 个任务再全部取回, 测的是吞吐
+static void bench_batch_new(int rounds, int workers, int batch){
+	WorkerPool<TestWorker, int> pool("bench");
+	pool.start(workers);
+	std::vector<int> results;
+	double stime = microtime();
+	for(int r=0; r<rounds; r++){
+		for(int i=1; i<=batch; i++){
+			pool.push(i);
+		}
+		int done = 0;
+		while(done < batch){
+			struct pollfd pfd;
+			pfd.fd = pool.fd();
+			pfd.events = POLLIN;
+			poll(&pfd, 1, -1);
+			results.clear();
+			done += pool.pop_all(&results);
+		}
+	}
+	double us = microtime() - stime;
+	printf("%-24s jobs: %8d  %10.0f jobs/s\n", "ring+eventfd batch", rounds * batch, rounds * batch / us * 1000000);
+	pool.stop();
+}
+
+static void bench_batch_legacy(int rounds, int workers, int batch){
+	LegacyPool &pool = *(new LegacyPool());
+	pool.start(workers);
+	double stime = microtime();
+	for(int r=0; r<rounds; r++){
+		for(int i=1; i<=batch; i++){
+			pool.jobs.push(i);
+		}
+		for(int i=0; i<batch; i++){
+			int job;
+			pool.results.pop(&job);
+		}
+	}
+	double us = microtime() - stime;
+	printf("%-24s jobs: %8d  %10.0f jobs/s\n", "mutex+pipe batch", rounds * batch, rounds * batch / us * 1000000);
+}
+
+int main(int argc, char **argv){
+	int rounds = 100000;
+	int workers = 4;
+	if(argc > 1){
+		rounds = atoi(argv[1]);
+	}
+	if(argc > 2){
+		workers = atoi(argv[2]);
+	}
+	if(check_pool(100000) == -1){
+		printf("FAILED\n");
+		return 1;
+	}
+	{
+		WorkerPool<TestWorker, int> pool("test");
+		if(check_resize(&pool, 100000) == -1){
+			printf("FAILED\n");
+			return 1;
+		}
+	}
+	{
+		StealingPool<TestWorker, int> pool("test");
+		if(check_resize(&pool, 100000) == -1){
+			printf("FAILED\n");
+			return 1;
+		}
+	}
+	{
+		WorkerPool<SlowWorker, int> pool("test");
+		if(check_stop(&pool, 2000) == -1){
+			printf("FAILED\n");
+			return 1;
+		}
+	}
+	{
+		StealingPool<SlowWorker, int> pool("test");
+		if(check_stop(&pool, 2000) == -1){
+			printf("FAILED\n");
+			return 1;
+		}
+	}
+	printf("check OK\n");
+	printf("workers: %d\n", workers);
+	bench_legacy(rounds, workers);
+	bench_new(rounds, workers);
+	bench_batch_legacy(rounds / 64, workers, 64);
+	bench_batch_new(rounds / 64, workers, 64);
+	return 0;
+}
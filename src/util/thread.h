@@ -11,9 +11,18 @@ found in the LICENSE file.
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <pthread.h>
+#include <time.h>
 #include <queue>
+#include <string>
 #include <vector>
+#ifdef __linux__
+	#include <sys/eventfd.h>
+	#define HAVE_EVENTFD 1
+#endif
 
 // 对线程锁的封装
 class Mutex{
@@ -117,21 +126,233 @@ class SelectableQueue{
 		int pop(T *data);
 };
 
-/**
- * 工作池？其中可以包含很多worker，应该是这样吧
- * 两个模板类，W是worker类，JOB是任务类
- *
- * 这是个多线程的运行某个任务的工具，可以指定线程数量。运行步骤如下：
- * 1. 确定W类和JOB类。也就是，确定worker类和任务类，任务类中实际上包含的应该是任务数据。
- *   这时候worker类可能还没有定义；
- * 2. 定义worker类，需要继承WorkerPool::Worder类，重载proc方法，指定处理任务的逻辑。
- * 3. 创建WorkerPool对象，这时候需要指定Worker类和JOB类。
- * 4. 调用pool的start方法，开始运行，这时候需要指定worker的数量，也就是线程的数量；
- * 5. 向pool中push任务；
- * 6. 从pool中读取任务结果；
- * 7. 调用pool的stop方法，停止运行；
- * 在NetworkServer中用到，在serve函数中创建工作池
- */
+
+// 用于线程间唤醒的文件描述符, Linux 下使用 eventfd, 其它系统使用管道.
+// fd() 是非阻塞的, 可以放到 select/epoll 中等待可读; notify() 使它
+// 可读, clear() 清除可读状态, wait() 阻塞到可读为止.
+class WakeupFd{
+	private:
+		int fds[2];
+		// No copying allowed
+		WakeupFd(const WakeupFd&);
+		void operator=(const WakeupFd&);
+	public:
+		WakeupFd();
+		~WakeupFd();
+		int fd(){
+			return fds[0];
+		}
+		void notify();
+		void wait();
+		void clear();
+};
+
+// 有界的无锁环形队列, 支持多个生产者和多个消费者(Vyukov 的算法).
+// 每个槽有一个序号, 生产者和消费者各用 CAS 抢占一个位置, 不需要加锁.
+// 环满时 push() 把元素放到加锁的溢出队列中, 所以 push() 总是成功;
+// 溢出的元素和环中的元素之间不保证先后顺序.
+template <class T>
+class RingQueue{
+	private:
+		struct Cell{
+			size_t seq;
+			T data;
+		};
+		Cell *cells;
+		size_t mask;
+		char pad0[64];
+		size_t enqueue_pos;
+		char pad1[64];
+		size_t dequeue_pos;
+		char pad2[64];
+		int overflow_size;
+		Mutex overflow_mutex;
+		std::queue<T> overflow;
+
+		// No copying allowed
+		RingQueue(const RingQueue&);
+		void operator=(const RingQueue&);
+	public:
+		// capacity 会向上取整为 2 的幂
+		RingQueue(int capacity);
+		~RingQueue();
+
+		// 环满时返回 false
+		bool try_push(const T &item);
+		// 队列空时返回 false
+		bool try_pop(T *data);
+		void push(const T &item);
+		bool pop(T *data);
+};
+
+// 用 RingQueue 实现的阻塞队列, 多个生产者, 多个消费者. 队列为空时
+// 消费者短暂自旋后在条件变量上睡眠; 生产者只在有消费者睡眠时才加锁
+// 唤醒一个, 忙的时候入队和出队都不加锁, 也没有系统调用.
+template <class T>
+class BlockingRing{
+	private:
+		RingQueue<T> items;
+		pthread_mutex_t mutex;
+		pthread_cond_t cond;
+		// 正在睡眠的消费者数
+		int sleepers;
+		int closed;
+		int spin;
+		// kick() 的次数
+		int kicks;
+
+		// No copying allowed
+		BlockingRing(const BlockingRing&);
+		void operator=(const BlockingRing&);
+	public:
+		BlockingRing(int capacity);
+		~BlockingRing();
+
+		int push(const T item);
+		// 队列关闭后返回 -1, 队列中剩下的元素不再取出;
+		// 等待时被 kick() 唤醒返回 0
+		int pop(T *data);
+		// 关闭队列, 唤醒所有等待的消费者
+		void close();
+		// 唤醒所有等待的消费者, 让它们检查自己是否需要退出
+		void kick();
+};
+
+// 用 RingQueue 实现的可 select 的队列, 多个生产者, 单个消费者.
+// 只有消费者清除了通知状态之后, 生产者才会再次通知, 所以一次唤醒
+// 可以取走一批结果, 见 pop_all().
+template <class T>
+class SelectableRing{
+	private:
+		RingQueue<T> items;
+		WakeupFd wakeup;
+		int signaled;
+	public:
+		SelectableRing(int capacity);
+		int fd(){
+			return wakeup.fd();
+		}
+
+		// multi writer
+		int push(const T item);
+		// single reader, 阻塞到有数据为止
+		int pop(T *data);
+		// single reader, fd() 可读时调用, 取走所有的数据, 返回取到的个数
+		int pop_all(std::vector<T> *data);
+};
+
+// 任务队列和结果队列中环的大小, 超过时使用加锁的溢出队列
+#define WORKER_POOL_QUEUE_SIZE	4096
+// 工作池的线程数上限
+#define WORKER_POOL_MAX_WORKERS	256
+
+// 工作池的线程表, 线程数可以在运行时调整.
+// resize() 只在一个线程(通常是主线程)中调用; id 不小于目标线程数的工作线程
+// 在空闲时调用 retire() 登记后退出, 它的位置之后可以被新的线程使用.
+class WorkerSlots{
+	public:
+		struct Arg{
+			int id;
+			void *pool;
+		};
+		typedef void* (*run_t)(void *arg);
+
+		WorkerSlots(){
+			target = 0;
+			for(int i=0; i<WORKER_POOL_MAX_WORKERS; i++){
+				states[i] = STOPPED;
+			}
+		}
+
+		int size() const{
+			return __atomic_load_n(&target, __ATOMIC_RELAXED);
+		}
+
+		// 工作线程调用, 返回 true 时线程必须立即退出
+		bool retire(int id){
+			if(id < __atomic_load_n(&target, __ATOMIC_RELAXED)){
+				return false;
+			}
+			Locking l(&mutex);
+			if(id < target){
+				return false;
+			}
+			// join_all() 已经接管了这个线程时不再修改状态
+			if(states[id] == RUNNING){
+				states[id] = EXITED;
+			}
+			return true;
+		}
+
+		// 把线程数调整为 n, 缺少的线程用 run(Arg *) 创建, 返回调整后的线程数.
+		// 减少时多出的线程不会马上退出, 调用者要负责唤醒它们
+		int resize(int n, run_t run, void *pool){
+			if(n < 1){
+				n = 1;
+			}
+			if(n > WORKER_POOL_MAX_WORKERS){
+				n = WORKER_POOL_MAX_WORKERS;
+			}
+			Locking l(&mutex);
+			__atomic_store_n(&target, n, __ATOMIC_RELAXED);
+			for(int i=0; i<n; i++){
+				if(states[i] == RUNNING){
+					continue;
+				}
+				if(states[i] == EXITED){
+					pthread_join(tids[i], NULL);
+					states[i] = STOPPED;
+				}
+				Arg *arg = new Arg();
+				arg->id = i;
+				arg->pool = pool;
+				int err = pthread_create(&tids[i], NULL, run, arg);
+				if(err != 0){
+					fprintf(stderr, "can't create thread: %s\n", strerror(err));
+					delete arg;
+					target = i;
+					break;
+				}
+				states[i] = RUNNING;
+			}
+			return target;
+		}
+
+		// 线程都已经(或即将)退出之后调用, 回收所有线程. 正在退出的线程
+		// 会在 retire() 中加锁, 所以不能持有锁 join
+		void join_all(){
+			std::vector<pthread_t> joins;
+			{
+				Locking l(&mutex);
+				target = 0;
+				for(int i=0; i<WORKER_POOL_MAX_WORKERS; i++){
+					if(states[i] != STOPPED){
+						joins.push_back(tids[i]);
+						states[i] = STOPPED;
+					}
+				}
+			}
+			for(int i=0; i<(int)joins.size(); i++){
+				pthread_join(joins[i], NULL);
+			}
+		}
+
+	private:
+		enum{
+			STOPPED = 0,
+			RUNNING,
+			EXITED,
+		};
+		Mutex mutex;
+		int target;
+		int states[WORKER_POOL_MAX_WORKERS];
+		pthread_t tids[WORKER_POOL_MAX_WORKERS];
+
+		// No copying allowed
+		WorkerSlots(const WorkerSlots&);
+		void operator=(const WorkerSlots&);
+};
+
 template<class W, class JOB>
 class WorkerPool{
 	public:
@@ -152,22 +373,17 @@ class WorkerPool{
 	    // worker pool的名称还是worker的名称？
 		std::string name;
 		// 任务队列
-		Queue<JOB> jobs;
+		BlockingRing<JOB> jobs;
 		// 任务处理的结果队列
-		SelectableQueue<JOB> results;
+		SelectableRing<JOB> results;
 
-        // worker数量
-		int num_workers;
-		// 线程id列表，应该是worker线程的列表的，那意味着每个worker会在独立的线程中运行?
-		std::vector<pthread_t> tids;
+		// 工作线程, 每个worker在独立的线程中运行, 线程数可以调整
+		WorkerSlots slots;
 		// 是否已开始运行？
 		bool started;
+		// 所有线程执行任务的总时间, 微秒
+		uint64_t busy_us;
 
-        // 运行参数
-		struct run_arg{
-			int id;
-			WorkerPool *tp;
-		};
 		static void* _run_worker(void *arg);
 	public:
 		WorkerPool(const char *name="");
@@ -179,10 +395,25 @@ class WorkerPool{
 		}
 		
 		int start(int num_workers);
+		// 线程处理完手上的任务后退出, 队列中的任务丢弃. stop() 只在服务器
+		// 退出时调用, 这时事件循环已经停止, 任务的结果不会再发给客户端;
+		// 继续执行排队的写操作只会推迟退出, 而客户端收不到响应, 重试时
+		// 会重复执行. 和原来用 pthread_cancel 时的行为一样
 		int stop();
+		// 运行中调整线程数, 返回调整后的线程数
+		int resize(int num_workers);
+		int size() const{
+			return slots.size();
+		}
+		// 所有线程执行任务的总时间(微秒), 用于计算线程的忙碌程度
+		uint64_t busy_time() const{
+			return busy_us;
+		}
 		
 		int push(JOB job);
 		int pop(JOB *job);
+		// fd() 可读时调用, 一次取走所有已完成的任务, 返回取到的个数
+		int pop_all(std::vector<JOB> *jobs);
 };
 
 
@@ -350,12 +581,312 @@ int SelectableQueue<T>::pop(T *data){
 }
 
 
+inline WakeupFd::WakeupFd(){
+#ifdef HAVE_EVENTFD
+	fds[0] = fds[1] = eventfd(0, EFD_NONBLOCK);
+	if(fds[0] == -1){
+		exit(0);
+	}
+#else
+	if(pipe(fds) == -1){
+		exit(0);
+	}
+	// 只需要可读这个状态, 管道满了也不要阻塞生产者
+	fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+	fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL) | O_NONBLOCK);
+#endif
+}
+
+inline WakeupFd::~WakeupFd(){
+	close(fds[0]);
+	if(fds[1] != fds[0]){
+		close(fds[1]);
+	}
+}
+
+inline void WakeupFd::notify(){
+#ifdef HAVE_EVENTFD
+	uint64_t n = 1;
+	while(::write(fds[1], &n, sizeof(n)) == -1 && errno == EINTR);
+#else
+	while(::write(fds[1], "1", 1) == -1 && errno == EINTR);
+#endif
+}
+
+inline void WakeupFd::wait(){
+	struct pollfd pfd;
+	pfd.fd = fds[0];
+	pfd.events = POLLIN;
+	while(poll(&pfd, 1, -1) == -1 && errno == EINTR);
+}
+
+inline void WakeupFd::clear(){
+#ifdef HAVE_EVENTFD
+	uint64_t n;
+	while(::read(fds[0], &n, sizeof(n)) == -1 && errno == EINTR);
+#else
+	char buf[64];
+	while(::read(fds[0], buf, sizeof(buf)) > 0);
+#endif
+}
+
+
+template <class T>
+RingQueue<T>::RingQueue(int capacity){
+	size_t n = 2;
+	while(n < (size_t)capacity){
+		n *= 2;
+	}
+	cells = new Cell[n];
+	for(size_t i=0; i<n; i++){
+		cells[i].seq = i;
+	}
+	mask = n - 1;
+	enqueue_pos = 0;
+	dequeue_pos = 0;
+	overflow_size = 0;
+}
+
+template <class T>
+RingQueue<T>::~RingQueue(){
+	delete[] cells;
+}
+
+template <class T>
+bool RingQueue<T>::try_push(const T &item){
+	Cell *cell;
+	size_t pos = __atomic_load_n(&enqueue_pos, __ATOMIC_RELAXED);
+	while(1){
+		cell = &cells[pos & mask];
+		size_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+		intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+		if(dif == 0){
+			if(__atomic_compare_exchange_n(&enqueue_pos, &pos, pos + 1, true,
+					__ATOMIC_RELAXED, __ATOMIC_RELAXED)){
+				break;
+			}
+		}else if(dif < 0){
+			// full
+			return false;
+		}else{
+			pos = __atomic_load_n(&enqueue_pos, __ATOMIC_RELAXED);
+		}
+	}
+	cell->data = item;
+	__atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+	return true;
+}
+
+template <class T>
+bool RingQueue<T>::try_pop(T *data){
+	Cell *cell;
+	size_t pos = __atomic_load_n(&dequeue_pos, __ATOMIC_RELAXED);
+	while(1){
+		cell = &cells[pos & mask];
+		size_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+		intptr_t dif = (intptr_t)seq - (intptr_t)(pos + 1);
+		if(dif == 0){
+			if(__atomic_compare_exchange_n(&dequeue_pos, &pos, pos + 1, true,
+					__ATOMIC_RELAXED, __ATOMIC_RELAXED)){
+				break;
+			}
+		}else if(dif < 0){
+			// empty
+			return false;
+		}else{
+			pos = __atomic_load_n(&dequeue_pos, __ATOMIC_RELAXED);
+		}
+	}
+	*data = cell->data;
+	__atomic_store_n(&cell->seq, pos + mask + 1, __ATOMIC_RELEASE);
+	return true;
+}
+
+template <class T>
+void RingQueue<T>::push(const T &item){
+	if(try_push(item)){
+		return;
+	}
+	Locking l(&overflow_mutex);
+	overflow.push(item);
+	__sync_fetch_and_add(&overflow_size, 1);
+}
+
+template <class T>
+bool RingQueue<T>::pop(T *data){
+	if(try_pop(data)){
+		return true;
+	}
+	if(__atomic_load_n(&overflow_size, __ATOMIC_ACQUIRE) == 0){
+		return false;
+	}
+	Locking l(&overflow_mutex);
+	if(overflow.empty()){
+		return false;
+	}
+	*data = overflow.front();
+	overflow.pop();
+	__sync_fetch_and_sub(&overflow_size, 1);
+	return true;
+}
+
+
+// 队列为空时, 消费者睡眠之前自旋的次数. 只有一个 CPU 时自旋只会
+// 占用生产者的时间, 不自旋
+#define RING_SPIN_COUNT		200
+
+template <class T>
+BlockingRing<T>::BlockingRing(int capacity) : items(capacity){
+	pthread_mutex_init(&mutex, NULL);
+	pthread_cond_init(&cond, NULL);
+	sleepers = 0;
+	closed = 0;
+	kicks = 0;
+	spin = sysconf(_SC_NPROCESSORS_ONLN) > 1? RING_SPIN_COUNT : 0;
+}
+
+template <class T>
+BlockingRing<T>::~BlockingRing(){
+	pthread_cond_destroy(&cond);
+	pthread_mutex_destroy(&mutex);
+}
+
+template <class T>
+int BlockingRing<T>::push(const T item){
+	items.push(item);
+	// 与 pop() 中 sleepers ++ 配对的内存屏障: 要么消费者在睡眠前的
+	// 检查中看到这个元素, 要么这里看到 sleepers > 0
+	__sync_synchronize();
+	if(__atomic_load_n(&sleepers, __ATOMIC_RELAXED) > 0){
+		pthread_mutex_lock(&mutex);
+		pthread_cond_signal(&cond);
+		pthread_mutex_unlock(&mutex);
+	}
+	return 1;
+}
+
+template <class T>
+int BlockingRing<T>::pop(T *data){
+	int gen = __atomic_load_n(&kicks, __ATOMIC_RELAXED);
+	while(1){
+		if(__atomic_load_n(&closed, __ATOMIC_ACQUIRE)){
+			return -1;
+		}
+		for(int i=0; i<spin; i++){
+			if(items.pop(data)){
+				return 1;
+			}
+#if defined(__x86_64__) || defined(__i386__)
+			__builtin_ia32_pause();
+#endif
+		}
+		if(items.pop(data)){
+			return 1;
+		}
+		pthread_mutex_lock(&mutex);
+		__sync_fetch_and_add(&sleepers, 1);
+		if(items.pop(data)){
+			__sync_fetch_and_sub(&sleepers, 1);
+			pthread_mutex_unlock(&mutex);
+			return 1;
+		}
+		if(closed){
+			__sync_fetch_and_sub(&sleepers, 1);
+			pthread_mutex_unlock(&mutex);
+			return -1;
+		}
+		if(kicks != gen){
+			__sync_fetch_and_sub(&sleepers, 1);
+			pthread_mutex_unlock(&mutex);
+			return 0;
+		}
+		// 可能被多余的 signal 唤醒, 回到循环开始重新检查即可
+		pthread_cond_wait(&cond, &mutex);
+		__sync_fetch_and_sub(&sleepers, 1);
+		pthread_mutex_unlock(&mutex);
+	}
+	return -1;
+}
+
+template <class T>
+void BlockingRing<T>::close(){
+	pthread_mutex_lock(&mutex);
+	__atomic_store_n(&closed, 1, __ATOMIC_RELEASE);
+	pthread_cond_broadcast(&cond);
+	pthread_mutex_unlock(&mutex);
+}
+
+template <class T>
+void BlockingRing<T>::kick(){
+	pthread_mutex_lock(&mutex);
+	__sync_fetch_and_add(&kicks, 1);
+	pthread_cond_broadcast(&cond);
+	pthread_mutex_unlock(&mutex);
+}
+
+
+template <class T>
+SelectableRing<T>::SelectableRing(int capacity) : items(capacity){
+	signaled = 0;
+}
+
+template <class T>
+int SelectableRing<T>::push(const T item){
+	items.push(item);
+	// 已经通知过而消费者还没有处理, 不需要再次通知
+	if(__sync_lock_test_and_set(&signaled, 1) == 0){
+		wakeup.notify();
+	}
+	return 1;
+}
+
+template <class T>
+int SelectableRing<T>::pop(T *data){
+	while(1){
+		if(items.pop(data)){
+			return 1;
+		}
+		// 队列空了, 清除通知状态后再检查一次, 然后等待
+		wakeup.clear();
+		__sync_lock_test_and_set(&signaled, 0);
+		__sync_synchronize();
+		if(items.pop(data)){
+			// 可能还有别的数据, 恢复可读状态, 不丢失通知
+			if(__sync_lock_test_and_set(&signaled, 1) == 0){
+				wakeup.notify();
+			}
+			return 1;
+		}
+		wakeup.wait();
+	}
+	return -1;
+}
+
+template <class T>
+int SelectableRing<T>::pop_all(std::vector<T> *data){
+	// 先清除通知状态再取数据, 之后入队的数据会再次通知
+	wakeup.clear();
+	__sync_lock_test_and_set(&signaled, 0);
+	__sync_synchronize();
+	int n = 0;
+	T item;
+	while(items.pop(&item)){
+		data->push_back(item);
+		n ++;
+	}
+	return n;
+}
+
+
 // 初始化worker pool，只指定了一个名字
 // 注意模板类的用法，有两个模板类的时候怎么写
 template<class W, class JOB>
-WorkerPool<W, JOB>::WorkerPool(const char *name){
+WorkerPool<W, JOB>::WorkerPool(const char *name) :
+	jobs(WORKER_POOL_QUEUE_SIZE), results(WORKER_POOL_QUEUE_SIZE)
+{
 	this->name = name;
 	this->started = false;
+	this->busy_us = 0;
 }
 
 // 析构函数，如果已经开始运行，则停止运行。除此之外每别的需要做的
@@ -378,15 +909,20 @@ int WorkerPool<W, JOB>::pop(JOB *job){
 	return this->results.pop(job);
 }
 
+template<class W, class JOB>
+int WorkerPool<W, JOB>::pop_all(std::vector<JOB> *jobs){
+	return this->results.pop_all(jobs);
+}
+
 // 根据指定的参数，开始运行
 // 这个应该在线程中调用？
 template<class W, class JOB>
 void* WorkerPool<W, JOB>::_run_worker(void *arg){
     // 获取到运行参数
-	struct run_arg *p = (struct run_arg*)arg;
+	WorkerSlots::Arg *p = (WorkerSlots::Arg *)arg;
 	int id = p->id;
 	// 获取到运行的worker pool
-	WorkerPool *tp = p->tp;
+	WorkerPool *tp = (WorkerPool *)p->pool;
 	// 为啥删除掉原来的运行参数？
 	delete p;
 
@@ -400,16 +936,28 @@ void* WorkerPool<W, JOB>::_run_worker(void *arg){
 	worker->init();
 	while(1){
 		JOB job;
+		// 线程数减少了, 见 resize()
+		if(tp->slots.retire(id)){
+			break;
+		}
 		// 拿出一个任务
-		if(tp->jobs.pop(&job) == -1){
-			fprintf(stderr, "jobs.pop error\n");
-			::exit(0);
+		// 返回 -1 表示任务队列已关闭, 见 stop(); 返回 0 表示被 resize() 唤醒
+		int ret = tp->jobs.pop(&job);
+		if(ret == -1){
 			break;
 		}
+		if(ret == 0){
+			continue;
+		}
 		// 处理任务，见net/worker.cpp中的实现
 		// 在处理过程中会调用处理函数得到结果，并将结果放到客户端连接的
 		// 输出缓冲区中。
+		struct timespec stime, etime;
+		clock_gettime(CLOCK_MONOTONIC, &stime);
 		worker->proc(&job);
+		clock_gettime(CLOCK_MONOTONIC, &etime);
+		__sync_fetch_and_add(&tp->busy_us, (uint64_t)((etime.tv_sec - stime.tv_sec) * 1000000
+			+ (etime.tv_nsec - stime.tv_nsec) / 1000));
 		// 将任务放到结果队列，这将触发结果队列的in事件，在NetworkServer的serve函数里会做处理
 		if(tp->results.push(job) == -1){
 			fprintf(stderr, "results.push error\n");
@@ -426,44 +974,38 @@ void* WorkerPool<W, JOB>::_run_worker(void *arg){
 // 开始运行工作池
 template<class W, class JOB>
 int WorkerPool<W, JOB>::start(int num_workers){
-    // worker的数量
-	this->num_workers = num_workers;
 	// 如果已经开始，就没必要再重新开始了
 	if(started){
 		return 0;
 	}
-	int err;
-	pthread_t tid;
-	// 循环构建
-	for(int i=0; i<num_workers; i++){
-	    // 初始化运行参数
-		struct run_arg *arg = new run_arg();
-		arg->id = i;
-		arg->tp = this;
-
-        // 起新线程，开始运行
-		err = pthread_create(&tid, NULL, &WorkerPool::_run_worker, arg);
-		if(err != 0){
-			fprintf(stderr, "can't create thread: %s\n", strerror(err));
-		}else{
-		    // 记录线程ID
-			tids.push_back(tid);
-		}
-	}
+	slots.resize(num_workers, &WorkerPool::_run_worker, this);
 	started = true;
 	return 0;
 }
 
+template<class W, class JOB>
+int WorkerPool<W, JOB>::resize(int num_workers){
+	if(!started){
+		return 0;
+	}
+	int old = slots.size();
+	int n = slots.resize(num_workers, &WorkerPool::_run_worker, this);
+	if(n < old){
+		// 让多出来的线程从等待中返回, 然后退出
+		jobs.kick();
+	}
+	return n;
+}
+
 template<class W, class JOB>
 int WorkerPool<W, JOB>::stop(){
-	// TODO: notify works quit and wait
-	for(int i=0; i<tids.size(); i++){
-#ifdef OS_ANDROID
-#else
-        // 停止线程
-		pthread_cancel(tids[i]);
-#endif
+	if(!started){
+		return 0;
 	}
+	// 关闭任务队列, 线程处理完手上的任务后退出, 队列中的任务不再处理
+	jobs.close();
+	slots.join_all();
+	started = false;
 	return 0;
 }
 
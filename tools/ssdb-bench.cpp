@@ -8,26 +8,222 @@ found in the LICENSE file.
 #include <string.h>
 #include <time.h>
 #include <errno.h>
+#include <math.h>
+#include <pthread.h>
 #include <string>
 #include <vector>
-#include <map>
+#include <deque>
 #include "net/link.h"
 #include "net/fde.h"
 #include "util/log.h"
+#include "util/clock.h"
+#include "util/histogram.h"
 #include "version.h"
 
 #include "../src/include.h"
 
-struct Data
-{
-	std::string key;
-	std::string val;
-	std::string num;
+// 负载生成器. 每个线程有自己的连接和事件循环, 每个连接最多有 pipeline
+// 个请求在途. 闭环模式下收到响应就发出下一个请求; 开环模式(--rate)按
+// 固定的间隔发出请求, 延迟从计划发出的时间算起, 连接忙时排队的时间也
+// 算在延迟中.
+
+enum{
+	OP_READ = 0,
+	OP_UPDATE,
+	OP_INSERT,
+	OP_SCAN,
+	// read-modify-write, 读取之后写回, 延迟是两个请求的总和
+	OP_RMW,
+	OP_DELETE,
+	OP_PUSH,
+	OP_POP,
+	NUM_OPS
+};
+static const char *op_names[NUM_OPS] = {
+	"read", "update", "insert", "scan", "rmw", "delete", "push", "pop"
+};
+
+enum{
+	DIST_UNIFORM = 0,
+	DIST_ZIPFIAN,
+	DIST_HOTSPOT,
+	DIST_SEQUENTIAL,
+	// 最近插入的 key 更热(zipfian)
+	DIST_LATEST,
+	NUM_DISTS
+};
+static const char *dist_names[NUM_DISTS] = {
+	"uniform", "zipfian", "hotspot", "sequential", "latest"
+};
+
+enum{
+	TYPE_KV = 0,
+	TYPE_HASH,
+	TYPE_ZSET,
+	TYPE_QUEUE,
+	NUM_TYPES
+};
+static const char *type_names[NUM_TYPES] = {"kv", "hash", "zset", "queue"};
+
+// 每种数据类型的每种操作使用的命令, NULL 表示不支持
+static const char *commands[NUM_TYPES][NUM_OPS] = {
+	{"get", "set", "set", "scan", "get", "del", NULL, NULL},
+	{"hget", "hset", "hset", "hscan", "hget", "hdel", NULL, NULL},
+	{"zget", "zset", "zset", "zscan", "zget", "zdel", NULL, NULL},
+	{NULL, NULL, NULL, NULL, NULL, NULL, "qpush", "qpop"},
+};
+
+enum{
+	VALUE_FIXED = 0,
+	VALUE_UNIFORM,
+	VALUE_EXP,
+};
+
+// 预定义的负载, 比例依次是 read, update, insert, scan, rmw
+struct Workload{
+	const char *name;
+	int mix[5];
+	int dist;
+};
+static const Workload workloads[] = {
+	{"a", {50, 50, 0, 0, 0}, DIST_ZIPFIAN},
+	{"b", {95, 5, 0, 0, 0}, DIST_ZIPFIAN},
+	{"c", {100, 0, 0, 0, 0}, DIST_ZIPFIAN},
+	{"d", {95, 0, 5, 0, 0}, DIST_LATEST},
+	{"e", {0, 0, 5, 95, 0}, DIST_ZIPFIAN},
+	{"f", {50, 0, 0, 0, 50}, DIST_ZIPFIAN},
+	{NULL, {0}, 0},
+};
+
+struct Options{
+	std::string ip;
+	int port;
+	// a-f, custom(--mix), 或者 suite(依次测试每个命令)
+	std::string workload;
+	int mix[NUM_OPS];
+	int type;
+	int64_t keys;
+	int dist;
+	double zipf_theta;
+	// 热点: hot_set 比例的 key 占 hot_ops 比例的请求
+	double hot_set;
+	double hot_ops;
+	int value_dist;
+	int value_min;
+	int value_max;
+	int scan_len;
+	int threads;
+	int clients;
+	int pipeline;
+	int64_t requests;
+	double duration;
+	double warmup;
+	// 每秒的请求数, 0: 闭环
+	double rate;
+	bool load;
+	bool json;
+};
+static Options opt;
+
+// 统计, 多个线程同时更新
+struct OpStats{
+	Histogram hist;
+	int64_t count;
+	int64_t errors;
+	int64_t total_us;
+};
+static OpStats *stats;
+
+struct Zipfian{
+	int64_t n;
+	double theta;
+	double alpha;
+	double zetan;
+	double eta;
+
+	// 见 Gray et al, Quickly Generating Billion-Record Synthetic Databases
+	void init(int64_t n, double theta){
+		this->n = n;
+		this->theta = theta;
+		double zeta2 = 0;
+		zetan = 0;
+		for(int64_t i=1; i<=n; i++){
+			double v = 1 / pow((double)i, theta);
+			zetan += v;
+			if(i <= 2){
+				zeta2 += v;
+			}
+		}
+		alpha = 1 / (1 - theta);
+		eta = (1 - pow(2.0 / n, 1 - theta)) / (1 - zeta2 / zetan);
+	}
+
+	// u: [0, 1), 返回 [0, n), 0 最热
+	int64_t next(double u) const{
+		double uz = u * zetan;
+		if(uz < 1){
+			return 0;
+		}
+		if(uz < 1 + pow(0.5, theta)){
+			return 1;
+		}
+		int64_t r = (int64_t)(n * pow(eta * u - eta + 1, alpha));
+		return r < n? r : n - 1;
+	}
 };
+static Zipfian zipf;
 
-std::map<std::string, Data *> *ds;
-Fdevents *fdes;
-std::vector<Link *> *free_links;
+// 已经插入的 key 数, 新插入的 key 的序号从这里开始
+static volatile int64_t inserted;
+// 随机的值, 值从中截取
+static std::string value_buf;
+
+enum{
+	MODE_LOAD = 0,
+	MODE_RUN,
+};
+
+struct Call{
+	int op;
+	// rmw 的第几个请求
+	int stage;
+	// 计划发出的时间, 开环模式下可能早于实际发出的时间
+	uint64_t start_us;
+	int64_t key;
+};
+
+struct Conn{
+	Link *link;
+	std::deque<Call> calls;
+};
+
+struct Worker{
+	int id;
+	pthread_t tid;
+	int mode;
+	Fdevents *fdes;
+	std::vector<Conn *> conns;
+	int inflight;
+	uint64_t rnd;
+	// sequential 分布和 load 的下一个 key, 以及线程负责的区间
+	int64_t seq;
+	int64_t seq_begin;
+	int64_t seq_end;
+	// 需要测量的请求数, -1 表示不限
+	int64_t quota;
+	int64_t measured;
+	double interval_us;
+	uint64_t next_send_us;
+	int next_conn;
+	uint64_t last_done_us;
+	char keybuf[32];
+	char numbuf[32];
+	char lenbuf[32];
+	std::vector<Conn *> dirty;
+};
+
+static uint64_t warmup_end_us;
+static uint64_t run_end_us;
 
 
 void welcome(){
@@ -38,194 +234,789 @@ void welcome(){
 
 void usage(int argc, char **argv){
 	printf("Usage:\n");
-	printf("    %s [ip] [port] [requests] [clients]\n", argv[0]);
+	printf("    %s [ip] [port] [requests] [clients] [--option=value ...]\n", argv[0]);
 	printf("\n");
 	printf("Options:\n");
-	printf("    ip          server ip (default 127.0.0.1)\n");
+	printf("    ip          server ip, or unix socket path starting with '/' (default 127.0.0.1)\n");
 	printf("    port        server port (default 8888)\n");
 	printf("    requests    Total number of requests (default 10000)\n");
 	printf("    clients     Number of parallel connections (default 50)\n");
+	printf("    --workload=suite|a|b|c|d|e|f|custom\n");
+	printf("                suite: each command in turn (default)\n");
+	printf("                a-f: YCSB core workloads, custom: use --mix\n");
+	printf("    --mix=read:N,update:N,insert:N,scan:N,rmw:N,delete:N,push:N,pop:N\n");
+	printf("                proportions of operations, implies --workload=custom\n");
+	printf("    --type=kv|hash|zset|queue  data type (default kv)\n");
+	printf("    --keys=N    number of records (default: requests)\n");
+	printf("    --dist=uniform|zipfian|hotspot|sequential|latest\n");
+	printf("    --zipf=0.99 zipfian constant, in (0, 1)\n");
+	printf("    --hotspot=0.2:0.8  fraction of keys : fraction of operations\n");
+	printf("    --value=N|MIN-MAX|exp:MEAN  value size, fixed, uniform or exponential (default 100)\n");
+	printf("    --scan=N    max records of a scan, uniform in [1, N] (default 100)\n");
+	printf("    --threads=N client threads, connections are split among them (default 1)\n");
+	printf("    --pipeline=N  requests in flight per connection (default 1)\n");
+	printf("    --duration=S  run for S seconds instead of a number of requests\n");
+	printf("    --warmup=S  seconds before measuring (default 0)\n");
+	printf("    --rate=N    target requests per second(open loop), 0: as fast as possible\n");
+	printf("    --load      insert all records before the run\n");
+	printf("    --json      print the results as JSON\n");
 	printf("\n");
 }
 
-void init_data(int num){
-	srand(time(NULL));
-	ds = new std::map<std::string, Data *>();
-	while(ds->size() < num){
-		Data *d = new Data();
-		char buf[1024];
+static inline uint64_t next_rand(Worker *w){
+	// xorshift64*
+	w->rnd ^= w->rnd >> 12;
+	w->rnd ^= w->rnd << 25;
+	w->rnd ^= w->rnd >> 27;
+	return w->rnd * 2685821657736338717ULL;
+}
 
-		int n = rand();
-		snprintf(buf, sizeof(buf), "%d", n);
-		d->num = buf;
-		snprintf(buf, sizeof(buf), "k%010d", n);
-		d->key = buf;
-		snprintf(buf, sizeof(buf), "v%0100d", n);
-		d->val = buf;
-		ds->insert(make_pair(d->key, d));
+static inline double next_double(Worker *w){
+	return (next_rand(w) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static inline uint64_t fnv64(uint64_t v){
+	uint64_t h = 14695981039346656037ULL;
+	for(int i=0; i<8; i++){
+		h ^= v & 0xff;
+		h *= 1099511628211ULL;
+		v >>= 8;
 	}
+	return h;
 }
 
-void init_links(int num, const char *ip, int port){
-	fdes = new Fdevents();
-	free_links = new std::vector<Link *>();
+static int64_t next_key(Worker *w){
+	int64_t n = opt.keys;
+	switch(opt.dist){
+		case DIST_ZIPFIAN:
+			// 打散, 热的 key 不相邻
+			return (int64_t)(fnv64(zipf.next(next_double(w))) % n);
+		case DIST_HOTSPOT:{
+			int64_t hot = (int64_t)(n * opt.hot_set);
+			if(hot < 1){
+				hot = 1;
+			}
+			if(hot >= n || next_double(w) < opt.hot_ops){
+				return (int64_t)(next_rand(w) % hot);
+			}
+			return hot + (int64_t)(next_rand(w) % (n - hot));
+		}
+		case DIST_SEQUENTIAL:{
+			int64_t k = w->seq++;
+			if(w->seq >= w->seq_end){
+				w->seq = w->seq_begin;
+			}
+			return k;
+		}
+		case DIST_LATEST:{
+			int64_t max = inserted;
+			int64_t k = max - 1 - zipf.next(next_double(w));
+			return k >= 0? k : 0;
+		}
+		default:
+			return (int64_t)(next_rand(w) % n);
+	}
+}
 
-	for(int i=0; i<num; i++){
-		Link *link = Link::connect(ip, port);
-		if(!link){
-			fprintf(stderr, "connect error! %s\n", strerror(errno));
-			exit(0);
+static int next_op(Worker *w){
+	int total = 0;
+	for(int i=0; i<NUM_OPS; i++){
+		total += opt.mix[i];
+	}
+	int r = (int)(next_rand(w) % total);
+	for(int i=0; i<NUM_OPS; i++){
+		if(r < opt.mix[i]){
+			return i;
 		}
-		fdes->set(link->fd(), FDEVENT_IN, 0, link);
-		free_links->push_back(link);
-	}
-}
-
-void send_req(Link *link, const std::string &cmd, const Data *d){
-	if(cmd == "set"){
-		link->send(cmd, d->key, d->val);
-	}else if(cmd == "get"){
-		link->send(cmd, d->key);
-	}else if(cmd == "del"){
-		link->send(cmd, d->key);
-	}else if(cmd == "hset"){
-		link->send(cmd, "TEST", d->key, d->val);
-	}else if(cmd == "hget"){
-		link->send(cmd, "TEST", d->key);
-	}else if(cmd == "hdel"){
-		link->send(cmd, "TEST", d->key);
-	}else if(cmd == "zset"){
-		link->send(cmd, "TEST", d->key, d->num);
-	}else if(cmd == "zget"){
-		link->send(cmd, "TEST", d->key);
-	}else if(cmd == "zdel"){
-		link->send(cmd, "TEST", d->key);
-	}else if(cmd == "qpush"){
-		link->send(cmd, "TEST", d->key);
-	}else if(cmd == "qpop"){
-		link->send(cmd, "TEST");
+		r -= opt.mix[i];
+	}
+	return OP_READ;
+}
+
+static Bytes next_value(Worker *w){
+	int len = opt.value_min;
+	if(opt.value_dist == VALUE_UNIFORM){
+		len = opt.value_min + (int)(next_rand(w) % (opt.value_max - opt.value_min + 1));
+	}else if(opt.value_dist == VALUE_EXP){
+		len = (int)(-log(1 - next_double(w)) * opt.value_min);
+		if(len > opt.value_max){
+			len = opt.value_max;
+		}
+	}
+	int off = (int)(next_rand(w) % 64);
+	return Bytes(value_buf.data() + off, len);
+}
+
+static void send_call(Worker *w, Conn *conn, const Call &call){
+	Link *link = conn->link;
+	int op = call.op;
+	if(op == OP_RMW){
+		op = (call.stage == 0)? OP_READ : OP_UPDATE;
+	}
+	const char *cmd = commands[opt.type][op];
+	int len = snprintf(w->keybuf, sizeof(w->keybuf), "k%012" PRId64, call.key);
+	Bytes key(w->keybuf, len);
+	const char *name = "bench";
+
+	switch(op){
+		case OP_READ:
+		case OP_DELETE:
+			if(opt.type == TYPE_KV){
+				link->send(cmd, key);
+			}else{
+				link->send(cmd, name, key);
+			}
+			break;
+		case OP_UPDATE:
+		case OP_INSERT:
+			if(opt.type == TYPE_KV){
+				link->send(cmd, key, next_value(w));
+			}else if(opt.type == TYPE_HASH){
+				link->send(cmd, name, key, next_value(w));
+			}else{
+				snprintf(w->numbuf, sizeof(w->numbuf), "%" PRId64, call.key);
+				link->send(cmd, name, key, w->numbuf);
+			}
+			break;
+		case OP_SCAN:
+			snprintf(w->lenbuf, sizeof(w->lenbuf), "%d", 1 + (int)(next_rand(w) % opt.scan_len));
+			if(opt.type == TYPE_KV){
+				link->send(cmd, key, "", w->lenbuf);
+			}else if(opt.type == TYPE_HASH){
+				link->send(cmd, name, key, "", w->lenbuf);
+			}else{
+				std::vector<Bytes> req;
+				req.push_back(cmd);
+				req.push_back(name);
+				req.push_back(key);
+				req.push_back("");
+				req.push_back("");
+				req.push_back(w->lenbuf);
+				link->send(req);
+			}
+			break;
+		case OP_PUSH:
+			link->send(cmd, name, next_value(w));
+			break;
+		case OP_POP:
+			link->send(cmd, name);
+			break;
+	}
+	conn->calls.push_back(call);
+	w->inflight ++;
+	w->dirty.push_back(conn);
+}
+
+// 发出一个新的请求, 没有要发的请求时返回 false
+static bool new_call(Worker *w, Conn *conn, uint64_t start_us){
+	Call call;
+	call.stage = 0;
+	call.start_us = start_us;
+	if(w->mode == MODE_LOAD){
+		if(w->seq >= w->seq_end){
+			return false;
+		}
+		call.op = OP_INSERT;
+		call.key = w->seq++;
 	}else{
-		log_error("bad command!");
-		exit(0);
+		if(w->quota >= 0 && start_us >= warmup_end_us){
+			if(w->measured >= w->quota){
+				return false;
+			}
+			w->measured ++;
+		}
+		call.op = next_op(w);
+		if(call.op == OP_INSERT){
+			call.key = __sync_fetch_and_add(&inserted, 1);
+		}else{
+			call.key = next_key(w);
+		}
 	}
-	link->flush();
+	send_call(w, conn, call);
+	return true;
 }
 
-void bench(std::string cmd){
-	int total = (int)ds->size();
-	int finished = 0;
-	int num_sent = 0;
-	
-	printf("========== %s ==========\n", cmd.c_str());
+static bool sending_done(Worker *w, uint64_t now){
+	if(w->mode == MODE_LOAD){
+		return w->seq >= w->seq_end;
+	}
+	if(opt.duration > 0 && now >= run_end_us){
+		return true;
+	}
+	return w->quota >= 0 && w->measured >= w->quota;
+}
 
-	std::map<std::string, Data *>::iterator it;
-	it = ds->begin();
-	
-	double stime = millitime();
-	while(1){
-		while(!free_links->empty()){
-			if(num_sent == total){
+static void fill(Worker *w, uint64_t now){
+	if(opt.rate > 0 && w->mode == MODE_RUN){
+		// 落后于计划的请求在连接空闲时补发, start_us 仍是计划的时间
+		while(w->next_send_us <= now && !sending_done(w, w->next_send_us)){
+			Conn *conn = NULL;
+			for(int i=0; i<(int)w->conns.size(); i++){
+				Conn *c = w->conns[(w->next_conn + i) % w->conns.size()];
+				if((int)c->calls.size() < opt.pipeline){
+					conn = c;
+					w->next_conn = (w->next_conn + i + 1) % w->conns.size();
+					break;
+				}
+			}
+			if(conn == NULL){
 				break;
 			}
-			num_sent ++;
+			if(!new_call(w, conn, w->next_send_us)){
+				break;
+			}
+			w->next_send_us += (uint64_t)w->interval_us;
+		}
+	}else{
+		for(int i=0; i<(int)w->conns.size(); i++){
+			Conn *conn = w->conns[i];
+			while((int)conn->calls.size() < opt.pipeline){
+				if(sending_done(w, now) || !new_call(w, conn, now)){
+					break;
+				}
+			}
+		}
+	}
+	for(int i=0; i<(int)w->dirty.size(); i++){
+		if(w->dirty[i]->link->flush() == -1){
+			fprintf(stderr, "write error! %s\n", strerror(errno));
+			exit(1);
+		}
+	}
+	w->dirty.clear();
+}
+
+static void finish_call(Worker *w, Conn *conn, const std::vector<Bytes> *resp, uint64_t now){
+	Call call = conn->calls.front();
+	conn->calls.pop_front();
+	w->inflight --;
 
-			Link *link = free_links->back();
-			free_links->pop_back();
-			
-			send_req(link, cmd, it->second);
-			it ++;
+	const Bytes &code = resp->at(0);
+	bool ok = (code == "ok" || code == "not_found");
+	if(ok && call.op == OP_RMW && call.stage == 0){
+		call.stage = 1;
+		send_call(w, conn, call);
+		return;
+	}
+	w->last_done_us = now;
+	if(w->mode == MODE_LOAD || call.start_us < warmup_end_us){
+		if(!ok){
+			fprintf(stderr, "bad response: %s\n", code.String().c_str());
+			exit(1);
 		}
+		return;
+	}
+	OpStats *st = &stats[call.op];
+	if(!ok){
+		__sync_fetch_and_add(&st->errors, 1);
+		return;
+	}
+	uint64_t us = now > call.start_us? now - call.start_us : 0;
+	st->hist.add(us);
+	__sync_fetch_and_add(&st->count, 1);
+	__sync_fetch_and_add(&st->total_us, (int64_t)us);
+}
 
+void* run_worker(void *arg){
+	Worker *w = (Worker *)arg;
+	uint64_t now = clock_mono_us();
+	w->next_send_us = now;
+	while(1){
+		now = clock_mono_us();
+		fill(w, now);
+		if(w->inflight == 0 && sending_done(w, now)){
+			break;
+		}
 		const Fdevents::events_t *events;
-		events = fdes->wait(50);
+		events = w->fdes->wait(opt.rate > 0? 1 : 50);
 		if(events == NULL){
-			log_error("events.wait error: %s", strerror(errno));
-			break;
+			fprintf(stderr, "events.wait error: %s\n", strerror(errno));
+			exit(1);
 		}
-
+		now = clock_mono_us();
 		for(int i=0; i<(int)events->size(); i++){
 			const Fdevent *fde = events->at(i);
-			Link *link = (Link *)fde->data.ptr;
-
-			int len = link->read();
+			Conn *conn = (Conn *)fde->data.ptr;
+			int len = conn->link->read();
 			if(len <= 0){
-				log_error("fd: %d, read: %d, delete link", link->fd(), len);
-				exit(0);
+				fprintf(stderr, "fd: %d, read: %d, connection closed\n", conn->link->fd(), len);
+				exit(1);
 			}
-
-			const std::vector<Bytes> *resp = link->recv();
-			if(resp == NULL){
-				log_error("error");
-				break;
-			}else if(resp->empty()){
-				continue;
-			}else{
-				if(resp->at(0) != "ok"){
-					log_error("bad response: %s", resp->at(0).String().c_str());
-					exit(0);
+			while(1){
+				const std::vector<Bytes> *resp = conn->link->recv();
+				if(resp == NULL){
+					fprintf(stderr, "bad response\n");
+					exit(1);
 				}
-				free_links->push_back(link);
-				finished ++;
-				if(finished == total){
-					double etime = millitime();
-					double ts = (stime == etime)? 1 : (etime - stime);
-					double speed = total / ts;
-					printf("qps: %d, time: %.3f s\n", (int)speed, ts);
-					return;
+				if(resp->empty()){
+					break;
 				}
+				if(conn->calls.empty()){
+					fprintf(stderr, "unexpected response\n");
+					exit(1);
+				}
+				finish_call(w, conn, resp, now);
 			}
 		}
 	}
+	return NULL;
 }
 
-int main(int argc, char **argv){
-	const char *ip = "127.0.0.1";
-	int port = 8888;
-	int requests = 10000;
-	int clients = 50;
+static std::vector<Worker *> workers;
 
-	welcome();
-	usage(argc, argv);
-	for(int i=1; i<argc; i++){
-		if(strcmp("-v", argv[i]) == 0){
-			exit(0);
+void init_workers(){
+	int clients = opt.clients;
+	if(clients < opt.threads){
+		clients = opt.threads;
+	}
+	for(int i=0; i<opt.threads; i++){
+		Worker *w = new Worker();
+		w->id = i;
+		w->fdes = new Fdevents();
+		w->inflight = 0;
+		w->rnd = (uint64_t)time(NULL) * 2654435761ULL + (i + 1) * 0x9E3779B97F4A7C15ULL;
+		w->next_conn = 0;
+		int num = clients / opt.threads + (i < clients % opt.threads? 1 : 0);
+		for(int j=0; j<num; j++){
+			Conn *conn = new Conn();
+			conn->link = Link::connect(opt.ip.c_str(), opt.port);
+			if(!conn->link){
+				fprintf(stderr, "connect error! %s\n", strerror(errno));
+				exit(1);
+			}
+			w->fdes->set(conn->link->fd(), FDEVENT_IN, 0, conn);
+			w->conns.push_back(conn);
 		}
+		workers.push_back(w);
 	}
-	if(argc > 1){
-		ip = argv[1];
+}
+
+// 运行一个阶段, 返回从开始(或者预热结束)到最后一个响应的秒数
+double run_phase(int mode){
+	uint64_t stime = clock_mono_us();
+	warmup_end_us = (mode == MODE_RUN)? stime + (uint64_t)(opt.warmup * 1000000) : 0;
+	run_end_us = warmup_end_us + (uint64_t)(opt.duration * 1000000);
+	for(int i=0; i<NUM_OPS; i++){
+		stats[i].hist.reset();
+		stats[i].count = 0;
+		stats[i].errors = 0;
+		stats[i].total_us = 0;
 	}
-	if(argc > 2){
-		port = atoi(argv[2]);
+	int64_t range = opt.keys;
+	for(int i=0; i<(int)workers.size(); i++){
+		Worker *w = workers[i];
+		w->mode = mode;
+		w->seq_begin = range * i / opt.threads;
+		w->seq_end = range * (i + 1) / opt.threads;
+		if(w->seq_end <= w->seq_begin){
+			w->seq_end = w->seq_begin + 1;
+		}
+		w->seq = w->seq_begin;
+		w->measured = 0;
+		w->last_done_us = stime;
+		if(opt.duration > 0){
+			w->quota = -1;
+		}else{
+			w->quota = opt.requests / opt.threads + (i < opt.requests % opt.threads? 1 : 0);
+		}
+		w->interval_us = (opt.rate > 0)? 1000000.0 * opt.threads / opt.rate : 0;
+	}
+	for(int i=0; i<(int)workers.size(); i++){
+		pthread_create(&workers[i]->tid, NULL, run_worker, workers[i]);
+	}
+	uint64_t etime = stime;
+	for(int i=0; i<(int)workers.size(); i++){
+		pthread_join(workers[i]->tid, NULL);
+		if(workers[i]->last_done_us > etime){
+			etime = workers[i]->last_done_us;
+		}
 	}
-	if(argc > 3){
-		requests = atoi(argv[3]);
+	uint64_t begin = (mode == MODE_RUN)? warmup_end_us : stime;
+	if(etime <= begin){
+		return 0.000001;
 	}
-	if(argc > 4){
-		clients = atoi(argv[4]);
+	return (etime - begin) / 1000000.0;
+}
+
+static std::string op_stats_json(const OpStats *st, double secs){
+	char buf[512];
+	snprintf(buf, sizeof(buf),
+		"{\"count\": %" PRId64 ", \"errors\": %" PRId64 ", \"ops_per_sec\": %.1f, "
+		"\"avg_us\": %.1f, \"p50_us\": %" PRIu64 ", \"p90_us\": %" PRIu64 ", "
+		"\"p99_us\": %" PRIu64 ", \"p999_us\": %" PRIu64 ", \"max_us\": %" PRIu64 "}",
+		st->count, st->errors, st->count / secs,
+		st->count? (double)st->total_us / st->count : 0.0,
+		st->hist.percentile(50), st->hist.percentile(90),
+		st->hist.percentile(99), st->hist.percentile(99.9), st->hist.max());
+	return buf;
+}
+
+static void print_op_stats(const char *name, const OpStats *st, double secs){
+	printf("%-8s ops: %" PRId64 ", qps: %d, errors: %" PRId64 ", latency(us) avg: %.1f"
+		", p50: %" PRIu64 ", p90: %" PRIu64 ", p99: %" PRIu64 ", p99.9: %" PRIu64 ", max: %" PRIu64 "\n",
+		name, st->count, (int)(st->count / secs), st->errors,
+		st->count? (double)st->total_us / st->count : 0.0,
+		st->hist.percentile(50), st->hist.percentile(90),
+		st->hist.percentile(99), st->hist.percentile(99.9), st->hist.max());
+}
+
+static std::string config_json(){
+	char buf[1024];
+	std::string mix;
+	for(int i=0; i<NUM_OPS; i++){
+		if(opt.mix[i] == 0){
+			continue;
+		}
+		char tmp[64];
+		snprintf(tmp, sizeof(tmp), "%s\"%s\": %d", mix.empty()? "" : ", ", op_names[i], opt.mix[i]);
+		mix += tmp;
 	}
+	snprintf(buf, sizeof(buf),
+		"{\"version\": \"%s\", \"workload\": \"%s\", \"type\": \"%s\", \"mix\": {%s}, "
+		"\"keys\": %" PRId64 ", \"dist\": \"%s\", \"zipf\": %.3f, \"value_min\": %d, \"value_max\": %d, "
+		"\"threads\": %d, \"clients\": %d, \"pipeline\": %d, \"requests\": %" PRId64 ", "
+		"\"duration\": %.1f, \"warmup\": %.1f, \"rate\": %.1f}",
+		SSDB_VERSION, opt.workload.c_str(), type_names[opt.type], mix.c_str(),
+		opt.keys, dist_names[opt.dist], opt.zipf_theta, opt.value_min, opt.value_max,
+		opt.threads, opt.clients, opt.pipeline, opt.requests,
+		opt.duration, opt.warmup, opt.rate);
+	return buf;
+}
 
-	//printf("preparing data...\n");
-	init_data(requests);
-	//printf("preparing links...\n");
-	init_links(clients, ip, port);
+// 依次测试每个命令, 原来的 ssdb-bench 的行为
+void run_suite(){
+	static const struct{
+		int type;
+		int op;
+	}steps[] = {
+		{TYPE_KV, OP_UPDATE}, {TYPE_KV, OP_READ}, {TYPE_KV, OP_DELETE},
+		{TYPE_HASH, OP_UPDATE}, {TYPE_HASH, OP_READ}, {TYPE_HASH, OP_DELETE},
+		{TYPE_ZSET, OP_UPDATE}, {TYPE_ZSET, OP_READ}, {TYPE_ZSET, OP_DELETE},
+		{TYPE_QUEUE, OP_PUSH}, {TYPE_QUEUE, OP_POP},
+	};
+	opt.dist = DIST_SEQUENTIAL;
+	opt.warmup = 0;
+	std::string json;
+	for(int i=0; i<(int)(sizeof(steps)/sizeof(steps[0])); i++){
+		opt.type = steps[i].type;
+		memset(opt.mix, 0, sizeof(opt.mix));
+		opt.mix[steps[i].op] = 1;
+		const char *cmd = commands[opt.type][steps[i].op];
+		if(!opt.json){
+			printf("========== %s ==========\n", cmd);
+		}
+		double secs = run_phase(MODE_RUN);
+		const OpStats *st = &stats[steps[i].op];
+		if(opt.json){
+			json += json.empty()? "" : ",\n    ";
+			json += "\"" + std::string(cmd) + "\": " + op_stats_json(st, secs);
+		}else{
+			printf("qps: %d, time: %.3f s\n", (int)(st->count / secs), secs);
+			print_op_stats(cmd, st, secs);
+		}
+	}
+	if(opt.json){
+		opt.type = TYPE_KV;
+		memset(opt.mix, 0, sizeof(opt.mix));
+		printf("{\n  \"config\": %s,\n  \"suite\": {\n    %s\n  }\n}\n",
+			config_json().c_str(), json.c_str());
+	}
+}
 
-	bench("set");
-	bench("get");
-	bench("del");
+void run_workload(){
+	if(!opt.json){
+		printf("workload: %s, type: %s, keys: %" PRId64 ", dist: %s, threads: %d, clients: %d, pipeline: %d\n",
+			opt.workload.c_str(), type_names[opt.type], opt.keys, dist_names[opt.dist],
+			opt.threads, opt.clients, opt.pipeline);
+	}
+	std::string load_json = "null";
+	inserted = 0;
+	if(opt.load){
+		double secs = run_phase(MODE_LOAD);
+		char buf[128];
+		snprintf(buf, sizeof(buf), "{\"records\": %" PRId64 ", \"seconds\": %.3f, \"ops_per_sec\": %.1f}",
+			opt.keys, secs, opt.keys / secs);
+		load_json = buf;
+		if(!opt.json){
+			printf("load: %" PRId64 " records, time: %.3f s, qps: %d\n", opt.keys, secs, (int)(opt.keys / secs));
+		}
+	}
+	inserted = opt.keys;
 
-	bench("hset");
-	bench("hget");
-	bench("hdel");
+	double secs = run_phase(MODE_RUN);
+	OpStats total;
+	total.count = 0;
+	total.errors = 0;
+	total.total_us = 0;
+	for(int i=0; i<NUM_OPS; i++){
+		total.count += stats[i].count;
+		total.errors += stats[i].errors;
+	}
+	if(opt.json){
+		std::string ops;
+		for(int i=0; i<NUM_OPS; i++){
+			if(opt.mix[i] == 0){
+				continue;
+			}
+			ops += ops.empty()? "" : ",\n      ";
+			ops += "\"" + std::string(op_names[i]) + "\": " + op_stats_json(&stats[i], secs);
+		}
+		printf("{\n  \"config\": %s,\n  \"load\": %s,\n  \"run\": {\n"
+			"    \"ops\": %" PRId64 ", \"errors\": %" PRId64 ", \"seconds\": %.3f, \"ops_per_sec\": %.1f,\n"
+			"    \"operations\": {\n      %s\n    }\n  }\n}\n",
+			config_json().c_str(), load_json.c_str(),
+			total.count, total.errors, secs, total.count / secs, ops.c_str());
+	}else{
+		printf("run: %" PRId64 " ops, errors: %" PRId64 ", time: %.3f s, qps: %d\n",
+			total.count, total.errors, secs, (int)(total.count / secs));
+		for(int i=0; i<NUM_OPS; i++){
+			if(opt.mix[i]){
+				print_op_stats(op_names[i], &stats[i], secs);
+			}
+		}
+	}
+}
 
-	bench("zset");
-	bench("zget");
-	bench("zdel");
+static int find_name(const char **names, int num, const char *name){
+	for(int i=0; i<num; i++){
+		if(strcmp(names[i], name) == 0){
+			return i;
+		}
+	}
+	return -1;
+}
 
-	bench("qpush");
-	bench("qpop");
-	
-	printf("\n");
+static void bad_option(const char *arg){
+	fprintf(stderr, "invalid option: %s\n", arg);
+	exit(1);
+}
 
-	return 0;
+// read:50,update:50
+static void parse_mix(const char *arg, const char *val){
+	memset(opt.mix, 0, sizeof(opt.mix));
+	std::string s = val;
+	size_t pos = 0;
+	while(pos < s.size()){
+		size_t end = s.find(',', pos);
+		if(end == std::string::npos){
+			end = s.size();
+		}
+		std::string item = s.substr(pos, end - pos);
+		size_t colon = item.find(':');
+		if(colon == std::string::npos){
+			bad_option(arg);
+		}
+		int op = find_name(op_names, NUM_OPS, item.substr(0, colon).c_str());
+		int n = atoi(item.substr(colon + 1).c_str());
+		if(op == -1 || n < 0){
+			bad_option(arg);
+		}
+		opt.mix[op] = n;
+		pos = end + 1;
+	}
 }
 
+static void parse_value(const char *arg, const char *val){
+	if(strncmp(val, "exp:", 4) == 0){
+		opt.value_dist = VALUE_EXP;
+		opt.value_min = atoi(val + 4);
+		opt.value_max = opt.value_min * 16;
+	}else if(strchr(val, '-')){
+		opt.value_dist = VALUE_UNIFORM;
+		opt.value_min = atoi(val);
+		opt.value_max = atoi(strchr(val, '-') + 1);
+	}else{
+		opt.value_dist = VALUE_FIXED;
+		opt.value_min = opt.value_max = atoi(val);
+	}
+	if(opt.value_min < 0 || opt.value_max < opt.value_min || opt.value_max > 32 * 1024 * 1024){
+		bad_option(arg);
+	}
+}
+
+int main(int argc, char **argv){
+	opt.ip = "127.0.0.1";
+	opt.port = 8888;
+	opt.workload = "suite";
+	memset(opt.mix, 0, sizeof(opt.mix));
+	opt.type = TYPE_KV;
+	opt.keys = 0;
+	opt.dist = -1;
+	opt.zipf_theta = 0.99;
+	opt.hot_set = 0.2;
+	opt.hot_ops = 0.8;
+	opt.value_dist = VALUE_FIXED;
+	opt.value_min = opt.value_max = 100;
+	opt.scan_len = 100;
+	opt.threads = 1;
+	opt.clients = 50;
+	opt.pipeline = 1;
+	opt.requests = 10000;
+	opt.duration = 0;
+	opt.warmup = 0;
+	opt.rate = 0;
+	opt.load = false;
+	opt.json = false;
+
+	bool has_mix = false;
+	int pos = 0;
+	for(int i=1; i<argc; i++){
+		const char *arg = argv[i];
+		if(strcmp("-v", arg) == 0){
+			welcome();
+			exit(0);
+		}
+		if(strcmp("-h", arg) == 0 || strcmp("--help", arg) == 0){
+			welcome();
+			usage(argc, argv);
+			exit(0);
+		}
+		if(strncmp(arg, "--", 2) != 0){
+			// 位置参数: ip port requests clients
+			switch(pos++){
+				case 0: opt.ip = arg; break;
+				case 1: opt.port = atoi(arg); break;
+				case 2: opt.requests = atoll(arg); break;
+				case 3: opt.clients = atoi(arg); break;
+				default: bad_option(arg);
+			}
+			continue;
+		}
+		std::string name = arg + 2;
+		const char *val = "";
+		size_t eq = name.find('=');
+		if(eq != std::string::npos){
+			val = arg + 2 + eq + 1;
+			name = name.substr(0, eq);
+		}
+		if(name == "workload"){
+			opt.workload = val;
+		}else if(name == "mix"){
+			parse_mix(arg, val);
+			has_mix = true;
+		}else if(name == "type"){
+			opt.type = find_name(type_names, NUM_TYPES, val);
+			if(opt.type == -1){
+				bad_option(arg);
+			}
+		}else if(name == "keys"){
+			opt.keys = atoll(val);
+		}else if(name == "dist"){
+			opt.dist = find_name(dist_names, NUM_DISTS, val);
+			if(opt.dist == -1){
+				bad_option(arg);
+			}
+		}else if(name == "zipf"){
+			opt.zipf_theta = atof(val);
+			if(opt.zipf_theta <= 0 || opt.zipf_theta >= 1){
+				bad_option(arg);
+			}
+		}else if(name == "hotspot"){
+			if(sscanf(val, "%lf:%lf", &opt.hot_set, &opt.hot_ops) != 2
+				|| opt.hot_set <= 0 || opt.hot_set > 1 || opt.hot_ops < 0 || opt.hot_ops > 1)
+			{
+				bad_option(arg);
+			}
+		}else if(name == "value"){
+			parse_value(arg, val);
+		}else if(name == "scan"){
+			opt.scan_len = atoi(val);
+		}else if(name == "threads"){
+			opt.threads = atoi(val);
+		}else if(name == "clients"){
+			opt.clients = atoi(val);
+		}else if(name == "pipeline"){
+			opt.pipeline = atoi(val);
+		}else if(name == "requests"){
+			opt.requests = atoll(val);
+		}else if(name == "duration"){
+			opt.duration = atof(val);
+		}else if(name == "warmup"){
+			opt.warmup = atof(val);
+		}else if(name == "rate"){
+			opt.rate = atof(val);
+		}else if(name == "load"){
+			opt.load = true;
+		}else if(name == "json"){
+			opt.json = true;
+		}else{
+			bad_option(arg);
+		}
+	}
+	if(opt.threads <= 0 || opt.clients <= 0 || opt.pipeline <= 0 || opt.scan_len <= 0
+		|| opt.requests <= 0 || opt.duration < 0 || opt.warmup < 0 || opt.rate < 0)
+	{
+		fprintf(stderr, "invalid options\n");
+		exit(1);
+	}
+	if(opt.keys <= 0){
+		opt.keys = opt.requests;
+	}
+
+	if(has_mix && opt.workload == "suite"){
+		opt.workload = "custom";
+	}
+	if(opt.workload != "suite" && opt.workload != "custom"){
+		const Workload *wl = NULL;
+		for(int i=0; workloads[i].name; i++){
+			if(opt.workload == workloads[i].name){
+				wl = &workloads[i];
+			}
+		}
+		if(wl == NULL){
+			fprintf(stderr, "invalid workload: %s\n", opt.workload.c_str());
+			exit(1);
+		}
+		for(int i=0; i<5; i++){
+			opt.mix[i] = wl->mix[i];
+		}
+		if(opt.dist == -1){
+			opt.dist = wl->dist;
+		}
+	}
+	if(opt.workload == "custom"){
+		int total = 0;
+		for(int i=0; i<NUM_OPS; i++){
+			total += opt.mix[i];
+			if(opt.mix[i] && commands[opt.type][i] == NULL){
+				fprintf(stderr, "%s is not supported by type %s\n", op_names[i], type_names[opt.type]);
+				exit(1);
+			}
+		}
+		if(total == 0){
+			fprintf(stderr, "empty --mix\n");
+			exit(1);
+		}
+	}
+	if(opt.workload != "suite" && opt.workload != "custom" && opt.type == TYPE_QUEUE){
+		fprintf(stderr, "YCSB workloads need type kv, hash or zset\n");
+		exit(1);
+	}
+	if(opt.dist == -1){
+		opt.dist = DIST_UNIFORM;
+	}
+
+	if(!opt.json){
+		welcome();
+	}
+	srand(time(NULL));
+	value_buf.resize(opt.value_max + 64);
+	for(int i=0; i<(int)value_buf.size(); i++){
+		value_buf[i] = 'a' + rand() % 26;
+	}
+	if(opt.dist == DIST_ZIPFIAN || opt.dist == DIST_LATEST){
+		zipf.init(opt.keys, opt.zipf_theta);
+	}
+	stats = new OpStats[NUM_OPS];
+
+	init_workers();
+	if(opt.workload == "suite"){
+		run_suite();
+	}else{
+		run_workload();
+	}
+	if(!opt.json){
+		printf("\n");
+	}
+	return 0;
+}
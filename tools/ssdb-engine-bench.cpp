@@ -0,0 +1,713 @@
+/*
+Copyright (c) 2012-2015 The SSDB Authors. All rights reserved.
+Use of this source code is governed by a BSD-style license that can be
+found in the LICENSE file.
+*/
+#include "include.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+#include <map>
+
+#include "ssdb/ssdb.h"
+#include "util/log.h"
+#include "util/bytes.h"
+#include "util/histogram.h"
+#include "util/strings.h"
+#include "version.h"
+
+// 不经过网络, 直接在进程中打开 SSDB 测试存储引擎(key 的编码, 事务和
+// binlog, leveldb). 每组(值的长度, 线程数)使用一个新的数据库, 依次运行
+// 各个测试, 最后做一次完整的 compaction, 输出 leveldb 的 compaction 统计
+// 和写放大.
+
+struct BenchOptions{
+	std::string dir;
+	bool keep;
+	int num;
+	std::vector<int> threads;
+	std::vector<int> values;
+	std::vector<std::string> benchmarks;
+	bool binlog;
+	int cache_size;
+	int write_buffer_size;
+	bool compression;
+	bool json;
+};
+static BenchOptions opt;
+
+// 一个测试
+struct Bench{
+	std::string name;
+	SSDB *db;
+	int threads;
+	int value_size;
+	// 各个线程的直方图在结束后合并到这里
+	Histogram hist;
+	int64_t errors;
+	// 写入的 key 和值的字节数, 用于计算写放大
+	int64_t user_bytes;
+};
+
+struct Worker{
+	Bench *bench;
+	int id;
+	int begin;
+	int end;
+	uint64_t rnd;
+	// 每个线程单独统计, 避免多个线程原子地更新同一个直方图影响结果
+	Histogram hist;
+	pthread_t tid;
+};
+
+// 同一个哈希表/有序集合/队列中的元素数大约是 num/NUM_NAMES
+static const int NUM_NAMES = 100;
+static std::string value_buf;
+
+
+void welcome(){
+	printf("ssdb-engine-bench - SSDB storage engine benchmark, %s\n", SSDB_VERSION);
+	printf("Copyright (c) 2013-2015 ssdb.io\n");
+	printf("\n");
+}
+
+void usage(int argc, char **argv){
+	printf("Usage:\n");
+	printf("    %s [--option=value ...]\n", argv[0]);
+	printf("\n");
+	printf("Options:\n");
+	printf("    --dir=PATH      database directory, must not exist (default: a new temp directory)\n");
+	printf("    --keep          don't delete the database directories\n");
+	printf("    --num=N         operations of each benchmark (default 100000)\n");
+	printf("    --threads=1,4   thread counts to run with\n");
+	printf("    --values=100,1000  value sizes to run with\n");
+	printf("    --benchmarks=set,get,hset,zset,zrange,qpush,qpop,scan\n");
+	printf("    --binlog=yes|no (default yes)\n");
+	printf("    --cache_size=MB leveldb block cache (default 8)\n");
+	printf("    --write_buffer_size=MB  leveldb memtable (default 4)\n");
+	printf("    --compression=yes|no (default yes)\n");
+	printf("    --json          print the results as JSON\n");
+	printf("\n");
+}
+
+static inline uint64_t now_ns(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static inline uint64_t next_rand(Worker *w){
+	// xorshift64*
+	w->rnd ^= w->rnd >> 12;
+	w->rnd ^= w->rnd << 25;
+	w->rnd ^= w->rnd >> 27;
+	return w->rnd * 2685821657736338717ULL;
+}
+
+// 第 i 个 key, 打散之后写入的顺序是随机的
+static inline Bytes make_key(char *buf, uint64_t i){
+	uint64_t h = 14695981039346656037ULL;
+	for(int n=0; n<8; n++){
+		h ^= (i >> (n * 8)) & 0xff;
+		h *= 1099511628211ULL;
+	}
+	int len = snprintf(buf, 32, "k%016" PRIx64, h);
+	return Bytes(buf, len);
+}
+
+static inline Bytes make_name(char *buf, const char *prefix, int i){
+	int len = snprintf(buf, 32, "%s%d", prefix, i);
+	return Bytes(buf, len);
+}
+
+static inline Bytes make_value(Worker *w){
+	int off = (int)(next_rand(w) % 64);
+	return Bytes(value_buf.data() + off, w->bench->value_size);
+}
+
+static void* run_worker(void *arg){
+	Worker *w = (Worker *)arg;
+	Bench *b = w->bench;
+	SSDB *db = b->db;
+	const std::string &name = b->name;
+	char kbuf[32], nbuf[32], sbuf[32];
+	std::string val;
+	int64_t errors = 0;
+	int64_t user_bytes = 0;
+
+	for(int i=w->begin; i<w->end; i++){
+		uint64_t stime = now_ns();
+		int ret = 0;
+		if(name == "set"){
+			Bytes key = make_key(kbuf, i);
+			Bytes v = make_value(w);
+			ret = db->set(key, v);
+			user_bytes += key.size() + v.size();
+		}else if(name == "get"){
+			ret = db->get(make_key(kbuf, next_rand(w) % opt.num), &val);
+		}else if(name == "hset"){
+			Bytes hname = make_name(nbuf, "h", i % NUM_NAMES);
+			Bytes key = make_key(kbuf, i);
+			Bytes v = make_value(w);
+			ret = db->hset(hname, key, v);
+			user_bytes += hname.size() + key.size() + v.size();
+		}else if(name == "zset"){
+			Bytes zname = make_name(nbuf, "z", i % NUM_NAMES);
+			Bytes key = make_key(kbuf, i);
+			int len = snprintf(sbuf, sizeof(sbuf), "%d", (int)(next_rand(w) % 1000000));
+			Bytes score(sbuf, len);
+			ret = db->zset(zname, key, score);
+			user_bytes += zname.size() + key.size() + score.size();
+		}else if(name == "zrange"){
+			int size = opt.num / NUM_NAMES;
+			uint64_t offset = size > 10? next_rand(w) % (size - 10) : 0;
+			ZIterator *it = db->zrange(make_name(nbuf, "z", next_rand(w) % NUM_NAMES), offset, 10);
+			while(it->next()){
+				ret = 1;
+			}
+			delete it;
+		}else if(name == "qpush"){
+			Bytes qname = make_name(nbuf, "q", w->id);
+			Bytes v = make_value(w);
+			ret = db->qpush_back(qname, v) > 0? 1 : -1;
+			user_bytes += qname.size() + v.size();
+		}else if(name == "qpop"){
+			ret = db->qpop_front(make_name(nbuf, "q", w->id), &val);
+		}else if(name == "scan"){
+			KIterator *it = db->scan(make_key(kbuf, next_rand(w) % opt.num), "", 100);
+			while(it->next()){
+				ret = 1;
+			}
+			delete it;
+		}
+		uint64_t etime = now_ns();
+		w->hist.add(etime - stime);
+		if(ret == -1){
+			errors ++;
+		}
+	}
+	__sync_fetch_and_add(&b->errors, errors);
+	__sync_fetch_and_add(&b->user_bytes, user_bytes);
+	return NULL;
+}
+
+// 返回秒数
+static double run_bench(Bench *b){
+	std::vector<Worker> workers(b->threads);
+	uint64_t stime = now_ns();
+	for(int i=0; i<b->threads; i++){
+		Worker *w = &workers[i];
+		w->bench = b;
+		w->id = i;
+		w->begin = (int)((int64_t)opt.num * i / b->threads);
+		w->end = (int)((int64_t)opt.num * (i + 1) / b->threads);
+		w->rnd = (uint64_t)time(NULL) * 2654435761ULL + (i + 1) * 0x9E3779B97F4A7C15ULL;
+		pthread_create(&w->tid, NULL, run_worker, w);
+	}
+	for(int i=0; i<b->threads; i++){
+		pthread_join(workers[i].tid, NULL);
+	}
+	double secs = (now_ns() - stime) / 1000000000.0;
+	for(int i=0; i<b->threads; i++){
+		b->hist.merge(workers[i].hist);
+	}
+	return secs;
+}
+
+static int64_t dir_size(const std::string &dir){
+	DIR *dp = opendir(dir.c_str());
+	if(!dp){
+		return 0;
+	}
+	int64_t size = 0;
+	struct dirent *de;
+	while((de = readdir(dp)) != NULL){
+		std::string path = dir + "/" + de->d_name;
+		struct stat st;
+		if(stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode)){
+			size += st.st_size;
+		}
+	}
+	closedir(dp);
+	return size;
+}
+
+// leveldb 的数据库目录中没有子目录
+static void remove_dir(const std::string &dir){
+	DIR *dp = opendir(dir.c_str());
+	if(!dp){
+		return;
+	}
+	struct dirent *de;
+	while((de = readdir(dp)) != NULL){
+		if(strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0){
+			continue;
+		}
+		unlink((dir + "/" + de->d_name).c_str());
+	}
+	closedir(dp);
+	rmdir(dir.c_str());
+}
+
+// 统计 leveldb 写出的 WAL(*.log) 和表文件(*.sst, *.ldb)的字节数. 写文件
+// 使用 mmap, 不能从 /proc/self/io 得到; leveldb.stats 以 MB 为单位, 也
+// 不包括 WAL. 文件写完之后不再修改, 但 compaction 之后会被删除, 所以后台
+// 线程定时给新文件建立硬链接, 原文件删除后从链接得到文件的最终大小.
+// 创建之后不到一个扫描周期就被删除的文件统计不到, 对 MB 级的文件可以忽略
+struct FileTracker{
+	std::string dir;
+	std::string link_dir;
+	// 已建立链接, 原文件还没有删除的文件
+	std::map<std::string, bool> files;
+	int64_t log_bytes;
+	int64_t table_bytes;
+	volatile bool quit;
+	pthread_t tid;
+};
+
+static bool is_data_file(const char *name, bool *is_log){
+	const char *ext = strrchr(name, '.');
+	if(!ext || ext == name){
+		return false;
+	}
+	*is_log = strcmp(ext, ".log") == 0;
+	return *is_log || strcmp(ext, ".sst") == 0 || strcmp(ext, ".ldb") == 0;
+}
+
+// 链接的文件已经写完, 计入统计并删除链接
+static void tracker_collect(FileTracker *t, const std::string &name, bool is_log){
+	std::string path = t->link_dir + "/" + name;
+	struct stat st;
+	if(stat(path.c_str(), &st) == 0){
+		if(is_log){
+			t->log_bytes += st.st_size;
+		}else{
+			t->table_bytes += st.st_size;
+		}
+	}
+	unlink(path.c_str());
+}
+
+static void tracker_scan(FileTracker *t){
+	std::map<std::string, bool> found;
+	DIR *dp = opendir(t->dir.c_str());
+	if(!dp){
+		return;
+	}
+	struct dirent *de;
+	while((de = readdir(dp)) != NULL){
+		bool is_log;
+		if(!is_data_file(de->d_name, &is_log)){
+			continue;
+		}
+		std::string name = de->d_name;
+		if(t->files.find(name) == t->files.end()){
+			std::string src = t->dir + "/" + name;
+			std::string dst = t->link_dir + "/" + name;
+			if(link(src.c_str(), dst.c_str()) == -1){
+				// 刚刚被删除
+				continue;
+			}
+		}
+		found[name] = is_log;
+	}
+	closedir(dp);
+
+	std::map<std::string, bool>::iterator it;
+	for(it=t->files.begin(); it!=t->files.end(); it++){
+		if(found.find(it->first) == found.end()){
+			tracker_collect(t, it->first, it->second);
+		}
+	}
+	t->files.swap(found);
+}
+
+static void* run_tracker(void *arg){
+	FileTracker *t = (FileTracker *)arg;
+	while(!t->quit){
+		tracker_scan(t);
+		usleep(10 * 1000);
+	}
+	return NULL;
+}
+
+static int tracker_start(FileTracker *t, const std::string &dir){
+	t->dir = dir;
+	t->link_dir = dir + ".files";
+	t->log_bytes = 0;
+	t->table_bytes = 0;
+	t->quit = false;
+	if(mkdir(t->link_dir.c_str(), 0755) == -1){
+		fprintf(stderr, "mkdir %s error: %s\n", t->link_dir.c_str(), strerror(errno));
+		return -1;
+	}
+	tracker_scan(t);
+	pthread_create(&t->tid, NULL, run_tracker, t);
+	return 0;
+}
+
+// 停止后台线程, 最后扫描一次, 把还存在的文件(当前的 WAL)也链接上
+static void tracker_stop(FileTracker *t){
+	t->quit = true;
+	pthread_join(t->tid, NULL);
+	tracker_scan(t);
+}
+
+// 数据库关闭之后调用, 这时所有文件都已写完
+static void tracker_finish(FileTracker *t){
+	std::map<std::string, bool>::iterator it;
+	for(it=t->files.begin(); it!=t->files.end(); it++){
+		tracker_collect(t, it->first, it->second);
+	}
+	t->files.clear();
+	rmdir(t->link_dir.c_str());
+}
+
+// leveldb.stats 中每一层的统计
+struct LevelStats{
+	int level;
+	int files;
+	double size_mb;
+	double time_sec;
+	double read_mb;
+	double write_mb;
+};
+
+static std::vector<LevelStats> compaction_stats(SSDB *db){
+	std::vector<LevelStats> ret;
+	std::vector<std::string> info = db->info();
+	for(int i=0; i + 1<(int)info.size(); i+=2){
+		if(info[i] != "leveldb.stats"){
+			continue;
+		}
+		const char *p = info[i + 1].c_str();
+		while(*p){
+			LevelStats ls;
+			if(sscanf(p, "%d %d %lf %lf %lf %lf", &ls.level, &ls.files, &ls.size_mb,
+				&ls.time_sec, &ls.read_mb, &ls.write_mb) == 6)
+			{
+				ret.push_back(ls);
+			}
+			const char *nl = strchr(p, '\n');
+			if(!nl){
+				break;
+			}
+			p = nl + 1;
+		}
+	}
+	return ret;
+}
+
+static void print_bench(const Bench *b, double secs){
+	const Histogram &h = b->hist;
+	int64_t count = (int64_t)h.count();
+	if(opt.json){
+		printf("        {\"name\": \"%s\", \"ops\": %" PRId64 ", \"errors\": %" PRId64 ", "
+			"\"seconds\": %.3f, \"ops_per_sec\": %.1f, "
+			"\"p50_us\": %.2f, \"p90_us\": %.2f, \"p99_us\": %.2f, \"p999_us\": %.2f, \"max_us\": %.2f}",
+			b->name.c_str(), count, b->errors, secs, count / secs,
+			h.percentile(50) / 1000.0, h.percentile(90) / 1000.0, h.percentile(99) / 1000.0,
+			h.percentile(99.9) / 1000.0, h.max() / 1000.0);
+	}else{
+		printf("%-8s ops: %" PRId64 ", errors: %" PRId64 ", time: %.3f s, ops/s: %d, latency(us)"
+			" p50: %.2f, p90: %.2f, p99: %.2f, p99.9: %.2f, max: %.2f\n",
+			b->name.c_str(), count, b->errors, secs, (int)(count / secs),
+			h.percentile(50) / 1000.0, h.percentile(90) / 1000.0, h.percentile(99) / 1000.0,
+			h.percentile(99.9) / 1000.0, h.max() / 1000.0);
+	}
+}
+
+// 一组(值的长度, 线程数)
+static int run_config(int value_size, int threads, bool first){
+	std::string dir;
+	if(opt.dir.empty()){
+		char tmp[] = "/tmp/ssdb-engine-bench.XXXXXX";
+		if(mkdtemp(tmp) == NULL){
+			fprintf(stderr, "mkdtemp error: %s\n", strerror(errno));
+			return -1;
+		}
+		dir = tmp;
+	}else{
+		char buf[64];
+		snprintf(buf, sizeof(buf), "/value%d_threads%d", value_size, threads);
+		dir = opt.dir + buf;
+		mkdir(opt.dir.c_str(), 0755);
+	}
+
+	Options dbopt;
+	dbopt.binlog = opt.binlog;
+	dbopt.cache_size = opt.cache_size;
+	dbopt.write_buffer_size = opt.write_buffer_size;
+	dbopt.compression = opt.compression? "yes" : "no";
+	SSDB *db = SSDB::open(dbopt, dir);
+	if(!db){
+		fprintf(stderr, "open db error: %s\n", dir.c_str());
+		return -1;
+	}
+	FileTracker tracker;
+	if(tracker_start(&tracker, dir) == -1){
+		delete db;
+		return -1;
+	}
+
+	if(opt.json){
+		printf("%s    {\"value_size\": %d, \"threads\": %d, \"benchmarks\": [\n",
+			first? "" : ",\n", value_size, threads);
+	}else{
+		printf("========== value: %d, threads: %d, dir: %s ==========\n",
+			value_size, threads, dir.c_str());
+	}
+
+	int64_t user_bytes = 0;
+	for(int i=0; i<(int)opt.benchmarks.size(); i++){
+		Bench *b = new Bench();
+		b->name = opt.benchmarks[i];
+		b->db = db;
+		b->threads = threads;
+		b->value_size = value_size;
+		b->errors = 0;
+		b->user_bytes = 0;
+		double secs = run_bench(b);
+		if(opt.json && i > 0){
+			printf(",\n");
+		}
+		print_bench(b, secs);
+		user_bytes += b->user_bytes;
+		delete b;
+	}
+
+	// 把 memtable 和还没有完成的 compaction 都写到磁盘, 否则数据量小时
+	// 大部分数据还没有写出, 写放大偏小. 完整的 compaction 会把所有数据
+	// 合并到最底层, 相当于数据最终稳定下来的成本
+	uint64_t stime = now_ns();
+	db->compact();
+	double compact_secs = (now_ns() - stime) / 1000000000.0;
+	tracker_stop(&tracker);
+
+	// 写放大: WAL 和表文件(memtable 写到 level 0 以及 compaction)写出的
+	// 字节数, 相对于写入的 key 和值的字节数
+	std::vector<LevelStats> levels = compaction_stats(db);
+	double read_mb = 0, write_mb = 0;
+	for(int i=0; i<(int)levels.size(); i++){
+		read_mb += levels[i].read_mb;
+		write_mb += levels[i].write_mb;
+	}
+	delete db;
+	tracker_finish(&tracker);
+	double user_mb = user_bytes / 1048576.0;
+	double log_mb = tracker.log_bytes / 1048576.0;
+	double table_mb = tracker.table_bytes / 1048576.0;
+	double write_amp = user_mb > 0? (log_mb + table_mb) / user_mb : 0;
+	double disk_mb = dir_size(dir) / 1048576.0;
+
+	if(opt.json){
+		printf("\n      ],\n      \"levels\": [");
+		for(int i=0; i<(int)levels.size(); i++){
+			const LevelStats &ls = levels[i];
+			printf("%s{\"level\": %d, \"files\": %d, \"size_mb\": %.0f, \"time_sec\": %.0f, "
+				"\"read_mb\": %.0f, \"write_mb\": %.0f}", i? ", " : "",
+				ls.level, ls.files, ls.size_mb, ls.time_sec, ls.read_mb, ls.write_mb);
+		}
+		printf("],\n      \"compact_sec\": %.3f, \"user_mb\": %.2f, \"log_mb\": %.2f, \"table_mb\": %.2f, "
+			"\"compaction_read_mb\": %.0f, \"compaction_write_mb\": %.0f, "
+			"\"disk_mb\": %.2f, \"write_amp\": %.2f, \"space_amp\": %.2f}",
+			compact_secs, user_mb, log_mb, table_mb, read_mb, write_mb,
+			disk_mb, write_amp, user_mb > 0? disk_mb / user_mb : 0);
+	}else{
+		printf("compact: %.3f s\n", compact_secs);
+		printf("compactions:\n");
+		printf("    level  files  size(MB)  time(sec)  read(MB)  write(MB)\n");
+		for(int i=0; i<(int)levels.size(); i++){
+			const LevelStats &ls = levels[i];
+			printf("    %5d  %5d  %8.0f  %9.0f  %8.0f  %9.0f\n",
+				ls.level, ls.files, ls.size_mb, ls.time_sec, ls.read_mb, ls.write_mb);
+		}
+		printf("written: %.2f MB, wal: %.2f MB, table files: %.2f MB, disk: %.2f MB\n",
+			user_mb, log_mb, table_mb, disk_mb);
+		printf("write amplification: %.2f, space amplification: %.2f\n",
+			write_amp, user_mb > 0? disk_mb / user_mb : 0);
+		printf("\n");
+	}
+
+	if(!opt.keep){
+		remove_dir(dir);
+	}
+	return 0;
+}
+
+static bool parse_list(const char *val, std::vector<std::string> *ret){
+	ret->clear();
+	std::string s = val;
+	size_t pos = 0;
+	while(pos <= s.size()){
+		size_t end = s.find(',', pos);
+		if(end == std::string::npos){
+			end = s.size();
+		}
+		std::string item = s.substr(pos, end - pos);
+		if(item.empty()){
+			return false;
+		}
+		ret->push_back(item);
+		pos = end + 1;
+	}
+	return !ret->empty();
+}
+
+static bool parse_int_list(const char *val, std::vector<int> *ret){
+	std::vector<std::string> items;
+	if(!parse_list(val, &items)){
+		return false;
+	}
+	ret->clear();
+	for(int i=0; i<(int)items.size(); i++){
+		int n = str_to_int(items[i]);
+		if(n <= 0){
+			return false;
+		}
+		ret->push_back(n);
+	}
+	return true;
+}
+
+static void bad_option(const char *arg){
+	fprintf(stderr, "invalid option: %s\n", arg);
+	exit(1);
+}
+
+int main(int argc, char **argv){
+	set_log_level(Logger::LEVEL_MIN);
+
+	opt.keep = false;
+	opt.num = 100000;
+	opt.threads.push_back(1);
+	opt.threads.push_back(4);
+	opt.values.push_back(100);
+	opt.values.push_back(1000);
+	parse_list("set,get,hset,zset,zrange,qpush,qpop,scan", &opt.benchmarks);
+	opt.binlog = true;
+	opt.cache_size = 8;
+	opt.write_buffer_size = 4;
+	opt.compression = true;
+	opt.json = false;
+
+	for(int i=1; i<argc; i++){
+		const char *arg = argv[i];
+		if(strcmp("-v", arg) == 0){
+			welcome();
+			exit(0);
+		}
+		if(strcmp("-h", arg) == 0 || strcmp("--help", arg) == 0){
+			welcome();
+			usage(argc, argv);
+			exit(0);
+		}
+		if(strncmp(arg, "--", 2) != 0){
+			bad_option(arg);
+		}
+		std::string name = arg + 2;
+		const char *val = "";
+		size_t eq = name.find('=');
+		if(eq != std::string::npos){
+			val = arg + 2 + eq + 1;
+			name = name.substr(0, eq);
+		}
+		if(name == "dir"){
+			opt.dir = val;
+			struct stat st;
+			if(opt.dir.empty() || stat(val, &st) == 0){
+				fprintf(stderr, "%s exists\n", val);
+				exit(1);
+			}
+		}else if(name == "keep"){
+			opt.keep = true;
+		}else if(name == "num"){
+			opt.num = str_to_int(val);
+			if(opt.num <= 0){
+				bad_option(arg);
+			}
+		}else if(name == "threads"){
+			if(!parse_int_list(val, &opt.threads)){
+				bad_option(arg);
+			}
+		}else if(name == "values"){
+			if(!parse_int_list(val, &opt.values)){
+				bad_option(arg);
+			}
+		}else if(name == "benchmarks"){
+			if(!parse_list(val, &opt.benchmarks)){
+				bad_option(arg);
+			}
+			const char *names[] = {"set", "get", "hset", "zset", "zrange", "qpush", "qpop", "scan"};
+			for(int j=0; j<(int)opt.benchmarks.size(); j++){
+				bool found = false;
+				for(int k=0; k<(int)(sizeof(names)/sizeof(names[0])); k++){
+					if(opt.benchmarks[j] == names[k]){
+						found = true;
+					}
+				}
+				if(!found){
+					bad_option(arg);
+				}
+			}
+		}else if(name == "binlog"){
+			opt.binlog = (strcmp(val, "no") != 0);
+		}else if(name == "cache_size"){
+			opt.cache_size = str_to_int(val);
+		}else if(name == "write_buffer_size"){
+			opt.write_buffer_size = str_to_int(val);
+		}else if(name == "compression"){
+			opt.compression = (strcmp(val, "no") != 0);
+		}else if(name == "json"){
+			opt.json = true;
+		}else{
+			bad_option(arg);
+		}
+	}
+
+	int max_value = 0;
+	for(int i=0; i<(int)opt.values.size(); i++){
+		if(opt.values[i] > max_value){
+			max_value = opt.values[i];
+		}
+	}
+	srand(time(NULL));
+	value_buf.resize(max_value + 64);
+	for(int i=0; i<(int)value_buf.size(); i++){
+		value_buf[i] = 'a' + rand() % 26;
+	}
+
+	if(opt.json){
+		printf("{\n  \"version\": \"%s\", \"num\": %d, \"binlog\": %s, \"compression\": %s, "
+			"\"cache_size\": %d, \"write_buffer_size\": %d,\n  \"runs\": [\n",
+			SSDB_VERSION, opt.num, opt.binlog? "true" : "false", opt.compression? "true" : "false",
+			opt.cache_size, opt.write_buffer_size);
+	}else{
+		welcome();
+	}
+	bool first = true;
+	for(int i=0; i<(int)opt.values.size(); i++){
+		for(int j=0; j<(int)opt.threads.size(); j++){
+			if(run_config(opt.values[i], opt.threads[j], first) == -1){
+				exit(1);
+			}
+			first = false;
+		}
+	}
+	if(opt.json){
+		printf("\n  ]\n}\n");
+	}
+	if(!opt.dir.empty() && !opt.keep){
+		rmdir(opt.dir.c_str());
+	}
+	return 0;
+}
@@ -0,0 +1,536 @@
+/*
+Copyright (c) 2012-2015 The SSDB Authors. All rights reserved.
+Use of this source code is governed by a BSD-style license that can be
+found in the LICENSE file.
+*/
+#include "include.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <inttypes.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+
+#include "net/link.h"
+#include "net/proc.h"
+#include "ssdb/binlog.h"
+#include "ssdb/t_hash.h"
+#include "ssdb/t_zset.h"
+#include "util/log.h"
+#include "util/bytes.h"
+#include "util/strings.h"
+#include "util/sorted_set.h"
+#include "version.h"
+
+// 热路径上的基本操作(协议解析, 缓冲区, key 的编码, binlog, 字符串转换
+// 等)的微基准测试. 输入数据由固定的种子生成, 每次运行都一样.
+//
+// 每个测试先倍增循环次数, 直到一轮的耗时超过 --time, 然后用这个次数
+// 运行 --repeat 轮, 输出每次操作耗时的中位数和最小值. 输出的每一行是
+//     name  ns/op  min  ops/s  iters
+// 以 # 开头的是注释行. 把输出保存下来, 之后用 --baseline 指定这个文件,
+// 会多输出一列和它相比的变化.
+
+struct MicroOptions{
+	std::string filter;
+	int time_ms;
+	int repeat;
+	bool json;
+	std::string baseline;
+};
+static MicroOptions opt;
+
+// 防止编译器把测试的代码优化掉
+static volatile uint64_t sink;
+
+struct Case{
+	const char *name;
+	void (*setup)();
+	// 执行 iters 次操作
+	void (*run)(int64_t iters);
+};
+
+struct Result{
+	std::string name;
+	double ns_median;
+	double ns_min;
+	int64_t iters;
+};
+
+static uint64_t rnd = 0x9e3779b97f4a7c15ULL;
+
+static inline uint64_t next_rand(){
+	// xorshift64*
+	rnd ^= rnd >> 12;
+	rnd ^= rnd << 25;
+	rnd ^= rnd >> 27;
+	return rnd * 2685821657736338717ULL;
+}
+
+static inline uint64_t now_ns(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// 输入数据的个数, 2 的幂
+static const int NUM_INPUTS = 1024;
+static std::vector<std::string> names;
+static std::vector<std::string> keys;
+static std::vector<std::string> scores;
+static std::vector<std::string> values;
+
+static std::string random_str(int len){
+	std::string s;
+	for(int i=0; i<len; i++){
+		s.push_back('a' + (char)(next_rand() % 26));
+	}
+	return s;
+}
+
+static void init_inputs(){
+	for(int i=0; i<NUM_INPUTS; i++){
+		names.push_back("name" + random_str(8));
+		keys.push_back("key" + random_str(13));
+		int64_t score = (int64_t)(next_rand() % 2000000000) - 1000000000;
+		scores.push_back(str(score));
+		values.push_back(random_str(100));
+	}
+}
+
+/* link */
+
+static std::string packet_get;
+static std::string packet_set;
+static Link *recv_link = NULL;
+// 一次放进输入缓冲区的流水线请求数
+static const int PIPELINE = 64;
+
+static void setup_link(){
+	packet_get.clear();
+	packet_set.clear();
+	for(int i=0; i<PIPELINE; i++){
+		packet_get.append("3\nget\n");
+		packet_get.append(str((int)keys[i].size()) + "\n" + keys[i] + "\n");
+		packet_get.append("\n");
+	}
+	packet_set.append("3\nset\n");
+	packet_set.append(str((int)keys[0].size()) + "\n" + keys[0] + "\n");
+	packet_set.append(str((int)values[0].size()) + "\n" + values[0] + "\n");
+	packet_set.append("\n");
+	if(recv_link == NULL){
+		recv_link = new Link();
+	}
+}
+
+static void run_link_recv(int64_t iters){
+	uint64_t n = 0;
+	for(int64_t i=0; i<iters; i++){
+		if(recv_link->input->empty()){
+			recv_link->input->nice();
+			recv_link->input->append(packet_get.data(), (int)packet_get.size());
+		}
+		const std::vector<Bytes> *req = recv_link->recv();
+		n += req->size();
+	}
+	sink += n;
+}
+
+template<int LEVEL>
+static void run_link_parse(int64_t iters){
+	std::vector<Bytes> out;
+	out.reserve(8);
+	uint64_t n = 0;
+	for(int64_t i=0; i<iters; i++){
+		out.clear();
+		n += Link::parse(packet_set.data(), (int)packet_set.size(), &out, LEVEL);
+	}
+	sink += n;
+}
+
+/* buffer */
+
+static void run_buffer_grow(int64_t iters){
+	uint64_t n = 0;
+	for(int64_t i=0; i<iters; i++){
+		// 8K 有 4K 数据, 扩大到 64K
+		Buffer buf(8 * 1024);
+		buf.append(values[i & (NUM_INPUTS - 1)].data(), 100);
+		buf.incr(4 * 1024 - 100);
+		buf.grow();
+		n += buf.total();
+	}
+	sink += n;
+}
+
+static void run_buffer_append_record(int64_t iters){
+	Buffer buf(64 * 1024);
+	uint64_t n = 0;
+	for(int64_t i=0; i<iters; i++){
+		if(buf.size() > 32 * 1024){
+			n += buf.size();
+			buf.decr(buf.size());
+			buf.nice();
+		}
+		buf.append_record(values[i & (NUM_INPUTS - 1)]);
+	}
+	sink += n + buf.size();
+}
+
+/* key 的编码 */
+
+static std::vector<std::string> zscore_keys;
+
+static void setup_zscore_keys(){
+	zscore_keys.clear();
+	for(int i=0; i<NUM_INPUTS; i++){
+		zscore_keys.push_back(encode_zscore_key(names[i], keys[i], scores[i]));
+	}
+}
+
+static void run_encode_zscore_key(int64_t iters){
+	uint64_t n = 0;
+	for(int64_t i=0; i<iters; i++){
+		int j = (int)(i & (NUM_INPUTS - 1));
+		n += encode_zscore_key(names[j], keys[j], scores[j]).size();
+	}
+	sink += n;
+}
+
+static void run_decode_zscore_key(int64_t iters){
+	std::string name, key, score;
+	uint64_t n = 0;
+	for(int64_t i=0; i<iters; i++){
+		const std::string &s = zscore_keys[i & (NUM_INPUTS - 1)];
+		if(decode_zscore_key(s, &name, &key, &score) == 0){
+			n += score.size();
+		}
+	}
+	sink += n;
+}
+
+static void run_encode_hash_key(int64_t iters){
+	uint64_t n = 0;
+	for(int64_t i=0; i<iters; i++){
+		int j = (int)(i & (NUM_INPUTS - 1));
+		n += encode_hash_key(names[j], keys[j]).size();
+	}
+	sink += n;
+}
+
+/* binlog */
+
+static void run_binlog_construct(int64_t iters){
+	uint64_t n = 0;
+	for(int64_t i=0; i<iters; i++){
+		const std::string &key = keys[i & (NUM_INPUTS - 1)];
+		Binlog log(i, BinlogType::SYNC, BinlogCommand::KSET, leveldb::Slice(key));
+		n += log.size();
+	}
+	sink += n;
+}
+
+/* strings */
+
+static std::vector<int64_t> ints;
+
+static void setup_ints(){
+	ints.clear();
+	for(int i=0; i<NUM_INPUTS; i++){
+		ints.push_back(str_to_int64(scores[i]));
+	}
+}
+
+static void run_str_to_int64(int64_t iters){
+	uint64_t n = 0;
+	for(int64_t i=0; i<iters; i++){
+		n += (uint64_t)str_to_int64(scores[i & (NUM_INPUTS - 1)]);
+	}
+	sink += n;
+}
+
+static void run_str_int64(int64_t iters){
+	uint64_t n = 0;
+	for(int64_t i=0; i<iters; i++){
+		n += str(ints[i & (NUM_INPUTS - 1)]).size();
+	}
+	sink += n;
+}
+
+static void run_hexmem(int64_t iters){
+	uint64_t n = 0;
+	for(int64_t i=0; i<iters; i++){
+		// zscore 的 key 中有需要转义的字节
+		const std::string &s = zscore_keys[i & (NUM_INPUTS - 1)];
+		n += hexmem(s.data(), (int)s.size()).size();
+	}
+	sink += n;
+}
+
+/* sorted_set */
+
+static void run_sorted_set_add(int64_t iters){
+	// 保持集合中大约 NUM_INPUTS/2 个元素, 新增和更新各占一部分
+	SortedSet zset;
+	uint64_t r = 1;
+	for(int64_t i=0; i<iters; i++){
+		r = r * 6364136223846793005ULL + 1442695040888963407ULL;
+		zset.add(keys[(r >> 33) & (NUM_INPUTS - 1)], (int64_t)(r >> 40));
+		if(zset.size() > NUM_INPUTS / 2){
+			zset.pop_front();
+		}
+	}
+	sink += zset.size();
+}
+
+/* BytesHash */
+
+static void run_bytes_hash(int64_t iters){
+	BytesHash hash;
+	uint64_t n = 0;
+	for(int64_t i=0; i<iters; i++){
+		n += hash(Bytes(keys[i & (NUM_INPUTS - 1)]));
+	}
+	sink += n;
+}
+
+static Case cases[] = {
+	{"link.recv",                 setup_link,        run_link_recv},
+	{"link.parse.scalar",         setup_link,        run_link_parse<Link::PARSER_SCALAR>},
+	{"link.parse.sse2",           setup_link,        run_link_parse<Link::PARSER_SSE2>},
+	{"link.parse.avx2",           setup_link,        run_link_parse<Link::PARSER_AVX2>},
+	{"buffer.grow",               NULL,              run_buffer_grow},
+	{"buffer.append_record",      NULL,              run_buffer_append_record},
+	{"zset.encode_zscore_key",    NULL,              run_encode_zscore_key},
+	{"zset.decode_zscore_key",    setup_zscore_keys, run_decode_zscore_key},
+	{"hash.encode_hash_key",      NULL,              run_encode_hash_key},
+	{"binlog.construct",          NULL,              run_binlog_construct},
+	{"strings.str_to_int64",      NULL,              run_str_to_int64},
+	{"strings.str_int64",         setup_ints,        run_str_int64},
+	{"strings.hexmem",            setup_zscore_keys, run_hexmem},
+	{"sorted_set.add",            NULL,              run_sorted_set_add},
+	{"proc.bytes_hash",           NULL,              run_bytes_hash},
+};
+
+
+void welcome(){
+	printf("# ssdb-microbench - SSDB hot path micro benchmark, %s\n", SSDB_VERSION);
+	printf("# Copyright (c) 2013-2015 ssdb.io\n");
+}
+
+void usage(int argc, char **argv){
+	printf("Usage:\n");
+	printf("    %s [--option=value ...]\n", argv[0]);
+	printf("\n");
+	printf("Options:\n");
+	printf("    --filter=STR    only run benchmarks whose name contains STR\n");
+	printf("    --time=MS       minimum time of one round (default 100)\n");
+	printf("    --repeat=N      rounds of each benchmark, median is reported (default 5)\n");
+	printf("    --baseline=FILE compare with a previous output of this program\n");
+	printf("    --json          print the results as JSON\n");
+	printf("    --list          list the benchmarks\n");
+	printf("\n");
+}
+
+static void bad_option(const char *arg){
+	fprintf(stderr, "invalid option: %s\n", arg);
+	exit(1);
+}
+
+static bool case_enabled(const Case &c){
+	if(!opt.filter.empty() && strstr(c.name, opt.filter.c_str()) == NULL){
+		return false;
+	}
+	// CPU 不支持的解析器会退回到低级的, 不单独测试
+	if(strncmp(c.name, "link.parse.", 11) == 0){
+		for(int level=Link::PARSER_AVX2; level>=Link::PARSER_SCALAR; level--){
+			if(strcmp(c.name + 11, Link::parser_name(level)) == 0){
+				return level <= Link::parser_level();
+			}
+		}
+	}
+	return true;
+}
+
+static double run_round(const Case &c, int64_t iters){
+	uint64_t start = now_ns();
+	c.run(iters);
+	return (double)(now_ns() - start);
+}
+
+static void run_case(const Case &c, Result *ret){
+	if(c.setup){
+		c.setup();
+	}
+	// 预热, 同时确定循环次数
+	int64_t iters = 1;
+	double min_ns = opt.time_ms * 1000000.0;
+	while(1){
+		double ns = run_round(c, iters);
+		if(ns >= min_ns || iters >= ((int64_t)1 << 40)){
+			break;
+		}
+		if(ns < min_ns / 100){
+			iters *= 10;
+		}else{
+			iters *= 2;
+		}
+	}
+	std::vector<double> samples;
+	for(int i=0; i<opt.repeat; i++){
+		samples.push_back(run_round(c, iters) / iters);
+	}
+	std::sort(samples.begin(), samples.end());
+	ret->name = c.name;
+	ret->ns_median = samples[samples.size() / 2];
+	ret->ns_min = samples[0];
+	ret->iters = iters;
+}
+
+// 读取之前的输出, name => ns/op
+static int load_baseline(const std::string &file, std::map<std::string, double> *ret){
+	FILE *fp = fopen(file.c_str(), "r");
+	if(!fp){
+		return -1;
+	}
+	char line[1024];
+	while(fgets(line, sizeof(line), fp)){
+		if(line[0] == '#'){
+			continue;
+		}
+		char name[256];
+		double ns;
+		if(sscanf(line, "%255s %lf", name, &ns) == 2){
+			(*ret)[name] = ns;
+		}
+	}
+	fclose(fp);
+	return 0;
+}
+
+int main(int argc, char **argv){
+	set_log_level(Logger::LEVEL_MIN);
+
+	opt.time_ms = 100;
+	opt.repeat = 5;
+	opt.json = false;
+	bool list = false;
+
+	for(int i=1; i<argc; i++){
+		const char *arg = argv[i];
+		if(strcmp("-v", arg) == 0){
+			welcome();
+			exit(0);
+		}
+		if(strcmp("-h", arg) == 0 || strcmp("--help", arg) == 0){
+			welcome();
+			usage(argc, argv);
+			exit(0);
+		}
+		if(strncmp(arg, "--", 2) != 0){
+			bad_option(arg);
+		}
+		std::string name = arg + 2;
+		const char *val = "";
+		size_t eq = name.find('=');
+		if(eq != std::string::npos){
+			val = arg + 2 + eq + 1;
+			name = name.substr(0, eq);
+		}
+		if(name == "filter"){
+			opt.filter = val;
+		}else if(name == "time"){
+			opt.time_ms = str_to_int(val);
+			if(opt.time_ms <= 0){
+				bad_option(arg);
+			}
+		}else if(name == "repeat"){
+			opt.repeat = str_to_int(val);
+			if(opt.repeat <= 0){
+				bad_option(arg);
+			}
+		}else if(name == "baseline"){
+			opt.baseline = val;
+		}else if(name == "json"){
+			opt.json = true;
+		}else if(name == "list"){
+			list = true;
+		}else{
+			bad_option(arg);
+		}
+	}
+
+	int num_cases = (int)(sizeof(cases) / sizeof(cases[0]));
+	if(list){
+		for(int i=0; i<num_cases; i++){
+			if(case_enabled(cases[i])){
+				printf("%s\n", cases[i].name);
+			}
+		}
+		return 0;
+	}
+
+	std::map<std::string, double> baseline;
+	if(!opt.baseline.empty() && load_baseline(opt.baseline, &baseline) == -1){
+		fprintf(stderr, "unable to open %s\n", opt.baseline.c_str());
+		exit(1);
+	}
+
+	init_inputs();
+
+	if(opt.json){
+		printf("{\n  \"version\": \"%s\", \"parser\": \"%s\", \"time_ms\": %d, \"repeat\": %d,\n  \"results\": [",
+			SSDB_VERSION, Link::parser_name(Link::parser_level()), opt.time_ms, opt.repeat);
+	}else{
+		welcome();
+		printf("# parser: %s, time: %d ms, repeat: %d\n",
+			Link::parser_name(Link::parser_level()), opt.time_ms, opt.repeat);
+		printf("# %-28s %10s %10s %14s %12s%s\n", "name", "ns/op", "min", "ops/s", "iters",
+			baseline.empty()? "" : "     change");
+	}
+	bool first = true;
+	for(int i=0; i<num_cases; i++){
+		const Case &c = cases[i];
+		if(!case_enabled(c)){
+			continue;
+		}
+		Result r;
+		run_case(c, &r);
+
+		double base = 0;
+		std::map<std::string, double>::iterator it = baseline.find(r.name);
+		if(it != baseline.end()){
+			base = it->second;
+		}
+		double ops = r.ns_median > 0? 1000000000.0 / r.ns_median : 0;
+		if(opt.json){
+			printf("%s\n    {\"name\": \"%s\", \"ns_per_op\": %.2f, \"ns_min\": %.2f, "
+				"\"ops_per_sec\": %.0f, \"iters\": %" PRId64,
+				first? "" : ",", r.name.c_str(), r.ns_median, r.ns_min, ops, r.iters);
+			if(base > 0){
+				printf(", \"baseline_ns_per_op\": %.2f, \"change\": %.4f",
+					base, (r.ns_median - base) / base);
+			}
+			printf("}");
+		}else{
+			printf("  %-28s %10.2f %10.2f %14.0f %12" PRId64,
+				r.name.c_str(), r.ns_median, r.ns_min, ops, r.iters);
+			if(base > 0){
+				printf(" %+9.1f%%", (r.ns_median - base) / base * 100);
+			}else if(!baseline.empty()){
+				printf(" %10s", "new");
+			}
+			printf("\n");
+		}
+		fflush(stdout);
+		first = false;
+	}
+	if(opt.json){
+		printf("\n  ]\n}\n");
+	}
+	return 0;
+}
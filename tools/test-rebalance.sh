@@ -0,0 +1,167 @@
+#!/bin/bash
+#
+# 启动 3 个 ssdb-server, 把数据都写到第一个节点, 执行 cluster_rebalance,
+# 然后检查: 数据没有丢失也没有多出, 每个 key 都在负责它的区间的节点上,
+# 值没有改变, 各节点的数据量大致平衡, rebalance 期间集群命令没有被阻塞.
+#
+# Usage: tools/test-rebalance.sh [base_port]
+#
+export LC_ALL=C
+
+root=$(cd "$(dirname "$0")/.." && pwd)
+server=$root/ssdb-server
+base_port=${1:-18900}
+num_keys=30000
+dir=$(mktemp -d /tmp/ssdb-rebalance.XXXXXX)
+ports="$base_port $((base_port + 1)) $((base_port + 2))"
+failed=0
+
+cleanup(){
+	local pids=""
+	for port in $ports; do
+		if [ -f $dir/$port/var/ssdb.pid ]; then
+			pids="$pids $(cat $dir/$port/var/ssdb.pid)"
+		fi
+	done
+	if [ -n "$pids" ]; then
+		kill $pids 2>/dev/null
+		sleep 2
+		# 卡住的服务器不会响应 SIGTERM
+		kill -9 $pids 2>/dev/null
+	fi
+	rm -rf $dir
+}
+trap cleanup EXIT
+
+fail(){
+	echo "FAILED: $*"
+	failed=1
+}
+
+# 发送一个请求, 响应的每个块输出一行. 服务器卡住时超时返回, 不会一直等待
+req(){
+	local port=$1
+	shift
+	exec 3<>/dev/tcp/127.0.0.1/$port || return 1
+	local s="" a len data
+	for a in "$@"; do
+		s+="${#a}"$'\n'"$a"$'\n'
+	done
+	printf '%s\n' "$s" >&3
+	while read -r -t 30 len <&3 && [ -n "$len" ]; do
+		read -r -t 30 -N "$len" data <&3
+		read -r -t 30 <&3
+		echo "$data"
+	done
+	exec 3<&-
+}
+
+# 每个 key 的值, 保存在 $value 中
+value_of(){
+	printf -v value '%s-%0180d' "$1" 0
+}
+
+for port in $ports; do
+	mkdir -p $dir/$port/var
+	sed -e "s/^\tport: 8888/\tport: $port/" -e 's/level: debug/level: info/' \
+		-e 's/cache_size: 500/cache_size: 16/' -e 's/write_buffer_size: 64/write_buffer_size: 4/' \
+		$root/ssdb.conf > $dir/$port/ssdb.conf
+	$server -d $dir/$port/ssdb.conf > /dev/null || exit 1
+done
+sleep 1
+for port in $ports; do
+	if [ "$(req $port ping)" != "ok" ]; then
+		echo "FAILED: server on port $port is not running"
+		exit 1
+	fi
+done
+
+set -- $ports
+A=$1; B=$2; C=$3
+
+# 节点的区间: ("", "k1"], ("k1", "k2"], ("k2", ""], 数据都在 A
+req $A set_kv_range "" "k1" > /dev/null
+req $B set_kv_range "k1" "k2" > /dev/null
+req $C set_kv_range "k2" "" > /dev/null
+i=0
+while [ $i -lt $num_keys ]; do
+	args=()
+	for((j=0; j<500; j++)); do
+		printf -v key 'k0%06d' $((i + j))
+		value_of $key
+		args+=("$key" "$value")
+	done
+	req $A multi_set "${args[@]}" > /dev/null
+	i=$((i + 500))
+done
+
+for port in $ports; do
+	req $A cluster_add_kv_node 127.0.0.1 $port > /dev/null
+done
+req $A cluster_set_kv_range 1 "" "k1" > /dev/null
+req $A cluster_set_kv_range 2 "k1" "k2" > /dev/null
+req $A cluster_set_kv_range 3 "k2" "" > /dev/null
+for id in 1 2 3; do
+	req $A cluster_set_kv_status $id 1 > /dev/null
+done
+
+# 限速 2MB/s, 迁移需要几秒, 期间其它集群命令要能立即返回
+req $A cluster_rebalance 0.1 2 0 > $dir/rebalance.out &
+pid=$!
+sleep 1
+start=$(date +%s%N)
+req $A cluster_kv_node_list > /dev/null
+ms=$(( ($(date +%s%N) - start) / 1000000 ))
+if [ $ms -gt 500 ]; then
+	fail "cluster_kv_node_list took $ms ms during rebalance"
+fi
+wait $pid
+if [ "$(head -1 $dir/rebalance.out)" != "ok" ]; then
+	fail "cluster_rebalance: $(cat $dir/rebalance.out)"
+fi
+
+# cluster_kv_node_list 的响应: ok, 然后每个节点是 6 id status begin end ip port
+mapfile -t list < <(req $A cluster_kv_node_list)
+total=0
+id=0
+for port in $ports; do
+	begin=${list[$((id * 7 + 4))]}
+	end=${list[$((id * 7 + 5))]}
+	id=$((id + 1))
+	echo "node $id: (\"$begin\" - \"$end\"]"
+	range=$(req $port get_kv_range | sed -n 2,3p | tr '\n' ' ')
+	if [ "$range" != "$begin $end " ]; then
+		fail "node $id range: $range, cluster: $begin $end"
+	fi
+
+	n=0
+	bad=0
+	while read -r key && read -r val; do
+		n=$((n + 1))
+		if [[ ! "$key" > "$begin" ]] || { [ -n "$end" ] && [[ "$key" > "$end" ]]; }; then
+			bad=$((bad + 1))
+		else
+			value_of $key
+			if [ "$val" != "$value" ]; then
+				bad=$((bad + 1))
+			fi
+		fi
+	done < <(req $port scan "" "" $((num_keys * 2)) | tail -n +2)
+	echo "node $id ($port): $n keys"
+	if [ $bad -gt 0 ]; then
+		fail "node $id: $bad keys out of range or with wrong value"
+	fi
+	# 平衡时每个节点 1/3, 允许 tolerance 0.1 之外再多一些
+	if [ $n -lt $((num_keys / 4)) ] || [ $n -gt $((num_keys * 5 / 12)) ]; then
+		fail "node $id is not balanced: $n keys"
+	fi
+	total=$((total + n))
+done
+if [ $total -ne $num_keys ]; then
+	fail "total keys: $total, expected: $num_keys"
+fi
+
+if [ $failed -eq 0 ]; then
+	echo "all tests passed"
+fi
+exit $failed